@@ -0,0 +1,174 @@
+//
+//
+// Lighting
+//
+// Vertex shader only. The game's precompiled Lighting pixel shaders are left in place, so the output
+// layout below has to match their input signature.
+//
+// Only the techniques BSLightingShader::IsInstancingCompatible() accepts are supported. This file exists
+// for the AUTO_INSTANCED variants (BSBatchRenderer::SetupAndDrawInstanced), but it also compiles without
+// the define.
+//
+// Possible technique defines:
+// - GLOWMAP        Unique
+// - PARALLAX       Unique
+// - PARALLAX_OCC   Unique
+// - VC
+// - MODELSPACENORMALS
+// - DO_ALPHA_TEST
+// - SHADOW_DIR
+// - DEFSHADOW
+// - SNOW
+// - BASE_OBJECT_IS_SNOW
+// - ADDITIONAL_ALPHA_MASK
+// - AUTO_INSTANCED
+//
+//
+#include "ShaderCommon.h"
+
+#if defined(PSHADER) || defined(CSHADER)
+#error Lighting.hlsl only provides vertex shaders
+#endif
+
+#if defined(SKINNED) || defined(ENVMAP) || defined(MULTI_LAYER_PARALLAX) || defined(EYE) || defined(LANDSCAPE) || \
+	defined(LODLANDSCAPE) || defined(TREE_ANIM) || defined(PROJECTED_UV) || defined(WORLD_MAP)
+#error Technique is not supported by Lighting.hlsl
+#endif
+
+struct VS_INPUT
+{
+	float4 Position : POSITION0;			// w: tangent x
+	float2 TexCoord0 : TEXCOORD0;
+#if !defined(MODELSPACENORMALS)
+	float4 Normal : NORMAL0;				// w: tangent y
+	float4 Bitangent : BINORMAL0;			// w: tangent z
+#endif
+#if defined(VC)
+	float4 Color : COLOR0;
+#endif
+#if defined(AUTO_INSTANCED)
+	uint InstanceID : SV_InstanceID;
+#endif
+};
+
+struct VS_OUTPUT
+{
+	float4 Position : SV_POSITION0;
+	float2 TexCoord0 : TEXCOORD0;
+#if !defined(MODELSPACENORMALS)
+	float3 TBN0 : TEXCOORD1;
+	float3 TBN1 : TEXCOORD2;
+	float3 TBN2 : TEXCOORD3;
+#endif
+	float3 ViewVector : TEXCOORD5;
+	float3 ScreenNormalTransform0 : TEXCOORD8;
+	float3 ScreenNormalTransform1 : TEXCOORD9;
+	float3 ScreenNormalTransform2 : TEXCOORD10;
+	float4 WorldPosition : POSITION1;
+	float4 PreviousWorldPosition : POSITION2;
+	float4 Color : COLOR0;
+	float4 FogParam : COLOR1;
+};
+
+//
+// Vertex shader code
+//
+cbuffer PerTechnique : register(b0)
+{
+	float4 HighDetailRange						: packoffset(c0);
+	float4 FogParam								: packoffset(c1);
+	float4 FogNearColor							: packoffset(c2);
+	float4 FogFarColor							: packoffset(c3);
+};
+
+cbuffer PerMaterial : register(b1)
+{
+	float4 LeftEyeCenter						: packoffset(c0);
+	float4 RightEyeCenter						: packoffset(c1);
+	float4 TexcoordOffset						: packoffset(c2);
+};
+
+cbuffer PerGeometry : register(b2)
+{
+	row_major float3x4 World					: packoffset(c0);
+	row_major float3x4 PreviousWorld			: packoffset(c3);
+	float3 EyePosition							: packoffset(c6);
+	float4 LandBlendParams						: packoffset(c7);
+	float4 TreeParams							: packoffset(c8);
+	float2 WindTimers							: packoffset(c9);
+	row_major float3x4 TextureProj				: packoffset(c10);
+	float IndexScale							: packoffset(c13);
+	float4 WorldMapOverlayParameters			: packoffset(c14);
+};
+
+cbuffer PerFrame : register(b12)
+{
+	row_major float4x4 ViewMatrix				: packoffset(c0);
+	row_major float4x4 ProjMatrix				: packoffset(c4);
+	row_major float4x4 ViewProjMatrix			: packoffset(c8);
+};
+
+VS_OUTPUT main(VS_INPUT input)
+{
+	VS_OUTPUT vsout;
+
+	float4 modelPosition = float4(input.Position.xyz, 1.0);
+
+#if defined(AUTO_INSTANCED)
+	// Instances only differ from the geometry constants by translation (BSLightingShader::CanShareInstancedDraw),
+	// so the model space eye position can be moved instead of re-inverting the matrix. World is s * R, which
+	// makes its inverse transpose(World) / s^2.
+	InstanceData instance = Instances[input.InstanceID];
+
+	float3x4 world = instance.World;
+	float3x4 previousWorld = instance.PreviousWorld;
+
+	float3 translationDelta = float3(World[0].w, World[1].w, World[2].w) - float3(world[0].w, world[1].w, world[2].w);
+	float3 eyePosition = EyePosition + mul(translationDelta, (float3x3)World) / dot(World[0].xyz, World[0].xyz);
+#else
+	float3x4 world = World;
+	float3x4 previousWorld = PreviousWorld;
+	float3 eyePosition = EyePosition;
+#endif
+
+	float4 worldPosition = float4(mul(world, modelPosition), 1.0);
+	float4 previousWorldPosition = float4(mul(previousWorld, modelPosition), 1.0);
+	float4 viewPosition = mul(ViewMatrix, worldPosition);
+
+	vsout.Position = mul(ViewProjMatrix, worldPosition);
+	vsout.TexCoord0 = input.TexCoord0 * TexcoordOffset.zw + TexcoordOffset.xy;
+
+#if !defined(MODELSPACENORMALS)
+	float3x3 tbn = float3x3(
+		float3(input.Position.w, input.Normal.w * 2 - 1, input.Bitangent.w * 2 - 1),
+		input.Bitangent.xyz * 2 - 1,
+		input.Normal.xyz * 2 - 1);
+	float3x3 tbnTranspose = transpose(tbn);
+
+	vsout.TBN0 = normalize(tbnTranspose[0]);
+	vsout.TBN1 = normalize(tbnTranspose[1]);
+	vsout.TBN2 = normalize(tbnTranspose[2]);
+#endif
+
+	vsout.ViewVector = eyePosition - modelPosition.xyz;
+
+	float3x3 screenNormalTransform = mul((float3x3)ViewMatrix, (float3x3)world);
+	vsout.ScreenNormalTransform0 = screenNormalTransform[0];
+	vsout.ScreenNormalTransform1 = screenNormalTransform[1];
+	vsout.ScreenNormalTransform2 = screenNormalTransform[2];
+
+	vsout.WorldPosition = worldPosition;
+	vsout.PreviousWorldPosition = previousWorldPosition;
+
+#if defined(VC)
+	vsout.Color = input.Color;
+#else
+	vsout.Color = float4(1, 1, 1, 1);
+#endif
+
+	float fogFactor = min(FogParam.w, pow(saturate(length(viewPosition.xyz) * FogParam.y - FogParam.x), FogParam.z));
+	vsout.FogParam.xyz = lerp(FogNearColor.xyz, FogFarColor.xyz, fogFactor);
+	vsout.FogParam.w = fogFactor;
+
+	return vsout;
+}
\ No newline at end of file
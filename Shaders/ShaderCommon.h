@@ -22,4 +22,19 @@ const static float4x4 M_IdentityMatrix =
 	{ 0, 0, 0, 1 }
 };
 
+//
+// Automatic instancing (BSBatchRenderer::SetupAndDrawInstanced). Vertex shaders compiled with
+// AUTO_INSTANCED read World/PreviousWorld from here instead of the PerGeometry constants. Layout
+// must match BSGraphics::InstanceData.
+//
+#if defined(VSHADER) && defined(AUTO_INSTANCED)
+struct InstanceData
+{
+	row_major float3x4 World;
+	row_major float3x4 PreviousWorld;
+};
+
+StructuredBuffer<InstanceData> Instances : register(t15);
+#endif
+
 // TODO: Validate that only 1 unique technique define is given
\ No newline at end of file
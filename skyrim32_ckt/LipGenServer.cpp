@@ -0,0 +1,35 @@
+#include "LipGenServer.h"
+
+LipGenServerStats RunLipGenServer(LipGenTransport& Transport, LipGenGenerator& Generator)
+{
+	LipGenServerStats stats = {};
+
+	for (;;)
+	{
+		LipGenRequest request;
+		auto result = Transport.WaitForRequest(&request);
+
+		if (result == LipGenTransport::WaitResult::Timeout)
+			continue;
+
+		if (result != LipGenTransport::WaitResult::Request)
+			break;
+
+		stats.Requests++;
+
+		// The CK image stays loaded between requests, only the first one pays for it
+		if (!stats.Initialized)
+			stats.Initialized = Generator.Initialize();
+
+		bool generated = stats.Initialized && Generator.Generate(request);
+
+		if (generated)
+			stats.Generated++;
+		else
+			stats.Failed++;
+
+		Transport.CompleteRequest();
+	}
+
+	return stats;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// Request loop for the resident LIP generator. One process serves every CKLipGenTunnel request the CK
+// sends until the CK exits, so the decompressed CK image is loaded and patched once, on the first
+// request. The loop knows nothing about Windows: the shared memory/event handshake is a LipGenTransport
+// and the CK code is a LipGenGenerator, so either side can be replaced with a fake.
+//
+struct LipGenRequest
+{
+	const char *InputWAVPath;
+	const char *ResampleTempWAVPath;
+	const char *DialogueText;
+	const char *FonixDataPath;
+	const char *Language;
+};
+
+class LipGenTransport
+{
+public:
+	enum class WaitResult
+	{
+		Request,		// *Request is valid until CompleteRequest()
+		Timeout,		// Nothing yet, wait again
+		Shutdown,		// Parent exited or asked to stop
+		Failed,			// Transport is broken
+	};
+
+	virtual ~LipGenTransport() = default;
+	virtual WaitResult WaitForRequest(LipGenRequest *Request) = 0;
+	virtual void CompleteRequest() = 0;
+};
+
+class LipGenGenerator
+{
+public:
+	virtual ~LipGenGenerator() = default;
+	virtual bool Initialize() = 0;
+	virtual bool Generate(const LipGenRequest& Request) = 0;
+};
+
+struct LipGenServerStats
+{
+	uint32_t Requests;
+	uint32_t Generated;
+	uint32_t Failed;
+	bool Initialized;
+};
+
+LipGenServerStats RunLipGenServer(LipGenTransport& Transport, LipGenGenerator& Generator);
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "stdafx.h"
+#include "LipGenServer.h"
 
 #define BAD_DLL ((HCUSTOMMODULE)0xDEADBEEF)
 #define BAD_IMPORT ((FARPROC)0xFEFEDEDE)
@@ -59,21 +60,143 @@ void CKLogCallback(int Type, const char *Format, ...)
 	printf("[CKIT32 %02d]: %s\n", Type, buffer);
 }
 
-void InitializeCreationKit()
+struct ImageCacheHeader
 {
-	FORCE_LOAD_REQUIRED_DATA[0] = 0;
-	FORCE_LOAD_REQUIRED_DATA[sizeof(FORCE_LOAD_REQUIRED_DATA) - 1] = 0;
+	uint32_t Magic;
+	uint32_t ImageSize;
+	uint64_t ResourceHash;
+	uint64_t ImageHash;
+};
 
-	// Read the exe into memory then initialize it
+uint64_t HashImageData(const unsigned char *Data, uint32_t Size)
+{
+	// FNV-1a over 8 byte words, the tail a byte at a time. Only needs to catch stale or damaged files.
+	uint64_t hash = 0xCBF29CE484222325ull;
+	uint32_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= Size; i += sizeof(uint64_t))
+		hash = (hash ^ *(const uint64_t *)&Data[i]) * 0x100000001B3ull;
+
+	for (; i < Size; i++)
+		hash = (hash ^ Data[i]) * 0x100000001B3ull;
+
+	return hash ^ Size;
+}
+
+void GetImageCachePath(char *Path, uint32_t PathLength, uint64_t ResourceHash)
+{
+	char tempDirectory[MAX_PATH];
+
+	if (GetTempPathA(ARRAYSIZE(tempDirectory), tempDirectory) == 0)
+		tempDirectory[0] = '\0';
+
+	sprintf_s(Path, PathLength, "%sskyrim32_ckt_%016llX.bin", tempDirectory, ResourceHash);
+}
+
+unsigned char *ReadImageCache(const char *Path, uint64_t ResourceHash, uint32_t ImageSize)
+{
+	HANDLE file = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	ImageCacheHeader header;
+	unsigned char *exeData = nullptr;
+	DWORD bytesRead;
+
+	if (ReadFile(file, &header, sizeof(header), &bytesRead, nullptr) && bytesRead == sizeof(header) &&
+		header.Magic == 'CK32' && header.ImageSize == ImageSize && header.ResourceHash == ResourceHash)
+	{
+		exeData = new unsigned char[ImageSize];
+
+		if (!ReadFile(file, exeData, ImageSize, &bytesRead, nullptr) || bytesRead != ImageSize || HashImageData(exeData, ImageSize) != header.ImageHash)
+		{
+			delete[] exeData;
+			exeData = nullptr;
+		}
+	}
+
+	CloseHandle(file);
+	return exeData;
+}
+
+void WriteImageCache(const char *Path, uint64_t ResourceHash, const unsigned char *Data, uint32_t ImageSize)
+{
+	// Write under a unique name and rename it into place so a parallel instance never reads half a file
+	char tempPath[MAX_PATH];
+	sprintf_s(tempPath, "%s.%u.tmp", Path, GetCurrentProcessId());
+
+	HANDLE file = CreateFileA(tempPath, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	ImageCacheHeader header;
+	header.Magic = 'CK32';
+	header.ImageSize = ImageSize;
+	header.ResourceHash = ResourceHash;
+	header.ImageHash = HashImageData(Data, ImageSize);
+
+	DWORD headerWritten = 0;
+	DWORD dataWritten = 0;
+	WriteFile(file, &header, sizeof(header), &headerWritten, nullptr);
+	WriteFile(file, Data, ImageSize, &dataWritten, nullptr);
+	CloseHandle(file);
+
+	if (headerWritten != sizeof(header) || dataWritten != ImageSize || !MoveFileExA(tempPath, Path, MOVEFILE_REPLACE_EXISTING))
+		DeleteFileA(tempPath);
+}
+
+unsigned char *LoadCreationKitImage(uint32_t *ImageSize)
+{
+	//
+	// The embedded exe is stb compressed. Decompressing it is most of the startup cost, so the result is kept
+	// in %TEMP%, keyed by a hash of the compressed resource. A new build of this tool gets a new file.
+	//
 	HRSRC binaryResource	= FindResource(GetModuleHandle(nullptr), MAKEINTRESOURCE(IDR_CK_LIP_BINARY1), L"CK_LIP_BINARY");
 	uint32_t size			= SizeofResource(GetModuleHandle(nullptr), binaryResource);
 	unsigned char *data		= (unsigned char *)LockResource(LoadResource(GetModuleHandle(nullptr), binaryResource));
-	unsigned char *exeData	= new unsigned char[stb_decompress_length(data)];
+
+	if (!data)
+		return nullptr;
+
+	*ImageSize = stb_decompress_length(data);
+
+	uint64_t resourceHash = HashImageData(data, size);
+	char cachePath[MAX_PATH];
+	GetImageCachePath(cachePath, ARRAYSIZE(cachePath), resourceHash);
+
+	if (unsigned char *exeData = ReadImageCache(cachePath, resourceHash, *ImageSize))
+	{
+		printf("Loaded cached CK image from '%s'\n", cachePath);
+		return exeData;
+	}
+
+	unsigned char *exeData = new unsigned char[*ImageSize];
 
 	if (stb_decompress(exeData, data, size) == 0)
+	{
+		delete[] exeData;
+		return nullptr;
+	}
+
+	WriteImageCache(cachePath, resourceHash, exeData, *ImageSize);
+	return exeData;
+}
+
+void InitializeCreationKit()
+{
+	FORCE_LOAD_REQUIRED_DATA[0] = 0;
+	FORCE_LOAD_REQUIRED_DATA[sizeof(FORCE_LOAD_REQUIRED_DATA) - 1] = 0;
+
+	// Read the exe into memory then initialize it
+	uint32_t exeSize		= 0;
+	unsigned char *exeData	= LoadCreationKitImage(&exeSize);
+
+	if (!exeData)
 		__debugbreak();
 
-	HMEMORYMODULE creationKitExe = MemoryLoadLibraryEx(exeData, stb_decompress_length(data), MemoryAlloc, MemoryDefaultFree, GetLibrary, GetLibraryProcAddr, MemoryDefaultFreeLibrary, nullptr);
+	HMEMORYMODULE creationKitExe = MemoryLoadLibraryEx(exeData, exeSize, MemoryAlloc, MemoryDefaultFree, GetLibrary, GetLibraryProcAddr, MemoryDefaultFreeLibrary, nullptr);
 	delete[] exeData;
 
 	if (!creationKitExe)
@@ -118,6 +241,115 @@ void InitializeCreationKit()
 	PatchJump(0x40AFC0, (uintptr_t)&CKLogCallback);
 }
 
+class TunnelTransport : public LipGenTransport
+{
+private:
+	CKLipGenTunnel *m_Tunnel;
+
+public:
+	TunnelTransport(CKLipGenTunnel *Tunnel) : m_Tunnel(Tunnel)
+	{
+	}
+
+	virtual WaitResult WaitForRequest(LipGenRequest *Request) override
+	{
+		DWORD waitStatus = WaitForSingleObject(g_NotifyEvent, 5000);
+
+		if (waitStatus == WAIT_FAILED)
+		{
+			printf("Failed waiting for CKIT64 notification (%d).\n", GetLastError());
+			return WaitResult::Failed;
+		}
+
+		// If the parent process exited, bail
+		if ((waitStatus == WAIT_OBJECT_0 && strlen(m_Tunnel->InputWAVPath) <= 0) || g_CreationKitPID == 0)
+			return WaitResult::Shutdown;
+
+		if (waitStatus == WAIT_TIMEOUT)
+			return WaitResult::Timeout;
+
+		Request->InputWAVPath = m_Tunnel->InputWAVPath;
+		Request->ResampleTempWAVPath = m_Tunnel->ResampleTempWAVPath;
+		Request->DialogueText = m_Tunnel->DialogueText;
+		Request->FonixDataPath = m_Tunnel->FonixDataPath;
+		Request->Language = m_Tunnel->Language;
+		return WaitResult::Request;
+	}
+
+	virtual void CompleteRequest() override
+	{
+		memset(m_Tunnel->InputWAVPath, 0, sizeof(m_Tunnel->InputWAVPath));
+		m_Tunnel->UnknownStatus = true;
+
+		// Done
+		SetEvent(g_WaitEvent);
+		WaitForSingleObject(g_NotifyEvent, INFINITE);
+		SetEvent(g_WaitEvent);
+	}
+};
+
+class CreationKitLipGenerator : public LipGenGenerator
+{
+private:
+	char m_CurrentDirectory[MAX_PATH];
+	char m_OutputPath[MAX_PATH];
+
+public:
+	CreationKitLipGenerator(const char *OutputPath)
+	{
+		GetCurrentDirectoryA(MAX_PATH, m_CurrentDirectory);
+		strcpy_s(m_OutputPath, OutputPath);
+	}
+
+	virtual bool Initialize() override
+	{
+		InitializeCreationKit();
+		return true;
+	}
+
+	virtual bool Generate(const LipGenRequest& Request) override
+	{
+		// Both strings live in the tunnel, so the pointers only change if the mapping does
+		uintptr_t fonixPathPtr = (uintptr_t)Request.FonixDataPath;
+		PatchMemory(0x469CA8, (PBYTE)&fonixPathPtr, sizeof(uintptr_t));// Manually patch Fonix.cdf lookup path
+
+		uintptr_t languagePtr = (uintptr_t)Request.Language;
+		PatchMemory(0x11B0AEC, (PBYTE)&languagePtr, sizeof(uintptr_t));// Manually patch language
+
+		printf("Attempting to create LIP file:\n");
+		printf("     Language: '%s'\n", Request.Language);
+		printf("     Input data: '%s'\n", Request.FonixDataPath);
+		printf("     Input WAV: '%s'\n", Request.InputWAVPath);
+		printf("     Resampled input WAV: '%s'\n", Request.ResampleTempWAVPath);
+		printf("     Text: '%s'\n", Request.DialogueText);
+
+		// Generate the lip file, then tell the CK
+		auto generateLipFile = [](const char *WAVPath, const char *ResamplePath, const char *BaseDirectory, const char *DialogueText, int *FaceFxObject)
+		{
+			return ((void *(__cdecl *)(const char *, const char *, const char *, const char *, int *))(0x46ACD0))
+				(WAVPath, ResamplePath, BaseDirectory, DialogueText, FaceFxObject);
+		};
+
+		void *lipAsset = generateLipFile(Request.InputWAVPath, Request.ResampleTempWAVPath, m_CurrentDirectory, Request.DialogueText, nullptr/*dword_12B64B8*/);
+
+		if (!lipAsset)
+			return false;
+
+		// Write it to disk as a temp copy & free memory
+		bool created = ((bool(__thiscall *)(void *, const char *, int, int, int))(0x587C70))(lipAsset, m_OutputPath, 16, 1, 1);
+
+		printf("Writing temporary LIP file to '%s'\n", m_OutputPath);
+
+		if (!created)
+			printf("LIP data was generated but the file couldn't be saved!\n");
+
+		((void(__thiscall *)(void *))(0x586A40))(lipAsset);
+		MemoryManager_Free(nullptr, nullptr, lipAsset, false);
+
+		return created;
+	}
+};
+
 DWORD WINAPI ExitNotifyThread(LPVOID Arg)
 {
 	// Grab handle to parent process (check for termination)
@@ -148,7 +380,6 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
 {
 	UNREFERENCED_PARAMETER(hInstance);
 	UNREFERENCED_PARAMETER(hPrevInstance);
-	UNREFERENCED_PARAMETER(lpCmdLine);
 	UNREFERENCED_PARAMETER(nCmdShow);
 
 	setvbuf(stdout, NULL, _IONBF, 0);
@@ -173,9 +404,24 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
 
 	g_CreationKitPID = atoi(getenv("Ckpid"));
 
+	//
+	// Workers in a CK64 batch pool ("-lipworker <index>") get their own tunnel and output file. The names
+	// must match LipGenPool.cpp.
+	//
+	char tunnelSuffix[32] = {};
+	char outputPath[MAX_PATH] = "Data\\Sound\\Voice\\Processing\\Temp.lip";
+
+	if (const wchar_t *workerArg = wcsstr(lpCmdLine, L"-lipworker "))
+	{
+		uint32_t workerIndex = wcstoul(workerArg + wcslen(L"-lipworker "), nullptr, 10);
+
+		sprintf_s(tunnelSuffix, "_%u", workerIndex);
+		sprintf_s(outputPath, "Data\\Sound\\Voice\\Processing\\Temp_%u.lip", workerIndex);
+	}
+
 	// Establish tunnel
 	char temp[128];
-	sprintf_s(temp, "CkSharedMem%d", g_CreationKitPID);
+	sprintf_s(temp, "CkSharedMem%d%s", g_CreationKitPID, tunnelSuffix);
 
 	HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, TRUE, temp);
 
@@ -194,10 +440,10 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
 		return 1;
 	}
 
-	sprintf_s(temp, "CkNotifyEvent%d", g_CreationKitPID);
+	sprintf_s(temp, "CkNotifyEvent%d%s", g_CreationKitPID, tunnelSuffix);
 	g_NotifyEvent = OpenEventA(EVENT_ALL_ACCESS, TRUE, temp);
 
-	sprintf_s(temp, "CkWaitEvent%d", g_CreationKitPID);
+	sprintf_s(temp, "CkWaitEvent%d%s", g_CreationKitPID, tunnelSuffix);
 	g_WaitEvent = OpenEventA(EVENT_ALL_ACCESS, TRUE, temp);
 
 	if (!g_NotifyEvent || !g_WaitEvent)
@@ -211,78 +457,13 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
 	CloseHandle(CreateThread(nullptr, 0, ExitNotifyThread, nullptr, 0, nullptr));
 
 	//
-	// Wait until the creation kit asks to do something
+	// Serve every request from this process until the creation kit exits
 	//
-	char currentDirectory[MAX_PATH];
-	GetCurrentDirectoryA(MAX_PATH, currentDirectory);
+	TunnelTransport transport(tunnel);
+	CreationKitLipGenerator generator(outputPath);
 
-	for (bool ckCodeLoaded = false;;)
-	{
-		DWORD waitStatus = WaitForSingleObject(g_NotifyEvent, 5000);
-
-		if (waitStatus == WAIT_FAILED)
-		{
-			printf("Failed waiting for CKIT64 notification (%d).\n", GetLastError());
-			break;
-		}
-
-		// If the parent process exited, bail
-		if ((waitStatus == WAIT_OBJECT_0 && strlen(tunnel->InputWAVPath) <= 0) || g_CreationKitPID == 0)
-			break;
-
-		if (waitStatus == WAIT_TIMEOUT)
-			continue;
-
-		if (!ckCodeLoaded)
-		{
-			InitializeCreationKit();
-			ckCodeLoaded = true;
-		}
-
-		uintptr_t fonixPathPtr = (uintptr_t)&tunnel->FonixDataPath;
-		PatchMemory(0x469CA8, (PBYTE)&fonixPathPtr, sizeof(uintptr_t));// Manually patch Fonix.cdf lookup path
-
-		uintptr_t languagePtr = (uintptr_t)&tunnel->Language;
-		PatchMemory(0x11B0AEC, (PBYTE)&languagePtr, sizeof(uintptr_t));// Manually patch language
-
-		printf("Attempting to create LIP file:\n");
-		printf("     Language: '%s'\n", tunnel->Language);
-		printf("     Input data: '%s'\n", tunnel->FonixDataPath);
-		printf("     Input WAV: '%s'\n", tunnel->InputWAVPath);
-		printf("     Resampled input WAV: '%s'\n", tunnel->ResampleTempWAVPath);
-		printf("     Text: '%s'\n", tunnel->DialogueText);
-
-		// Generate the lip file, then tell the CK
-		auto generateLipFile = [](const char *WAVPath, const char *ResamplePath, const char *BaseDirectory, const char *DialogueText, int *FaceFxObject)
-		{
-			return ((void *(__cdecl *)(const char *, const char *, const char *, const char *, int *))(0x46ACD0))
-				(WAVPath, ResamplePath, BaseDirectory, DialogueText, FaceFxObject);
-		};
-
-		void *lipAsset = generateLipFile(tunnel->InputWAVPath, tunnel->ResampleTempWAVPath, currentDirectory, tunnel->DialogueText, nullptr/*dword_12B64B8*/);
-
-		// Write it to disk as a temp copy & free memory
-		if (lipAsset)
-		{
-			bool created = ((bool(__thiscall *)(void *, const char *, int, int, int))(0x587C70))(lipAsset, "Data\\Sound\\Voice\\Processing\\Temp.lip", 16, 1, 1);
-
-			printf("Writing temporary LIP file to 'Data\\Sound\\Voice\\Processing\\Temp.lip'\n");
-
-			if (!created)
-				printf("LIP data was generated but the file couldn't be saved!\n");
-
-			((void(__thiscall *)(void *))(0x586A40))(lipAsset);
-			MemoryManager_Free(nullptr, nullptr, lipAsset, false);
-		}
-
-		memset(tunnel->InputWAVPath, 0, sizeof(tunnel->InputWAVPath));
-		tunnel->UnknownStatus = true;
-
-		// Done
-		SetEvent(g_WaitEvent);
-		WaitForSingleObject(g_NotifyEvent, INFINITE);
-		SetEvent(g_WaitEvent);
-	}
+	LipGenServerStats stats = RunLipGenServer(transport, generator);
+	printf("Processed %u LIP requests (%u generated, %u failed)\n", stats.Requests, stats.Generated, stats.Failed);
 
 	CloseHandle(g_NotifyEvent);
 	CloseHandle(g_WaitEvent);
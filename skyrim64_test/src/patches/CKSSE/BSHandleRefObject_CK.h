@@ -60,9 +60,29 @@ public:
 		return m_uiRefCount >> HANDLE_BIT_INDEX;
 	}
 
+	// Fails if the object already has an active handle. Atomic so a racing IncRefCount/DecRefCount isn't lost.
+	bool TrySetHandleEntryIndex(uint32_t HandleIndex)
+	{
+		uint32_t oldValue = m_uiRefCount;
+
+		for (;;)
+		{
+			if ((oldValue & (1u << ACTIVE_BIT_INDEX)) != 0)
+				return false;
+
+			const uint32_t newValue = (HandleIndex << HANDLE_BIT_INDEX) | (1u << ACTIVE_BIT_INDEX) | (oldValue & REF_COUNT_MASK);
+			const uint32_t value = InterlockedCompareExchange(&m_uiRefCount, newValue, oldValue);
+
+			if (value == oldValue)
+				return true;
+
+			oldValue = value;
+		}
+	}
+
 	void ClearHandleEntryIndex()
 	{
-		m_uiRefCount &= REF_COUNT_MASK;
+		InterlockedAnd((volatile LONG *)&m_uiRefCount, REF_COUNT_MASK);
 	}
 
 	bool IsHandleValid() const
@@ -1,3 +1,4 @@
+#include <thread>
 #include "../../common.h"
 #include "BSPointerHandleManager.h"
 
@@ -7,48 +8,99 @@ template class BSPointerHandleManagerInterface<>;
 template<typename HandleType>
 void BSPointerHandleManager<HandleType>::InitSDM()
 {
-	FreeListHead = 0;
-	HandleEntries.resize(HandleType::MAX_HANDLE_COUNT);
+	HandleEntries = std::make_unique<Entry[]>(HandleType::MAX_HANDLE_COUNT);
+	FreeIndices.Initialize(HandleType::MAX_HANDLE_COUNT);
 
-	for (uint32_t i = 0; i < HandleType::MAX_HANDLE_COUNT; i++)
+	// Same initial order as the vanilla free list: 0, 1, 2, ...
+	uint32_t indices[1024];
+
+	for (uint32_t i = 0; i < HandleType::MAX_HANDLE_COUNT; i += ARRAYSIZE(indices))
 	{
-		if ((i + 1) >= HandleType::MAX_HANDLE_COUNT)
-			HandleEntries[i].SetNextFreeEntry(i);
-		else
-			HandleEntries[i].SetNextFreeEntry(i + 1);
-	}
+		for (uint32_t j = 0; j < ARRAYSIZE(indices); j++)
+			indices[j] = i + j;
 
-	FreeListTail = HandleType::MAX_HANDLE_COUNT - 1;
+		FreeIndices.EnqueueBatch(indices, ARRAYSIZE(indices));
+	}
 }
 
 template<typename HandleType>
 void BSPointerHandleManager<HandleType>::KillSDM()
 {
-	HandleManagerLock.LockForWrite();
-
 	for (uint32_t i = 0; i < HandleType::MAX_HANDLE_COUNT; i++)
 	{
 		auto& arrayHandle = HandleEntries[i];
 
-		if (!arrayHandle.IsInUse())
+		if (!arrayHandle.TrySetNotInUse(arrayHandle.QAge()))
 			continue;
 
 		if (arrayHandle.GetPointer())
 			arrayHandle.GetPointer()->ClearHandleEntryIndex();
 
 		arrayHandle.SetPointer(nullptr);
-		arrayHandle.SetNotInUse();
+		ReleaseIndex(i);
+	}
 
-		if (FreeListTail == 0xFFFFFFFF)
-			FreeListHead = i;
-		else
-			HandleEntries[FreeListTail].SetNextFreeEntry(i);
+	IndexCache.Flush();
+}
+
+template<typename HandleType>
+BSPointerHandleManager<HandleType>::ThreadIndexCache::~ThreadIndexCache()
+{
+	Flush();
+}
 
-		arrayHandle.SetNextFreeEntry(i);
-		FreeListTail = i;
+template<typename HandleType>
+void BSPointerHandleManager<HandleType>::ThreadIndexCache::Flush()
+{
+	// Unused cached indices go back too, otherwise they'd be lost when the thread exits
+	if (AllocatedCount > 0)
+		FreeIndices.EnqueueBatch(&Allocated[AllocatedNext], AllocatedCount);
+
+	if (FreedCount > 0)
+		FreeIndices.EnqueueBatch(Freed, FreedCount);
+
+	AllocatedNext = 0;
+	AllocatedCount = 0;
+	FreedCount = 0;
+}
+
+template<typename HandleType>
+uint32_t BSPointerHandleManager<HandleType>::AllocateIndex()
+{
+	auto& cache = IndexCache;
+
+	if (cache.AllocatedCount == 0)
+	{
+		cache.AllocatedNext = 0;
+		cache.AllocatedCount = FreeIndices.DequeueBatch(cache.Allocated, CACHE_BATCH_SIZE);
+
+		// Nearly out: hand back this thread's freed indices and take whatever is left
+		if (cache.AllocatedCount == 0 && cache.FreedCount > 0)
+		{
+			FreeIndices.EnqueueBatch(cache.Freed, cache.FreedCount);
+			cache.FreedCount = 0;
+			cache.AllocatedCount = FreeIndices.DequeueBatch(cache.Allocated, CACHE_BATCH_SIZE);
+		}
+
+		if (cache.AllocatedCount == 0)
+			return INVALID_INDEX;
 	}
 
-	HandleManagerLock.UnlockWrite();
+	cache.AllocatedCount--;
+	return cache.Allocated[cache.AllocatedNext++];
+}
+
+template<typename HandleType>
+void BSPointerHandleManager<HandleType>::ReleaseIndex(uint32_t Index)
+{
+	auto& cache = IndexCache;
+	cache.Freed[cache.FreedCount++] = Index;
+
+	if (cache.FreedCount == CACHE_BATCH_SIZE)
+	{
+		FreeIndices.EnqueueBatch(cache.Freed, cache.FreedCount);
+		cache.FreedCount = 0;
+	}
 }
 
 void HandleManager::KillSDM()
@@ -85,55 +137,66 @@ inline BSUntypedPointerHandle<> BSPointerHandleManagerInterface<ObjectType, Mana
 	if (!Refr)
 		return untypedHandle;
 
-	// Shortcut: Check if the handle is already valid
-	untypedHandle = GetCurrentHandle(Refr);
-
-	if (untypedHandle != NullHandle)
-		return untypedHandle;
+	uint32_t newIndex = INVALID_INDEX;
 
-	// Wasn't present. Acquire lock and add it (unless someone else inserted it in the meantime)
-	HandleManagerLock.LockForWrite();
+	for (;;)
 	{
-		untypedHandle = GetCurrentHandle(Refr);
-
-		if (untypedHandle == NullHandle)
+		// Shortcut: Check if the handle is already valid
+		if (Refr->IsHandleValid())
 		{
-			if (FreeListHead == 0xFFFFFFFF)
+			const uint32_t index = Refr->QHandleEntryIndex();
+			auto& handle = HandleEntries[index];
+			const uint32_t age = handle.QAge();
+
+			if (handle.IsValid(age) && handle.GetPointer() == Refr)
 			{
-				untypedHandle.SetBitwiseNull();
-				AssertMsgVa(false, "OUT OF HANDLE ARRAY ENTRIES. Null handle created for pointer 0x%p.", Refr);
+				// Someone else's handle is live. Give back the index allocated below if this is a retry.
+				if (newIndex != INVALID_INDEX)
+				{
+					HandleEntries[newIndex].SetNotInUse();
+					HandleEntries[newIndex].SetPointer(nullptr);
+					ReleaseIndex(newIndex);
+				}
+
+				untypedHandle.Set(index, age);
+				return untypedHandle;
 			}
-			else
-			{
-				auto& newHandle = HandleEntries[FreeListHead];
-				newHandle.IncrementAge();
-				newHandle.SetInUse();
 
-				untypedHandle.Set(newHandle.QNextFreeEntry(), newHandle.QAge());
-				newHandle.SetPointer(Refr);
+			//
+			// A destroy has retired the entry but hasn't cleared the object's index yet. Returning this
+			// handle would hand out a dead one, and publishing a new index fails until the destroy is done.
+			//
+			std::this_thread::yield();
+			continue;
+		}
 
-				Refr->SetHandleEntryIndex(FreeListHead);
-				Assert(Refr->QHandleEntryIndex() == FreeListHead);
+		// Wasn't present. Take an index and publish it on the object unless someone else inserted one in the meantime.
+		if (newIndex == INVALID_INDEX)
+		{
+			newIndex = AllocateIndex();
 
-				if (newHandle.QNextFreeEntry() == FreeListHead)
-				{
-					// Table reached the maximum count
-					Assert(FreeListHead == FreeListTail);
+			if (newIndex == INVALID_INDEX)
+			{
+				untypedHandle.SetBitwiseNull();
+				AssertMsgVa(false, "OUT OF HANDLE ARRAY ENTRIES. Null handle created for pointer 0x%p.", Refr);
 
-					FreeListHead = 0xFFFFFFFF;
-					FreeListTail = 0xFFFFFFFF;
-				}
-				else
-				{
-					Assert(FreeListHead != FreeListTail);
-					FreeListHead = newHandle.QNextFreeEntry();
-				}
+				return untypedHandle;
 			}
+
+			auto& newHandle = HandleEntries[newIndex];
+			newHandle.IncrementAge();
+			newHandle.SetPointer(Refr);
+			newHandle.SetInUse();
 		}
-	}
-	HandleManagerLock.UnlockWrite();
 
-	return untypedHandle;
+		if (Refr->TrySetHandleEntryIndex(newIndex))
+		{
+			untypedHandle.Set(newIndex, HandleEntries[newIndex].QAge());
+			return untypedHandle;
+		}
+
+		// Lost the race. The winner's handle is either live or being destroyed; check again.
+	}
 }
 
 template<typename ObjectType, typename Manager>
@@ -142,27 +205,16 @@ inline void BSPointerHandleManagerInterface<ObjectType, Manager>::Destroy1(const
 	if (Handle.IsBitwiseNull())
 		return;
 
-	HandleManagerLock.LockForWrite();
-	{
-		const uint32_t handleIndex = Handle.QIndex();
-		auto& arrayHandle = HandleEntries[handleIndex];
-
-		if (arrayHandle.IsValid(Handle.QAge()))
-		{
-			arrayHandle.GetPointer()->ClearHandleEntryIndex();
-			arrayHandle.SetPointer(nullptr);
-			arrayHandle.SetNotInUse();
-
-			if (FreeListTail == 0xFFFFFFFF)
-				FreeListHead = handleIndex;
-			else
-				HandleEntries[FreeListTail].SetNextFreeEntry(handleIndex);
+	const uint32_t handleIndex = Handle.QIndex();
+	auto& arrayHandle = HandleEntries[handleIndex];
 
-			arrayHandle.SetNextFreeEntry(handleIndex);
-			FreeListTail = handleIndex;
-		}
+	// Only one of several racing destroys gets to release the entry
+	if (arrayHandle.TrySetNotInUse(Handle.QAge()))
+	{
+		arrayHandle.GetPointer()->ClearHandleEntryIndex();
+		arrayHandle.SetPointer(nullptr);
+		ReleaseIndex(handleIndex);
 	}
-	HandleManagerLock.UnlockWrite();
 }
 
 template<typename ObjectType, typename Manager>
@@ -171,30 +223,19 @@ inline void BSPointerHandleManagerInterface<ObjectType, Manager>::Destroy2(BSUnt
 	if (Handle.IsBitwiseNull())
 		return;
 
-	HandleManagerLock.LockForWrite();
-	{
-		const uint32_t handleIndex = Handle.QIndex();
-		auto& arrayHandle = HandleEntries[handleIndex];
-
-		if (arrayHandle.IsValid(Handle.QAge()))
-		{
-			arrayHandle.GetPointer()->ClearHandleEntryIndex();
-			arrayHandle.SetPointer(nullptr);
-			arrayHandle.SetNotInUse();
-
-			if (FreeListTail == 0xFFFFFFFF)
-				FreeListHead = handleIndex;
-			else
-				HandleEntries[FreeListTail].SetNextFreeEntry(handleIndex);
-
-			arrayHandle.SetNextFreeEntry(handleIndex);
-			FreeListTail = handleIndex;
-		}
+	const uint32_t handleIndex = Handle.QIndex();
+	auto& arrayHandle = HandleEntries[handleIndex];
 
-		// Identical to Destroy1 except for this Handle.SetBitwiseNull();
-		Handle.SetBitwiseNull();
+	// Only one of several racing destroys gets to release the entry
+	if (arrayHandle.TrySetNotInUse(Handle.QAge()))
+	{
+		arrayHandle.GetPointer()->ClearHandleEntryIndex();
+		arrayHandle.SetPointer(nullptr);
+		ReleaseIndex(handleIndex);
 	}
-	HandleManagerLock.UnlockWrite();
+
+	// Identical to Destroy1 except for this Handle.SetBitwiseNull();
+	Handle.SetBitwiseNull();
 }
 
 template<typename ObjectType, typename Manager>
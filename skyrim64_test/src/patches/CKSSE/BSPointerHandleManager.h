@@ -1,7 +1,9 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include "../TES/NiMain/NiPointer.h"
-#include "../TES/BSReadWriteLock.h"
+#include "HandleIndexQueue.h"
 #include "TESForm_CK.h"
 
 template<int IndexBits = 21, int AgeCountBits = 6>
@@ -85,41 +87,50 @@ template<typename HandleType = BSUntypedPointerHandle<>>
 class BSPointerHandleManager
 {
 protected:
+	//
+	// Entry bits use the handle layout. The index field is unused (free indices are kept in FreeIndices
+	// instead of being threaded through the entries) and the age changes on every allocation. Bits are
+	// atomic because handles are created, destroyed and checked without a lock.
+	//
 	class Entry
 	{
 	private:
-		uint32_t m_EntryBits = 0;
+		std::atomic<uint32_t> m_EntryBits = 0;
 		NiPointer<BSHandleRefObject> m_Pointer;
 
 	public:
 		void SetInUse()
 		{
-			m_EntryBits |= HandleType::ACTIVE_BIT_MASK;
+			m_EntryBits.fetch_or(HandleType::ACTIVE_BIT_MASK);
 		}
 
 		void SetNotInUse()
 		{
-			m_EntryBits &= ~HandleType::ACTIVE_BIT_MASK;
+			m_EntryBits.fetch_and(~HandleType::ACTIVE_BIT_MASK);
 		}
 
 		bool IsInUse() const
 		{
-			return (m_EntryBits & HandleType::ACTIVE_BIT_MASK) != 0;
+			return (m_EntryBits.load() & HandleType::ACTIVE_BIT_MASK) != 0;
 		}
 
-		void SetNextFreeEntry(uint32_t Index)
+		// Clears the active bit if the entry is in use with this age. Only one of several racing callers succeeds.
+		bool TrySetNotInUse(uint32_t Age)
 		{
-			m_EntryBits = (Index & HandleType::INDEX_MASK) | (m_EntryBits & ~HandleType::INDEX_MASK);
-		}
+			uint32_t bits = m_EntryBits.load();
 
-		uint32_t QNextFreeEntry() const
-		{
-			return m_EntryBits & HandleType::INDEX_MASK;
+			do
+			{
+				if ((bits & HandleType::ACTIVE_BIT_MASK) == 0 || (bits & HandleType::AGE_MASK) != Age)
+					return false;
+			} while (!m_EntryBits.compare_exchange_weak(bits, bits & ~HandleType::ACTIVE_BIT_MASK));
+
+			return true;
 		}
 
 		uint32_t QAge() const
 		{
-			return m_EntryBits & HandleType::AGE_MASK;
+			return m_EntryBits.load() & HandleType::AGE_MASK;
 		}
 
 		void SetPointer(BSHandleRefObject *Pointer)
@@ -134,22 +145,53 @@ protected:
 
 		bool IsValid(uint32_t Age) const
 		{
-			return IsInUse() && QAge() == Age;
+			const uint32_t bits = m_EntryBits.load();
+
+			return (bits & HandleType::ACTIVE_BIT_MASK) != 0 && (bits & HandleType::AGE_MASK) == Age;
 		}
 
 		void IncrementAge()
 		{
-			m_EntryBits = ((m_EntryBits << HandleType::INDEX_BITS) & HandleType::AGE_MASK) | (m_EntryBits & ~HandleType::AGE_MASK);
+			// Age 0 is skipped so index 0 never produces a bitwise null handle
+			const uint32_t bits = m_EntryBits.load();
+			uint32_t age = (bits + (1u << HandleType::INDEX_BITS)) & HandleType::AGE_MASK;
+
+			if (age == 0)
+				age = 1u << HandleType::INDEX_BITS;
+
+			m_EntryBits.store(age | (bits & ~HandleType::AGE_MASK));
 		}
 	};
 	static_assert(sizeof(Entry) == 0x10);
 
-	inline static uint32_t FreeListHead;
-	inline static uint32_t FreeListTail;
-	inline static BSReadWriteLock HandleManagerLock;
-	inline static std::vector<Entry> HandleEntries;
+	//
+	// Free indices are handed out in batches to per-thread caches. Freed indices collect in a separate
+	// per-thread buffer and go to the back of FreeIndices, so an index is only reused after every other
+	// free one has been. That distance, not the 6-bit age alone, is what keeps stale handles from matching.
+	//
+	constexpr static uint32_t CACHE_BATCH_SIZE = 32;
+	constexpr static uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+	struct ThreadIndexCache
+	{
+		uint32_t Allocated[CACHE_BATCH_SIZE];
+		uint32_t AllocatedNext = 0;
+		uint32_t AllocatedCount = 0;
+		uint32_t Freed[CACHE_BATCH_SIZE];
+		uint32_t FreedCount = 0;
+
+		~ThreadIndexCache();
+		void Flush();
+	};
+
+	inline static HandleIndexQueue FreeIndices;
+	inline static std::unique_ptr<Entry[]> HandleEntries;
+	inline static thread_local ThreadIndexCache IndexCache;
 	inline const static BSUntypedPointerHandle<> NullHandle;
 
+	static uint32_t AllocateIndex();
+	static void ReleaseIndex(uint32_t Index);
+
 public:
 	static void InitSDM();
 	static void KillSDM();
@@ -1,8 +1,123 @@
+#include <mutex>
+#include <memory>
 #include "../../common.h"
 #include "../TES/NiMain/BSDynamicTriShape.h"
 #include "../TES/NiMain/NiCollisionUtils.h"
+#include "TrianglePickBVH.h"
 #include "BSShaderResourceManager_CK.h"
 
+namespace
+{
+	// Shapes smaller than this are tested directly instead of getting a cached hierarchy
+	const uint32_t MinHierarchyTriangles = 64;
+	const size_t MaxCachedHierarchyBytes = 64 * 1024 * 1024;
+	const uint32_t FingerprintSamples = 32;
+
+	//
+	// Static renderer data is never modified after creation, so a hierarchy stays valid until the
+	// pointer is freed and reused. There's no hook for that; every lookup compares the buffers, counts
+	// and a fingerprint of sampled triangles instead.
+	//
+	struct CachedHierarchy
+	{
+		uintptr_t Positions;
+		const uint16_t *Indices;
+		uint32_t Stride;
+		uint32_t TriangleCount;
+		uint64_t Fingerprint;
+		std::shared_ptr<const TrianglePickBVH> BVH;
+	};
+
+	std::mutex HierarchyCacheLock;
+	std::unordered_map<const void *, CachedHierarchy> HierarchyCache;
+	size_t HierarchyCacheBytes = 0;
+
+	thread_local std::vector<uint8_t> DynamicDataCopy;
+	thread_local std::vector<NiPoint3> TriangleVertices;
+	thread_local std::vector<uint32_t> TriangleHits;
+	thread_local TrianglePickBVH FlatBVH;
+
+	NiPoint3 FetchPosition(uintptr_t Positions, uint32_t Stride, uintptr_t VertexIndex)
+	{
+		float *data = (float *)(Positions + (VertexIndex * Stride));
+		return NiPoint3(data[0], data[1], data[2]);
+	}
+
+	void GatherTriangles(const uint16_t *Indices, uint32_t TriangleCount, uintptr_t Positions, uint32_t Stride)
+	{
+		TriangleVertices.resize(TriangleCount * 3);
+
+		for (uint32_t i = 0; i < TriangleCount * 3; i++)
+			TriangleVertices[i] = FetchPosition(Positions, Stride, Indices[i]);
+	}
+
+	uint64_t GetFingerprint(const uint16_t *Indices, uint32_t TriangleCount, uintptr_t Positions, uint32_t Stride)
+	{
+		NiPoint3 samples[FingerprintSamples * 3];
+		const uint32_t sampleCount = std::min(TriangleCount, FingerprintSamples);
+
+		for (uint32_t i = 0; i < sampleCount; i++)
+		{
+			const uint32_t triangle = (uint32_t)(((uint64_t)i * TriangleCount) / sampleCount);
+
+			for (uint32_t j = 0; j < 3; j++)
+				samples[i * 3 + j] = FetchPosition(Positions, Stride, Indices[triangle * 3 + j]);
+		}
+
+		return XUtil::MurmurHash64A(samples, sampleCount * 3 * sizeof(NiPoint3), TriangleCount);
+	}
+
+	std::shared_ptr<const TrianglePickBVH> GetHierarchy(const void *RendererData, const uint16_t *Indices, uint32_t TriangleCount, uintptr_t Positions, uint32_t Stride)
+	{
+		const uint64_t fingerprint = GetFingerprint(Indices, TriangleCount, Positions, Stride);
+
+		auto isCurrent = [&](const CachedHierarchy& Entry)
+		{
+			return Entry.Positions == Positions && Entry.Indices == Indices && Entry.Stride == Stride &&
+				Entry.TriangleCount == TriangleCount && Entry.Fingerprint == fingerprint;
+		};
+
+		{
+			std::lock_guard<std::mutex> lock(HierarchyCacheLock);
+			auto itr = HierarchyCache.find(RendererData);
+
+			if (itr != HierarchyCache.end() && isCurrent(itr->second))
+				return itr->second.BVH;
+		}
+
+		// Build without the lock so picks on other shapes aren't serialized behind it. Two threads missing
+		// on the same shape both build; the first one stored wins.
+		auto bvh = std::make_shared<TrianglePickBVH>();
+
+		GatherTriangles(Indices, TriangleCount, Positions, Stride);
+		bvh->Build(TriangleVertices.data(), TriangleCount, true);
+
+		std::lock_guard<std::mutex> lock(HierarchyCacheLock);
+		auto itr = HierarchyCache.find(RendererData);
+
+		if (itr != HierarchyCache.end())
+		{
+			if (isCurrent(itr->second))
+				return itr->second.BVH;
+
+			HierarchyCacheBytes -= itr->second.BVH->GetMemoryUsage();
+			HierarchyCache.erase(itr);
+		}
+
+		// Callers keep their own reference, so dropping everything at once is safe
+		if (HierarchyCacheBytes + bvh->GetMemoryUsage() > MaxCachedHierarchyBytes)
+		{
+			HierarchyCache.clear();
+			HierarchyCacheBytes = 0;
+		}
+
+		HierarchyCacheBytes += bvh->GetMemoryUsage();
+		HierarchyCache.emplace(RendererData, CachedHierarchy{ Positions, Indices, Stride, TriangleCount, fingerprint, bvh });
+
+		return bvh;
+	}
+}
+
 bool BSShaderResourceManager_CK::FindIntersectionsTriShapeFastPath(NiPoint3& kOrigin, const NiPoint3& kDir, NiPick& kPick, BSTriShape *pkTriShape)
 {
 	if (pkTriShape->m_TriangleCount <= 0 || !pkTriShape->QRendererData())
@@ -11,6 +126,7 @@ bool BSShaderResourceManager_CK::FindIntersectionsTriShapeFastPath(NiPoint3& kOr
 	const uint16_t *indices = nullptr;
 	uintptr_t vertexData[2] = {};
 	uint32_t vertexStrides[2] = {};
+	bool dynamicDataLocked = false;
 
 	if (pkTriShape->QType() == GEOMETRY_TYPE_TRISHAPE || pkTriShape->QType() == GEOMETRY_TYPE_MULTIINDEX_TRISHAPE)
 	{
@@ -38,6 +154,20 @@ bool BSShaderResourceManager_CK::FindIntersectionsTriShapeFastPath(NiPoint3& kOr
 		indices = (uint16_t *)rendererData->m_RawIndexData;
 		uintptr_t dynamicData = (uintptr_t)shape->LockDynamicDataForRead();// NOTE: SPINLOCK IS HELD
 
+		// Test against a copy so the spinlock is only held for the memcpy. Shapes that don't report a
+		// size keep the lock until the end, like before.
+		if (dynamicData && shape->QDynamicDataSize() > 0)
+		{
+			DynamicDataCopy.assign((uint8_t *)dynamicData, (uint8_t *)dynamicData + shape->QDynamicDataSize());
+			shape->UnlockDynamicData();
+
+			dynamicData = (uintptr_t)DynamicDataCopy.data();
+		}
+		else
+		{
+			dynamicDataLocked = true;
+		}
+
 		// Position
 		if (BSGeometry::HasVertexAttribute(shape->GetVertexDesc(), 0))
 		{
@@ -115,8 +245,31 @@ bool BSShaderResourceManager_CK::FindIntersectionsTriShapeFastPath(NiPoint3& kOr
 		NiPoint3 kModelOrigin = (kDiff * kWorld.m_Rotate) * fInvWorldScale;
 		NiPoint3 kModelDir = kDir * kWorld.m_Rotate;
 
-		for (uint32_t i = 0; i < (pkTriShape->m_TriangleCount * 3u); i += 3)
+		//
+		// Find candidate triangles with the SIMD kernel, then run the scalar test again on each one for
+		// the intersection parameters. The kernel matches IntersectTriangle() exactly and hits come back
+		// sorted, so records are produced in the same order as a linear scan.
+		//
+		const uint32_t triangleCount = pkTriShape->m_TriangleCount;
+		TriangleHits.clear();
+
+		if (pkTriShape->QType() != GEOMETRY_TYPE_DYNAMIC_TRISHAPE && triangleCount >= MinHierarchyTriangles)
 		{
+			GetHierarchy(pkTriShape->QRendererData(), indices, triangleCount, vertexData[0], vertexStrides[0])->Intersect(kModelOrigin, kModelDir, kPick.GetFrontOnly(), TriangleHits);
+		}
+		else
+		{
+			// Dynamic positions change every frame, so these are never cached
+			GatherTriangles(indices, triangleCount, vertexData[0], vertexStrides[0]);
+
+			FlatBVH.Build(TriangleVertices.data(), triangleCount, false);
+			FlatBVH.Intersect(kModelOrigin, kModelDir, kPick.GetFrontOnly(), TriangleHits);
+		}
+
+		for (uint32_t triangle : TriangleHits)
+		{
+			const uint32_t i = triangle * 3;
+
 			NiPoint3 v[3] =
 			{
 				fetchStream(0, indices[i + 0]),
@@ -185,7 +338,7 @@ bool BSShaderResourceManager_CK::FindIntersectionsTriShapeFastPath(NiPoint3& kOr
 		}
 	}
 
-	if (pkTriShape->QType() == GEOMETRY_TYPE_DYNAMIC_TRISHAPE)
+	if (dynamicDataLocked)
 		static_cast<BSDynamicTriShape *>(pkTriShape)->UnlockDynamicData();
 
 	return intersectionFound;
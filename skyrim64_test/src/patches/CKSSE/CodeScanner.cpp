@@ -0,0 +1,90 @@
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "CodeScanner.h"
+
+CodeScanner::CodeScanner(uintptr_t Start, uintptr_t End, uintptr_t ChunkSize) : m_Start(Start), m_End(End), m_ChunkSize(ChunkSize)
+{
+	m_ChunkMatches.resize((End - Start + ChunkSize - 1) / ChunkSize);
+}
+
+size_t CodeScanner::AddPattern(const char *Mask)
+{
+	Matcher matcher = {};
+
+	for (size_t i = 0; i < strlen(Mask);)
+	{
+		if (Mask[i] != '?')
+		{
+			matcher.Pattern.emplace_back((uint8_t)strtoul(&Mask[i], nullptr, 16), false);
+			i += 3;
+		}
+		else
+		{
+			matcher.Pattern.emplace_back(0x00, true);
+			i += 2;
+		}
+	}
+
+	m_Matchers.push_back(std::move(matcher));
+	return m_Matchers.size() - 1;
+}
+
+size_t CodeScanner::AddMatcher(MatchCallback Callback)
+{
+	m_Matchers.push_back({ {}, Callback });
+	return m_Matchers.size() - 1;
+}
+
+size_t CodeScanner::GetChunkCount() const
+{
+	return m_ChunkMatches.size();
+}
+
+void CodeScanner::ScanChunk(size_t Chunk)
+{
+	const uintptr_t start = m_Start + Chunk * m_ChunkSize;
+	const uintptr_t end = std::min(start + m_ChunkSize, m_End);
+	auto& results = m_ChunkMatches[Chunk];
+
+	results.assign(m_Matchers.size(), {});
+
+	for (uintptr_t i = start; i < end; i++)
+	{
+		for (size_t j = 0; j < m_Matchers.size(); j++)
+		{
+			const Matcher& matcher = m_Matchers[j];
+			const bool match = matcher.Callback ? matcher.Callback(i, m_End) : MatchPattern(i, m_End, matcher.Pattern);
+
+			if (match)
+				results[j].push_back(i);
+		}
+	}
+}
+
+std::vector<uintptr_t> CodeScanner::GetMatches(size_t Matcher) const
+{
+	std::vector<uintptr_t> matches;
+
+	for (auto& chunk : m_ChunkMatches)
+	{
+		if (Matcher < chunk.size())
+			matches.insert(matches.end(), chunk[Matcher].begin(), chunk[Matcher].end());
+	}
+
+	return matches;
+}
+
+bool CodeScanner::MatchPattern(uintptr_t Address, uintptr_t End, const std::vector<std::pair<uint8_t, bool>>& Pattern)
+{
+	if (End - Address < Pattern.size())
+		return false;
+
+	for (size_t i = 0; i < Pattern.size(); i++)
+	{
+		if (!Pattern[i].second && ((uint8_t *)Address)[i] != Pattern[i].first)
+			return false;
+	}
+
+	return true;
+}
\ No newline at end of file
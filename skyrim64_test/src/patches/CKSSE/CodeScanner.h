@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+//
+// Chunked search over a code section for the startup patches. Every matcher runs at every address, and
+// ScanChunk() handles one chunk so callers can spread the chunks over any thread pool. Matchers may read
+// past the end of their chunk (up to the section end) so nothing straddling a boundary is missed, but a
+// match is only reported by the chunk holding its first byte. GetMatches() joins the chunks in order,
+// which gives the same address-sorted list a single linear scan would.
+//
+// Add every matcher before the first ScanChunk() call. Different chunks can be scanned concurrently.
+// Nothing here depends on Windows.
+//
+class CodeScanner
+{
+public:
+	using MatchCallback = bool(*)(uintptr_t Address, uintptr_t End);
+
+private:
+	struct Matcher
+	{
+		std::vector<std::pair<uint8_t, bool>> Pattern;	// Byte, wildcard
+		MatchCallback Callback;
+	};
+
+	uintptr_t m_Start;
+	uintptr_t m_End;
+	uintptr_t m_ChunkSize;
+	std::vector<Matcher> m_Matchers;
+	std::vector<std::vector<std::vector<uintptr_t>>> m_ChunkMatches;	// [chunk][matcher]
+
+	static bool MatchPattern(uintptr_t Address, uintptr_t End, const std::vector<std::pair<uint8_t, bool>>& Pattern);
+
+public:
+	CodeScanner(uintptr_t Start, uintptr_t End, uintptr_t ChunkSize);
+
+	// Same format as XUtil::FindPatterns ("48 8B ? ? C3")
+	size_t AddPattern(const char *Mask);
+	size_t AddMatcher(MatchCallback Callback);
+
+	size_t GetChunkCount() const;
+	void ScanChunk(size_t Chunk);
+	std::vector<uintptr_t> GetMatches(size_t Matcher) const;
+};
\ No newline at end of file
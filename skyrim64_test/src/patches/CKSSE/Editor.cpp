@@ -231,6 +231,8 @@ bool IsBSAVersionCurrent(class BSFile *File)
 	return false;
 }
 
+char g_LipGenToolPath[MAX_PATH];
+
 void CreateLipGenProcess(__int64 a1)
 {
 	char procIdString[32];
@@ -240,6 +242,7 @@ void CreateLipGenProcess(__int64 a1)
 	char procToolPath[MAX_PATH];
 	strcpy_s(procToolPath, (const char *)(a1 + 0x0));
 	strcat_s(procToolPath, (const char *)(a1 + 0x104));
+	strcpy_s(g_LipGenToolPath, procToolPath);
 
 	PROCESS_INFORMATION *procInfo = (PROCESS_INFORMATION *)(a1 + 0x228);
 	memset(procInfo, 0, sizeof(PROCESS_INFORMATION));
@@ -262,6 +265,12 @@ void CreateLipGenProcess(__int64 a1)
 		EditorUI_Log("FaceFXWrapper background process started.\n");
 }
 
+const char *GetLipGenToolPath()
+{
+	// Known once the CK has started its own generator process
+	return g_LipGenToolPath[0] ? g_LipGenToolPath : nullptr;
+}
+
 bool IsLipDataPresent(void *Thisptr)
 {
 	char currentDir[MAX_PATH];
@@ -736,6 +745,8 @@ void SortDialogueInfo(__int64 TESDataHandler, uint32_t FormType, int(*SortFuncti
 
 void QuitHandler()
 {
+	// Nothing runs after TerminateProcess, so write out whatever the log is still holding
+	EditorUI_FlushLog();
 	TerminateProcess(GetCurrentProcess(), 0);
 }
 
@@ -36,6 +36,7 @@ bool OpenPluginSaveDialog(HWND ParentWindow, const char *BasePath, bool IsESM, c
 bool IsBSAVersionCurrent(class BSFile *File);
 
 void CreateLipGenProcess(__int64 a1);
+const char *GetLipGenToolPath();
 bool IsLipDataPresent(void *Thisptr);
 bool WriteLipData(void *Thisptr, const char *Path, int Unkown1, bool Unknown2, bool Unknown3);
 int IsWavDataPresent(const char *Path, __int64 a2, __int64 a3, __int64 a4);
@@ -6,6 +6,7 @@
 #include "TESForm_CK.h"
 #include "EditorUI.h"
 #include "LogWindow.h"
+#include "LipGenPool.h"
 
 #pragma comment(lib, "comctl32.lib")
 
@@ -47,6 +48,7 @@ bool EditorUI_CreateExtensionMenu(HWND MainWindow, HMENU MainMenu)
 	result = result && InsertMenu(g_ExtensionMenu, -1, MF_BYPOSITION | MF_STRING, (UINT_PTR)UI_EXTMENU_LOADEDESPINFO, "Dump Active Forms");
 	result = result && InsertMenu(g_ExtensionMenu, -1, MF_BYPOSITION | MF_SEPARATOR, (UINT_PTR)UI_EXTMENU_SPACER, "");
 	result = result && InsertMenu(g_ExtensionMenu, -1, MF_BYPOSITION | MF_STRING, (UINT_PTR)UI_EXTMENU_HARDCODEDFORMS, "Save Hardcoded Forms");
+	result = result && InsertMenu(g_ExtensionMenu, -1, MF_BYPOSITION | MF_STRING, (UINT_PTR)UI_EXTMENU_LIPBATCH, "Batch Generate LIP Files...");
 
 	MENUITEMINFO menuInfo;
 	memset(&menuInfo, 0, sizeof(MENUITEMINFO));
@@ -267,6 +269,24 @@ LRESULT CALLBACK EditorUI_WndProc(HWND Hwnd, UINT Message, WPARAM wParam, LPARAM
 			PostMessageA(Hwnd, WM_COMMAND, 40127, 0);
 		}
 		return 0;
+
+		case UI_EXTMENU_LIPBATCH:
+		{
+			char filePath[MAX_PATH];
+			memset(filePath, 0, sizeof(filePath));
+
+			OPENFILENAME ofnData;
+			memset(&ofnData, 0, sizeof(OPENFILENAME));
+			ofnData.lStructSize = sizeof(OPENFILENAME);
+			ofnData.lpstrFilter = "LIP Job Lists (*.txt)\0*.txt\0\0";
+			ofnData.lpstrFile = filePath;
+			ofnData.nMaxFile = ARRAYSIZE(filePath);
+			ofnData.Flags = OFN_FILEMUSTEXIST | OFN_NOCHANGEDIR;
+
+			if (GetOpenFileName(&ofnData))
+				LipGenPool_StartBatch(filePath);
+		}
+		return 0;
 		}
 	}
 	else if (Message == WM_SETTEXT && Hwnd == g_MainHwnd)
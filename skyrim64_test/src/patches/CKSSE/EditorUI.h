@@ -28,6 +28,7 @@
 #define UI_EXTMENU_DUMPHAVOKRTTI		51008
 #define UI_EXTMENU_LOADEDESPINFO		51009
 #define UI_EXTMENU_HARDCODEDFORMS		51010
+#define UI_EXTMENU_LIPBATCH				51011
 
 void EditorUI_Initialize();
 bool EditorUI_CreateExtensionMenu(HWND MainWindow, HMENU MainMenu);
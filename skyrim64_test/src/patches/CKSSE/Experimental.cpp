@@ -1,7 +1,10 @@
 #include "../../common.h"
+#include <tbb/parallel_for.h>
 #include <intrin.h>
 #include <chrono>
 #include "LogWindow.h"
+#include "PeepholeOptimizer.h"
+#include "CodeScanner.h"
 
 using namespace std::chrono;
 
@@ -109,7 +112,62 @@ bool PatchNullsub(uintptr_t SourceAddress, uintptr_t TargetFunction, bool Extend
 	return false;
 }
 
-uint64_t ExperimentalPatchEditAndContinue()
+namespace
+{
+	// .text is split into chunks of this size for the startup scan
+	const uintptr_t ScanChunkSize = 1 * 1024 * 1024;
+
+	const char *MemInitPattern = "83 3D ? ? ? ? 02 74 13 48 8D 15 ? ? ? ? 48 8D 0D ? ? ? ? E8";
+	const char *LinkedListPattern = "48 89 4C 24 08 48 83 EC 18 48 8B 44 24 20 48 83 78 08 00 75 14 48 8B 44 24 20 48 83 38 00 75 09 C7 04 24 01 00 00 00 EB 07 C7 04 24 00 00 00 00 0F B6 04 24 48 83 C4 18 C3";
+
+	struct CodeScanResults
+	{
+		std::vector<uintptr_t> MemInit;
+		std::vector<uintptr_t> LinkedList;
+		std::vector<uintptr_t> EditAndContinue;
+	};
+
+	bool IsEditAndContinueBranch(uintptr_t Address, uintptr_t End)
+	{
+		const uintptr_t ecTableStart = OFFSET(0xFB4000, 1530);
+		const uintptr_t ecTableEnd = OFFSET(0x104C50D, 1530);
+
+		// Must be a call or a jump
+		if (*(uint8_t *)Address != 0xE9 && *(uint8_t *)Address != 0xE8)
+			return false;
+
+		if (End - Address < 5)
+			return false;
+
+		uintptr_t destination = Address + *(int32_t *)(Address + 1) + 5;
+
+		// if (destination is within E&C table)
+		return destination >= ecTableStart && destination < ecTableEnd && *(uint8_t *)destination == 0xE9;
+	}
+
+	CodeScanResults ScanCodeSection()
+	{
+		CodeScanner scanner(g_CodeBase, g_CodeEnd, ScanChunkSize);
+		const size_t memInit = scanner.AddPattern(MemInitPattern);
+		const size_t linkedList = scanner.AddPattern(LinkedListPattern);
+		const size_t editAndContinue = scanner.AddMatcher(IsEditAndContinueBranch);
+
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, scanner.GetChunkCount(), 1), [&](const tbb::blocked_range<size_t>& Range)
+		{
+			for (size_t chunk = Range.begin(); chunk != Range.end(); chunk++)
+				scanner.ScanChunk(chunk);
+		});
+
+		CodeScanResults results;
+		results.MemInit = scanner.GetMatches(memInit);
+		results.LinkedList = scanner.GetMatches(linkedList);
+		results.EditAndContinue = scanner.GetMatches(editAndContinue);
+
+		return results;
+	}
+}
+
+uint64_t ExperimentalPatchEditAndContinue(const std::vector<uintptr_t>& Branches)
 {
 	//
 	// Remove any references to the giant trampoline table generated for edit & continue
@@ -120,35 +178,27 @@ uint64_t ExperimentalPatchEditAndContinue()
 	uint64_t patchCount = 0;
 	std::vector<uintptr_t> branchTargets;
 
-	const uintptr_t ecTableStart = OFFSET(0xFB4000, 1530);
-	const uintptr_t ecTableEnd = OFFSET(0x104C50D, 1530);
-
-	for (uintptr_t i = g_CodeBase; i < g_CodeEnd; i++)
+	for (uintptr_t i : Branches)
 	{
-		// Must be a call or a jump
-		if (*(uint8_t *)i != 0xE9 && *(uint8_t *)i != 0xE8)
+		// The scan saw the original bytes. Earlier patches may have rewritten this one since.
+		if (!IsEditAndContinueBranch(i, g_CodeEnd))
 			continue;
 
+		// Find where the trampoline actually points to, then remove it
 		uintptr_t destination = i + *(int32_t *)(i + 1) + 5;
+		uintptr_t real = destination + *(int32_t *)(destination + 1) + 5;
 
-		// if (destination is within E&C table)
-		if (destination >= ecTableStart && destination < ecTableEnd && *(uint8_t *)destination == 0xE9)
-		{
-			// Find where the trampoline actually points to, then remove it
-			uintptr_t real = destination + *(int32_t *)(destination + 1) + 5;
+		uint8_t data[5];
+		data[0] = *(uint8_t *)i;
+		*(int32_t *)&data[1] = (int32_t)(real - i) - 5;
 
-			uint8_t data[5];
-			data[0] = *(uint8_t *)i;
-			*(int32_t *)&data[1] = (int32_t)(real - i) - 5;
+		memcpy((void *)i, data, sizeof(data));
+		patchCount++;
 
-			memcpy((void *)i, data, sizeof(data));
+		if (PatchNullsub(i, real, true))
 			patchCount++;
-
-			if (PatchNullsub(i, real, true))
-				patchCount++;
-			else
-				branchTargets.push_back(i);
-		}
+		else
+			branchTargets.push_back(i);
 	}
 
 	// Secondary pass to remove nullsubs missed or created above
@@ -163,7 +213,7 @@ uint64_t ExperimentalPatchEditAndContinue()
 	return patchCount;
 }
 
-uint64_t ExperimentalPatchMemInit()
+uint64_t ExperimentalPatchMemInit(const std::vector<uintptr_t>& Matches)
 {
 	//
 	// Remove the thousands of [code below] since they're useless checks:
@@ -171,15 +221,13 @@ uint64_t ExperimentalPatchMemInit()
 	// if ( dword_141ED6C88 != 2 ) // MemoryManager initialized flag
 	//     sub_140C00D30((__int64)&unk_141ED6800, &dword_141ED6C88);
 	//
-	auto matches = XUtil::FindPatterns(g_CodeBase, g_CodeEnd - g_CodeBase, "83 3D ? ? ? ? 02 74 13 48 8D 15 ? ? ? ? 48 8D 0D ? ? ? ? E8");
-
-	for (uintptr_t match : matches)
+	for (uintptr_t match : Matches)
 		memcpy((void *)match, "\xEB\x1A", 2);
 
-	return matches.size();
+	return Matches.size();
 }
 
-uint64_t ExperimentalPatchLinkedList()
+uint64_t ExperimentalPatchLinkedList(const std::vector<uintptr_t>& Matches)
 {
 	//
 	// Optimize a linked list HasValue<T>() hot-code-path function. Checks if the 16-byte structure
@@ -189,11 +237,8 @@ uint64_t ExperimentalPatchLinkedList()
 	__cpuid(cpuinfo, 1);
 
 	const bool hasSSE41 = ((cpuinfo[2] & (1 << 19)) != 0);
-	const char *pattern = "48 89 4C 24 08 48 83 EC 18 48 8B 44 24 20 48 83 78 08 00 75 14 48 8B 44 24 20 48 83 38 00 75 09 C7 04 24 01 00 00 00 EB 07 C7 04 24 00 00 00 00 0F B6 04 24 48 83 C4 18 C3";
 
-	auto matches = XUtil::FindPatterns(g_CodeBase, g_CodeEnd - g_CodeBase, pattern);
-
-	for (uintptr_t match : matches)
+	for (uintptr_t match : Matches)
 	{
 		if (hasSSE41)
 			memcpy((void *)match, "\xF3\x0F\x6F\x01\x66\x0F\x38\x17\xC0\x0F\x94\xC0\xC3", 13);
@@ -201,7 +246,7 @@ uint64_t ExperimentalPatchLinkedList()
 			memcpy((void *)match, "\x48\x83\x39\x00\x75\x0A\x48\x83\x79\x08\x00\x75\x03\xB0\x01\xC3\x32\xC0\xC3", 19);
 	}
 
-	return matches.size();
+	return Matches.size();
 }
 
 void ExperimentalPatchOptimizations()
@@ -230,9 +275,12 @@ void ExperimentalPatchOptimizations()
 		Assert(VirtualProtect((void *)range.Start, range.End - range.Start, PAGE_READWRITE, &range.Protection));
 	}
 
-	uint64_t count1 = ExperimentalPatchMemInit();
-	uint64_t count2 = ExperimentalPatchLinkedList();
-	uint64_t count3 = ExperimentalPatchEditAndContinue();
+	// Find everything in one parallel pass, then patch in a fixed order on this thread
+	auto scanResults = ScanCodeSection();
+
+	uint64_t count1 = ExperimentalPatchMemInit(scanResults.MemInit);
+	uint64_t count2 = ExperimentalPatchLinkedList(scanResults.LinkedList);
+	uint64_t count3 = ExperimentalPatchEditAndContinue(scanResults.EditAndContinue);
 
 	// Then restore the old permissions
 	for (auto& range : addressRanges)
@@ -246,4 +294,55 @@ void ExperimentalPatchOptimizations()
 
 	auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - timerStart).count();
 	EditorUI_Log("%s: (%llu + %llu + %llu) = %llu patches applied in %llums.\n", __FUNCTION__, count1, count2, count3, (count1 + count2 + count3), duration);
+}
+
+std::vector<PeepholeOptimizer::FunctionRange> GetFunctionTable()
+{
+	// Exception directory entries are sorted by BeginAddress
+	PIMAGE_NT_HEADERS64 ntHeaders = (PIMAGE_NT_HEADERS64)(g_ModuleBase + ((PIMAGE_DOS_HEADER)g_ModuleBase)->e_lfanew);
+	const IMAGE_DATA_DIRECTORY& directory = ntHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXCEPTION];
+
+	auto entries = (const RUNTIME_FUNCTION *)(g_ModuleBase + directory.VirtualAddress);
+	std::vector<PeepholeOptimizer::FunctionRange> functions(directory.Size / sizeof(RUNTIME_FUNCTION));
+
+	for (size_t i = 0; i < functions.size(); i++)
+		functions[i] = { g_ModuleBase + entries[i].BeginAddress, g_ModuleBase + entries[i].EndAddress };
+
+	return functions;
+}
+
+void ExperimentalPatchPeephole()
+{
+	// 0 = off, 1 = report only, 2 = apply
+	const int mode = g_INI.GetInteger("CreationKit", "PeepholeOptimizer", 0);
+
+	if (mode == 0)
+		return;
+
+	auto timerStart = high_resolution_clock::now();
+
+	//
+	// Inline or shorten every trivial debug-build function. This reads the code with every hook already in
+	// place, so detoured functions are left alone. A dry run only lists the candidates and what would be saved.
+	//
+	PeepholeOptimizer optimizer;
+	optimizer.Scan((const uint8_t *)g_CodeBase, g_CodeEnd - g_CodeBase, g_CodeBase, GetFunctionTable());
+	optimizer.WriteReport(EditorUI_Log, mode == 1);
+
+	if (mode == 2)
+	{
+		DWORD protection;
+		Assert(VirtualProtect((void *)g_CodeBase, g_CodeEnd - g_CodeBase, PAGE_READWRITE, &protection));
+
+		optimizer.Apply((uint8_t *)g_CodeBase);
+
+		BOOL ret =
+			VirtualProtect((void *)g_CodeBase, g_CodeEnd - g_CodeBase, protection, &protection) &&
+			FlushInstructionCache(GetCurrentProcess(), (void *)g_CodeBase, g_CodeEnd - g_CodeBase);
+
+		Assert(ret);
+	}
+
+	auto duration = duration_cast<milliseconds>(high_resolution_clock::now() - timerStart).count();
+	EditorUI_Log("%s: %llu patches applied in %llums.\n", __FUNCTION__, (mode == 2) ? optimizer.GetStatistics().InlinedSites + optimizer.GetStatistics().ShortenedFunctions : 0, duration);
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
 
 bool PatchNullsub(uintptr_t SourceAddress, uintptr_t TargetFunction, bool Extended);
-void ExperimentalPatchOptimizations();
\ No newline at end of file
+void ExperimentalPatchOptimizations();
+void ExperimentalPatchPeephole();
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include <thread>
+#include "HandleIndexQueue.h"
+
+void HandleIndexQueue::Initialize(uint32_t Capacity)
+{
+	m_Capacity = Capacity;
+	m_Slots.reset(new Slot[Capacity]);
+
+	for (uint32_t i = 0; i < Capacity; i++)
+		m_Slots[i].Sequence.store(i, std::memory_order_relaxed);
+
+	m_EnqueuePos.store(0, std::memory_order_relaxed);
+	m_DequeuePos.store(0, std::memory_order_release);
+}
+
+void HandleIndexQueue::EnqueueBatch(const uint32_t *Values, uint32_t Count)
+{
+	const uint32_t mask = m_Capacity - 1;
+
+	while (Count > 0)
+	{
+		const uint32_t count = (Count < m_Capacity) ? Count : m_Capacity;
+		uint32_t pos = m_EnqueuePos.load(std::memory_order_relaxed);
+
+		for (;;)
+		{
+			// Every slot in the run has to be free for this lap
+			uint32_t free = 0;
+			int32_t diff = 0;
+
+			for (; free < count; free++)
+			{
+				diff = (int32_t)(m_Slots[(pos + free) & mask].Sequence.load(std::memory_order_acquire) - (pos + free));
+
+				if (diff != 0)
+					break;
+			}
+
+			if (free == count)
+			{
+				if (m_EnqueuePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				// A consumer claimed the slot and hasn't released it yet
+				std::this_thread::yield();
+				pos = m_EnqueuePos.load(std::memory_order_relaxed);
+			}
+			else
+			{
+				pos = m_EnqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			Slot& slot = m_Slots[(pos + i) & mask];
+
+			slot.Value = Values[i];
+			slot.Sequence.store(pos + i + 1, std::memory_order_release);
+		}
+
+		Values += count;
+		Count -= count;
+	}
+}
+
+uint32_t HandleIndexQueue::DequeueBatch(uint32_t *Values, uint32_t MaxCount)
+{
+	const uint32_t mask = m_Capacity - 1;
+	uint32_t pos = m_DequeuePos.load(std::memory_order_relaxed);
+	uint32_t count;
+
+	for (;;)
+	{
+		// Take the published run at the front, up to MaxCount
+		int32_t diff = 0;
+
+		for (count = 0; count < MaxCount; count++)
+		{
+			diff = (int32_t)(m_Slots[(pos + count) & mask].Sequence.load(std::memory_order_acquire) - (pos + count + 1));
+
+			if (diff != 0)
+				break;
+		}
+
+		if (count > 0)
+		{
+			if (m_DequeuePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// Empty, unless a producer already claimed the slot and is still copying into it
+			if (m_EnqueuePos.load(std::memory_order_relaxed) == pos)
+				return 0;
+
+			std::this_thread::yield();
+			pos = m_DequeuePos.load(std::memory_order_relaxed);
+		}
+		else
+		{
+			pos = m_DequeuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Slot& slot = m_Slots[(pos + i) & mask];
+
+		Values[i] = slot.Value;
+		slot.Sequence.store(pos + i + m_Capacity, std::memory_order_release);
+	}
+
+	return count;
+}
+
+uint32_t HandleIndexQueue::GetApproximateCount() const
+{
+	return m_EnqueuePos.load(std::memory_order_relaxed) - m_DequeuePos.load(std::memory_order_relaxed);
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+//
+// Bounded lock-free FIFO of 32-bit indices, any number of producers and consumers (Vyukov's
+// sequence-per-slot design). Batch calls claim a run of consecutive slots with one CAS, so a caller moving
+// 32 indices pays for one contended atomic instead of 32. Positions are 32-bit and wrap; the capacity must
+// be a power of two.
+//
+// The queue is sized to hold every index it will ever be given, so it never fills up for good. A slot that
+// looks busy is only waiting on another thread's copy and the caller spins until it's done.
+//
+// Nothing here depends on Windows.
+//
+class HandleIndexQueue
+{
+private:
+	struct Slot
+	{
+		std::atomic<uint32_t> Sequence;
+		uint32_t Value;
+	};
+
+	uint32_t m_Capacity = 0;
+	std::unique_ptr<Slot[]> m_Slots;
+	alignas(64) std::atomic<uint32_t> m_EnqueuePos = 0;
+	alignas(64) std::atomic<uint32_t> m_DequeuePos = 0;
+
+public:
+	void Initialize(uint32_t Capacity);
+
+	void EnqueueBatch(const uint32_t *Values, uint32_t Count);
+	uint32_t DequeueBatch(uint32_t *Values, uint32_t MaxCount);
+	uint32_t GetApproximateCount() const;
+};
\ No newline at end of file
@@ -0,0 +1,361 @@
+#include "../../common.h"
+#include <atomic>
+#include <thread>
+#include "Editor.h"
+#include "LogWindow.h"
+#include "LipGenScheduler.h"
+#include "LipGenPool.h"
+
+namespace
+{
+	const uint32_t MaxJobAttempts = 3;
+	const uint32_t MaxWorkers = 32;
+	const uint32_t TunnelSize = 0x40000;
+	const DWORD PollInterval = 10;				// Milliseconds between scheduler pumps
+	const DWORD ProgressInterval = 5000;		// Milliseconds between progress lines in the log
+	const DWORD WorkerExitTimeout = 5000;
+
+	//
+	// Same layout as CKLipGenTunnel in skyrim32_ckt. Every pool worker gets its own mapping and event pair,
+	// named like the CK's with "_<worker index>" appended.
+	//
+	struct LipGenTunnel
+	{
+		char unknown[0x20];
+		char InputWAVPath[MAX_PATH];
+		char ResampleTempWAVPath[MAX_PATH];
+		char DialogueText[MAX_PATH];
+		char FonixDataPath[MAX_PATH];
+		char Language[MAX_PATH];
+		char data[0x2F21];
+		bool UnknownStatus;
+	};
+	static_assert_offset(LipGenTunnel, InputWAVPath, 0x20);
+	static_assert_offset(LipGenTunnel, ResampleTempWAVPath, 0x124);
+	static_assert_offset(LipGenTunnel, DialogueText, 0x228);
+	static_assert_offset(LipGenTunnel, FonixDataPath, 0x32C);
+	static_assert_offset(LipGenTunnel, Language, 0x430);
+	static_assert_offset(LipGenTunnel, UnknownStatus, 0x3455);
+
+	std::atomic_bool BatchRunning;
+
+	class LipGenWorkerProcess : public LipGenScheduler::Worker
+	{
+	private:
+		uint32_t m_Index;
+		std::string m_ToolPath;
+		std::string m_FonixDataPath;
+		std::string m_Language;
+		char m_TempLIPPath[MAX_PATH];
+		char m_ResampleWAVPath[MAX_PATH];
+		std::string m_OutputPath;
+
+		HANDLE m_Mapping = nullptr;
+		LipGenTunnel *m_Tunnel = nullptr;
+		HANDLE m_NotifyEvent = nullptr;
+		HANDLE m_WaitEvent = nullptr;
+		PROCESS_INFORMATION m_Process = {};
+		bool m_Acknowledging = false;
+
+	public:
+		LipGenWorkerProcess(uint32_t Index, const char *ToolPath, const char *FonixDataPath, const char *Language) :
+			m_Index(Index), m_ToolPath(ToolPath), m_FonixDataPath(FonixDataPath), m_Language(Language)
+		{
+			// Must match the worker's output path
+			sprintf_s(m_TempLIPPath, "Data\\Sound\\Voice\\Processing\\Temp_%u.lip", Index);
+			sprintf_s(m_ResampleWAVPath, "Data\\Sound\\Voice\\Processing\\Temp_%u.wav", Index);
+		}
+
+		virtual ~LipGenWorkerProcess()
+		{
+			Stop();
+		}
+
+		virtual bool Start() override
+		{
+			const uint32_t pid = GetCurrentProcessId();
+			char name[128];
+
+			sprintf_s(name, "CkSharedMem%u_%u", pid, m_Index);
+			m_Mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, TunnelSize, name);
+
+			if (m_Mapping)
+				m_Tunnel = (LipGenTunnel *)MapViewOfFile(m_Mapping, FILE_MAP_ALL_ACCESS, 0, 0, TunnelSize);
+
+			sprintf_s(name, "CkNotifyEvent%u_%u", pid, m_Index);
+			m_NotifyEvent = CreateEventA(nullptr, FALSE, FALSE, name);
+
+			sprintf_s(name, "CkWaitEvent%u_%u", pid, m_Index);
+			m_WaitEvent = CreateEventA(nullptr, FALSE, FALSE, name);
+
+			if (!m_Tunnel || !m_NotifyEvent || !m_WaitEvent)
+			{
+				EditorUI_Log("LIP worker %u: could not create tunnel (%d).\n", m_Index, GetLastError());
+				Stop();
+				return false;
+			}
+
+			memset(m_Tunnel, 0, sizeof(LipGenTunnel));
+
+			char procIdString[32];
+			sprintf_s(procIdString, "%d", pid);
+			SetEnvironmentVariableA("Ckpid", procIdString);
+
+			char commandLine[MAX_PATH + 64];
+			sprintf_s(commandLine, "\"%s\" -lipworker %u", m_ToolPath.c_str(), m_Index);
+
+			STARTUPINFOA startupInfo;
+			memset(&startupInfo, 0, sizeof(STARTUPINFOA));
+			startupInfo.cb = sizeof(STARTUPINFOA);
+
+			if (EditorUI_GetStdoutListenerPipe())
+			{
+				startupInfo.dwFlags |= STARTF_USESTDHANDLES;
+				startupInfo.hStdError = EditorUI_GetStdoutListenerPipe();
+				startupInfo.hStdOutput = EditorUI_GetStdoutListenerPipe();
+				startupInfo.hStdInput = nullptr;
+			}
+
+			if (!CreateProcessA(m_ToolPath.c_str(), commandLine, nullptr, nullptr, TRUE, 0, nullptr, nullptr, &startupInfo, &m_Process))
+			{
+				EditorUI_Log("LIP worker %u: '%s' could not be started (%d).\n", m_Index, m_ToolPath.c_str(), GetLastError());
+				memset(&m_Process, 0, sizeof(m_Process));
+				Stop();
+				return false;
+			}
+
+			m_Acknowledging = false;
+			return true;
+		}
+
+		virtual bool Submit(const LipGenScheduler::Job& Job) override
+		{
+			// An empty input path tells the worker to exit
+			if (Job.InputWAVPath.empty())
+				return false;
+
+			m_Acknowledging = false;
+			m_OutputPath = Job.OutputLIPPath;
+			DeleteFileA(m_TempLIPPath);
+
+			strncpy_s(m_Tunnel->InputWAVPath, Job.InputWAVPath.c_str(), _TRUNCATE);
+			strcpy_s(m_Tunnel->ResampleTempWAVPath, m_ResampleWAVPath);
+			strncpy_s(m_Tunnel->DialogueText, Job.DialogueText.c_str(), _TRUNCATE);
+			strncpy_s(m_Tunnel->FonixDataPath, m_FonixDataPath.c_str(), _TRUNCATE);
+			strncpy_s(m_Tunnel->Language, m_Language.c_str(), _TRUNCATE);
+			m_Tunnel->UnknownStatus = false;
+
+			return SetEvent(m_NotifyEvent) != FALSE;
+		}
+
+		virtual PollResult Poll() override
+		{
+			// Same liveness check the worker uses for its parent in ExitNotifyThread
+			DWORD exitCode;
+
+			if (!GetExitCodeProcess(m_Process.hProcess, &exitCode) || exitCode != STILL_ACTIVE)
+				return PollResult::Crashed;
+
+			if (WaitForSingleObject(m_WaitEvent, 0) != WAIT_OBJECT_0)
+				return PollResult::Busy;
+
+			// The worker signals once when done, then again after seeing our acknowledgement
+			if (!m_Acknowledging)
+			{
+				m_Acknowledging = true;
+				SetEvent(m_NotifyEvent);
+				return PollResult::Busy;
+			}
+
+			m_Acknowledging = false;
+
+			if (GetFileAttributesA(m_TempLIPPath) == INVALID_FILE_ATTRIBUTES)
+				return PollResult::Failed;
+
+			if (!MoveFileExA(m_TempLIPPath, m_OutputPath.c_str(), MOVEFILE_COPY_ALLOWED | MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+				return PollResult::Failed;
+
+			return PollResult::Succeeded;
+		}
+
+		virtual void Stop() override
+		{
+			if (m_Process.hProcess)
+			{
+				if (m_Tunnel)
+				{
+					memset(m_Tunnel->InputWAVPath, 0, sizeof(m_Tunnel->InputWAVPath));
+					SetEvent(m_NotifyEvent);
+				}
+
+				if (WaitForSingleObject(m_Process.hProcess, WorkerExitTimeout) != WAIT_OBJECT_0)
+					TerminateProcess(m_Process.hProcess, 1);
+
+				CloseHandle(m_Process.hThread);
+				CloseHandle(m_Process.hProcess);
+				memset(&m_Process, 0, sizeof(m_Process));
+			}
+
+			if (m_Tunnel)
+				UnmapViewOfFile(m_Tunnel);
+
+			if (m_Mapping)
+				CloseHandle(m_Mapping);
+
+			if (m_NotifyEvent)
+				CloseHandle(m_NotifyEvent);
+
+			if (m_WaitEvent)
+				CloseHandle(m_WaitEvent);
+
+			m_Tunnel = nullptr;
+			m_Mapping = nullptr;
+			m_NotifyEvent = nullptr;
+			m_WaitEvent = nullptr;
+		}
+
+		virtual void Terminate() override
+		{
+			if (m_Process.hProcess)
+			{
+				EditorUI_Log("LIP worker %u: job timed out, terminating the worker.\n", m_Index);
+
+				TerminateProcess(m_Process.hProcess, 1);
+				WaitForSingleObject(m_Process.hProcess, WorkerExitTimeout);
+			}
+
+			Stop();
+		}
+	};
+
+	bool ParseJobList(const char *Path, LipGenScheduler& Scheduler)
+	{
+		FILE *f;
+
+		if (fopen_s(&f, Path, "r") != 0)
+			return false;
+
+		char line[2048];
+
+		while (fgets(line, sizeof(line), f))
+		{
+			line[strcspn(line, "\r\n")] = '\0';
+
+			if (line[0] == '\0' || line[0] == '#')
+				continue;
+
+			// <wav path>\t<dialogue text>
+			char *text = strchr(line, '\t');
+
+			if (text)
+				*text++ = '\0';
+
+			if (strlen(line) >= MAX_PATH)
+			{
+				EditorUI_Log("LIP batch: skipping path longer than %d characters: '%s'\n", MAX_PATH - 1, line);
+				continue;
+			}
+
+			// The tunnel has the same limit for the text, and a truncated line would give a wrong .lip
+			if (text && strlen(text) >= MAX_PATH)
+			{
+				EditorUI_Log("LIP batch: skipping '%s', dialogue text is longer than %d characters.\n", line, MAX_PATH - 1);
+				continue;
+			}
+
+			char outputPath[MAX_PATH];
+			strcpy_s(outputPath, line);
+
+			if (char *extension = strrchr(outputPath, '.'); extension && !strchr(extension, '\\'))
+				*extension = '\0';
+
+			if (strcat_s(outputPath, ".lip") != 0)
+				continue;
+
+			Scheduler.AddJob(line, text, outputPath);
+		}
+
+		fclose(f);
+		return true;
+	}
+
+	void RunBatch(std::string JobListPath)
+	{
+		const char *toolPath = GetLipGenToolPath();
+		uint32_t workerCount = std::clamp<int>(g_INI.GetInteger("CreationKit_LipGen", "Workers", 4), 1, MaxWorkers);
+		std::string fonixDataPath = g_INI.Get("CreationKit_LipGen", "FonixDataPath", "Data\\Sound\\Voice\\Processing\\FonixData.cdf");
+		std::string language = g_INI.Get("CreationKit_LipGen", "Language", "USEnglish");
+		int jobTimeout = std::max<int>(g_INI.GetInteger("CreationKit_LipGen", "JobTimeout", 120), 0);
+
+		CreateDirectoryA("Data\\Sound", nullptr);
+		CreateDirectoryA("Data\\Sound\\Voice", nullptr);
+		CreateDirectoryA("Data\\Sound\\Voice\\Processing", nullptr);
+
+		std::vector<std::unique_ptr<LipGenScheduler::Worker>> workers;
+
+		for (uint32_t i = 0; i < workerCount; i++)
+			workers.emplace_back(std::make_unique<LipGenWorkerProcess>(i, toolPath, fonixDataPath.c_str(), language.c_str()));
+
+		LipGenScheduler scheduler(std::move(workers), MaxJobAttempts, std::chrono::seconds(jobTimeout));
+
+		if (!ParseJobList(JobListPath.c_str(), scheduler))
+		{
+			EditorUI_Log("LIP batch: could not open job list '%s'.\n", JobListPath.c_str());
+			BatchRunning = false;
+			return;
+		}
+
+		EditorUI_Log("LIP batch: %zu jobs on %u worker(s) using '%s'.\n", scheduler.GetJobCount(), workerCount, toolPath);
+
+		for (DWORD lastProgress = GetTickCount(); scheduler.Pump(); Sleep(PollInterval))
+		{
+			if (GetTickCount() - lastProgress < ProgressInterval)
+				continue;
+
+			auto stats = scheduler.GetStatistics();
+			EditorUI_Log("LIP batch: %llu/%zu done, %llu failed, %llu running, %.2f jobs/s\n",
+				stats.Completed + stats.Failed, scheduler.GetJobCount(), stats.Failed, stats.Running, stats.JobsPerSecond);
+
+			lastProgress = GetTickCount();
+		}
+
+		scheduler.Shutdown();
+
+		for (size_t i = 0; i < scheduler.GetJobCount(); i++)
+		{
+			auto& job = scheduler.GetJob(i);
+
+			if (job.Status == LipGenScheduler::JobStatus::Failed)
+				EditorUI_Log("LIP batch: failed '%s' after %u attempt(s).\n", job.InputWAVPath.c_str(), job.Attempts);
+		}
+
+		auto stats = scheduler.GetStatistics();
+		EditorUI_Log("LIP batch: finished in %.1f seconds. %llu generated, %llu failed, %llu retries, %llu timeouts, %llu worker restarts (%.2f jobs/s).\n",
+			stats.ElapsedSeconds, stats.Completed, stats.Failed, stats.Retries, stats.Timeouts, stats.WorkerRestarts, stats.JobsPerSecond);
+
+		BatchRunning = false;
+	}
+}
+
+bool LipGenPool_StartBatch(const char *JobListPath)
+{
+	if (!GetLipGenToolPath())
+	{
+		EditorUI_Log("LIP batch: the LIP generator hasn't been started by the CK yet, so its path is unknown.\n");
+		return false;
+	}
+
+	if (BatchRunning.exchange(true))
+	{
+		EditorUI_Log("LIP batch: a batch is already running.\n");
+		return false;
+	}
+
+	std::thread(RunBatch, std::string(JobListPath)).detach();
+	return true;
+}
+
+bool LipGenPool_IsBatchRunning()
+{
+	return BatchRunning;
+}
\ No newline at end of file
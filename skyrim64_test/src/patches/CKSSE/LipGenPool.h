@@ -0,0 +1,11 @@
+#pragma once
+
+#include "../../common.h"
+
+//
+// Batch LIP generation over several skyrim32_ckt worker processes. The job list is a text file with one
+// "<wav path><tab><dialogue text>" line per job (text optional, '#' starts a comment). Each .lip is written
+// next to its .wav. The batch runs on a background thread and reports progress to the log.
+//
+bool LipGenPool_StartBatch(const char *JobListPath);
+bool LipGenPool_IsBatchRunning();
\ No newline at end of file
@@ -0,0 +1,230 @@
+#include "LipGenScheduler.h"
+
+LipGenScheduler::LipGenScheduler(std::vector<std::unique_ptr<Worker>> Workers, uint32_t MaxAttempts, std::chrono::milliseconds JobTimeout) :
+	m_MaxAttempts(MaxAttempts), m_JobTimeout(JobTimeout)
+{
+	for (auto& worker : Workers)
+	{
+		WorkerSlot slot;
+		slot.Instance = std::move(worker);
+		slot.CurrentJob = 0;
+		slot.Started = false;
+		slot.Busy = false;
+		slot.Dead = false;
+
+		m_Workers.push_back(std::move(slot));
+	}
+}
+
+LipGenScheduler::~LipGenScheduler()
+{
+	Shutdown();
+}
+
+size_t LipGenScheduler::AddJob(const char *InputWAVPath, const char *DialogueText, const char *OutputLIPPath)
+{
+	Job job;
+	job.InputWAVPath = InputWAVPath;
+	job.DialogueText = DialogueText ? DialogueText : "";
+	job.OutputLIPPath = OutputLIPPath;
+	job.Status = JobStatus::Pending;
+	job.Attempts = 0;
+
+	m_Jobs.push_back(std::move(job));
+	m_PendingJobs.push_back(m_Jobs.size() - 1);
+
+	return m_Jobs.size() - 1;
+}
+
+void LipGenScheduler::FinishJob(WorkerSlot& Slot, JobStatus Status)
+{
+	m_Jobs[Slot.CurrentJob].Status = Status;
+	Slot.Busy = false;
+}
+
+void LipGenScheduler::HandleCrash(WorkerSlot& Slot, bool Hung)
+{
+	if (Slot.Busy)
+	{
+		Job& job = m_Jobs[Slot.CurrentJob];
+
+		if (job.Attempts < m_MaxAttempts)
+		{
+			// Retried before anything queued later
+			job.Status = JobStatus::Pending;
+			m_PendingJobs.push_front(Slot.CurrentJob);
+			m_Retries++;
+		}
+		else
+		{
+			job.Status = JobStatus::Failed;
+		}
+
+		Slot.Busy = false;
+	}
+
+	if (Hung)
+		Slot.Instance->Terminate();
+	else
+		Slot.Instance->Stop();
+
+	m_WorkerRestarts++;
+
+	if (!Slot.Instance->Start())
+		Slot.Dead = true;
+}
+
+bool LipGenScheduler::Pump()
+{
+	if (!m_Started)
+	{
+		m_StartTime = std::chrono::steady_clock::now();
+		m_Started = true;
+	}
+
+	bool anyAlive = false;
+
+	for (auto& slot : m_Workers)
+	{
+		if (slot.Dead)
+			continue;
+
+		// Workers are started lazily so an empty batch never launches anything
+		if (!slot.Started)
+		{
+			if (m_PendingJobs.empty())
+				continue;
+
+			slot.Started = true;
+
+			if (!slot.Instance->Start())
+			{
+				slot.Dead = true;
+				continue;
+			}
+		}
+
+		if (slot.Busy)
+		{
+			switch (slot.Instance->Poll())
+			{
+			case Worker::PollResult::Busy:
+				if (m_JobTimeout.count() > 0 && std::chrono::steady_clock::now() >= slot.Deadline)
+				{
+					m_Timeouts++;
+					HandleCrash(slot, true);
+				}
+				break;
+
+			case Worker::PollResult::Succeeded:
+				FinishJob(slot, JobStatus::Completed);
+				break;
+
+			case Worker::PollResult::Failed:
+				FinishJob(slot, JobStatus::Failed);
+				break;
+
+			case Worker::PollResult::Crashed:
+				HandleCrash(slot, false);
+				break;
+			}
+		}
+
+		if (!slot.Dead && !slot.Busy && !m_PendingJobs.empty())
+		{
+			size_t index = m_PendingJobs.front();
+			m_PendingJobs.pop_front();
+
+			Job& job = m_Jobs[index];
+			job.Status = JobStatus::Running;
+			job.Attempts++;
+
+			slot.CurrentJob = index;
+			slot.Deadline = std::chrono::steady_clock::now() + m_JobTimeout;
+			slot.Busy = true;
+
+			// A worker that can't take a job is treated the same as one that died running it
+			if (!slot.Instance->Submit(job))
+				HandleCrash(slot, false);
+		}
+
+		anyAlive |= !slot.Dead;
+	}
+
+	// Nobody left to run them
+	if (!anyAlive)
+	{
+		for (size_t index : m_PendingJobs)
+			m_Jobs[index].Status = JobStatus::Failed;
+
+		m_PendingJobs.clear();
+	}
+
+	for (auto& slot : m_Workers)
+	{
+		if (slot.Busy)
+			return true;
+	}
+
+	return !m_PendingJobs.empty();
+}
+
+void LipGenScheduler::Shutdown()
+{
+	for (auto& slot : m_Workers)
+	{
+		if (slot.Busy)
+			FinishJob(slot, JobStatus::Failed);
+
+		if (slot.Started && !slot.Dead)
+			slot.Instance->Stop();
+
+		slot.Started = false;
+	}
+}
+
+const LipGenScheduler::Job& LipGenScheduler::GetJob(size_t Index) const
+{
+	return m_Jobs[Index];
+}
+
+size_t LipGenScheduler::GetJobCount() const
+{
+	return m_Jobs.size();
+}
+
+LipGenScheduler::Statistics LipGenScheduler::GetStatistics() const
+{
+	Statistics stats = {};
+
+	for (auto& job : m_Jobs)
+	{
+		switch (job.Status)
+		{
+		case JobStatus::Pending: stats.Pending++; break;
+		case JobStatus::Running: stats.Running++; break;
+		case JobStatus::Completed: stats.Completed++; break;
+		case JobStatus::Failed: stats.Failed++; break;
+		}
+	}
+
+	for (auto& slot : m_Workers)
+	{
+		if (slot.Started && !slot.Dead)
+			stats.ActiveWorkers++;
+	}
+
+	stats.Retries = m_Retries;
+	stats.Timeouts = m_Timeouts;
+	stats.WorkerRestarts = m_WorkerRestarts;
+
+	if (m_Started)
+	{
+		stats.ElapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_StartTime).count();
+
+		if (stats.ElapsedSeconds > 0.0)
+			stats.JobsPerSecond = (stats.Completed + stats.Failed) / stats.ElapsedSeconds;
+	}
+
+	return stats;
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+//
+// Spreads LIP generation jobs over a pool of workers. Each worker runs one job at a time. Pump() hands
+// pending jobs to idle workers and collects finished ones; the caller decides how often to call it. A
+// worker that dies takes its job back to the queue (up to MaxAttempts tries) and is restarted once per
+// crash. A worker that can't be restarted is dropped, and when none are left the remaining jobs fail.
+// Jobs that a live worker reports as failed are not retried, since the same input fails again.
+//
+// A job still running after JobTimeout counts as a crash too, except that the worker is terminated
+// instead of being asked to exit. A zero timeout waits forever.
+//
+// Nothing here depends on Windows. The process/tunnel side is a LipGenScheduler::Worker.
+//
+class LipGenScheduler
+{
+public:
+	enum class JobStatus : uint8_t
+	{
+		Pending,
+		Running,
+		Completed,
+		Failed,
+	};
+
+	struct Job
+	{
+		std::string InputWAVPath;
+		std::string DialogueText;
+		std::string OutputLIPPath;
+		JobStatus Status;
+		uint32_t Attempts;
+	};
+
+	class Worker
+	{
+	public:
+		enum class PollResult
+		{
+			Busy,
+			Succeeded,
+			Failed,			// Worker is fine, the job isn't
+			Crashed,		// Worker is gone
+		};
+
+		virtual ~Worker() = default;
+		virtual bool Start() = 0;
+		virtual bool Submit(const Job& Job) = 0;
+		virtual PollResult Poll() = 0;
+		virtual void Stop() = 0;
+		virtual void Terminate() = 0;	// Hung worker, don't wait for it
+	};
+
+	struct Statistics
+	{
+		uint64_t Pending;
+		uint64_t Running;
+		uint64_t Completed;
+		uint64_t Failed;
+		uint64_t Retries;
+		uint64_t Timeouts;
+		uint64_t WorkerRestarts;
+		uint32_t ActiveWorkers;
+		double ElapsedSeconds;
+		double JobsPerSecond;			// Finished (completed or failed) jobs since the first Pump()
+	};
+
+private:
+	struct WorkerSlot
+	{
+		std::unique_ptr<Worker> Instance;
+		size_t CurrentJob;
+		std::chrono::steady_clock::time_point Deadline;
+		bool Started;
+		bool Busy;
+		bool Dead;
+	};
+
+	std::vector<WorkerSlot> m_Workers;
+	std::vector<Job> m_Jobs;
+	std::deque<size_t> m_PendingJobs;
+	uint32_t m_MaxAttempts;
+	std::chrono::milliseconds m_JobTimeout;
+	uint64_t m_Retries = 0;
+	uint64_t m_Timeouts = 0;
+	uint64_t m_WorkerRestarts = 0;
+	bool m_Started = false;
+	std::chrono::steady_clock::time_point m_StartTime;
+
+	void FinishJob(WorkerSlot& Slot, JobStatus Status);
+	void HandleCrash(WorkerSlot& Slot, bool Hung);
+
+public:
+	LipGenScheduler(std::vector<std::unique_ptr<Worker>> Workers, uint32_t MaxAttempts, std::chrono::milliseconds JobTimeout);
+	~LipGenScheduler();
+
+	size_t AddJob(const char *InputWAVPath, const char *DialogueText, const char *OutputLIPPath);
+	bool Pump();
+	void Shutdown();
+
+	const Job& GetJob(size_t Index) const;
+	size_t GetJobCount() const;
+	Statistics GetStatistics() const;
+};
\ No newline at end of file
@@ -0,0 +1,258 @@
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "LogSink.h"
+
+namespace
+{
+	// Bytes collected before the writer stops draining and emits what it has
+	const size_t MaxBatchBytes = 256 * 1024;
+}
+
+LogSink::LogSink(uint32_t Capacity) : m_Capacity(Capacity), m_Slots(new Slot[Capacity])
+{
+	for (size_t i = 0; i < m_Capacity; i++)
+		m_Slots[i].Sequence.store(i, std::memory_order_relaxed);
+}
+
+LogSink::~LogSink()
+{
+	Stop();
+}
+
+void LogSink::Start(FILE *File, OverflowPolicy Policy, BatchCallback Callback)
+{
+	if (m_Running)
+		return;
+
+	m_File = File;
+	m_Policy = Policy;
+	m_Callback = std::move(Callback);
+	m_StopRequested = false;
+	m_Running = true;
+
+	// Anything submitted before this point is still in the ring and gets written first
+	m_Writer = std::thread(&LogSink::WriterThread, this);
+}
+
+void LogSink::Stop()
+{
+	if (!m_Running)
+		return;
+
+	m_StopRequested = true;
+	WakeWriter();
+	m_Writer.join();
+
+	m_Running = false;
+	m_FlushCondition.notify_all();
+}
+
+bool LogSink::Submit(const char *Text, size_t Length)
+{
+	if (Length == 0)
+		return true;
+
+	Length = std::min<size_t>(Length, m_Capacity * RecordTextSize);
+	const size_t recordCount = (Length + RecordTextSize - 1) / RecordTextSize;
+
+	if (!TryEnqueue(Text, Length, recordCount))
+	{
+		m_Stalls++;
+
+		// Without a writer nothing would ever make room, so the policy doesn't matter
+		do
+		{
+			if (m_Policy == OverflowPolicy::Drop || !m_Running)
+			{
+				m_Dropped++;
+				return false;
+			}
+
+			WakeWriter();
+			std::this_thread::yield();
+		} while (!TryEnqueue(Text, Length, recordCount));
+	}
+
+	m_Submitted++;
+
+	// Pairs with the writer publishing m_WriterSleeping before its final IsPending() check
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (m_WriterSleeping)
+		WakeWriter();
+
+	return true;
+}
+
+void LogSink::Flush()
+{
+	if (!m_Running)
+		return;
+
+	// Every position below this is claimed by a producer and will be published
+	const size_t target = m_EnqueuePos.load();
+
+	WakeWriter();
+
+	std::unique_lock<std::mutex> lock(m_WakeLock);
+	m_FlushCondition.wait(lock, [&]() { return m_Consumed >= target || !m_Running; });
+}
+
+LogSink::Statistics LogSink::GetStatistics() const
+{
+	Statistics stats;
+	stats.Submitted = m_Submitted;
+	stats.Dropped = m_Dropped;
+	stats.Written = m_Written;
+	stats.Stalls = m_Stalls;
+	stats.Batches = m_Batches;
+
+	return stats;
+}
+
+bool LogSink::TryEnqueue(const char *Text, size_t Length, size_t RecordCount)
+{
+	const size_t mask = m_Capacity - 1;
+	size_t pos = m_EnqueuePos.load(std::memory_order_relaxed);
+
+	//
+	// The consumer frees slots in order, so if the last slot of the range is free for this lap, every
+	// slot before it is too. Claiming the whole range with one CAS keeps a message's records adjacent.
+	//
+	for (;;)
+	{
+		const size_t last = pos + RecordCount - 1;
+		const size_t sequence = m_Slots[last & mask].Sequence.load(std::memory_order_acquire);
+		const intptr_t diff = (intptr_t)sequence - (intptr_t)last;
+
+		if (diff == 0)
+		{
+			if (m_EnqueuePos.compare_exchange_weak(pos, pos + RecordCount, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// Full
+			return false;
+		}
+		else
+		{
+			pos = m_EnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	for (size_t i = 0; i < RecordCount; i++)
+	{
+		Slot& slot = m_Slots[(pos + i) & mask];
+		const size_t offset = i * RecordTextSize;
+		const size_t length = std::min<size_t>(Length - offset, RecordTextSize);
+
+		slot.Data.Length = (uint16_t)length;
+		slot.Data.Continued = (i + 1) < RecordCount;
+		memcpy(slot.Data.Text, Text + offset, length);
+
+		slot.Sequence.store(pos + i + 1, std::memory_order_release);
+	}
+
+	return true;
+}
+
+bool LogSink::IsPending() const
+{
+	return m_Slots[m_DequeuePos & (m_Capacity - 1)].Sequence.load(std::memory_order_acquire) == (m_DequeuePos + 1);
+}
+
+void LogSink::WakeWriter()
+{
+	// Taking the lock orders this with the writer's check-then-wait
+	{
+		std::lock_guard<std::mutex> lock(m_WakeLock);
+	}
+
+	m_WakeCondition.notify_one();
+}
+
+void LogSink::WriterThread()
+{
+	std::string batch;
+	batch.reserve(MaxBatchBytes + (2 * RecordTextSize));
+
+	for (;;)
+	{
+		uint32_t messageCount = 0;
+
+		if (Drain(batch, messageCount) > 0)
+		{
+			Emit(batch, messageCount);
+			continue;
+		}
+
+		if (m_StopRequested)
+			break;
+
+		std::unique_lock<std::mutex> lock(m_WakeLock);
+		m_WriterSleeping = true;
+
+		// Check again now that producers can see the flag. The timeout covers anything that still slips by.
+		if (!IsPending() && !m_StopRequested)
+			m_WakeCondition.wait_for(lock, std::chrono::milliseconds(50));
+
+		m_WriterSleeping = false;
+	}
+}
+
+size_t LogSink::Drain(std::string& Batch, uint32_t& MessageCount)
+{
+	const size_t start = m_DequeuePos;
+	bool partial = false;
+
+	while (Batch.size() < MaxBatchBytes || partial)
+	{
+		Slot& slot = m_Slots[m_DequeuePos & (m_Capacity - 1)];
+
+		if (slot.Sequence.load(std::memory_order_acquire) != (m_DequeuePos + 1))
+		{
+			if (!partial)
+				break;
+
+			// The rest of this message is claimed and being copied in right now
+			std::this_thread::yield();
+			continue;
+		}
+
+		Batch.append(slot.Data.Text, slot.Data.Length);
+		partial = slot.Data.Continued != 0;
+
+		slot.Sequence.store(m_DequeuePos + m_Capacity, std::memory_order_release);
+		m_DequeuePos++;
+
+		if (!partial)
+			MessageCount++;
+	}
+
+	return m_DequeuePos - start;
+}
+
+void LogSink::Emit(std::string& Batch, uint32_t MessageCount)
+{
+	if (m_File)
+	{
+		fwrite(Batch.data(), 1, Batch.size(), m_File);
+		fflush(m_File);
+	}
+
+	if (m_Callback)
+		m_Callback(Batch.data(), Batch.size(), MessageCount);
+
+	m_Written += MessageCount;
+	m_Batches++;
+	Batch.clear();
+
+	{
+		std::lock_guard<std::mutex> lock(m_WakeLock);
+		m_Consumed = m_DequeuePos;
+	}
+
+	m_FlushCondition.notify_all();
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+//
+// Multi-producer log queue with a background writer. Producers copy each message into fixed-size records
+// in a bounded lock-free ring (Vyukov's sequence-per-slot design, single consumer). A message longer than
+// one record claims consecutive slots with a single CAS, so messages are never interleaved or partially
+// dropped. The writer appends whole batches to the file with one write and one flush, and hands the same
+// batch to a callback for display.
+//
+// Nothing here depends on Windows.
+//
+class LogSink
+{
+public:
+	enum class OverflowPolicy
+	{
+		Block,			// Producers wait for the writer when the ring is full; nothing is lost
+		Drop,			// New messages are discarded when the ring is full and counted in Dropped
+	};
+
+	struct Statistics
+	{
+		uint64_t Submitted;		// Messages accepted into the ring
+		uint64_t Dropped;		// Messages discarded by OverflowPolicy::Drop (or while no writer runs)
+		uint64_t Written;		// Messages passed to the file and callback
+		uint64_t Stalls;		// Times a producer found the ring full
+		uint64_t Batches;		// File writes/callbacks issued
+	};
+
+	// Called on the writer thread with a run of complete, newline-terminated messages
+	using BatchCallback = std::function<void(const char *Text, size_t Length, uint32_t MessageCount)>;
+
+	static const uint32_t RecordTextSize = 244;	// Keeps a slot at 256 bytes
+	static const uint32_t DefaultCapacity = 16384;
+
+private:
+	struct Record
+	{
+		uint16_t Length;
+		uint16_t Continued;		// The next slot holds the rest of this message
+		char Text[RecordTextSize];
+	};
+
+	struct alignas(64) Slot
+	{
+		std::atomic<size_t> Sequence;
+		Record Data;
+	};
+
+	const size_t m_Capacity;
+	std::unique_ptr<Slot[]> m_Slots;
+
+	alignas(64) std::atomic<size_t> m_EnqueuePos = 0;
+	alignas(64) size_t m_DequeuePos = 0;
+
+	OverflowPolicy m_Policy = OverflowPolicy::Block;
+	FILE *m_File = nullptr;
+	BatchCallback m_Callback;
+	std::thread m_Writer;
+	std::atomic_bool m_Running = false;
+	std::atomic_bool m_StopRequested = false;
+
+	// Writer wakeup and Flush() completion. Producers only touch these when the writer is asleep.
+	std::mutex m_WakeLock;
+	std::condition_variable m_WakeCondition;
+	std::condition_variable m_FlushCondition;
+	std::atomic_bool m_WriterSleeping = false;
+	std::atomic<size_t> m_Consumed = 0;
+
+	std::atomic<uint64_t> m_Submitted = 0;
+	std::atomic<uint64_t> m_Dropped = 0;
+	std::atomic<uint64_t> m_Written = 0;
+	std::atomic<uint64_t> m_Stalls = 0;
+	std::atomic<uint64_t> m_Batches = 0;
+
+public:
+	// Capacity is in records and must be a power of two
+	LogSink(uint32_t Capacity = DefaultCapacity);
+	~LogSink();
+
+	LogSink(const LogSink&) = delete;
+	LogSink& operator=(const LogSink&) = delete;
+
+	void Start(FILE *File, OverflowPolicy Policy, BatchCallback Callback);
+	void Stop();
+
+	// Text doesn't need to be null terminated. Returns false if the message was dropped.
+	bool Submit(const char *Text, size_t Length);
+
+	// Waits until everything submitted before the call has been written
+	void Flush();
+
+	Statistics GetStatistics() const;
+
+private:
+	bool TryEnqueue(const char *Text, size_t Length, size_t RecordCount);
+	bool IsPending() const;
+	void WakeWriter();
+	void WriterThread();
+	size_t Drain(std::string& Batch, uint32_t& MessageCount);
+	void Emit(std::string& Batch, uint32_t MessageCount);
+};
\ No newline at end of file
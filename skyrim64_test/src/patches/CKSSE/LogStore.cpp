@@ -0,0 +1,183 @@
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include "LogStore.h"
+
+void LogStore::AppendLine(const char *Text, size_t Length, uint32_t Category, Severity Level)
+{
+	// Lines never straddle chunks. Anything bigger than a chunk gets a chunk of its own.
+	if (m_Chunks.empty() || m_ChunkUsed + Length > m_ChunkCapacity)
+	{
+		m_ChunkCapacity = std::max(ChunkSize, Length);
+		m_ChunkUsed = 0;
+		m_Chunks.emplace_back(new char[m_ChunkCapacity]);
+	}
+
+	memcpy(m_Chunks.back().get() + m_ChunkUsed, Text, Length);
+
+	const uint32_t index = (uint32_t)m_Lines.size();
+	m_Lines.push_back({ (uint32_t)(m_Chunks.size() - 1), (uint32_t)m_ChunkUsed, (uint32_t)Length });
+	m_ChunkUsed += Length;
+	m_MaxLineLength = std::max(m_MaxLineLength, (uint32_t)Length);
+
+	// Grow every bitmap together so they can be combined word by word
+	if ((index % 64) == 0)
+	{
+		for (auto& bits : m_CategoryBits)
+			bits.push_back(0);
+
+		for (auto& bits : m_SeverityBits)
+			bits.push_back(0);
+	}
+
+	m_CategoryBits[Category][index / 64] |= 1ull << (index % 64);
+	m_SeverityBits[(uint32_t)Level][index / 64] |= 1ull << (index % 64);
+
+	if (LineMatches(index))
+		m_VisibleRows.push_back(index);
+}
+
+void LogStore::Clear()
+{
+	m_Chunks.clear();
+	m_ChunkUsed = 0;
+	m_ChunkCapacity = 0;
+	m_Lines.clear();
+	m_MaxLineLength = 0;
+	m_VisibleRows.clear();
+
+	for (auto& bits : m_CategoryBits)
+		bits.clear();
+
+	for (auto& bits : m_SeverityBits)
+		bits.clear();
+}
+
+void LogStore::SetFilter(uint32_t CategoryMask, uint32_t SeverityMask)
+{
+	m_CategoryMask = CategoryMask;
+	m_SeverityMask = SeverityMask;
+	m_VisibleRows.clear();
+
+	const size_t wordCount = m_CategoryBits[0].size();
+
+	for (size_t word = 0; word < wordCount; word++)
+	{
+		uint64_t categories = 0;
+		uint64_t severities = 0;
+
+		for (uint32_t i = 0; i < MaxCategories; i++)
+		{
+			if (CategoryMask & (1u << i))
+				categories |= m_CategoryBits[i][word];
+		}
+
+		for (uint32_t i = 0; i < (uint32_t)Severity::Count; i++)
+		{
+			if (SeverityMask & (1u << i))
+				severities |= m_SeverityBits[i][word];
+		}
+
+		uint64_t bits = categories & severities;
+
+		for (uint32_t bit = 0; bits != 0; bit++, bits >>= 1)
+		{
+			if (bits & 1)
+				m_VisibleRows.push_back((uint32_t)(word * 64) + bit);
+		}
+	}
+}
+
+uint32_t LogStore::GetCategoryMask() const
+{
+	return m_CategoryMask;
+}
+
+uint32_t LogStore::GetSeverityMask() const
+{
+	return m_SeverityMask;
+}
+
+uint32_t LogStore::GetLineCount() const
+{
+	return (uint32_t)m_Lines.size();
+}
+
+uint32_t LogStore::GetVisibleCount() const
+{
+	return (uint32_t)m_VisibleRows.size();
+}
+
+uint32_t LogStore::GetMaxLineLength() const
+{
+	return m_MaxLineLength;
+}
+
+const char *LogStore::GetVisibleLine(uint32_t Row, size_t *Length) const
+{
+	if (Row >= m_VisibleRows.size())
+	{
+		*Length = 0;
+		return "";
+	}
+
+	const Line& line = m_Lines[m_VisibleRows[Row]];
+
+	*Length = line.Length;
+	return m_Chunks[line.Chunk].get() + line.Offset;
+}
+
+uint32_t LogStore::FindVisible(const char *Needle, uint32_t StartRow, bool Forward, bool MatchCase) const
+{
+	const size_t needleLength = strlen(Needle);
+	const uint32_t rowCount = (uint32_t)m_VisibleRows.size();
+
+	if (needleLength == 0 || rowCount == 0)
+		return InvalidRow;
+
+	uint32_t row = std::min(StartRow, rowCount - 1);
+
+	for (uint32_t i = 0; i < rowCount; i++)
+	{
+		if (LineContains(m_VisibleRows[row], Needle, needleLength, MatchCase))
+			return row;
+
+		if (Forward)
+			row = (row + 1 < rowCount) ? row + 1 : 0;
+		else
+			row = (row > 0) ? row - 1 : rowCount - 1;
+	}
+
+	return InvalidRow;
+}
+
+bool LogStore::LineMatches(uint32_t Index) const
+{
+	const uint64_t bit = 1ull << (Index % 64);
+
+	bool category = false;
+	bool severity = false;
+
+	for (uint32_t i = 0; i < MaxCategories && !category; i++)
+		category = (m_CategoryMask & (1u << i)) && (m_CategoryBits[i][Index / 64] & bit);
+
+	for (uint32_t i = 0; i < (uint32_t)Severity::Count && !severity; i++)
+		severity = (m_SeverityMask & (1u << i)) && (m_SeverityBits[i][Index / 64] & bit);
+
+	return category && severity;
+}
+
+bool LogStore::LineContains(uint32_t Index, const char *Needle, size_t NeedleLength, bool MatchCase) const
+{
+	const Line& line = m_Lines[Index];
+	const char *text = m_Chunks[line.Chunk].get() + line.Offset;
+	const char *end = text + line.Length;
+
+	if (MatchCase)
+		return std::search(text, end, Needle, Needle + NeedleLength) != end;
+
+	return std::search(text, end, Needle, Needle + NeedleLength, [](char A, char B)
+	{
+		return tolower((unsigned char)A) == tolower((unsigned char)B);
+	}) != end;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+
+//
+// Append-only storage for log lines. Text is packed into large chunks, each line is an (offset, length)
+// entry, and every category and severity has a bitmap with one bit per line. Filtering ORs the bitmaps a
+// word at a time to build the list of visible rows, so the text itself is only read for display and
+// search.
+//
+// Nothing here depends on Windows.
+//
+class LogStore
+{
+public:
+	enum class Severity : uint8_t
+	{
+		Info,
+		Warning,
+		Error,
+		Count,
+	};
+
+	static const uint32_t MaxCategories = 32;
+	static const uint32_t AllCategories = 0xFFFFFFFF;
+	static const uint32_t AllSeverities = (1u << (uint32_t)Severity::Count) - 1;
+	static const uint32_t InvalidRow = 0xFFFFFFFF;
+
+private:
+	static const size_t ChunkSize = 1024 * 1024;
+
+	struct Line
+	{
+		uint32_t Chunk;
+		uint32_t Offset;
+		uint32_t Length;
+	};
+
+	std::vector<std::unique_ptr<char[]>> m_Chunks;
+	size_t m_ChunkUsed = 0;
+	size_t m_ChunkCapacity = 0;
+
+	std::vector<Line> m_Lines;
+	std::vector<uint64_t> m_CategoryBits[MaxCategories];
+	std::vector<uint64_t> m_SeverityBits[(uint32_t)Severity::Count];
+	uint32_t m_MaxLineLength = 0;
+
+	uint32_t m_CategoryMask = AllCategories;
+	uint32_t m_SeverityMask = AllSeverities;
+	std::vector<uint32_t> m_VisibleRows;	// Line indices passing the filter, in order
+
+public:
+	// Text should not include the line terminator. Category must be below MaxCategories.
+	void AppendLine(const char *Text, size_t Length, uint32_t Category, Severity Level);
+	void Clear();
+
+	void SetFilter(uint32_t CategoryMask, uint32_t SeverityMask);
+	uint32_t GetCategoryMask() const;
+	uint32_t GetSeverityMask() const;
+
+	uint32_t GetLineCount() const;
+	uint32_t GetVisibleCount() const;
+	uint32_t GetMaxLineLength() const;
+	const char *GetVisibleLine(uint32_t Row, size_t *Length) const;
+
+	// Searches visible rows starting at StartRow, wrapping around once. Returns InvalidRow if nothing matches.
+	uint32_t FindVisible(const char *Needle, uint32_t StartRow, bool Forward, bool MatchCase) const;
+
+private:
+	bool LineMatches(uint32_t Index) const;
+	bool LineContains(uint32_t Index, const char *Needle, size_t NeedleLength, bool MatchCase) const;
+};
\ No newline at end of file
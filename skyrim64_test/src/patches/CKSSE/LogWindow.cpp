@@ -1,8 +1,11 @@
 #include "../../common.h"
 #include <regex>
-#include <tbb/concurrent_vector.h>
-#include <Richedit.h>
+#include <algorithm>
+#include <CommCtrl.h>
+#include <commdlg.h>
 #include "EditorUI.h"
+#include "LogSink.h"
+#include "LogStore.h"
 #include "LogWindow.h"
 
 HWND g_LogHwnd;
@@ -10,14 +13,75 @@ HANDLE g_LogPipeReader;
 HANDLE g_LogPipeWriter;
 FILE *g_LogFile;
 
-tbb::concurrent_vector<const char *> g_LogPendingMessages;
+LogSink g_LogSink;
+LogStore g_LogStore;// Only touched on the UI thread
 std::set<uint64_t> g_LogMessageBlacklist;
 
-bool EditorUI_CreateLogWindow()
+// Indexed by EditorUI_Warning's type. Lines without one of these prefixes go to GeneralLogCategory.
+const char *g_LogWarningTypes[30] =
 {
-	if (!LoadLibraryA("MSFTEDIT.dll"))
-		return false;
+	"DEFAULT",
+	"COMBAT",
+	"ANIMATION",
+	"AI",
+	"SCRIPTS",
+	"SAVELOAD",
+	"DIALOGUE",
+	"QUESTS",
+	"PACKAGES",
+	"EDITOR",
+	"MODELS",
+	"TEXTURES",
+	"PLUGINS",
+	"MASTERFILE",
+	"FORMS",
+	"MAGIC",
+	"SHADERS",
+	"RENDERING",
+	"PATHFINDING",
+	"MENUS",
+	"AUDIO",
+	"CELLS",
+	"HAVOK",
+	"FACEGEN",
+	"WATER",
+	"INGAME",
+	"MEMORY",
+	"PERFORMANCE",
+	"JOBS",
+	"SYSTEM"
+};
+
+const uint32_t GeneralLogCategory = ARRAYSIZE(g_LogWarningTypes);
+static_assert(GeneralLogCategory < LogStore::MaxCategories);
+
+// Log window context menu
+const UINT LogMenuFind = 1;
+const UINT LogMenuCopy = 2;
+const UINT LogMenuShowAll = 3;
+const UINT LogMenuSeverityBase = 0x100;
+const UINT LogMenuCategoryBase = 0x200;
+
+// Text appended by the log writer thread, waiting for the next UI timer tick
+std::mutex g_LogPendingLock;
+std::string g_LogPendingText;
+uint64_t g_LogUIDroppedMessages;
+
+const size_t MaxPendingUIBytes = 16 * 1024 * 1024;
+
+void EditorUI_AppendPendingText(const char *Text, size_t Length, uint32_t MessageCount)
+{
+	std::lock_guard<std::mutex> lock(g_LogPendingLock);
 
+	// The file still gets everything; the window just can't fall further behind than this
+	if (g_LogPendingText.size() + Length > MaxPendingUIBytes)
+		g_LogUIDroppedMessages += MessageCount;
+	else
+		g_LogPendingText.append(Text, Length);
+}
+
+bool EditorUI_CreateLogWindow()
+{
 	// Build warning blacklist stored in the ini file
 	EditorUI_GenerateWarningBlacklist();
 
@@ -33,11 +97,19 @@ bool EditorUI_CreateLogWindow()
 
 		atexit([]()
 		{
+			g_LogSink.Stop();
+
 			if (g_LogFile)
 				fclose(g_LogFile);
 		});
 	}
 
+	// Messages wait for the writer by default. With 'DropOnOverflow' producers never stall and the drop
+	// count is shown in the window title instead.
+	const bool dropOnOverflow = g_INI.GetBoolean("CreationKit_Log", "DropOnOverflow", false);
+
+	g_LogSink.Start(g_LogFile, dropOnOverflow ? LogSink::OverflowPolicy::Drop : LogSink::OverflowPolicy::Block, EditorUI_AppendPendingText);
+
 	// Window output
 	HINSTANCE instance = (HINSTANCE)GetModuleHandle(nullptr);
 
@@ -161,67 +233,312 @@ HANDLE EditorUI_GetStdoutListenerPipe()
 	return g_LogPipeWriter;
 }
 
+void EditorUI_FlushLog()
+{
+	g_LogSink.Flush();
+}
+
+void EditorUI_ClassifyLogLine(const char *Text, size_t Length, uint32_t *Category, LogStore::Severity *Level)
+{
+	*Category = GeneralLogCategory;
+	*Level = LogStore::Severity::Info;
+
+	// Warnings are written as "TYPE: message" (see EditorUI_Warning) and assertions as "ASSERTION: message"
+	const char *colon = (const char *)memchr(Text, ':', std::min<size_t>(Length, 16));
+
+	if (!colon)
+		return;
+
+	const size_t prefixLength = colon - Text;
+
+	if (prefixLength == 9 && !memcmp(Text, "ASSERTION", 9))
+	{
+		*Level = LogStore::Severity::Error;
+		return;
+	}
+
+	for (uint32_t i = 0; i < ARRAYSIZE(g_LogWarningTypes); i++)
+	{
+		if (strlen(g_LogWarningTypes[i]) == prefixLength && !memcmp(Text, g_LogWarningTypes[i], prefixLength))
+		{
+			*Category = i;
+			*Level = LogStore::Severity::Warning;
+			return;
+		}
+	}
+}
+
+void EditorUI_AddLogLines(const std::string& Text)
+{
+	for (size_t start = 0; start < Text.length();)
+	{
+		size_t end = Text.find('\n', start);
+
+		if (end == std::string::npos)
+			end = Text.length();
+
+		size_t length = end - start;
+
+		while (length > 0 && Text[start + length - 1] == '\r')
+			length--;
+
+		uint32_t category;
+		LogStore::Severity level;
+
+		EditorUI_ClassifyLogLine(&Text[start], length, &category, &level);
+		g_LogStore.AppendLine(&Text[start], length, category, level);
+
+		start = end + 1;
+	}
+}
+
+void EditorUI_UpdateLogView(HWND ListHwnd, int CharWidth, bool AutoScroll, bool Reset)
+{
+	const int count = (int)g_LogStore.GetVisibleCount();
+
+	// New rows only need to be painted if they're on screen
+	ListView_SetItemCountEx(ListHwnd, count, Reset ? 0 : (LVSICF_NOINVALIDATEALL | LVSICF_NOSCROLL));
+
+	// Single column wide enough for the longest line, so long lines scroll instead of being cut off
+	RECT client;
+	GetClientRect(ListHwnd, &client);
+
+	const int width = std::max<int>(client.right - GetSystemMetrics(SM_CXVSCROLL), (g_LogStore.GetMaxLineLength() + 2) * CharWidth);
+
+	if (width != ListView_GetColumnWidth(ListHwnd, 0))
+		ListView_SetColumnWidth(ListHwnd, 0, width);
+
+	if (AutoScroll && count > 0)
+		ListView_EnsureVisible(ListHwnd, count - 1, FALSE);
+
+	if (Reset)
+		InvalidateRect(ListHwnd, nullptr, TRUE);
+}
+
+void EditorUI_FindLogText(HWND ListHwnd, const char *Text, bool Forward, bool MatchCase)
+{
+	const uint32_t count = g_LogStore.GetVisibleCount();
+
+	if (count == 0 || Text[0] == '\0')
+		return;
+
+	// Start next to the selection, wrapping at either end
+	int selected = ListView_GetNextItem(ListHwnd, -1, LVNI_SELECTED);
+	uint32_t start;
+
+	if (selected == -1)
+		start = Forward ? 0 : count - 1;
+	else if (Forward)
+		start = ((uint32_t)selected + 1) % count;
+	else
+		start = (selected > 0) ? (uint32_t)selected - 1 : count - 1;
+
+	const uint32_t row = g_LogStore.FindVisible(Text, start, Forward, MatchCase);
+
+	if (row == LogStore::InvalidRow)
+	{
+		MessageBeep(MB_ICONASTERISK);
+		return;
+	}
+
+	EditorUI_ListViewSelectItem(ListHwnd, (int)row, false);
+	EditorUI_ListViewCustomSetItemState(ListHwnd, row, LVIS_FOCUSED, LVIS_FOCUSED);
+}
+
+void EditorUI_CopyLogSelection(HWND Hwnd, HWND ListHwnd)
+{
+	std::string text;
+
+	for (int i = -1; (i = ListView_GetNextItem(ListHwnd, i, LVNI_SELECTED)) != -1;)
+	{
+		size_t length;
+		const char *line = g_LogStore.GetVisibleLine(i, &length);
+
+		text.append(line, length);
+		text.append("\r\n");
+	}
+
+	if (text.empty() || !OpenClipboard(Hwnd))
+		return;
+
+	EmptyClipboard();
+
+	if (HGLOBAL memory = GlobalAlloc(GMEM_MOVEABLE, text.length() + 1))
+	{
+		memcpy(GlobalLock(memory), text.c_str(), text.length() + 1);
+		GlobalUnlock(memory);
+
+		if (!SetClipboardData(CF_TEXT, memory))
+			GlobalFree(memory);
+	}
+
+	CloseClipboard();
+}
+
+bool EditorUI_ShowLogFilterMenu(HWND Hwnd)
+{
+	static const char *severityNames[] = { "Messages", "Warnings", "Assertions" };
+	static_assert(ARRAYSIZE(severityNames) == (size_t)LogStore::Severity::Count);
+
+	uint32_t categoryMask = g_LogStore.GetCategoryMask();
+	uint32_t severityMask = g_LogStore.GetSeverityMask();
+
+	HMENU menu = CreatePopupMenu();
+	HMENU categoryMenu = CreatePopupMenu();
+
+	AppendMenuA(menu, MF_STRING, LogMenuFind, "Find...\tCtrl+F");
+	AppendMenuA(menu, MF_STRING, LogMenuCopy, "Copy\tCtrl+C");
+	AppendMenuA(menu, MF_SEPARATOR, 0, nullptr);
+	AppendMenuA(menu, MF_STRING, LogMenuShowAll, "Show All");
+
+	for (uint32_t i = 0; i < ARRAYSIZE(severityNames); i++)
+		AppendMenuA(menu, MF_STRING | ((severityMask & (1u << i)) ? MF_CHECKED : 0), LogMenuSeverityBase + i, severityNames[i]);
+
+	for (uint32_t i = 0; i <= GeneralLogCategory; i++)
+	{
+		const char *name = (i == GeneralLogCategory) ? "(None)" : g_LogWarningTypes[i];
+		AppendMenuA(categoryMenu, MF_STRING | ((categoryMask & (1u << i)) ? MF_CHECKED : 0), LogMenuCategoryBase + i, name);
+	}
+
+	AppendMenuA(menu, MF_POPUP, (UINT_PTR)categoryMenu, "Categories");
+
+	POINT cursor;
+	GetCursorPos(&cursor);
+
+	const UINT command = TrackPopupMenu(menu, TPM_RETURNCMD | TPM_RIGHTBUTTON, cursor.x, cursor.y, 0, Hwnd, nullptr);
+	DestroyMenu(menu);
+
+	if (command == LogMenuFind || command == LogMenuCopy)
+	{
+		PostMessageA(Hwnd, WM_COMMAND, command, 0);
+		return false;
+	}
+
+	if (command == LogMenuShowAll)
+	{
+		categoryMask = LogStore::AllCategories;
+		severityMask = LogStore::AllSeverities;
+	}
+	else if (command >= LogMenuCategoryBase && command <= LogMenuCategoryBase + GeneralLogCategory)
+	{
+		categoryMask ^= 1u << (command - LogMenuCategoryBase);
+	}
+	else if (command >= LogMenuSeverityBase && command < LogMenuSeverityBase + ARRAYSIZE(severityNames))
+	{
+		severityMask ^= 1u << (command - LogMenuSeverityBase);
+	}
+	else
+	{
+		return false;
+	}
+
+	g_LogStore.SetFilter(categoryMask, severityMask);
+	return true;
+}
+
 LRESULT CALLBACK EditorUI_LogWndProc(HWND Hwnd, UINT Message, WPARAM wParam, LPARAM lParam)
 {
-	static HWND richEditHwnd;
+	static HWND listHwnd;
+	static HFONT listFont;
+	static int charWidth;
 	static bool autoScroll;
 
+	static UINT findMessage;
+	static HWND findHwnd;
+	static FINDREPLACEA findRequest;
+	static char findText[256];
+
+	// Find dialog notifications use a registered message, so they can't be a case label
+	if (findMessage != 0 && Message == findMessage)
+	{
+		auto request = (const FINDREPLACEA *)lParam;
+
+		if (request->Flags & FR_DIALOGTERM)
+			findHwnd = nullptr;
+		else if (request->Flags & FR_FINDNEXT)
+			EditorUI_FindLogText(listHwnd, findText, (request->Flags & FR_DOWN) != 0, (request->Flags & FR_MATCHCASE) != 0);
+
+		return 0;
+	}
+
 	switch (Message)
 	{
 	case WM_CREATE:
 	{
 		const CREATESTRUCT *info = (CREATESTRUCT *)lParam;
 
-		// Create the rich edit control (https://docs.microsoft.com/en-us/windows/desktop/Controls/rich-edit-controls)
-		uint32_t style = WS_VISIBLE | WS_CHILD | WS_VSCROLL | ES_MULTILINE | ES_LEFT | ES_NOHIDESEL | ES_AUTOVSCROLL | ES_READONLY;
+		// Owner data list view: rows are fetched from g_LogStore on demand, so only visible lines cost anything
+		uint32_t style = WS_VISIBLE | WS_CHILD | LVS_REPORT | LVS_OWNERDATA | LVS_NOCOLUMNHEADER | LVS_SHOWSELALWAYS;
 
-		richEditHwnd = CreateWindowExW(0, MSFTEDIT_CLASS, L"", style, 0, 0, info->cx, info->cy, Hwnd, nullptr, info->hInstance, nullptr);
+		listHwnd = CreateWindowExA(0, WC_LISTVIEWA, "", style, 0, 0, info->cx, info->cy, Hwnd, nullptr, info->hInstance, nullptr);
 		autoScroll = true;
 
-		if (!richEditHwnd)
+		if (!listHwnd)
 			return -1;
 
-		// Set default position
-		int winW = g_INI.GetInteger("CreationKit_Log", "Width", info->cx);
-		int winH = g_INI.GetInteger("CreationKit_Log", "Height", info->cy);
+		ListView_SetExtendedListViewStyleEx(listHwnd, LVS_EX_DOUBLEBUFFER | LVS_EX_FULLROWSELECT, LVS_EX_DOUBLEBUFFER | LVS_EX_FULLROWSELECT);
 
-		MoveWindow(Hwnd, info->x, info->y, winW, winH, FALSE);
+		LVCOLUMNA column;
+		memset(&column, 0, sizeof(column));
+
+		column.mask = LVCF_WIDTH;
+		column.cx = info->cx;
+		SendMessageA(listHwnd, LVM_INSERTCOLUMNA, 0, (LPARAM)&column);
+
+		// Find dialog state
+		findMessage = RegisterWindowMessageA(FINDMSGSTRINGA);
+
+		memset(&findRequest, 0, sizeof(findRequest));
+		findRequest.lStructSize = sizeof(findRequest);
+		findRequest.hwndOwner = Hwnd;
+		findRequest.lpstrFindWhat = findText;
+		findRequest.wFindWhatLen = sizeof(findText);
+		findRequest.Flags = FR_DOWN;
 
 		// Set a better font
-		CHARFORMAT2A format;
-		memset(&format, 0, sizeof(format));
+		HDC dc = GetDC(Hwnd);
+		int pointSize = g_INI.GetInteger("CreationKit_Log", "FontSize", 10);
+		int weight = g_INI.GetInteger("CreationKit_Log", "FontWeight", FW_NORMAL);
+
+		listFont = CreateFontA(-MulDiv(pointSize, GetDeviceCaps(dc, LOGPIXELSY), 72), 0, 0, 0, weight, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+			OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH | FF_DONTCARE, g_INI.Get("CreationKit_Log", "Font", "Consolas").c_str());
+
+		HGDIOBJ oldFont = SelectObject(dc, listFont);
+		TEXTMETRICA metrics;
+		GetTextMetricsA(dc, &metrics);
+		charWidth = metrics.tmAveCharWidth;
+		SelectObject(dc, oldFont);
+		ReleaseDC(Hwnd, dc);
 
-		// Convert Twips to points (1 point = 20 Twips)
-		int pointSize = g_INI.GetInteger("CreationKit_Log", "FontSize", 10) * 20;
+		SendMessageA(listHwnd, WM_SETFONT, (WPARAM)listFont, FALSE);
 
-		format.cbSize = sizeof(format);
-		format.dwMask = CFM_FACE | CFM_SIZE | CFM_WEIGHT;
-		format.yHeight = pointSize;
-		strcpy_s(format.szFaceName, g_INI.Get("CreationKit_Log", "Font", "Consolas").c_str());
-		format.wWeight = (WORD)g_INI.GetInteger("CreationKit_Log", "FontWeight", FW_NORMAL);
-		SendMessageA(richEditHwnd, EM_SETCHARFORMAT, SCF_ALL, (LPARAM)&format);
+		// Set default position
+		int winW = g_INI.GetInteger("CreationKit_Log", "Width", info->cx);
+		int winH = g_INI.GetInteger("CreationKit_Log", "Height", info->cy);
 
-		// Subscribe to EN_MSGFILTER and EN_SELCHANGE
-		SendMessageA(richEditHwnd, EM_SETEVENTMASK, 0, ENM_MOUSEEVENTS | ENM_SELCHANGE);
+		MoveWindow(Hwnd, info->x, info->y, winW, winH, FALSE);
 	}
 	return 0;
 
 	case WM_DESTROY:
-		DestroyWindow(richEditHwnd);
+		DestroyWindow(listHwnd);
+		DeleteObject(listFont);
 		return 0;
 
 	case WM_SIZE:
 	{
 		int w = LOWORD(lParam);
 		int h = HIWORD(lParam);
-		MoveWindow(richEditHwnd, 0, 0, w, h, TRUE);
+		MoveWindow(listHwnd, 0, 0, w, h, TRUE);
+
+		EditorUI_UpdateLogView(listHwnd, charWidth, false, false);
 	}
 	break;
 
 	case WM_ACTIVATE:
 	{
 		if (wParam != WA_INACTIVE)
-			SetFocus(richEditHwnd);
+			SetFocus(listHwnd);
 	}
 	return 0;
 
@@ -229,58 +546,95 @@ LRESULT CALLBACK EditorUI_LogWndProc(HWND Hwnd, UINT Message, WPARAM wParam, LPA
 		ShowWindow(Hwnd, SW_HIDE);
 		return 0;
 
+	case WM_COMMAND:
+	{
+		if (LOWORD(wParam) == LogMenuFind)
+		{
+			if (findHwnd)
+				SetFocus(findHwnd);
+			else
+				findHwnd = FindTextA(&findRequest);
+
+			return 0;
+		}
+
+		if (LOWORD(wParam) == LogMenuCopy)
+		{
+			EditorUI_CopyLogSelection(Hwnd, listHwnd);
+			return 0;
+		}
+	}
+	break;
+
 	case WM_NOTIFY:
 	{
-		static uint64_t lastDoubleClickTime;
 		LPNMHDR notification = (LPNMHDR)lParam;
 
-		if (notification->code == EN_MSGFILTER)
-		{
-			auto msgFilter = (MSGFILTER *)notification;
+		if (notification->hwndFrom != listHwnd)
+			break;
 
-			if (msgFilter->msg == WM_LBUTTONDBLCLK)
-				lastDoubleClickTime = GetTickCount64();
-		}
-		else if (notification->code == EN_SELCHANGE)
+		if (notification->code == LVN_GETDISPINFOA)
 		{
-			auto selChange = (SELCHANGE *)lParam;
+			auto dispInfo = (NMLVDISPINFOA *)lParam;
 
-			// Mouse double click with a valid selection -> try to parse form id
-			if ((GetTickCount64() - lastDoubleClickTime > 1000) || abs(selChange->chrg.cpMax - selChange->chrg.cpMin) <= 0)
-				break;
+			if (dispInfo->item.mask & LVIF_TEXT)
+			{
+				// Point the control at our own buffer so lines aren't cut to cchTextMax
+				static char lineData[4096];
 
-			if (selChange->chrg.cpMin == 0 && selChange->chrg.cpMax == -1)
-				break;
+				size_t length;
+				const char *text = g_LogStore.GetVisibleLine(dispInfo->item.iItem, &length);
 
-			// Get the line number from the selected range
-			LRESULT lineIndex = SendMessageA(richEditHwnd, EM_LINEFROMCHAR, selChange->chrg.cpMin, 0);
+				length = std::min(length, sizeof(lineData) - 1);
+				memcpy(lineData, text, length);
+				lineData[length] = '\0';
 
-			char lineData[4096];
-			*(uint16_t *)&lineData[0] = ARRAYSIZE(lineData);
+				dispInfo->item.pszText = lineData;
+			}
+		}
+		else if (notification->code == NM_DBLCLK)
+		{
+			auto activate = (LPNMITEMACTIVATE)lParam;
 
-			LRESULT charCount = SendMessageA(richEditHwnd, EM_GETLINE, lineIndex, (LPARAM)&lineData);
+			if (activate->iItem < 0)
+				break;
 
-			if (charCount > 0)
-			{
-				lineData[charCount - 1] = '\0';
+			size_t length;
+			const char *text = g_LogStore.GetVisibleLine(activate->iItem, &length);
 
-				// Capture each form id with regex "(XXXXXXXX)"
-				static const std::regex formIdRegex("\\(([1234567890abcdefABCDEF]*?)\\)");
-				std::smatch sm;
+			// Capture each form id with regex "(XXXXXXXX)"
+			static const std::regex formIdRegex("\\(([1234567890abcdefABCDEF]*?)\\)");
+			std::smatch sm;
 
-				for (std::string line = lineData; std::regex_search(line, sm, formIdRegex); line = sm.suffix())
-				{
-					// Parse to integer, then bring up the menu
-					uint32_t id = strtoul(sm[1].str().c_str(), nullptr, 16);
+			for (std::string line(text, length); std::regex_search(line, sm, formIdRegex); line = sm.suffix())
+			{
+				// Parse to integer, then bring up the menu
+				uint32_t id = strtoul(sm[1].str().c_str(), nullptr, 16);
 
-					auto GetFormById = (__int64(__fastcall *)(uint32_t))OFFSET(0x16B8780, 1530);
-					__int64 form = GetFormById(id);
+				auto GetFormById = (__int64(__fastcall *)(uint32_t))OFFSET(0x16B8780, 1530);
+				__int64 form = GetFormById(id);
 
-					if (form)
-						(*(void(__fastcall **)(__int64, HWND, __int64, __int64))(*(__int64 *)form + 720i64))(form, EditorUI_GetMainWindow(), 0, 1);
-				}
+				if (form)
+					(*(void(__fastcall **)(__int64, HWND, __int64, __int64))(*(__int64 *)form + 720i64))(form, EditorUI_GetMainWindow(), 0, 1);
 			}
 		}
+		else if (notification->code == NM_RCLICK)
+		{
+			if (EditorUI_ShowLogFilterMenu(Hwnd))
+				EditorUI_UpdateLogView(listHwnd, charWidth, autoScroll, true);
+		}
+		else if (notification->code == LVN_KEYDOWN)
+		{
+			auto keyDown = (NMLVKEYDOWN *)lParam;
+			const bool control = GetKeyState(VK_CONTROL) < 0;
+
+			if (control && keyDown->wVKey == 'F')
+				SendMessageA(Hwnd, WM_COMMAND, LogMenuFind, 0);
+			else if (control && keyDown->wVKey == 'C')
+				SendMessageA(Hwnd, WM_COMMAND, LogMenuCopy, 0);
+			else if (keyDown->wVKey == VK_F3)
+				EditorUI_FindLogText(listHwnd, findText, (findRequest.Flags & FR_DOWN) != 0, (findRequest.Flags & FR_MATCHCASE) != 0);
+		}
 	}
 	break;
 
@@ -289,8 +643,25 @@ LRESULT CALLBACK EditorUI_LogWndProc(HWND Hwnd, UINT Message, WPARAM wParam, LPA
 		if (wParam != UI_LOG_CMD_ADDTEXT)
 			break;
 
-		if (g_LogPendingMessages.size() <= 0)
-			break;
+		// Report lost messages in the title so they're never silently missing
+		static uint64_t lastDroppedCount;
+		const uint64_t droppedCount = g_LogSink.GetStatistics().Dropped + g_LogUIDroppedMessages;
+
+		if (droppedCount != lastDroppedCount)
+		{
+			char title[128];
+			sprintf_s(title, "Log (%llu messages dropped)", droppedCount);
+
+			SetWindowTextA(Hwnd, title);
+			lastDroppedCount = droppedCount;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(g_LogPendingLock);
+
+			if (g_LogPendingText.empty())
+				break;
+		}
 
 		return EditorUI_LogWndProc(Hwnd, UI_LOG_CMD_ADDTEXT, 0, 0);
 	}
@@ -298,49 +669,29 @@ LRESULT CALLBACK EditorUI_LogWndProc(HWND Hwnd, UINT Message, WPARAM wParam, LPA
 
 	case UI_LOG_CMD_ADDTEXT:
 	{
-		SendMessageA(richEditHwnd, WM_SETREDRAW, FALSE, 0);
-
-		// Save old position if not scrolling
-		POINT scrollRange;
-
-		if (!autoScroll)
-			SendMessageA(richEditHwnd, EM_GETSCROLLPOS, 0, (WPARAM)&scrollRange);
-
-		// Get a copy of all elements and clear the global list
-		tbb::concurrent_vector<const char *> messages;
+		// Take everything the writer coalesced since the last tick
+		std::string text;
 
 		if (!wParam)
-			messages.swap(g_LogPendingMessages);
+		{
+			std::lock_guard<std::mutex> lock(g_LogPendingLock);
+			text.swap(g_LogPendingText);
+		}
 		else
-			messages.push_back((const char *)wParam);
-
-		for (const char *message : messages)
 		{
-			// Move caret to the end, then write
-			CHARRANGE range;
-			range.cpMin = LONG_MAX;
-			range.cpMax = LONG_MAX;
-
-			SendMessageA(richEditHwnd, EM_EXSETSEL, 0, (LPARAM)&range);
-			SendMessageA(richEditHwnd, EM_REPLACESEL, FALSE, (LPARAM)message);
-
-			free((void *)message);
+			text = (const char *)wParam;
+			free((void *)wParam);
 		}
 
-		if (!autoScroll)
-			SendMessageA(richEditHwnd, EM_SETSCROLLPOS, 0, (WPARAM)&scrollRange);
-
-		SendMessageA(richEditHwnd, WM_SETREDRAW, TRUE, 0);
-		RedrawWindow(richEditHwnd, nullptr, nullptr, RDW_ERASE | RDW_INVALIDATE | RDW_NOCHILDREN);
+		EditorUI_AddLogLines(text);
+		EditorUI_UpdateLogView(listHwnd, charWidth, autoScroll, false);
 	}
 	return 0;
 
 	case UI_LOG_CMD_CLEARTEXT:
 	{
-		char emptyString[1];
-		emptyString[0] = '\0';
-
-		SendMessageA(richEditHwnd, WM_SETTEXT, 0, (LPARAM)&emptyString);
+		g_LogStore.Clear();
+		EditorUI_UpdateLogView(listHwnd, charWidth, false, true);
 	}
 	return 0;
 
@@ -364,16 +715,13 @@ void EditorUI_LogVa(const char *Format, va_list Va)
 		return;
 
 	if (len >= 2 && buffer[len - 1] != '\n')
-		strcat_s(buffer, "\n");
-
-	if (g_LogFile)
 	{
-		fputs(buffer, g_LogFile);
-		fflush(g_LogFile);
+		strcat_s(buffer, "\n");
+		len = (int)strlen(buffer);
 	}
 
-	if (g_LogPendingMessages.size() < 50000)
-		g_LogPendingMessages.push_back(_strdup(buffer));
+	// File and window output happen on the log writer thread
+	g_LogSink.Submit(buffer, len);
 }
 
 void EditorUI_Log(const char *Format, ...)
@@ -387,40 +735,6 @@ void EditorUI_Log(const char *Format, ...)
 
 void EditorUI_Warning(int Type, const char *Format, ...)
 {
-	static const char *typeList[30] =
-	{
-		"DEFAULT",
-		"COMBAT",
-		"ANIMATION",
-		"AI",
-		"SCRIPTS",
-		"SAVELOAD",
-		"DIALOGUE",
-		"QUESTS",
-		"PACKAGES",
-		"EDITOR",
-		"MODELS",
-		"TEXTURES",
-		"PLUGINS",
-		"MASTERFILE",
-		"FORMS",
-		"MAGIC",
-		"SHADERS",
-		"RENDERING",
-		"PATHFINDING",
-		"MENUS",
-		"AUDIO",
-		"CELLS",
-		"HAVOK",
-		"FACEGEN",
-		"WATER",
-		"INGAME",
-		"MEMORY",
-		"PERFORMANCE",
-		"JOBS",
-		"SYSTEM"
-	};
-
 	char buffer[2048];
 	va_list va;
 
@@ -428,7 +742,7 @@ void EditorUI_Warning(int Type, const char *Format, ...)
 	_vsnprintf_s(buffer, _TRUNCATE, Format, va);
 	va_end(va);
 
-	EditorUI_Log("%s: %s", typeList[Type], buffer);
+	EditorUI_Log("%s: %s", g_LogWarningTypes[Type], buffer);
 }
 
 void EditorUI_WarningUnknown1(const char *Format, ...)
@@ -462,4 +776,7 @@ void EditorUI_Assert(const char *File, int Line, const char *Message, ...)
 	va_end(va);
 
 	EditorUI_Log("ASSERTION: %s (%s line %d)", buffer, File, Line);
+
+	// Get it on disk in case this assertion is followed by a crash
+	EditorUI_FlushLog();
 }
\ No newline at end of file
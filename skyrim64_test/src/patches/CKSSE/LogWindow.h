@@ -7,6 +7,7 @@ bool EditorUI_CreateStdoutListener();
 void EditorUI_GenerateWarningBlacklist();
 HWND EditorUI_GetLogWindow();
 HANDLE EditorUI_GetStdoutListenerPipe();
+void EditorUI_FlushLog();
 
 LRESULT CALLBACK EditorUI_LogWndProc(HWND Hwnd, UINT Message, WPARAM wParam, LPARAM lParam);
 
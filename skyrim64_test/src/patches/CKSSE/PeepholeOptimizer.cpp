@@ -0,0 +1,956 @@
+#include <string.h>
+#include <unordered_map>
+#include <algorithm>
+#include <iterator>
+#include <xbyak/xbyak.h>
+#include "PeepholeOptimizer.h"
+
+namespace
+{
+	const uint32_t MaxFunctionLength = 256;
+	const uint32_t MaxFunctionInstructions = 48;
+	const uint32_t MaxStackSlots = 16;
+	const uint32_t RegisterRAX = 0;
+	const uint32_t RegisterRSP = 4;
+
+	// Recommended multi-byte nops, indexed by length
+	const uint8_t NopPadding[6][5] =
+	{
+		{},
+		{ 0x90 },
+		{ 0x66, 0x90 },
+		{ 0x0F, 0x1F, 0x00 },
+		{ 0x0F, 0x1F, 0x40, 0x00 },
+		{ 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+	};
+
+	bool GetRegister(ZydisRegister Register, uint32_t *Id, uint32_t *Width)
+	{
+		switch (ZydisRegisterGetClass(Register))
+		{
+		case ZYDIS_REGCLASS_GPR8:
+			// AH-BH can't be encoded next to a REX prefix. SPL-DIL follow them in the enum.
+			if (Register >= ZYDIS_REGISTER_AH && Register <= ZYDIS_REGISTER_BH)
+				return false;
+
+			*Id = (Register < ZYDIS_REGISTER_AH) ? (Register - ZYDIS_REGISTER_AL) : (Register - ZYDIS_REGISTER_AL - 4);
+			*Width = 8;
+			return true;
+
+		case ZYDIS_REGCLASS_GPR16:
+			*Id = Register - ZYDIS_REGISTER_AX;
+			*Width = 16;
+			return true;
+
+		case ZYDIS_REGCLASS_GPR32:
+			*Id = Register - ZYDIS_REGISTER_EAX;
+			*Width = 32;
+			return true;
+
+		case ZYDIS_REGCLASS_GPR64:
+			*Id = Register - ZYDIS_REGISTER_RAX;
+			*Width = 64;
+			return true;
+		}
+
+		return false;
+	}
+
+	bool IsVolatileRegister(uint32_t Id)
+	{
+		// rax, rcx, rdx, r8-r11
+		return Id <= 2 || (Id >= 8 && Id <= 11);
+	}
+
+	Xbyak::Reg MakeRegister(uint32_t Id, uint32_t Width)
+	{
+		switch (Width)
+		{
+		case 8:		return Xbyak::Reg8(Id, Id >= 4 && Id < 8);
+		case 16:	return Xbyak::Reg16(Id);
+		case 32:	return Xbyak::Reg32(Id);
+		}
+
+		return Xbyak::Reg64(Id);
+	}
+
+	//
+	// Follows a debug-build leaf function and re-emits only the instructions that do real work. Register
+	// contents are tracked as "the low Width bits of physical register Register as of version Version".
+	// Copies and spill reloads just move those descriptions around. Emitting an instruction that writes a
+	// register bumps its version, which invalidates every description still pointing at the old contents.
+	//
+	class LeafInterpreter
+	{
+	private:
+		struct Value
+		{
+			uint32_t Register;
+			uint32_t Width;
+			uint32_t Version;
+		};
+
+		struct StackSlot
+		{
+			int64_t Offset;			// Relative to rsp at entry
+			uint32_t Size;			// Bytes
+			Value Data;
+		};
+
+		struct EmitOperand
+		{
+			ZydisOperandType Type;
+			uint32_t Id;			// Register: physical register
+			uint32_t Width;			// Register width or memory operand size in bits
+			Xbyak::RegExp Address;
+			uint64_t Immediate;
+		};
+
+		Value m_Registers[16];
+		uint32_t m_Versions[16] = {};
+		StackSlot m_Slots[MaxStackSlots];
+		uint32_t m_SlotCount = 0;
+		int64_t m_StackOffset = 0;
+		bool m_WritesMemory = false;
+		bool m_WritesReturn = false;
+
+		uint8_t m_Buffer[sizeof(PeepholeOptimizer::LeafFunction::Body)];
+		Xbyak::CodeGenerator m_Code;
+
+	public:
+		LeafInterpreter() : m_Code(sizeof(m_Buffer), m_Buffer)
+		{
+			for (uint32_t i = 0; i < std::size(m_Registers); i++)
+				m_Registers[i] = { i, 64, 0 };
+		}
+
+		bool Step(const ZydisDecodedInstruction& Instruction, bool *Finished)
+		{
+			if (Instruction.attributes & (ZYDIS_ATTRIB_HAS_LOCK | ZYDIS_ATTRIB_HAS_REP | ZYDIS_ATTRIB_HAS_REPE | ZYDIS_ATTRIB_HAS_REPNE | ZYDIS_ATTRIB_IS_RELATIVE))
+				return false;
+
+			const ZydisDecodedOperand *operands[3];
+			uint32_t operandCount = 0;
+
+			for (uint32_t i = 0; i < Instruction.operandCount; i++)
+			{
+				if (Instruction.operands[i].visibility != ZYDIS_OPERAND_VISIBILITY_EXPLICIT)
+					continue;
+
+				if (operandCount >= std::size(operands))
+					return false;
+
+				operands[operandCount++] = &Instruction.operands[i];
+			}
+
+			switch (Instruction.mnemonic)
+			{
+			case ZYDIS_MNEMONIC_NOP:
+				return true;
+
+			case ZYDIS_MNEMONIC_RET:
+				if (operandCount > 0 && operands[0]->imm.value.u != 0)
+					return false;
+
+				*Finished = true;
+				return m_StackOffset == 0 && MaterializeReturn();
+
+			case ZYDIS_MNEMONIC_ADD:
+			case ZYDIS_MNEMONIC_SUB:
+				if (operandCount == 2 && IsRegister(operands[0], ZYDIS_REGISTER_RSP))
+				{
+					if (operands[1]->type != ZYDIS_OPERAND_TYPE_IMMEDIATE || (operands[1]->imm.value.s % 8) != 0)
+						return false;
+
+					m_StackOffset += (Instruction.mnemonic == ZYDIS_MNEMONIC_ADD) ? operands[1]->imm.value.s : -operands[1]->imm.value.s;
+
+					if (m_StackOffset > 0)
+						return false;
+
+					// Locals below the new stack pointer are gone
+					m_SlotCount = (uint32_t)(std::remove_if(m_Slots, m_Slots + m_SlotCount, [&](const StackSlot& Slot)
+					{
+						return Slot.Offset < m_StackOffset;
+					}) - m_Slots);
+					return true;
+				}
+				return EmitGeneric(Instruction.mnemonic, operands, operandCount);
+
+			case ZYDIS_MNEMONIC_MOV:
+				if (operandCount == 2 && IsStackMemory(operands[0]))
+					return Spill(operands[0], operands[1]);
+
+				if (operandCount == 2 && operands[0]->type == ZYDIS_OPERAND_TYPE_REGISTER)
+				{
+					if (IsStackMemory(operands[1]) || operands[1]->type == ZYDIS_OPERAND_TYPE_REGISTER)
+						return Copy(operands[0], operands[1]);
+				}
+				return EmitGeneric(Instruction.mnemonic, operands, operandCount);
+
+			case ZYDIS_MNEMONIC_MOVZX:
+			case ZYDIS_MNEMONIC_MOVSX:
+			case ZYDIS_MNEMONIC_MOVSXD:
+			case ZYDIS_MNEMONIC_LEA:
+			case ZYDIS_MNEMONIC_AND:
+			case ZYDIS_MNEMONIC_OR:
+			case ZYDIS_MNEMONIC_XOR:
+			case ZYDIS_MNEMONIC_CMP:
+			case ZYDIS_MNEMONIC_TEST:
+			case ZYDIS_MNEMONIC_INC:
+			case ZYDIS_MNEMONIC_DEC:
+			case ZYDIS_MNEMONIC_NEG:
+			case ZYDIS_MNEMONIC_NOT:
+			case ZYDIS_MNEMONIC_SETB:
+			case ZYDIS_MNEMONIC_SETBE:
+			case ZYDIS_MNEMONIC_SETL:
+			case ZYDIS_MNEMONIC_SETLE:
+			case ZYDIS_MNEMONIC_SETNB:
+			case ZYDIS_MNEMONIC_SETNBE:
+			case ZYDIS_MNEMONIC_SETNL:
+			case ZYDIS_MNEMONIC_SETNLE:
+			case ZYDIS_MNEMONIC_SETNO:
+			case ZYDIS_MNEMONIC_SETNP:
+			case ZYDIS_MNEMONIC_SETNS:
+			case ZYDIS_MNEMONIC_SETNZ:
+			case ZYDIS_MNEMONIC_SETO:
+			case ZYDIS_MNEMONIC_SETP:
+			case ZYDIS_MNEMONIC_SETS:
+			case ZYDIS_MNEMONIC_SETZ:
+				return EmitGeneric(Instruction.mnemonic, operands, operandCount);
+			}
+
+			return false;
+		}
+
+		void Finish(uint32_t Length, PeepholeOptimizer::LeafFunction *Function)
+		{
+			Function->OriginalLength = Length;
+			Function->BodyLength = (uint32_t)m_Code.getSize();
+			memcpy(Function->Body, m_Buffer, Function->BodyLength);
+
+			if (Function->BodyLength == 0)
+				Function->Kind = PeepholeOptimizer::FunctionKind::Nullsub;
+			else if (m_WritesMemory)
+				Function->Kind = PeepholeOptimizer::FunctionKind::Setter;
+			else if (m_WritesReturn)
+				Function->Kind = PeepholeOptimizer::FunctionKind::Getter;
+			else
+				Function->Kind = PeepholeOptimizer::FunctionKind::Leaf;
+		}
+
+	private:
+		static bool IsRegister(const ZydisDecodedOperand *Operand, ZydisRegister Register)
+		{
+			return Operand->type == ZYDIS_OPERAND_TYPE_REGISTER && Operand->reg.value == Register;
+		}
+
+		static bool IsStackMemory(const ZydisDecodedOperand *Operand)
+		{
+			return Operand->type == ZYDIS_OPERAND_TYPE_MEMORY && Operand->mem.base == ZYDIS_REGISTER_RSP;
+		}
+
+		bool IsCurrent(const Value& Data, uint32_t Width) const
+		{
+			return m_Versions[Data.Register] == Data.Version && Width <= Data.Width;
+		}
+
+		StackSlot *FindSlot(const ZydisDecodedOperand *Operand)
+		{
+			if (Operand->mem.index != ZYDIS_REGISTER_NONE || Operand->mem.type != ZYDIS_MEMOP_TYPE_MEM)
+				return nullptr;
+
+			const int64_t offset = m_StackOffset + Operand->mem.disp.value;
+
+			for (uint32_t i = 0; i < m_SlotCount; i++)
+			{
+				if (m_Slots[i].Offset == offset && Operand->size <= m_Slots[i].Size * 8)
+					return &m_Slots[i];
+			}
+
+			return nullptr;
+		}
+
+		bool Spill(const ZydisDecodedOperand *Destination, const ZydisDecodedOperand *Source)
+		{
+			uint32_t id;
+			uint32_t width;
+
+			if (Destination->mem.index != ZYDIS_REGISTER_NONE || Source->type != ZYDIS_OPERAND_TYPE_REGISTER || !GetRegister(Source->reg.value, &id, &width) || id == RegisterRSP)
+				return false;
+
+			const Value& data = m_Registers[id];
+
+			if (!IsCurrent(data, width))
+				return false;
+
+			// Only the caller's home space (rsp+8 to rsp+0x28 at entry) and this function's own frame
+			const int64_t offset = m_StackOffset + Destination->mem.disp.value;
+			const int64_t size = width / 8;
+
+			if (!(offset >= 8 && offset + size <= 0x28) && !(offset >= m_StackOffset && offset + size <= 0))
+				return false;
+
+			// Overlapped slots are partially overwritten, drop them
+			m_SlotCount = (uint32_t)(std::remove_if(m_Slots, m_Slots + m_SlotCount, [&](const StackSlot& Slot)
+			{
+				return Slot.Offset < offset + size && offset < Slot.Offset + Slot.Size;
+			}) - m_Slots);
+
+			if (m_SlotCount >= MaxStackSlots)
+				return false;
+
+			m_Slots[m_SlotCount++] = { offset, (uint32_t)size, { data.Register, width, data.Version } };
+			return true;
+		}
+
+		bool Copy(const ZydisDecodedOperand *Destination, const ZydisDecodedOperand *Source)
+		{
+			uint32_t id;
+			uint32_t width;
+
+			if (!GetRegister(Destination->reg.value, &id, &width) || !IsVolatileRegister(id))
+				return false;
+
+			Value data;
+
+			if (Source->type == ZYDIS_OPERAND_TYPE_REGISTER)
+			{
+				uint32_t sourceId;
+				uint32_t sourceWidth;
+
+				if (!GetRegister(Source->reg.value, &sourceId, &sourceWidth) || sourceId == RegisterRSP)
+					return false;
+
+				data = m_Registers[sourceId];
+			}
+			else
+			{
+				const StackSlot *slot = FindSlot(Source);
+
+				if (!slot)
+					return false;
+
+				data = slot->Data;
+			}
+
+			// Nothing is emitted, the destination just names the same value
+			if (!IsCurrent(data, width))
+				return false;
+
+			m_Registers[id] = { data.Register, width, data.Version };
+			m_WritesReturn |= (id == RegisterRAX);
+			return true;
+		}
+
+		bool ReadRegister(uint32_t Id, uint32_t Width, uint32_t *Physical)
+		{
+			if (Id == RegisterRSP)
+				return false;
+
+			// A 32-bit copy zero extended in the original code, but the register it names still has its upper half
+			if (Width == 64 && m_Registers[Id].Width == 32 && IsVolatileRegister(Id) && !Materialize(Id, 32))
+				return false;
+
+			if (!IsCurrent(m_Registers[Id], Width))
+				return false;
+
+			*Physical = m_Registers[Id].Register;
+			return true;
+		}
+
+		void WriteRegister(uint32_t Id, uint32_t Width)
+		{
+			// 32-bit writes clear the upper half, 8/16-bit writes leave it alone
+			m_Versions[Id]++;
+			m_Registers[Id] = { Id, (Width >= 32) ? 64 : Width, m_Versions[Id] };
+			m_WritesReturn |= (Id == RegisterRAX);
+		}
+
+		bool Materialize(uint32_t Id, uint32_t Width)
+		{
+			const Value data = m_Registers[Id];
+
+			if (data.Register == Id && IsCurrent(data, Width))
+				return true;
+
+			if (!IsCurrent(data, Width))
+				return false;
+
+			try
+			{
+				m_Code.mov(MakeRegister(Id, Width), MakeRegister(data.Register, Width));
+			}
+			catch (const Xbyak::Error&)
+			{
+				return false;
+			}
+
+			WriteRegister(Id, Width);
+			return true;
+		}
+
+		bool MaterializeReturn()
+		{
+			// Nothing is known about the return type, so rax always gets whatever the function left in it
+			const Value data = m_Registers[RegisterRAX];
+
+			if (data.Register == RegisterRAX && data.Version == m_Versions[RegisterRAX])
+				return true;
+
+			return Materialize(RegisterRAX, data.Width);
+		}
+
+		bool ResolveOperand(const ZydisDecodedOperand *Operand, bool IsDestination, EmitOperand *Out)
+		{
+			const bool reads = (Operand->action == ZYDIS_OPERAND_ACTION_READ || Operand->action == ZYDIS_OPERAND_ACTION_READWRITE);
+			const bool writes = (Operand->action == ZYDIS_OPERAND_ACTION_WRITE || Operand->action == ZYDIS_OPERAND_ACTION_READWRITE);
+
+			if (!reads && !writes && !(Operand->type == ZYDIS_OPERAND_TYPE_MEMORY && Operand->mem.type == ZYDIS_MEMOP_TYPE_AGEN))
+				return false;
+
+			Out->Type = Operand->type;
+
+			switch (Operand->type)
+			{
+			case ZYDIS_OPERAND_TYPE_REGISTER:
+			{
+				uint32_t id;
+
+				if (!GetRegister(Operand->reg.value, &id, &Out->Width) || id == RegisterRSP)
+					return false;
+
+				if (writes)
+				{
+					// Written in place, so it has to be the real register, holding the real value if it's also read
+					if (!IsDestination || !IsVolatileRegister(id) || (reads && !Materialize(id, Out->Width)))
+						return false;
+
+					Out->Id = id;
+					return true;
+				}
+
+				return ReadRegister(id, Out->Width, &Out->Id);
+			}
+
+			case ZYDIS_OPERAND_TYPE_MEMORY:
+			{
+				Out->Width = Operand->size;
+
+				if (Operand->mem.segment == ZYDIS_REGISTER_FS || Operand->mem.segment == ZYDIS_REGISTER_GS)
+					return false;
+
+				if (Operand->mem.base == ZYDIS_REGISTER_RSP)
+				{
+					// A spilled argument read by a real instruction becomes the register it came from
+					const StackSlot *slot = FindSlot(Operand);
+
+					if (writes || !slot || !IsCurrent(slot->Data, Operand->size))
+						return false;
+
+					Out->Type = ZYDIS_OPERAND_TYPE_REGISTER;
+					Out->Id = slot->Data.Register;
+					return true;
+				}
+
+				uint32_t id;
+				uint32_t width;
+				uint32_t base;
+
+				if (!GetRegister(Operand->mem.base, &id, &width) || width != 64 || !ReadRegister(id, 64, &base))
+					return false;
+
+				Out->Address = Xbyak::RegExp(Xbyak::Reg64(base));
+
+				if (Operand->mem.index != ZYDIS_REGISTER_NONE)
+				{
+					uint32_t index;
+
+					if (!GetRegister(Operand->mem.index, &id, &width) || width != 64 || !ReadRegister(id, 64, &index))
+						return false;
+
+					Out->Address = Out->Address + Xbyak::RegExp(Xbyak::Reg64(index), Operand->mem.scale);
+				}
+
+				Out->Address = Out->Address + (size_t)Operand->mem.disp.value;
+				m_WritesMemory |= writes;
+				return true;
+			}
+
+			case ZYDIS_OPERAND_TYPE_IMMEDIATE:
+				Out->Immediate = Operand->imm.value.u;
+				return true;
+			}
+
+			return false;
+		}
+
+		bool EmitGeneric(ZydisMnemonic Mnemonic, const ZydisDecodedOperand **Operands, uint32_t OperandCount)
+		{
+			EmitOperand resolved[3];
+
+			// Everything handled here is either "op dst" or "op dst, src"
+			const bool isUnary =
+				Mnemonic == ZYDIS_MNEMONIC_INC || Mnemonic == ZYDIS_MNEMONIC_DEC || Mnemonic == ZYDIS_MNEMONIC_NEG || Mnemonic == ZYDIS_MNEMONIC_NOT ||
+				(Mnemonic >= ZYDIS_MNEMONIC_SETB && Mnemonic <= ZYDIS_MNEMONIC_SETZ);
+
+			if (OperandCount != (isUnary ? 1u : 2u) || Operands[0]->type == ZYDIS_OPERAND_TYPE_IMMEDIATE)
+				return false;
+
+			// The destination first: materializing it may invalidate what the sources resolve to
+			for (uint32_t i = 0; i < OperandCount; i++)
+			{
+				if (!ResolveOperand(Operands[i], i == 0, &resolved[i]))
+					return false;
+			}
+
+			Xbyak::Reg registers[3];
+			Xbyak::Address addresses[3] = { Xbyak::Address(8, false, Xbyak::RegExp()), Xbyak::Address(8, false, Xbyak::RegExp()), Xbyak::Address(8, false, Xbyak::RegExp()) };
+			const Xbyak::Operand *ops[3] = {};
+
+			for (uint32_t i = 0; i < OperandCount; i++)
+			{
+				if (resolved[i].Type == ZYDIS_OPERAND_TYPE_REGISTER)
+				{
+					registers[i] = MakeRegister(resolved[i].Id, resolved[i].Width);
+					ops[i] = &registers[i];
+				}
+				else if (resolved[i].Type == ZYDIS_OPERAND_TYPE_MEMORY)
+				{
+					addresses[i] = Xbyak::Address(resolved[i].Width, false, resolved[i].Address);
+					ops[i] = &addresses[i];
+				}
+			}
+
+			const bool hasImmediate = (OperandCount == 2 && resolved[1].Type == ZYDIS_OPERAND_TYPE_IMMEDIATE);
+			uint64_t immediate = hasImmediate ? resolved[1].Immediate : 0;
+
+			if (hasImmediate && resolved[0].Width < 64)
+				immediate &= (1ull << resolved[0].Width) - 1;
+
+			try
+			{
+				switch (Mnemonic)
+				{
+				case ZYDIS_MNEMONIC_MOV:
+					if (hasImmediate)
+						m_Code.mov(*ops[0], (size_t)immediate);
+					else
+						m_Code.mov(*ops[0], *ops[1]);
+					break;
+
+				case ZYDIS_MNEMONIC_MOVZX:	m_Code.movzx(registers[0], *ops[1]); break;
+				case ZYDIS_MNEMONIC_MOVSX:	m_Code.movsx(registers[0], *ops[1]); break;
+				case ZYDIS_MNEMONIC_MOVSXD:	m_Code.movsxd(Xbyak::Reg64(resolved[0].Id), *ops[1]); break;
+
+				case ZYDIS_MNEMONIC_LEA:
+					if (resolved[1].Type != ZYDIS_OPERAND_TYPE_MEMORY)
+						return false;
+
+					m_Code.lea(registers[0], addresses[1]);
+					break;
+
+				case ZYDIS_MNEMONIC_ADD:	hasImmediate ? m_Code.add(*ops[0], (uint32_t)immediate) : m_Code.add(*ops[0], *ops[1]); break;
+				case ZYDIS_MNEMONIC_SUB:	hasImmediate ? m_Code.sub(*ops[0], (uint32_t)immediate) : m_Code.sub(*ops[0], *ops[1]); break;
+				case ZYDIS_MNEMONIC_AND:	hasImmediate ? m_Code.and_(*ops[0], (uint32_t)immediate) : m_Code.and_(*ops[0], *ops[1]); break;
+				case ZYDIS_MNEMONIC_OR:		hasImmediate ? m_Code.or_(*ops[0], (uint32_t)immediate) : m_Code.or_(*ops[0], *ops[1]); break;
+				case ZYDIS_MNEMONIC_XOR:	hasImmediate ? m_Code.xor_(*ops[0], (uint32_t)immediate) : m_Code.xor_(*ops[0], *ops[1]); break;
+				case ZYDIS_MNEMONIC_CMP:	hasImmediate ? m_Code.cmp(*ops[0], (uint32_t)immediate) : m_Code.cmp(*ops[0], *ops[1]); break;
+
+				case ZYDIS_MNEMONIC_TEST:
+					if (hasImmediate)
+						m_Code.test(*ops[0], (uint32_t)immediate);
+					else if (resolved[1].Type == ZYDIS_OPERAND_TYPE_REGISTER)
+						m_Code.test(*ops[0], registers[1]);
+					else
+						return false;
+					break;
+
+				case ZYDIS_MNEMONIC_INC:	m_Code.inc(*ops[0]); break;
+				case ZYDIS_MNEMONIC_DEC:	m_Code.dec(*ops[0]); break;
+				case ZYDIS_MNEMONIC_NEG:	m_Code.neg(*ops[0]); break;
+				case ZYDIS_MNEMONIC_NOT:	m_Code.not_(*ops[0]); break;
+
+				case ZYDIS_MNEMONIC_SETB:	m_Code.setb(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETBE:	m_Code.setbe(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETL:	m_Code.setl(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETLE:	m_Code.setle(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETNB:	m_Code.setnb(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETNBE:	m_Code.setnbe(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETNL:	m_Code.setnl(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETNLE:	m_Code.setnle(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETNO:	m_Code.setno(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETNP:	m_Code.setnp(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETNS:	m_Code.setns(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETNZ:	m_Code.setnz(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETO:	m_Code.seto(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETP:	m_Code.setp(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETS:	m_Code.sets(*ops[0]); break;
+				case ZYDIS_MNEMONIC_SETZ:	m_Code.setz(*ops[0]); break;
+
+				default:
+					return false;
+				}
+			}
+			catch (const Xbyak::Error&)
+			{
+				// Unencodable combination or the body outgrew the buffer
+				return false;
+			}
+
+			if (resolved[0].Type == ZYDIS_OPERAND_TYPE_REGISTER && Operands[0]->action != ZYDIS_OPERAND_ACTION_READ)
+				WriteRegister(resolved[0].Id, resolved[0].Width);
+
+			return true;
+		}
+	};
+}
+
+PeepholeOptimizer::PeepholeOptimizer()
+{
+	ZydisDecoderInit(&m_Decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_ADDRESS_WIDTH_64);
+	ZydisDecoderInit(&m_MinimalDecoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_ADDRESS_WIDTH_64);
+	ZydisDecoderEnableMode(&m_MinimalDecoder, ZYDIS_DECODER_MODE_MINIMAL, ZYDIS_TRUE);
+
+	memset(&m_Statistics, 0, sizeof(m_Statistics));
+}
+
+bool PeepholeOptimizer::AnalyzeFunction(const uint8_t *Code, size_t Length, LeafFunction *Function) const
+{
+	LeafInterpreter interpreter;
+	size_t offset = 0;
+
+	Length = std::min<size_t>(Length, MaxFunctionLength);
+
+	for (uint32_t i = 0; i < MaxFunctionInstructions && offset < Length; i++)
+	{
+		ZydisDecodedInstruction instruction;
+		bool finished = false;
+
+		if (!ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(&m_Decoder, Code + offset, Length - offset, offset, &instruction)))
+			return false;
+
+		offset += instruction.length;
+
+		if (!interpreter.Step(instruction, &finished))
+			return false;
+
+		if (finished)
+		{
+			interpreter.Finish((uint32_t)offset, Function);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void PeepholeOptimizer::Scan(const uint8_t *Code, size_t Length, uint64_t BaseAddress, const std::vector<FunctionRange>& Functions)
+{
+	struct BranchSite
+	{
+		uint64_t Offset;
+		uint32_t Candidate;
+		bool IsJump;
+	};
+
+	struct RawBranch
+	{
+		uint64_t Offset;
+		uint64_t Target;
+	};
+
+	std::unordered_map<uint64_t, int64_t> targets;	// Buffer offset -> candidate index, -1 if rejected
+	std::vector<BranchSite> sites;
+	std::vector<RawBranch> branches;
+	std::vector<bool> followsReturn(Length + 1);		// Offsets right after a decoded ret
+
+	m_Candidates.clear();
+	m_Patches.clear();
+	memset(&m_Statistics, 0, sizeof(m_Statistics));
+
+	//
+	// Branch sites only come from code reached by decoding forward from a .pdata function start, following
+	// fallthrough and direct branches that stay inside the function's range. Padding, jump tables and other
+	// data in .text are never decoded, so bytes that merely look like E8/E9 are never rewritten. A function
+	// whose walk fails to decode, or runs into the middle of an instruction it already decoded, gives up
+	// all of its sites.
+	//
+	enum : uint8_t
+	{
+		UNVISITED,
+		INSTRUCTION_START,
+		INSTRUCTION_BODY,
+	};
+
+	std::vector<uint8_t> visited;
+	std::vector<uint64_t> pending;
+	std::vector<RawBranch> functionBranches;
+	std::vector<uint64_t> functionReturns;
+
+	for (auto& function : Functions)
+	{
+		if (function.Start < BaseAddress || function.End > BaseAddress + Length || function.Start >= function.End)
+			continue;
+
+		const uint64_t start = function.Start - BaseAddress;
+		const uint64_t end = function.End - BaseAddress;
+		uint64_t instructions = 0;
+		bool valid = true;
+
+		visited.assign(end - start, UNVISITED);
+		pending.assign(1, start);
+		functionBranches.clear();
+		functionReturns.clear();
+
+		while (valid && !pending.empty())
+		{
+			uint64_t offset = pending.back();
+			pending.pop_back();
+
+			while (offset < end)
+			{
+				if (visited[offset - start] == INSTRUCTION_START)
+					break;
+
+				if (visited[offset - start] == INSTRUCTION_BODY)
+				{
+					valid = false;
+					break;
+				}
+
+				ZydisDecodedInstruction instruction;
+
+				if (Code[offset] == 0xCC || !ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(&m_MinimalDecoder, Code + offset, end - offset, BaseAddress + offset, &instruction)))
+				{
+					// Padding can only be reached by falling off the end of the code
+					valid = (Code[offset] == 0xCC);
+					break;
+				}
+
+				visited[offset - start] = INSTRUCTION_START;
+
+				for (uint32_t i = 1; i < instruction.length; i++)
+				{
+					if (visited[offset - start + i] != UNVISITED)
+						valid = false;
+
+					visited[offset - start + i] = INSTRUCTION_BODY;
+				}
+
+				instructions++;
+
+				const uint64_t next = offset + instruction.length;
+
+				if (instruction.length == 5 && (Code[offset] == 0xE8 || Code[offset] == 0xE9))
+				{
+					int32_t displacement;
+					memcpy(&displacement, &Code[offset + 1], sizeof(displacement));
+
+					const int64_t target = (int64_t)next + displacement;
+
+					if (target >= 0 && target < (int64_t)Length)
+						functionBranches.push_back({ offset, (uint64_t)target });
+				}
+
+				if (instruction.mnemonic == ZYDIS_MNEMONIC_RET)
+				{
+					functionReturns.push_back(next);
+					break;
+				}
+
+				if (instruction.mnemonic == ZYDIS_MNEMONIC_INT3 || instruction.mnemonic == ZYDIS_MNEMONIC_UD2 || instruction.mnemonic == ZYDIS_MNEMONIC_HLT)
+					break;
+
+				// Direct jmp, jcc, loop and jrcxz. Targets outside the range are tail jumps or chunks of another function.
+				if (instruction.raw.imm[0].isRelative && instruction.mnemonic != ZYDIS_MNEMONIC_CALL)
+				{
+					const int64_t target = (int64_t)next + instruction.raw.imm[0].value.s;
+
+					if (target >= (int64_t)start && target < (int64_t)end)
+						pending.push_back((uint64_t)target);
+				}
+
+				// Indirect jumps (jump tables, detours) aren't followed
+				if (instruction.mnemonic == ZYDIS_MNEMONIC_JMP)
+					break;
+
+				offset = next;
+			}
+		}
+
+		if (!valid)
+			continue;
+
+		m_Statistics.Instructions += instructions;
+		branches.insert(branches.end(), functionBranches.begin(), functionBranches.end());
+
+		for (uint64_t offset : functionReturns)
+			followsReturn[offset] = true;
+	}
+
+	//
+	// Only targets that start a function are analyzed. With unwind data that's the start of a .pdata range,
+	// and anything strictly inside one is a branch into the middle of a function. Leaf functions have no
+	// entry, so outside every range the target has to follow padding or a ret decoded from a .pdata function. The byte
+	// before it being 0xC3 isn't enough: that's also a ModRM byte (8B C3 is mov eax, ebx).
+	//
+	auto isFunctionStart = [&](uint64_t Target)
+	{
+		const uint64_t address = BaseAddress + Target;
+		auto itr = std::upper_bound(Functions.begin(), Functions.end(), address, [](uint64_t Address, const FunctionRange& Range)
+		{
+			return Address < Range.Start;
+		});
+
+		if (itr != Functions.begin())
+		{
+			if (std::prev(itr)->Start == address)
+				return true;
+
+			if (address < std::prev(itr)->End)
+				return false;
+		}
+
+		return Target == 0 || Code[Target - 1] == 0xCC || followsReturn[Target];
+	};
+
+	for (auto& branch : branches)
+	{
+		if (!isFunctionStart(branch.Target))
+			continue;
+
+		m_Statistics.BranchSites++;
+		auto [itr, inserted] = targets.try_emplace(branch.Target, -1);
+
+		if (inserted)
+		{
+			Candidate candidate = {};
+
+			if (AnalyzeFunction(Code + branch.Target, Length - branch.Target, &candidate.Function))
+			{
+				candidate.Address = BaseAddress + branch.Target;
+				itr->second = m_Candidates.size();
+
+				m_Candidates.push_back(candidate);
+				m_Statistics.Candidates[(size_t)candidate.Function.Kind]++;
+			}
+		}
+
+		if (itr->second != -1)
+			sites.push_back({ branch.Offset, (uint32_t)itr->second, Code[branch.Offset] == 0xE9 });
+	}
+
+	// Sites inside a function that gets rewritten would be clobbered by it (only possible on a bad decode)
+	std::vector<std::pair<uint64_t, uint64_t>> functionRanges;
+
+	for (auto& candidate : m_Candidates)
+		functionRanges.emplace_back(candidate.Address - BaseAddress, candidate.Address - BaseAddress + candidate.Function.OriginalLength);
+
+	std::sort(functionRanges.begin(), functionRanges.end());
+
+	auto overlapsFunction = [&](uint64_t Offset)
+	{
+		auto itr = std::upper_bound(functionRanges.begin(), functionRanges.end(), std::pair<uint64_t, uint64_t>(Offset + 5, 0));
+
+		return itr != functionRanges.begin() && Offset < std::prev(itr)->second;
+	};
+
+	for (auto& site : sites)
+	{
+		Candidate& candidate = m_Candidates[site.Candidate];
+		const LeafFunction& function = candidate.Function;
+
+		if (function.BodyLength + (site.IsJump ? 1 : 0) > 5 || overlapsFunction(site.Offset))
+		{
+			candidate.SkippedSites++;
+			continue;
+		}
+
+		Patch patch;
+		patch.Offset = site.Offset;
+		patch.Bytes.assign(function.Body, function.Body + function.BodyLength);
+
+		if (site.IsJump)
+		{
+			// Tail call: the body returns to our caller's caller
+			patch.Bytes.push_back(0xC3);
+			patch.Bytes.resize(5, 0xCC);
+			candidate.JumpSites++;
+		}
+		else
+		{
+			patch.Bytes.insert(patch.Bytes.end(), NopPadding[5 - function.BodyLength], NopPadding[5 - function.BodyLength] + (5 - function.BodyLength));
+			candidate.CallSites++;
+		}
+
+		m_Patches.push_back(std::move(patch));
+		m_Statistics.InlinedSites++;
+		m_Statistics.BytesSaved += function.OriginalLength;
+	}
+
+	for (auto& candidate : m_Candidates)
+	{
+		const LeafFunction& function = candidate.Function;
+
+		if (function.BodyLength + 1 >= function.OriginalLength)
+			continue;
+
+		Patch patch;
+		patch.Offset = candidate.Address - BaseAddress;
+		patch.Bytes.assign(function.Body, function.Body + function.BodyLength);
+		patch.Bytes.push_back(0xC3);
+		patch.Bytes.resize(function.OriginalLength, 0xCC);
+
+		m_Patches.push_back(std::move(patch));
+		m_Statistics.ShortenedFunctions++;
+		m_Statistics.BytesSaved += function.OriginalLength - (function.BodyLength + 1);
+	}
+}
+
+void PeepholeOptimizer::Apply(uint8_t *Code) const
+{
+	for (auto& patch : m_Patches)
+		memcpy(Code + patch.Offset, patch.Bytes.data(), patch.Bytes.size());
+}
+
+void PeepholeOptimizer::WriteReport(void(*Callback)(const char *, ...), bool ListCandidates) const
+{
+	const char *kindNames[] = { "nullsub", "getter", "setter", "leaf" };
+	static_assert(std::size(kindNames) == (size_t)FunctionKind::Count);
+
+	if (ListCandidates)
+	{
+		for (auto& candidate : m_Candidates)
+		{
+			Callback("Peephole: 0x%llX %-7s %3u -> %2u bytes, %u calls and %u jumps inlined, %u skipped\n",
+				candidate.Address,
+				kindNames[(size_t)candidate.Function.Kind],
+				candidate.Function.OriginalLength,
+				candidate.Function.BodyLength + 1,
+				candidate.CallSites,
+				candidate.JumpSites,
+				candidate.SkippedSites);
+		}
+	}
+
+	Callback("Peephole: %llu instructions, %llu branch sites. Candidates: %llu nullsubs, %llu getters, %llu setters, %llu other leaves. %llu sites inlined, %llu functions shortened, %llu bytes saved.\n",
+		m_Statistics.Instructions,
+		m_Statistics.BranchSites,
+		m_Statistics.Candidates[(size_t)FunctionKind::Nullsub],
+		m_Statistics.Candidates[(size_t)FunctionKind::Getter],
+		m_Statistics.Candidates[(size_t)FunctionKind::Setter],
+		m_Statistics.Candidates[(size_t)FunctionKind::Leaf],
+		m_Statistics.InlinedSites,
+		m_Statistics.ShortenedFunctions,
+		m_Statistics.BytesSaved);
+}
+
+const std::vector<PeepholeOptimizer::Candidate>& PeepholeOptimizer::GetCandidates() const
+{
+	return m_Candidates;
+}
+
+const PeepholeOptimizer::Statistics& PeepholeOptimizer::GetStatistics() const
+{
+	return m_Statistics;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <zydis/include/Zydis/Zydis.h>
+
+//
+// Decoder-driven replacement for trivial debug-build functions. Walking forward from every .pdata function
+// start finds each rel32 call and jump to a function start; bytes never reached that way (padding, jump
+// tables, data in .text) are left alone. Each target is run through a small abstract interpreter that follows argument
+// spills to the home space, stack frame setup and reloads, and keeps only the instructions that do real
+// work, with their registers renamed back to the original arguments. Getters, setters, nullsubs and other
+// spill-only leaf functions reduce to a few bytes. That body replaces the call (padded with a nop) or the
+// tail jump (followed by a ret) when it fits in the 5 bytes. The function itself is always rewritten
+// shorter.
+//
+// Anything the interpreter doesn't fully understand rejects the function: branches, calls, push/pop,
+// RIP-relative or segment memory, stack accesses other than spill slots, and writes to non-volatile
+// registers.
+//
+// The pass has to run after every hook is installed. A detoured function starts with a jump and is
+// rejected, but a stub that only spills its varargs (EditorUI_Warning before its hook) reads as a nullsub,
+// and every call to it would be removed.
+//
+// Scan() only reads the buffer and Apply() writes the patches, so a dry run is Scan() plus
+// WriteReport(). Nothing here depends on Windows.
+//
+class PeepholeOptimizer
+{
+public:
+	enum class FunctionKind : uint8_t
+	{
+		Nullsub,		// Does nothing
+		Getter,			// Only computes a return value
+		Setter,			// Writes memory
+		Leaf,			// Anything else that reduced to plain instructions
+
+		Count,
+	};
+
+	struct LeafFunction
+	{
+		FunctionKind Kind;
+		uint32_t OriginalLength;		// Bytes through the ret
+		uint32_t BodyLength;			// Rewritten instructions, ret excluded
+		uint8_t Body[32];
+	};
+
+	struct Candidate
+	{
+		uint64_t Address;
+		LeafFunction Function;
+		uint32_t CallSites;				// Calls replaced by the body
+		uint32_t JumpSites;				// Tail jumps replaced by the body and a ret
+		uint32_t SkippedSites;			// Sites where the body didn't fit
+	};
+
+	struct FunctionRange
+	{
+		uint64_t Start;					// Same address space as Scan()'s BaseAddress
+		uint64_t End;
+	};
+
+	struct Statistics
+	{
+		uint64_t Instructions;			// Decoded while walking .pdata functions
+		uint64_t BranchSites;			// rel32 calls/jumps into the buffer
+		uint64_t Candidates[(size_t)FunctionKind::Count];
+		uint64_t InlinedSites;
+		uint64_t ShortenedFunctions;
+		uint64_t BytesSaved;			// Callee bytes no longer executed at inlined sites plus bytes cut from functions
+	};
+
+private:
+	struct Patch
+	{
+		uint64_t Offset;
+		std::vector<uint8_t> Bytes;
+	};
+
+	ZydisDecoder m_Decoder;
+	ZydisDecoder m_MinimalDecoder;
+	std::vector<Candidate> m_Candidates;
+	std::vector<Patch> m_Patches;
+	Statistics m_Statistics;
+
+public:
+	PeepholeOptimizer();
+
+	bool AnalyzeFunction(const uint8_t *Code, size_t Length, LeafFunction *Function) const;
+	// Functions holds the module's exception directory (.pdata) entries, sorted by Start. Only code
+	// reachable from those starts is scanned, so an empty table finds nothing.
+	void Scan(const uint8_t *Code, size_t Length, uint64_t BaseAddress, const std::vector<FunctionRange>& Functions);
+	void Apply(uint8_t *Code) const;
+	void WriteReport(void(*Callback)(const char *, ...), bool ListCandidates) const;
+
+	const std::vector<Candidate>& GetCandidates() const;
+	const Statistics& GetStatistics() const;
+};
\ No newline at end of file
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include "../TES/NiMain/NiCollisionUtils.h"
+#include "TrianglePickBVH.h"
+
+void TrianglePickBVH::Build(const NiPoint3 *Triangles, uint32_t TriangleCount, bool Hierarchy)
+{
+	Clear();
+
+	if (TriangleCount == 0)
+		return;
+
+	m_TriangleCount = TriangleCount;
+	m_Nodes.reserve(Hierarchy ? (TriangleCount / PackWidth) * 2 + 1 : 1);
+	m_Packs.reserve((TriangleCount + PackWidth - 1) / PackWidth);
+
+	std::vector<uint32_t> order(TriangleCount);
+	std::vector<NiPoint3> centroids;
+
+	for (uint32_t i = 0; i < TriangleCount; i++)
+		order[i] = i;
+
+	if (Hierarchy)
+	{
+		centroids.resize(TriangleCount);
+
+		for (uint32_t i = 0; i < TriangleCount; i++)
+		{
+			const NiPoint3 *v = &Triangles[i * 3];
+			centroids[i] = NiPoint3((v[0].x + v[1].x + v[2].x) / 3.0f, (v[0].y + v[1].y + v[2].y) / 3.0f, (v[0].z + v[1].z + v[2].z) / 3.0f);
+		}
+	}
+
+	m_Nodes.emplace_back();
+	BuildNode(0, Triangles, centroids, order.data(), TriangleCount);
+}
+
+void TrianglePickBVH::Clear()
+{
+	m_Nodes.clear();
+	m_Packs.clear();
+	m_TriangleCount = 0;
+}
+
+void TrianglePickBVH::Intersect(const NiPoint3& Origin, const NiPoint3& Dir, bool Cull, std::vector<uint32_t>& Hits) const
+{
+	if (m_Nodes.empty())
+		return;
+
+	const size_t firstHit = Hits.size();
+
+	// Median splits keep the tree balanced, so 64 entries covers any 32-bit triangle count
+	uint32_t stack[64];
+	uint32_t stackSize = 0;
+
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = m_Nodes[stack[--stackSize]];
+
+		if (!IntersectBounds(node, Origin, Dir))
+			continue;
+
+		if (node.PackCount == 0)
+		{
+			stack[stackSize++] = node.Start;
+			stack[stackSize++] = node.Start + 1;
+			continue;
+		}
+
+		for (uint32_t i = node.Start; i < node.Start + node.PackCount; i++)
+		{
+			const Pack& pack = m_Packs[i];
+
+			const uint32_t mask = NiCollisionUtils::IntersectTriangles8(Origin, Dir, pack.V, pack.Count, Cull);
+
+			for (uint32_t lane = 0; mask != 0 && lane < pack.Count; lane++)
+			{
+				if (mask & (1u << lane))
+					Hits.push_back(pack.Triangles[lane]);
+			}
+		}
+	}
+
+	// Callers expect the same order a linear scan over the index buffer produces
+	std::sort(Hits.begin() + firstHit, Hits.end());
+}
+
+uint32_t TrianglePickBVH::GetTriangleCount() const
+{
+	return m_TriangleCount;
+}
+
+size_t TrianglePickBVH::GetMemoryUsage() const
+{
+	return (m_Nodes.capacity() * sizeof(Node)) + (m_Packs.capacity() * sizeof(Pack));
+}
+
+void TrianglePickBVH::BuildNode(uint32_t NodeIndex, const NiPoint3 *Triangles, const std::vector<NiPoint3>& Centroids, uint32_t *Order, uint32_t Count)
+{
+	// Bounds of every vertex below this node
+	float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		const NiPoint3 *v = &Triangles[Order[i] * 3];
+
+		for (uint32_t j = 0; j < 3; j++)
+		{
+			for (uint32_t axis = 0; axis < 3; axis++)
+			{
+				min[axis] = std::min(min[axis], (&v[j].x)[axis]);
+				max[axis] = std::max(max[axis], (&v[j].x)[axis]);
+			}
+		}
+	}
+
+	//
+	// The triangle test and the slab test round differently. Grow the box by a small margin relative to
+	// its size and distance from the model origin so a hit on an edge is never pruned.
+	//
+	float scale = 0.0f;
+
+	for (uint32_t axis = 0; axis < 3; axis++)
+		scale = std::max({ scale, max[axis] - min[axis], fabsf(min[axis]), fabsf(max[axis]) });
+
+	const float padding = scale * 1e-4f + 1e-4f;
+
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		m_Nodes[NodeIndex].Min[axis] = min[axis] - padding;
+		m_Nodes[NodeIndex].Max[axis] = max[axis] + padding;
+	}
+
+	if (Centroids.empty() || Count <= PackWidth)
+	{
+		m_Nodes[NodeIndex].Start = (uint32_t)m_Packs.size();
+		m_Nodes[NodeIndex].PackCount = (Count + PackWidth - 1) / PackWidth;
+
+		EmitPacks(Triangles, Order, Count);
+		return;
+	}
+
+	// Split at the centroid median along the widest centroid axis
+	float centroidMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float centroidMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		for (uint32_t axis = 0; axis < 3; axis++)
+		{
+			centroidMin[axis] = std::min(centroidMin[axis], (&Centroids[Order[i]].x)[axis]);
+			centroidMax[axis] = std::max(centroidMax[axis], (&Centroids[Order[i]].x)[axis]);
+		}
+	}
+
+	uint32_t splitAxis = 0;
+
+	for (uint32_t axis = 1; axis < 3; axis++)
+	{
+		if (centroidMax[axis] - centroidMin[axis] > centroidMax[splitAxis] - centroidMin[splitAxis])
+			splitAxis = axis;
+	}
+
+	const uint32_t half = Count / 2;
+
+	std::nth_element(Order, Order + half, Order + Count, [&](uint32_t A, uint32_t B)
+	{
+		return (&Centroids[A].x)[splitAxis] < (&Centroids[B].x)[splitAxis];
+	});
+
+	const uint32_t left = (uint32_t)m_Nodes.size();
+
+	m_Nodes[NodeIndex].Start = left;
+	m_Nodes[NodeIndex].PackCount = 0;
+	m_Nodes.resize(m_Nodes.size() + 2);
+
+	BuildNode(left, Triangles, Centroids, Order, half);
+	BuildNode(left + 1, Triangles, Centroids, Order + half, Count - half);
+}
+
+void TrianglePickBVH::EmitPacks(const NiPoint3 *Triangles, const uint32_t *Order, uint32_t Count)
+{
+	for (uint32_t base = 0; base < Count; base += PackWidth)
+	{
+		// Unused lanes stay zeroed: a degenerate triangle never passes the determinant test
+		Pack& pack = m_Packs.emplace_back();
+		memset(&pack, 0, sizeof(Pack));
+
+		pack.Count = std::min(PackWidth, Count - base);
+
+		for (uint32_t lane = 0; lane < pack.Count; lane++)
+		{
+			const uint32_t triangle = Order[base + lane];
+			const NiPoint3 *v = &Triangles[triangle * 3];
+
+			for (uint32_t j = 0; j < 3; j++)
+			{
+				pack.V[j][0][lane] = v[j].x;
+				pack.V[j][1][lane] = v[j].y;
+				pack.V[j][2][lane] = v[j].z;
+			}
+
+			pack.Triangles[lane] = triangle;
+		}
+
+		for (uint32_t lane = pack.Count; lane < PackWidth; lane++)
+			pack.Triangles[lane] = InvalidTriangle;
+	}
+}
+
+bool TrianglePickBVH::IntersectBounds(const Node& Bounds, const NiPoint3& Origin, const NiPoint3& Dir)
+{
+	// Slab test against the ray's forward half (r >= 0), matching IntersectTriangle()
+	float tNear = 0.0f;
+	float tFar = FLT_MAX;
+
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		const float origin = (&Origin.x)[axis];
+		const float dir = (&Dir.x)[axis];
+
+		if (dir == 0.0f)
+		{
+			if (origin < Bounds.Min[axis] || origin > Bounds.Max[axis])
+				return false;
+
+			continue;
+		}
+
+		const float invDir = 1.0f / dir;
+		float t0 = (Bounds.Min[axis] - origin) * invDir;
+		float t1 = (Bounds.Max[axis] - origin) * invDir;
+
+		if (t0 > t1)
+			std::swap(t0, t1);
+
+		tNear = std::max(tNear, t0);
+		tFar = std::min(tFar, t1);
+
+		if (tNear > tFar)
+			return false;
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "../TES/NiMain/NiPoint.h"
+
+//
+// Bounding volume hierarchy over a triangle soup, built for ray picking. Leaves hold up to 8 triangles
+// in SoA packs so they can go straight to NiCollisionUtils::IntersectTriangles8(). A flat build skips
+// the hierarchy and puts every pack in one leaf, which is what shapes that are picked once want.
+//
+// Nothing here depends on the engine or Windows; positions are copied in at build time.
+//
+class TrianglePickBVH
+{
+public:
+	static const uint32_t PackWidth = 8;
+	static const uint32_t InvalidTriangle = 0xFFFFFFFF;
+
+private:
+	struct Pack
+	{
+		float V[3][3][PackWidth];			// [vertex][axis][lane]
+		uint32_t Triangles[PackWidth];		// Source triangle index per lane
+		uint32_t Count;
+	};
+
+	struct Node
+	{
+		float Min[3];
+		float Max[3];
+		uint32_t Start;						// Leaf: first pack. Interior: left child (right is Start + 1).
+		uint32_t PackCount;					// 0 for interior nodes
+	};
+
+	std::vector<Node> m_Nodes;
+	std::vector<Pack> m_Packs;
+	uint32_t m_TriangleCount = 0;
+
+public:
+	// Triangles holds 3 vertices per triangle
+	void Build(const NiPoint3 *Triangles, uint32_t TriangleCount, bool Hierarchy);
+	void Clear();
+
+	// Appends the index of every triangle the ray (Origin + r * Dir, r >= 0) hits, in ascending order
+	void Intersect(const NiPoint3& Origin, const NiPoint3& Dir, bool Cull, std::vector<uint32_t>& Hits) const;
+
+	uint32_t GetTriangleCount() const;
+	size_t GetMemoryUsage() const;
+
+private:
+	void BuildNode(uint32_t NodeIndex, const NiPoint3 *Triangles, const std::vector<NiPoint3>& Centroids, uint32_t *Order, uint32_t Count);
+	void EmitPacks(const NiPoint3 *Triangles, const uint32_t *Order, uint32_t Count);
+	static bool IntersectBounds(const Node& Bounds, const NiPoint3& Origin, const NiPoint3& Dir);
+};
\ No newline at end of file
@@ -1,4 +1,10 @@
 #include <tbb/concurrent_hash_map.h>
+#include <tbb/parallel_for.h>
+#include <intrin.h>
+#include <immintrin.h>
+#include <mutex>
+#include <memory>
+#include <atomic>
 #include "../../common.h"
 #include "NiMain/NiNode.h"
 #include "Setting.h"
@@ -9,118 +15,342 @@ DefineIniSetting(bEnableStippleFade, Display);
 
 tbb::concurrent_hash_map<uint32_t, TESObjectREFR *> InstanceFormCache;
 
-void BGSDistantTreeBlock::InvalidateCachedForm(uint32_t FormId)
+namespace
 {
-	InstanceFormCache.erase(FormId & 0x00FFFFFF);
-}
+	// Blocks with fewer trees than this aren't worth splitting across threads
+	const uint32_t ParallelInstanceThreshold = 1024;
+	const size_t MaxIndexedBlocks = 4096;
 
-void BGSDistantTreeBlock::UpdateBlockVisibility(ResourceData *Data)
-{
-	ZoneScopedN("BGSDistantTreeBlock::UpdateBlockVisibility");
+	//
+	// Every instance's tree reference, resolved once and stored in block order (group by group). The
+	// instance array pointers/sizes are kept to notice when the engine reuses a ResourceData for a
+	// different block. An index is never modified after it's built, so a visibility update can keep
+	// using it without holding BlockIndexLock.
+	//
+	struct BlockInstanceIndex
+	{
+		std::vector<std::pair<const void *, uint32_t>> Groups;
+		std::vector<uint32_t> GroupOffsets;
+		std::vector<TESObjectREFR *> References;
+	};
+
+	struct BlockEntry
+	{
+		std::shared_ptr<const BlockInstanceIndex> Index;
+		std::vector<uint32_t> FormIds;		// Unique masked form IDs registered in FormBlocks
+		bool Stale = true;					// Set by InvalidateCachedForm() for any of FormIds
+	};
 
-	for (uint32_t i = 0; i < Data->m_LODGroups.QSize(); i++)
+	// BlockIndexLock guards both maps. FormBlocks is the reverse of BlockEntry::FormIds.
+	std::mutex BlockIndexLock;
+	std::unordered_map<const BGSDistantTreeBlock::ResourceData *, BlockEntry> BlockEntries;
+	std::unordered_map<uint32_t, std::vector<const BGSDistantTreeBlock::ResourceData *>> FormBlocks;
+
+	bool DetectF16C()
+	{
+		int cpuinfo[4];
+		__cpuid(cpuinfo, 1);
+
+		// F16C uses VEX encoding, so the OS must also save YMM registers
+		const bool hasOSXSAVE = ((cpuinfo[2] & (1 << 27)) != 0);
+		const bool hasAVX = ((cpuinfo[2] & (1 << 28)) != 0);
+		const bool hasF16C = ((cpuinfo[2] & (1 << 29)) != 0);
+
+		return hasOSXSAVE && hasAVX && hasF16C && (_xgetbv(0) & 0x6) == 0x6;
+	}
+
+	const bool HasF16C = DetectF16C();
+
+	TESObjectREFR *FindTreeReference(uint32_t MaskedFormId)
 	{
-		LODGroup *group = Data->m_LODGroups[i];
+		// Check if this instance was cached, otherwise search each plugin
+		{
+			tbb::concurrent_hash_map<uint32_t, TESObjectREFR *>::const_accessor accessor;
 
-		for (uint32_t j = 0; j < group->m_LODInstances.QSize(); j++)
+			if (InstanceFormCache.find(accessor, MaskedFormId))
+				return accessor->second;
+		}
+
+		TESObjectREFR *treeReference = nullptr;
+
+		// Find first valid tree object by ESP/ESM load order (TESDataHandler::Singleton()->PluginCount)
+		for (uint32_t k = 0; k < *(uint32_t *)(qword_141EE43A8 + 0xD80); k++)
 		{
-			LODGroupInstance *instance = &group->m_LODInstances[j];
-			const uint32_t maskedFormId = instance->FormId & 0x00FFFFFF;
+			TESForm *form = TESForm::LookupFormById((k << 24) | MaskedFormId);
+
+			//
+			// This has a few requirements...the form must:
+			// - Be Loaded
+			// - Be TESObjectREFR
+			// - Have a base object that is TESObjectTREE or have a flag set (0x40)
+			//
+			if (!form)
+				continue;
 
-			// Check if this instance was cached, otherwise search each plugin
-			tbb::concurrent_hash_map<uint32_t, TESObjectREFR *>::accessor accessor;
-			TESObjectREFR *treeReference = nullptr;
+			TESObjectREFR *ref = form->IsREFR();
 
-			if (InstanceFormCache.find(accessor, maskedFormId))
+			if (!ref)
+				continue;
+
+			TESForm *baseForm = ref->GetBaseObject();
+
+			if (baseForm)
 			{
-				treeReference = accessor->second;
+				if ((*(uint32_t *)((__int64)baseForm + 16) >> 6) & 1 || *(uint8_t *)((__int64)baseForm + 0x1A) == 38)
+					treeReference = ref;
+
+				if (treeReference)
+					break;
 			}
-			else
-			{
-				// Find first valid tree object by ESP/ESM load order (TESDataHandler::Singleton()->PluginCount)
-				for (uint32_t k = 0; k < *(uint32_t *)(qword_141EE43A8 + 0xD80); k++)
-				{
-					TESForm *form = TESForm::LookupFormById((k << 24) | maskedFormId);
+		}
 
-					//
-					// This has a few requirements...the form must:
-					// - Be Loaded
-					// - Be TESObjectREFR
-					// - Have a base object that is TESObjectTREE or have a flag set (0x40)
-					//
-					if (!form)
-						continue;
+		// Cache even if it's a null pointer
+		InstanceFormCache.insert(std::make_pair(MaskedFormId, treeReference));
+		return treeReference;
+	}
 
-					TESObjectREFR *ref = form->IsREFR();
+	bool IsIndexCurrent(const BlockInstanceIndex& Index, const BGSDistantTreeBlock::ResourceData *Data)
+	{
+		const uint32_t groupCount = Data->m_LODGroups.QSize();
 
-					if (!ref)
-						continue;
+		if (Index.Groups.size() != groupCount)
+			return false;
 
-					TESForm *baseForm = ref->GetBaseObject();
+		for (uint32_t i = 0; i < groupCount; i++)
+		{
+			auto& instances = Data->m_LODGroups[i]->m_LODInstances;
 
-					if (baseForm)
-					{
-						if ((*(uint32_t *)((__int64)baseForm + 16) >> 6) & 1 || *(uint8_t *)((__int64)baseForm + 0x1A) == 38)
-							treeReference = ref;
+			if (Index.Groups[i] != std::pair<const void *, uint32_t>(instances.QBuffer(), instances.QSize()))
+				return false;
+		}
 
-						if (treeReference)
-							break;
-					}
-				}
+		return true;
+	}
+
+	void UnregisterBlockForms(const BGSDistantTreeBlock::ResourceData *Data, BlockEntry& Entry)
+	{
+		for (uint32_t formId : Entry.FormIds)
+		{
+			auto itr = FormBlocks.find(formId);
+			auto& blocks = itr->second;
+
+			blocks.erase(std::find(blocks.begin(), blocks.end(), Data));
+
+			if (blocks.empty())
+				FormBlocks.erase(itr);
+		}
+
+		Entry.FormIds.clear();
+	}
+
+	std::shared_ptr<const BlockInstanceIndex> GetBlockIndex(const BGSDistantTreeBlock::ResourceData *Data)
+	{
+		const uint32_t groupCount = Data->m_LODGroups.QSize();
+
+		{
+			std::lock_guard<std::mutex> lock(BlockIndexLock);
 
-				// Cache even if it's a null pointer
-				InstanceFormCache.insert(std::make_pair(maskedFormId, treeReference));
+			if (BlockEntries.size() >= MaxIndexedBlocks && !BlockEntries.count(Data))
+			{
+				BlockEntries.clear();
+				FormBlocks.clear();
 			}
 
-			bool fullyHidden = false;
-			float alpha = 1.0f;
+			BlockEntry& entry = BlockEntries[Data];
+
+			if (entry.Index && !entry.Stale && IsIndexCurrent(*entry.Index, Data))
+				return entry.Index;
+
+			//
+			// The block is new (just loaded), was reused for different data, or one of its forms was
+			// invalidated. Register its form IDs before resolving anything, so an invalidation that
+			// arrives while the references are looked up marks this entry stale again.
+			//
+			UnregisterBlockForms(Data, entry);
 
-			if (treeReference)
+			for (uint32_t i = 0; i < groupCount; i++)
 			{
-				NiNode *node = treeReference->GetNiNode();
+				auto& instances = Data->m_LODGroups[i]->m_LODInstances;
+
+				for (uint32_t j = 0; j < instances.QSize(); j++)
+					entry.FormIds.push_back(instances[j].FormId & 0x00FFFFFF);
+			}
+
+			std::sort(entry.FormIds.begin(), entry.FormIds.end());
+			entry.FormIds.erase(std::unique(entry.FormIds.begin(), entry.FormIds.end()), entry.FormIds.end());
+
+			for (uint32_t formId : entry.FormIds)
+				FormBlocks[formId].push_back(Data);
+
+			entry.Stale = false;
+		}
+
+		// Form lookups can end up in InvalidateCachedForm(), which takes BlockIndexLock
+		auto index = std::make_shared<BlockInstanceIndex>();
+
+		for (uint32_t i = 0; i < groupCount; i++)
+		{
+			auto& instances = Data->m_LODGroups[i]->m_LODInstances;
+
+			index->Groups.emplace_back(instances.QBuffer(), instances.QSize());
+			index->GroupOffsets.push_back((uint32_t)index->References.size());
+
+			for (uint32_t j = 0; j < instances.QSize(); j++)
+				index->References.push_back(FindTreeReference(instances[j].FormId & 0x00FFFFFF));
+		}
+
+		std::lock_guard<std::mutex> lock(BlockIndexLock);
+
+		if (auto itr = BlockEntries.find(Data); itr != BlockEntries.end())
+			itr->second.Index = index;
+
+		return index;
+	}
 
-				if (node && !node->QAppCulled() && treeReference->GetParentCell()->IsAttached())
+	void GetInstanceVisibility(TESObjectREFR *TreeReference, float& Alpha, bool& FullyHidden)
+	{
+		FullyHidden = false;
+		Alpha = 1.0f;
+
+		if (!TreeReference)
+			return;
+
+		NiNode *node = TreeReference->GetNiNode();
+
+		if (node && !node->QAppCulled() && TreeReference->GetParentCell()->IsAttached())
+		{
+			if (bEnableStippleFade->uValue.b)
+			{
+				void *fadeNode = node->IsFadeNode();
+
+				if (fadeNode)
 				{
-					if (bEnableStippleFade->uValue.b)
-					{
-						void *fadeNode = node->IsFadeNode();
-
-						if (fadeNode)
-						{
-							alpha = 1.0f - *(float *)((__int64)fadeNode + 0x130);// BSFadeNode::fCurrentFade
-
-							if (alpha <= 0.0f)
-								fullyHidden = true;
-						}
-					}
-					else
-					{
-						// No alpha fade - LOD trees will instantly appear or disappear
-						fullyHidden = true;
-					}
-				}
+					Alpha = 1.0f - *(float *)((__int64)fadeNode + 0x130);// BSFadeNode::fCurrentFade
 
-				if (*(uint32_t *)((__int64)treeReference + 16) & (0x800 | 0x20))// IsDisabled | IsDeleted
-					fullyHidden = true;
+					if (Alpha <= 0.0f)
+						FullyHidden = true;
+				}
+			}
+			else
+			{
+				// No alpha fade - LOD trees will instantly appear or disappear
+				FullyHidden = true;
 			}
+		}
+
+		if (*(uint32_t *)((__int64)TreeReference + 16) & (0x800 | 0x20))// IsDisabled | IsDeleted
+			FullyHidden = true;
+	}
+
+	void ConvertToHalf(const float *Values, uint16_t *Halves, uint32_t Count)
+	{
+		if (HasF16C)
+		{
+			uint32_t i = 0;
 
+			for (; i + 8 <= Count; i += 8)
+				_mm_storeu_si128((__m128i *)&Halves[i], _mm256_cvtps_ph(_mm256_loadu_ps(&Values[i]), _MM_FROUND_TO_NEAREST_INT));
+
+			for (; i < Count; i++)
+				Halves[i] = (uint16_t)_mm_extract_epi16(_mm_cvtps_ph(_mm_set_ss(Values[i]), _MM_FROUND_TO_NEAREST_INT), 0);
+		}
+		else
+		{
 			AutoFunc(uint16_t(__fastcall *)(float), Float2Half, 0xD41D80);
-			uint16_t halfFloat = Float2Half(alpha);
 
-			if (instance->Alpha != halfFloat)
-			{
-				instance->Alpha = halfFloat;
-				group->m_UnkByte24 = false;
-			}
+			for (uint32_t i = 0; i < Count; i++)
+				Halves[i] = Float2Half(Values[i]);
+		}
+	}
+
+	// Returns true if any instance is fully hidden
+	bool UpdateGroupVisibility(BGSDistantTreeBlock::LODGroup *Group, TESObjectREFR *const *References)
+	{
+		const uint32_t BatchSize = 64;
+
+		float alphas[BatchSize];
+		bool hidden[BatchSize];
+		uint16_t halves[BatchSize];
+		bool anyHidden = false;
+
+		for (uint32_t base = 0; base < Group->m_LODInstances.QSize(); base += BatchSize)
+		{
+			const uint32_t count = std::min(BatchSize, Group->m_LODInstances.QSize() - base);
+
+			for (uint32_t j = 0; j < count; j++)
+				GetInstanceVisibility(References[base + j], alphas[j], hidden[j]);
+
+			ConvertToHalf(alphas, halves, count);
 
-			if (instance->Hidden != fullyHidden)
+			for (uint32_t j = 0; j < count; j++)
 			{
-				instance->Hidden = fullyHidden;
-				group->m_UnkByte24 = false;
-			}
+				BGSDistantTreeBlock::LODGroupInstance *instance = &Group->m_LODInstances[base + j];
+
+				if (instance->Alpha != halves[j])
+				{
+					instance->Alpha = halves[j];
+					Group->m_UnkByte24 = false;
+				}
 
-			if (fullyHidden)
-				Data->m_UnkByte82 = false;
+				if (instance->Hidden != hidden[j])
+				{
+					instance->Hidden = hidden[j];
+					Group->m_UnkByte24 = false;
+				}
+
+				anyHidden |= hidden[j];
+			}
 		}
+
+		return anyHidden;
 	}
+}
+
+void BGSDistantTreeBlock::InvalidateCachedForm(uint32_t FormId)
+{
+	const uint32_t maskedFormId = FormId & 0x00FFFFFF;
+
+	// Null lookups are cached too, so this succeeds for most form inserts while plugins load. Only the
+	// blocks that resolved this ID have to rebuild their index.
+	if (!InstanceFormCache.erase(maskedFormId))
+		return;
+
+	std::lock_guard<std::mutex> lock(BlockIndexLock);
+
+	if (auto itr = FormBlocks.find(maskedFormId); itr != FormBlocks.end())
+	{
+		for (auto *block : itr->second)
+			BlockEntries[block].Stale = true;
+	}
+}
+
+void BGSDistantTreeBlock::UpdateBlockVisibility(ResourceData *Data)
+{
+	ZoneScopedN("BGSDistantTreeBlock::UpdateBlockVisibility");
+
+	const std::shared_ptr<const BlockInstanceIndex> indexRef = GetBlockIndex(Data);
+	const BlockInstanceIndex& index = *indexRef;
+
+	//
+	// Groups only write their own instances and m_UnkByte24, so they can be updated independently.
+	// Engine calls made per tree (GetNiNode, IsFadeNode, parent cell state) are read-only.
+	//
+	std::atomic_bool anyHidden = false;
+
+	auto updateGroups = [&](uint32_t Start, uint32_t End)
+	{
+		for (uint32_t i = Start; i < End; i++)
+		{
+			if (UpdateGroupVisibility(Data->m_LODGroups[i], index.References.data() + index.GroupOffsets[i]))
+				anyHidden = true;
+		}
+	};
+
+	if (index.References.size() >= ParallelInstanceThreshold)
+		tbb::parallel_for(tbb::blocked_range<uint32_t>(0, Data->m_LODGroups.QSize()), [&](const tbb::blocked_range<uint32_t>& Range) { updateGroups(Range.begin(), Range.end()); });
+	else
+		updateGroups(0, Data->m_LODGroups.QSize());
+
+	if (anyHidden)
+		Data->m_UnkByte82 = false;
 }
\ No newline at end of file
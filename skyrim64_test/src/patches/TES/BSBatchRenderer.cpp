@@ -5,12 +5,17 @@
 #include "MemoryContextTracker.h"
 #include "BSSpinLock.h"
 #include "BSBatchRenderer.h"
+#include "BSRenderPassSort.h"
 #include "BSShader/Shaders/BSSkyShader.h"
+#include "BSShader/Shaders/BSLightingShader.h"
 #include "MTRenderer.h"
 
 AutoPtr(BYTE, byte_1431F54CD, 0x31F54CD);
 AutoPtr(DWORD, dword_141E32FDC, 0x1E32FDC);
 
+thread_local std::vector<BSRenderPass *> GroupPasses;
+thread_local BSGraphics::InstanceData GroupInstances[MAX_DRAW_INSTANCES];
+
 bool BSBatchRenderer::SetupShaderAndTechnique(BSShader *Shader, uint32_t Technique)
 {
 	ClearShaderAndTechnique();
@@ -368,16 +373,24 @@ bool BSBatchRenderer::RenderNextGroup(uint32_t& Technique, uint32_t& GroupIndex,
 
 	MTRenderer::LockShader(shaderType);
 
+	// Optionally reorder the pass list so identical techniques and materials end up adjacent. Only groups
+	// 0 and 2 (no alpha test) are known to be order independent. Sky techniques are excluded outright
+	// because RenderSkyClouds draws them alpha blended and their order is the cloud layering.
+	bool sortPasses = ui::opt::EnableRenderPassSort && (GroupIndex == 0 || GroupIndex == 2) && shaderType != BSShaderManager::BSSM_SHADER_SKY;
+
+	BSRenderPassSort::Build(currentPass, GroupPasses, sortPasses);
+
 	// If we can, submit it to the command list queue instead of running it directly
 	if (MTRenderer::IsGeneratingGameCommandList())
 	{
 		// Combine 3 draw command packets into 1 when possible
 		BSRenderPass *temp[3];
+		size_t passIndex = 0;
 
 		for (int count = 0;; count = 0)
 		{
-			for (; currentPass && count < ARRAYSIZE(temp); currentPass = currentPass->m_Next)
-				temp[count++] = currentPass;
+			for (; passIndex < GroupPasses.size() && count < ARRAYSIZE(temp); passIndex++)
+				temp[count++] = GroupPasses[passIndex];
 
 			if (count == 0)
 				break;
@@ -396,8 +409,18 @@ bool BSBatchRenderer::RenderNextGroup(uint32_t& Technique, uint32_t& GroupIndex,
 	}
 	else
 	{
-		for (; currentPass; currentPass = currentPass->m_Next)
-			SetupAndDrawPass(currentPass, Technique, alphaTest, RenderFlags);
+		for (size_t i = 0; i < GroupPasses.size();)
+		{
+			// Consecutive passes that only differ by their world transform are drawn together
+			uint32_t count = GetInstancedRunLength(&GroupPasses[i], GroupPasses.size() - i, Technique);
+
+			if (count > 1)
+				SetupAndDrawInstanced(&GroupPasses[i], count, Technique, alphaTest, RenderFlags);
+			else
+				SetupAndDrawPass(GroupPasses[i], Technique, alphaTest, RenderFlags);
+
+			i += count;
+		}
 	}
 
 	// Zero the pointers only - the memory is freed elsewhere
@@ -437,7 +460,7 @@ void UnmapDynamicData()
 	renderer->m_DeviceContext->Unmap(renderer->m_DynamicBuffers[renderer->m_CurrentDynamicBufferIndex], 0);
 }
 
-void BSBatchRenderer::SetupAndDrawPass(BSRenderPass *Pass, uint32_t Technique, bool AlphaTest, uint32_t RenderFlags)
+bool BSBatchRenderer::SetupPassTechniqueAndMaterial(BSRenderPass *Pass, uint32_t Technique)
 {
 	auto *GraphicsGlobals = BSGraphics::Renderer::GetGlobals();
 	uint32_t& dword_1432A8214 = *(uint32_t *)((uintptr_t)GraphicsGlobals + 0x3014);
@@ -471,7 +494,15 @@ void BSBatchRenderer::SetupAndDrawPass(BSRenderPass *Pass, uint32_t Technique, b
 
 			qword_1434B5220 = (uintptr_t)material;
 		}
+	}
 
+	return techniqueIsSetup;
+}
+
+void BSBatchRenderer::SetupAndDrawPass(BSRenderPass *Pass, uint32_t Technique, bool AlphaTest, uint32_t RenderFlags)
+{
+	if (SetupPassTechniqueAndMaterial(Pass, Technique))
+	{
 		*(BYTE *)((uintptr_t)Pass->m_Geometry + 264) = *(BYTE *)(&Pass->m_Lod);// WARNING: MT data write hazard. ucCurrentMeshLODLevel?
 
 		if (Pass->m_Geometry->QSkinInstance())
@@ -483,6 +514,90 @@ void BSBatchRenderer::SetupAndDrawPass(BSRenderPass *Pass, uint32_t Technique, b
 	}
 }
 
+uint32_t BSBatchRenderer::GetInstancedRunLength(BSRenderPass *const *Passes, size_t Count, uint32_t Technique)
+{
+	BSRenderPass *first = Passes[0];
+
+	if (!ui::opt::EnableAutoInstancing || Count < 2)
+		return 1;
+
+	// Only plain static triangle shapes. Skinned/custom geometry needs per-object setup.
+	auto isPlainTriShape = [](const BSGeometry *Geometry)
+	{
+		return Geometry &&
+			Geometry->QType() == GEOMETRY_TYPE_TRISHAPE &&
+			!Geometry->QSkinInstance() &&
+			(*(BYTE *)((uintptr_t)Geometry + 265) & 8) == 0;
+	};
+
+	if (first->m_Shader != BSLightingShader::pInstance || !isPlainTriShape(first->m_Geometry) || !BSLightingShader::IsInstancingCompatible(Technique))
+		return 1;
+
+	const void *rendererData = first->m_Geometry->QRendererData();
+	const BSShaderMaterial *material = first->m_Property ? first->m_Property->pMaterial : nullptr;
+	uint32_t count = 1;
+
+	for (; count < Count && count < MAX_DRAW_INSTANCES; count++)
+	{
+		BSRenderPass *pass = Passes[count];
+
+		if (pass->m_Shader != first->m_Shader || !isPlainTriShape(pass->m_Geometry))
+			break;
+
+		if (pass->m_Geometry->QRendererData() != rendererData ||
+			static_cast<BSTriShape *>(pass->m_Geometry)->m_TriangleCount != static_cast<BSTriShape *>(first->m_Geometry)->m_TriangleCount)
+			break;
+
+		if (!pass->m_Property || pass->m_Property->pMaterial != material || *(BYTE *)(&pass->m_Lod) != *(BYTE *)(&first->m_Lod))
+			break;
+
+		if (!BSLightingShader::CanShareInstancedDraw(first, pass))
+			break;
+	}
+
+	return count;
+}
+
+void BSBatchRenderer::SetupAndDrawInstanced(BSRenderPass *const *Passes, uint32_t Count, uint32_t Technique, bool AlphaTest, uint32_t RenderFlags)
+{
+	MemoryContextTracker tracker(MemoryContextTracker::RENDER_ACCUMULATOR, "BSBatchRenderer.cpp");
+
+	BSRenderPass *first = Passes[0];
+
+	if (!SetupPassTechniqueAndMaterial(first, Technique))
+		return;
+
+	auto *renderer = BSGraphics::Renderer::GetGlobals();
+	BSGraphics::VertexShader *originalShader = renderer->m_CurrentVertexShader;
+	BSGraphics::VertexShader *instancedShader = BSLightingShader::GetInstancedVertexShader(originalShader);
+
+	// No variant for this technique: technique and material are already set, draw them one by one
+	if (!instancedShader)
+	{
+		for (uint32_t i = 0; i < Count; i++)
+			SetupAndDrawPass(Passes[i], Technique, AlphaTest, RenderFlags);
+
+		return;
+	}
+
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		*(BYTE *)((uintptr_t)Passes[i]->m_Geometry + 264) = *(BYTE *)(&Passes[i]->m_Lod);// WARNING: MT data write hazard. ucCurrentMeshLODLevel?
+		BSLightingShader::GetInstanceData(Passes[i], RenderFlags, GroupInstances[i]);
+	}
+
+	// Geometry constants are written with the bound shader's offsets, so swap first
+	renderer->SetVertexShader(instancedShader);
+
+	SetupGeometryBlending(first, first->m_Shader, AlphaTest || BSGraphics::gState.bUseEarlyZ, RenderFlags);
+
+	auto triShape = static_cast<BSTriShape *>(first->m_Geometry);
+	renderer->DrawTriShapeInstanced(reinterpret_cast<BSGraphics::TriShape *>(triShape->QRendererData()), 0, triShape->m_TriangleCount, GroupInstances, Count);
+
+	first->m_Shader->RestoreGeometry(first, RenderFlags);
+	renderer->SetVertexShader(originalShader);
+}
+
 void BSBatchRenderer::SetupGeometryBlending(BSRenderPass *Pass, BSShader *Shader, bool AlphaTest, uint32_t RenderFlags)
 {
 	if (Shader != BSSkyShader::pInstance)
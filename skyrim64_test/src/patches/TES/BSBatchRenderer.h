@@ -58,7 +58,10 @@ public:
 	bool RenderNextGroup(uint32_t& Technique, uint32_t& GroupIndex, __int64 a4, uint32_t RenderFlags);
 	void sub_14131D6E0();
 
+	static bool SetupPassTechniqueAndMaterial(BSRenderPass *Pass, uint32_t Technique);
 	static void SetupAndDrawPass(BSRenderPass *Pass, uint32_t Technique, bool AlphaTest, uint32_t RenderFlags);
+	static uint32_t GetInstancedRunLength(BSRenderPass *const *Passes, size_t Count, uint32_t Technique);
+	static void SetupAndDrawInstanced(BSRenderPass *const *Passes, uint32_t Count, uint32_t Technique, bool AlphaTest, uint32_t RenderFlags);
 	static void SetupGeometryBlending(BSRenderPass *Pass, BSShader *Shader, bool AlphaTest, uint32_t RenderFlags);
 	static void DrawPass(BSRenderPass *Pass, bool AlphaTest, uint32_t RenderFlags);
 	static void DrawPassSkinned(BSRenderPass *Pass, bool AlphaTest, uint32_t RenderFlags);
@@ -0,0 +1,288 @@
+#include <intrin.h>
+#include <immintrin.h>
+#include "../../common.h"
+#include "NiMain/NiNode.h"
+#include "BSCullingBatch.h"
+
+namespace BSCullingBatch
+{
+	// Nodes with fewer children aren't worth the copy
+	const uint32_t MinBatchChildren = 8;
+
+	// Wide nodes nested deeper than this share the last level
+	const uint32_t MaxBatchDepth = 16;
+
+	struct SiblingBatch
+	{
+		const NiNode *Parent = nullptr;
+		uint32_t NextIndex = 0;
+
+		uint32_t ActivePlanes = 0;
+		NiPlane Planes[NiFrustumPlanes::MAX_PLANES];
+
+		std::vector<const NiAVObject *> Children;
+		std::vector<NiBound> Bounds;			// Bounds the mask was computed from
+		std::vector<float> CenterX;				// SoA copies, padded to a multiple of 8
+		std::vector<float> CenterY;
+		std::vector<float> CenterZ;
+		std::vector<float> NegRadius;
+		std::vector<uint32_t> CulledMask;		// One bit per child
+	};
+
+	//
+	// One batch per wide node on the current path from the root. Culling is depth first, so a child's
+	// subtree can't evict its parent's batch, and returning to a sibling finds the parent's batch intact.
+	//
+	struct BatchStack
+	{
+		SiblingBatch Levels[MaxBatchDepth];
+		uint32_t Depth = 0;
+	};
+
+	thread_local BatchStack Batches;
+
+	bool DetectAVX()
+	{
+		int cpuinfo[4];
+		__cpuid(cpuinfo, 1);
+
+		// CPU support plus OS support for saving YMM registers
+		const bool hasOSXSAVE = ((cpuinfo[2] & (1 << 27)) != 0);
+		const bool hasAVX = ((cpuinfo[2] & (1 << 28)) != 0);
+
+		return hasOSXSAVE && hasAVX && (_xgetbv(0) & 0x6) == 0x6;
+	}
+
+	const bool HasAVX = DetectAVX();
+
+	struct PlaneSet
+	{
+		uint32_t Count;
+		float NormalX[NiFrustumPlanes::MAX_PLANES];
+		float NormalY[NiFrustumPlanes::MAX_PLANES];
+		float NormalZ[NiFrustumPlanes::MAX_PLANES];
+		float Constant[NiFrustumPlanes::MAX_PLANES];
+	};
+
+	//
+	// Both versions evaluate (nx * x + ny * y + nz * z) - constant <= -radius in the same order as the
+	// scalar NiPlane::Distance/NiBound::WhichSide pair. NaNs compare false on both sides (not culled).
+	//
+	void TestAVX(SiblingBatch& B, const PlaneSet& P)
+	{
+		for (size_t i = 0; i < B.CenterX.size(); i += 8)
+		{
+			const __m256 x = _mm256_loadu_ps(&B.CenterX[i]);
+			const __m256 y = _mm256_loadu_ps(&B.CenterY[i]);
+			const __m256 z = _mm256_loadu_ps(&B.CenterZ[i]);
+			const __m256 negRadius = _mm256_loadu_ps(&B.NegRadius[i]);
+
+			__m256 culled = _mm256_setzero_ps();
+
+			for (uint32_t p = 0; p < P.Count; p++)
+			{
+				__m256 d = _mm256_mul_ps(x, _mm256_set1_ps(P.NormalX[p]));
+				d = _mm256_add_ps(d, _mm256_mul_ps(y, _mm256_set1_ps(P.NormalY[p])));
+				d = _mm256_add_ps(d, _mm256_mul_ps(z, _mm256_set1_ps(P.NormalZ[p])));
+				d = _mm256_sub_ps(d, _mm256_set1_ps(P.Constant[p]));
+
+				culled = _mm256_or_ps(culled, _mm256_cmp_ps(d, negRadius, _CMP_LE_OQ));
+			}
+
+			B.CulledMask[i / 32] |= (uint32_t)_mm256_movemask_ps(culled) << (i % 32);
+		}
+
+		_mm256_zeroupper();
+	}
+
+	void TestSSE(SiblingBatch& B, const PlaneSet& P)
+	{
+		for (size_t i = 0; i < B.CenterX.size(); i += 4)
+		{
+			const __m128 x = _mm_loadu_ps(&B.CenterX[i]);
+			const __m128 y = _mm_loadu_ps(&B.CenterY[i]);
+			const __m128 z = _mm_loadu_ps(&B.CenterZ[i]);
+			const __m128 negRadius = _mm_loadu_ps(&B.NegRadius[i]);
+
+			__m128 culled = _mm_setzero_ps();
+
+			for (uint32_t p = 0; p < P.Count; p++)
+			{
+				__m128 d = _mm_mul_ps(x, _mm_set1_ps(P.NormalX[p]));
+				d = _mm_add_ps(d, _mm_mul_ps(y, _mm_set1_ps(P.NormalY[p])));
+				d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(P.NormalZ[p])));
+				d = _mm_sub_ps(d, _mm_set1_ps(P.Constant[p]));
+
+				culled = _mm_or_ps(culled, _mm_cmple_ps(d, negRadius));
+			}
+
+			B.CulledMask[i / 32] |= (uint32_t)_mm_movemask_ps(culled) << (i % 32);
+		}
+	}
+
+	void Build(SiblingBatch& B, const NiFrustumPlanes& Planes, const NiNode *Parent)
+	{
+		const uint32_t childCount = Parent->GetArrayCount();
+
+		B.Parent = Parent;
+		B.NextIndex = 0;
+		B.ActivePlanes = Planes.GetActivePlaneState();
+		memcpy(B.Planes, Planes.m_akCullingPlanes, sizeof(B.Planes));
+
+		const size_t paddedCount = (childCount + 7) & ~7u;
+
+		B.Children.resize(childCount);
+		B.Bounds.resize(childCount);
+		B.CenterX.assign(paddedCount, 0.0f);
+		B.CenterY.assign(paddedCount, 0.0f);
+		B.CenterZ.assign(paddedCount, 0.0f);
+		B.NegRadius.assign(paddedCount, 0.0f);
+		B.CulledMask.assign((paddedCount + 31) / 32, 0);
+
+		for (uint32_t i = 0; i < childCount; i++)
+		{
+			const NiAVObject *child = Parent->GetAt(i);
+			B.Children[i] = child;
+
+			// Empty slots are never queried
+			if (!child)
+				continue;
+
+			const NiBound& bound = child->m_kWorldBound;
+			B.Bounds[i] = bound;
+			B.CenterX[i] = bound.m_kCenter.x;
+			B.CenterY[i] = bound.m_kCenter.y;
+			B.CenterZ[i] = bound.m_kCenter.z;
+			B.NegRadius[i] = -bound.m_fRadius;
+		}
+
+		PlaneSet planeSet;
+		planeSet.Count = 0;
+
+		for (uint32_t p = 0; p < NiFrustumPlanes::MAX_PLANES; p++)
+		{
+			if (!Planes.IsPlaneActive(p))
+				continue;
+
+			const NiPlane& plane = Planes.GetPlane(p);
+			planeSet.NormalX[planeSet.Count] = plane.m_kNormal.x;
+			planeSet.NormalY[planeSet.Count] = plane.m_kNormal.y;
+			planeSet.NormalZ[planeSet.Count] = plane.m_kNormal.z;
+			planeSet.Constant[planeSet.Count] = plane.m_fConstant;
+			planeSet.Count++;
+		}
+
+		if (HasAVX)
+			TestAVX(B, planeSet);
+		else
+			TestSSE(B, planeSet);
+	}
+
+	bool IsCurrent(const SiblingBatch& B, const NiFrustumPlanes& Planes, const NiNode *Parent)
+	{
+		if (B.Parent != Parent || B.ActivePlanes != Planes.GetActivePlaneState())
+			return false;
+
+		// Inactive planes are never tested and may differ freely
+		for (uint32_t p = 0; p < NiFrustumPlanes::MAX_PLANES; p++)
+		{
+			if (Planes.IsPlaneActive(p) && memcmp(&B.Planes[p], &Planes.GetPlane(p), sizeof(NiPlane)) != 0)
+				return false;
+		}
+
+		return true;
+	}
+
+	bool FindChild(SiblingBatch& B, const NiAVObject *Object, uint32_t& Index)
+	{
+		// Siblings are almost always visited in order, so start after the last hit
+		const uint32_t count = (uint32_t)B.Children.size();
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t index = (B.NextIndex + i) % count;
+
+			if (B.Children[index] == Object)
+			{
+				Index = index;
+				B.NextIndex = index + 1;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool Lookup(SiblingBatch& B, const NiAVObject *Object, bool& Culled)
+	{
+		uint32_t index;
+
+		if (!FindChild(B, Object, index))
+			return false;
+
+		// Moved since the batch was built
+		if (memcmp(&B.Bounds[index], &Object->m_kWorldBound, sizeof(NiBound)) != 0)
+			return false;
+
+		Culled = (B.CulledMask[index / 32] & (1u << (index % 32))) != 0;
+		return true;
+	}
+
+	bool IsAncestor(const NiNode *Ancestor, const NiNode *Node)
+	{
+		for (const NiNode *parent = Node->GetParent(); parent; parent = parent->GetParent())
+		{
+			if (parent == Ancestor)
+				return true;
+		}
+
+		return false;
+	}
+
+	SiblingBatch& GetBatch(BatchStack& Stack, const NiNode *Parent)
+	{
+		// Anything above Parent's level belongs to a subtree that has already been culled
+		for (uint32_t i = Stack.Depth; i > 0; i--)
+		{
+			if (Stack.Levels[i - 1].Parent == Parent)
+			{
+				Stack.Depth = i;
+				return Stack.Levels[i - 1];
+			}
+		}
+
+		// New wide node. Keep only the levels on its path from the root.
+		while (Stack.Depth > 0 && !IsAncestor(Stack.Levels[Stack.Depth - 1].Parent, Parent))
+			Stack.Depth--;
+
+		if (Stack.Depth == MaxBatchDepth)
+			Stack.Depth--;
+
+		SiblingBatch& batch = Stack.Levels[Stack.Depth++];
+		batch.Parent = nullptr;
+
+		return batch;
+	}
+
+	bool IsCulled(const NiCullingProcess *Process, const NiAVObject *Object)
+	{
+		const NiNode *parent = Object->GetParent();
+
+		// Narrow nodes go straight to DoCulling without touching the batches above them
+		if (!parent || parent->GetArrayCount() < MinBatchChildren)
+			return false;
+
+		SiblingBatch& batch = GetBatch(Batches, parent);
+		bool culled = false;
+
+		if (IsCurrent(batch, Process->m_kPlanes, parent) && Lookup(batch, Object, culled))
+			return culled;
+
+		Build(batch, Process->m_kPlanes, parent);
+
+		if (!Lookup(batch, Object, culled))
+			return false;
+
+		return culled;
+	}
+}
\ No newline at end of file
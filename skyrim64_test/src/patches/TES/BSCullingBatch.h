@@ -0,0 +1,22 @@
+#pragma once
+
+#include "NiMain/NiAVObject.h"
+#include "NiMain/NiCullingProcess.h"
+
+//
+// Batched frustum rejection for siblings. The first time a child of a wide node reaches the
+// frustum test, every sibling's world bound is copied into SoA arrays and tested against the
+// active planes 8 at a time (4 without AVX). The remaining siblings read their result from the
+// cached mask instead of going through NiCullingProcess::DoCulling one at a time. Each thread keeps
+// one batch per wide node on the current path from the root, so descendants don't evict it. Nodes
+// with fewer than 8 children skip batching entirely.
+//
+// A cached answer is only used when the active planes and the object's world bound are bit-for-bit
+// the ones it was computed from, so the result always matches the scalar NiBound::WhichSide test.
+// Only rejections are taken from the batch. Accepted objects still go through DoCulling, which
+// disables fully-inside planes for their own children exactly as before.
+//
+namespace BSCullingBatch
+{
+	bool IsCulled(const NiCullingProcess *Process, const NiAVObject *Object);
+}
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "BSTLocklessQueue.h"
 
 #include "MOC.h"
+#include "BSCullingBatch.h"
 extern bool doCullTest;
 
 class BSCullingProcess : public NiCullingProcess
@@ -119,6 +120,10 @@ public:
 
 					if (!Object->QAlwaysDraw() && m_kPlanes.IsAnyPlaneActive())
 					{
+						// Siblings rejected in bulk skip the per-plane test entirely
+						if (ui::opt::EnableBatchFrustumCulling && BSCullingBatch::IsCulled(this, Object))
+							return;
+
 						// Test each plane
 						DoCulling(Object, Unknown);
 						return;
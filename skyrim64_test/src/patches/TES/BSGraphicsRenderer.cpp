@@ -1,5 +1,10 @@
 #include "../rendering/common.h"
 #include "../rendering/GpuCircularBuffer.h"
+#include "../rendering/GpuTimer.h"
+#include "../rendering/D3DShaderCompiler.h"
+#include "../rendering/ShaderBytecodeStore.h"
+#include "../rendering/RenderStateKey.h"
+#include "../rendering/ConstantDedupCache.h"
 #include <d3dcompiler.h>
 #include "BSGraphicsRenderer.h"
 #include "BSShader/BSShaderAccumulator.h"
@@ -47,9 +52,14 @@ namespace BSGraphics
 	const uint32_t VertexIndexRingBufferSize = 128 * 1024 * 1024;
 	const uint32_t ShaderConstantRingBufferSize = 32 * 1024 * 1024;
 	const uint32_t RingBufferMaxFrames = 8;
+	const uint32_t InvalidRingBufferLane = 0xFFFFFFFF;
 
 	thread_local VertexShader *TLS_CurrentVertexShader;
 	thread_local PixelShader *TLS_CurrentPixelShader;
+	thread_local uint32_t TLS_RingBufferLane;		// 0 = immediate context/not a worker
+	thread_local PackedRenderState TLS_AppliedRenderState;	// What SyncD3DState last sent to this thread's context, per group
+
+	bool RingBufferLanesSupported;
 
 	GpuCircularBuffer *DynamicBuffer;		// Holds vertices and indices
 	GpuCircularBuffer *ShaderConstantBuffer;// Holds shader constant values
@@ -63,12 +73,82 @@ namespace BSGraphics
 
 	ID3D11Buffer *TempDynamicBuffers[11];
 
+	ID3D11Buffer *InstanceDataBuffer;			// StructuredBuffer<InstanceData>, rewritten for every instanced draw
+	ID3D11ShaderResourceView *InstanceDataView;
+
 	const uint32_t ThresholdSize = 32;
+	const uint32_t InvalidStagingSlot = 0xFFFFFFFF;
+
+	thread_local ConstantDedupCache TLS_ConstantDedup;	// Dropped in FlushThreadedVars() and OnExecuteCommandList()
 
 	std::unordered_map<uint64_t, ID3D11InputLayout *> m_InputLayoutMap;
 	BSReadWriteLock m_InputLayoutLock;
 
-	std::unordered_map<void *, std::pair<void *, size_t>> m_ShaderBytecodeMap;
+	std::unordered_map<void *, ShaderBytecodeStore::Handle> m_ShaderBytecodeMap;
+	BSReadWriteLock m_ShaderBytecodeLock;
+
+	// {6E1A3B52-90D4-4C8F-A1E7-3D2B5C0F9A84}
+	const GUID ShaderBytecodeReferenceGuid = { 0x6e1a3b52, 0x90d4, 0x4c8f, { 0xa1, 0xe7, 0x3d, 0x2b, 0x5c, 0x0f, 0x9a, 0x84 } };
+
+	//
+	// Attached to every registered shader as private data. D3D releases it when the shader object is
+	// destroyed, which drops the bytecode reference no matter who frees the shader (BSShader::DeleteShaders
+	// in the game, a rejected instanced variant, anything created through the device proxy).
+	//
+	class ShaderBytecodeReference : public IUnknown
+	{
+	private:
+		void *m_Shader;
+		LONG m_RefCount = 1;
+
+	public:
+		ShaderBytecodeReference(void *Shader) : m_Shader(Shader)
+		{
+		}
+
+		virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ppvObject) override
+		{
+			if (riid != __uuidof(IUnknown))
+			{
+				*ppvObject = nullptr;
+				return E_NOINTERFACE;
+			}
+
+			AddRef();
+			*ppvObject = this;
+			return S_OK;
+		}
+
+		virtual ULONG STDMETHODCALLTYPE AddRef() override
+		{
+			return InterlockedIncrement(&m_RefCount);
+		}
+
+		virtual ULONG STDMETHODCALLTYPE Release() override
+		{
+			ULONG refCount = InterlockedDecrement(&m_RefCount);
+
+			if (refCount == 0)
+			{
+				ShaderBytecodeStore::Handle handle;
+
+				m_ShaderBytecodeLock.LockForWrite();
+				{
+					auto itr = m_ShaderBytecodeMap.find(m_Shader);
+					Assert(itr != m_ShaderBytecodeMap.end());
+
+					handle = itr->second;
+					m_ShaderBytecodeMap.erase(itr);
+				}
+				m_ShaderBytecodeLock.UnlockWrite();
+
+				g_ShaderBytecodeStore.Release(handle);
+				delete this;
+			}
+
+			return refCount;
+		}
+	};
 
 	Renderer *Renderer::GetGlobals()
 	{
@@ -111,7 +191,19 @@ namespace BSGraphics
 			Assert(SUCCEEDED(Device->CreateBuffer(&desc, nullptr, &TempDynamicBuffers[i])));
 		}
 
-		DynamicBuffer = new GpuCircularBuffer(Device, D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_INDEX_BUFFER, VertexIndexRingBufferSize, RingBufferMaxFrames);
+		//
+		// Deferred contexts can only sub-allocate from the rings when the driver allows
+		// WRITE_NO_OVERWRITE maps on them (D3D11.1). Otherwise they keep using the temp buffers below.
+		//
+		D3D11_FEATURE_DATA_D3D11_OPTIONS options;
+		memset(&options, 0, sizeof(options));
+
+		if (SUCCEEDED(Device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+			RingBufferLanesSupported = options.MapNoOverwriteOnDynamicConstantBuffer != FALSE;
+
+		const uint32_t laneCount = RingBufferLanesSupported ? (1 + MAXIMUM_WORKER_THREADS) : 1;	// One per DC_Thread
+
+		DynamicBuffer = new GpuCircularBuffer(Device, D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_INDEX_BUFFER, VertexIndexRingBufferSize, RingBufferMaxFrames, laneCount);
 
 		//
 		// Small temporary shader constant buffers and ring buffer
@@ -150,7 +242,25 @@ namespace BSGraphics
 		desc.StructureByteStride = 0;
 		Assert(SUCCEEDED(Device->CreateBuffer(&desc, nullptr, &TestLargeBuffer)));
 
-		ShaderConstantBuffer = new GpuCircularBuffer(Device, D3D11_BIND_CONSTANT_BUFFER, ShaderConstantRingBufferSize, RingBufferMaxFrames);
+		ShaderConstantBuffer = new GpuCircularBuffer(Device, D3D11_BIND_CONSTANT_BUFFER, ShaderConstantRingBufferSize, RingBufferMaxFrames, laneCount);
+
+		//
+		// Per-instance transforms for automatic instancing (BSBatchRenderer::SetupAndDrawInstanced)
+		//
+		desc.ByteWidth = MAX_DRAW_INSTANCES * sizeof(InstanceData);
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		desc.StructureByteStride = sizeof(InstanceData);
+		Assert(SUCCEEDED(Device->CreateBuffer(&desc, nullptr, &InstanceDataBuffer)));
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+		viewDesc.Format = DXGI_FORMAT_UNKNOWN;
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		viewDesc.Buffer.FirstElement = 0;
+		viewDesc.Buffer.NumElements = MAX_DRAW_INSTANCES;
+		Assert(SUCCEEDED(Device->CreateShaderResourceView(InstanceDataBuffer, &viewDesc, &InstanceDataView)));
 	}
 
 	void Renderer::OnNewFrame()
@@ -190,10 +300,39 @@ namespace BSGraphics
 			CurrentFrameIndex = 0;
 	}
 
+	void Renderer::SetRingBufferLane(uint32_t Lane)
+	{
+		TLS_RingBufferLane = Lane;
+	}
+
+	uint32_t GetRingBufferLane()
+	{
+		// Immediate context
+		if (!MTRenderer::IsRenderingMultithreaded())
+			return 0;
+
+		// Deferred context on a worker with its own lane. Lanes are only written between
+		// DC_RenderDeferred() and DC_WaitDeferred(), so they're fenced with the rest of the frame.
+		if (RingBufferLanesSupported && TLS_RingBufferLane > 0 && TLS_RingBufferLane < DynamicBuffer->GetLaneCount())
+			return TLS_RingBufferLane;
+
+		return InvalidRingBufferLane;
+	}
+
 	void Renderer::FlushThreadedVars()
 	{
 		memset(&TestBufferUsedBits, 0, sizeof(TestBufferUsedBits));
 
+		TLS_ConstantDedup.ReleaseAllStaging();
+		TLS_ConstantDedup.Invalidate();
+
+		// Worker lanes start a new command list, which has to discard before it can append
+		if (RingBufferLanesSupported && TLS_RingBufferLane > 0 && TLS_RingBufferLane < DynamicBuffer->GetLaneCount())
+		{
+			DynamicBuffer->BeginCommandList(TLS_RingBufferLane);
+			ShaderConstantBuffer->BeginCommandList(TLS_RingBufferLane);
+		}
+
 		//
 		// Shaders should've been unique because each technique is different,
 		// but for some reason that isn't the case.
@@ -203,12 +342,24 @@ namespace BSGraphics
 		//
 		TLS_CurrentVertexShader = (VertexShader *)0xFEFEFEFEFEFEFEFE;
 		TLS_CurrentPixelShader = (PixelShader *)0xFEFEFEFEFEFEFEFE;
+		RenderStateKey::Invalidate(&TLS_AppliedRenderState, RenderStateKey::AllMask);
+	}
+
+	void Renderer::OnExecuteCommandList()
+	{
+		// Worker lanes are separate buffers, so a command list's WRITE_DISCARD can't rename this context's
+		// lane anymore. Dropping the cached offsets is kept as cheap insurance in case a lane is ever shared.
+		TLS_ConstantDedup.Invalidate();
 	}
 
 	void Renderer::BeginEvent(wchar_t *Marker) const
 	{
 #if SKYRIM64_USE_PROFILER
 		m_DeviceContext->BeginEventInt(Marker, 0);
+
+		// Deferred command lists can't be timed against the frame, so only the immediate context is
+		if (m_DeviceContext == GetGlobalsNonThreaded()->m_DeviceContext)
+			g_GPUScopeTimers.BeginScope(m_DeviceContext, Marker);
 #endif
 	}
 
@@ -216,6 +367,9 @@ namespace BSGraphics
 	{
 #if SKYRIM64_USE_PROFILER
 		m_DeviceContext->EndEvent();
+
+		if (m_DeviceContext == GetGlobalsNonThreaded()->m_DeviceContext)
+			g_GPUScopeTimers.EndScope(m_DeviceContext);
 #endif
 	}
 
@@ -249,6 +403,33 @@ namespace BSGraphics
 		m_DeviceContext->DrawIndexed(3 * Count, StartIndex, 0);
 	}
 
+	void Renderer::DrawTriShapeInstanced(TriShape *GraphicsTriShape, uint32_t StartIndex, uint32_t Count, const InstanceData *Instances, uint32_t InstanceCount)
+	{
+		AssertMsg(InstanceCount <= MAX_DRAW_INSTANCES, "Instance count exceeds MAX_DRAW_INSTANCES");
+
+		SetVertexDescription(GraphicsTriShape->m_VertexDesc);
+		SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+		SyncD3DState(false);
+
+		// Deferred contexts get their own copy of the buffer contents on each WRITE_DISCARD
+		D3D11_MAPPED_SUBRESOURCE map;
+		Assert(SUCCEEDED(m_DeviceContext->Map(InstanceDataBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &map)));
+		memcpy(map.pData, Instances, InstanceCount * sizeof(InstanceData));
+		m_DeviceContext->Unmap(InstanceDataBuffer, 0);
+
+		UINT stride = BSGeometry::CalculateVertexSize(GraphicsTriShape->m_VertexDesc);
+		UINT offset = 0;
+
+		m_DeviceContext->VSSetShaderResources(INSTANCE_DATA_VS_SLOT, 1, &InstanceDataView);
+		m_DeviceContext->IASetVertexBuffers(0, 1, &GraphicsTriShape->m_VertexBuffer, &stride, &offset);
+		m_DeviceContext->IASetIndexBuffer(GraphicsTriShape->m_IndexBuffer, DXGI_FORMAT_R16_UINT, 0);
+		m_DeviceContext->DrawIndexedInstanced(3 * Count, InstanceCount, StartIndex, 0, 0);
+
+		ProfileCounterAdd("Instanced Draws", 1);
+		ProfileCounterAdd("Instanced Passes", InstanceCount);
+	}
+
 	DynamicTriShape *Renderer::GetParticlesDynamicTriShape()
 	{
 		static DynamicTriShape particles =
@@ -364,6 +545,34 @@ namespace BSGraphics
 
 	SRWLOCK InputLayoutLock = SRWLOCK_INIT;
 
+	PackedRenderState Renderer::GetRenderStateKey() const
+	{
+		auto field = [this](uint32_t Offset) { return *(const uint32_t *)&__zz0[Offset]; };
+
+		RenderStateFields fields;
+		fields.StencilRef = field(44);
+		fields.DepthMode = field(32);
+		fields.StencilMode = field(40);
+		fields.RasterUnknown = field(48);
+		fields.CullMode = field(52);
+		fields.DepthBias = field(56);
+		fields.ScissorMode = field(60);
+		fields.BlendMode = field(64);
+		fields.AlphaToCoverage = field(68);
+		fields.WriteMode = field(72);
+		fields.BlendUnknown = *(const uint32_t *)&__zz2[656];
+		memcpy(fields.BlendFactor, (const float *)(g_ModuleBase + 0x1E2C168), sizeof(fields.BlendFactor));
+
+		return RenderStateKey::Pack(fields);
+	}
+
+	void Renderer::InvalidateAppliedRenderState(uint64_t GroupMask)
+	{
+		// Called by the context proxy when state is set behind SyncD3DState's back, including by SyncD3DState
+		// itself. The groups it did apply are written back once it's done.
+		RenderStateKey::Invalidate(&TLS_AppliedRenderState, GroupMask);
+	}
+
 	void Renderer::SyncD3DState(bool Unknown)
 	{
 		auto renderer = BSGraphics::Renderer::GetGlobals();
@@ -380,6 +589,10 @@ namespace BSGraphics
 
 		if (uint32_t flags = renderer->m_StateUpdateFlags; flags != 0)
 		{
+			const PackedRenderState state = renderer->GetRenderStateKey();
+			const uint64_t stateChanged = RenderStateKey::GetChangedGroups(TLS_AppliedRenderState, state);
+			uint64_t stateApplied = 0;
+
 			if (flags & 1)
 			{
 				//
@@ -482,26 +695,32 @@ namespace BSGraphics
 			}
 
 			// OMSetDepthStencilState
-			if (flags & (0x4 | 0x8))
+			if ((flags & (0x4 | 0x8)) && (stateChanged & RenderStateKey::DepthStencilMask))
 			{
 				// OMSetDepthStencilState(m_DepthStates[m_DepthMode][m_StencilMode], m_StencilRef);
 				renderer->m_DeviceContext->OMSetDepthStencilState(
 					renderer->m_DepthStates[*(signed int *)&renderer->__zz0[32]][*(signed int *)&renderer->__zz0[40]],
 					*(UINT *)&renderer->__zz0[44]);
+
+				stateApplied |= RenderStateKey::DepthStencilMask;
 			}
 
 			// RSSetState
 			if (flags & (0x1000 | 0x40 | 0x20 | 0x10))
 			{
 				// Cull mode, depth bias, fill mode, scissor mode, scissor rect (order unknown)
-				void *wtf = renderer->m_RasterStates[0][0][0][*(signed int *)&renderer->__zz0[60]
-					+ 2
-					* (*(signed int *)&renderer->__zz0[56]
-						+ 12
-						* (*(signed int *)&renderer->__zz0[52]// Cull mode
-							+ 3i64 * *(signed int *)&renderer->__zz0[48]))];
-
-				renderer->m_DeviceContext->RSSetState((ID3D11RasterizerState *)wtf);
+				if (stateChanged & RenderStateKey::RasterMask)
+				{
+					void *wtf = renderer->m_RasterStates[0][0][0][*(signed int *)&renderer->__zz0[60]
+						+ 2
+						* (*(signed int *)&renderer->__zz0[56]
+							+ 12
+							* (*(signed int *)&renderer->__zz0[52]// Cull mode
+								+ 3i64 * *(signed int *)&renderer->__zz0[48]))];
+
+					renderer->m_DeviceContext->RSSetState((ID3D11RasterizerState *)wtf);
+					stateApplied |= RenderStateKey::RasterMask;
+				}
 
 				flags = renderer->m_StateUpdateFlags;
 				if (renderer->m_StateUpdateFlags & 0x40)
@@ -533,7 +752,7 @@ namespace BSGraphics
 			}
 
 			// OMSetBlendState
-			if (flags & 0x80)
+			if ((flags & 0x80) && (stateChanged & RenderStateKey::BlendMask))
 			{
 				float *blendFactor = (float *)(g_ModuleBase + 0x1E2C168);
 
@@ -546,6 +765,7 @@ namespace BSGraphics
 							+ 2i64 * *(signed int *)&renderer->__zz0[64]))];// AlphaBlendMode
 
 				renderer->m_DeviceContext->OMSetBlendState((ID3D11BlendState *)wtf, blendFactor, 0xFFFFFFFF);
+				stateApplied |= RenderStateKey::BlendMask;
 			}
 
 			if (flags & (0x200 | 0x100))
@@ -595,6 +815,17 @@ namespace BSGraphics
 				renderer->m_DeviceContext->IASetPrimitiveTopology(renderer->m_PrimitiveTopology);
 			}
 
+#if SKYRIM64_USE_PROFILER
+			uint32_t skipped = 0;
+			skipped += ((flags & (0x4 | 0x8)) && !(stateChanged & RenderStateKey::DepthStencilMask)) ? 1 : 0;
+			skipped += ((flags & (0x1000 | 0x40 | 0x20 | 0x10)) && !(stateChanged & RenderStateKey::RasterMask)) ? 1 : 0;
+			skipped += ((flags & 0x80) && !(stateChanged & RenderStateKey::BlendMask)) ? 1 : 0;
+
+			ProfileCounterAdd("State Changes Skipped", skipped);
+#endif
+
+			RenderStateKey::Apply(&TLS_AppliedRenderState, state, stateApplied);
+
 			if (Unknown)
 				renderer->m_StateUpdateFlags = flags & 0x400;
 			else
@@ -881,22 +1112,23 @@ namespace BSGraphics
 	{
 		uint32_t initialAllocSize = *AllocationSize;
 		uint32_t roundedAllocSize = 0;
+		uint32_t lane = GetRingBufferLane();
 		ID3D11Buffer *buffer = nullptr;
 
 		Assert(initialAllocSize > 0);
 
 		//
 		// If the user lets us, try to use the global ring buffer instead of small temporary
-		// allocations. It must be used on the immediate D3D context only. No MTR here.
+		// allocations. Each context writes to its own lane of the ring.
 		//
-		if (initialAllocSize > ThresholdSize && !MTRenderer::IsRenderingMultithreaded())
+		if (initialAllocSize > ThresholdSize && lane != InvalidRingBufferLane)
 		{
 			// Size must be rounded up to nearest 256 bytes (D3D11.1 specification)
 			roundedAllocSize = (initialAllocSize + 256 - 1) & ~(256 - 1);
 
-			*DataPointer = ShaderConstantBuffer->MapData(m_DeviceContext, roundedAllocSize, AllocationOffset, false);
+			*DataPointer = ShaderConstantBuffer->MapData(m_DeviceContext, roundedAllocSize, AllocationOffset, false, lane);
 			*AllocationSize = roundedAllocSize;
-			buffer = ShaderConstantBuffer->D3DBuffer;
+			buffer = ShaderConstantBuffer->GetBuffer(lane);
 		}
 		else
 		{
@@ -944,15 +1176,71 @@ namespace BSGraphics
 
 		ProfileCounterAdd("CB Bytes Requested", initialAllocSize);
 		ProfileCounterAdd("CB Bytes Wasted", (roundedAllocSize - initialAllocSize));
+		ProfileCounterAdd("CB Bytes Uploaded", roundedAllocSize);
 		return buffer;
 	}
 
+	bool MapStagedConstantBuffer(void **DataPointer, uint32_t *AllocationSize, uint32_t *StagingSlot)
+	{
+		uint32_t initialAllocSize = *AllocationSize;
+
+		// Only groups that would have gone to the ring buffer can be rebound by offset
+		if (!ui::opt::EnableConstantBufferDedup || initialAllocSize <= ThresholdSize || initialAllocSize > ConstantDedupCache::StagingSize)
+			return false;
+
+		if (GetRingBufferLane() == InvalidRingBufferLane)
+			return false;
+
+		uint32_t slot;
+		uint8_t *staging = TLS_ConstantDedup.AcquireStaging(&slot);
+
+		if (!staging)
+			return false;
+
+		// Size must be rounded up to nearest 256 bytes (D3D11.1 specification)
+		uint32_t roundedAllocSize = (initialAllocSize + 256 - 1) & ~(256 - 1);
+
+		*DataPointer = staging;
+		*AllocationSize = roundedAllocSize;
+		*StagingSlot = slot;
+
+		ProfileCounterAdd("CB Bytes Requested", initialAllocSize);
+		ProfileCounterAdd("CB Bytes Wasted", (roundedAllocSize - initialAllocSize));
+		return true;
+	}
+
+	uint32_t UploadStagedConstantBuffer(ID3D11DeviceContext *Context, uint32_t StagingSlot, uint32_t Level, uint32_t Size)
+	{
+		ConstantDedupCache& cache = TLS_ConstantDedup;
+		uint32_t lane = GetRingBufferLane();
+		uint8_t *data = cache.GetStaging(StagingSlot);
+		uint64_t hash = XUtil::MurmurHash64A(data, Size);
+		uint32_t offset = 0;
+
+		if (cache.Find(StagingSlot, Level, hash, Size, lane, &offset))
+		{
+			cache.ReleaseStaging(StagingSlot);
+
+			ProfileCounterAdd("CB Bytes Deduplicated", Size);
+			return offset;
+		}
+
+		memcpy(ShaderConstantBuffer->MapData(Context, Size, &offset, false, lane), data, Size);
+
+		cache.Insert(StagingSlot, Level, hash, Size, lane, offset);
+		cache.ReleaseStaging(StagingSlot);
+
+		ProfileCounterAdd("CB Bytes Uploaded", Size);
+		return offset;
+	}
+
 	void Renderer::UnmapDynamicConstantBuffer()
 	{
-		if (!MTRenderer::IsRenderingMultithreaded())
-			ShaderConstantBuffer->UnmapData(m_DeviceContext);
+		if (uint32_t lane = GetRingBufferLane(); lane != InvalidRingBufferLane)
+			ShaderConstantBuffer->UnmapData(m_DeviceContext, lane);
 
 		memset(&TestBufferUsedBits, 0, sizeof(TestBufferUsedBits));
+		TLS_ConstantDedup.ReleaseAllStaging();
 	}
 
 	void *Renderer::MapDynamicBuffer(uint32_t AllocationSize, uint32_t *AllocationOffset)
@@ -960,20 +1248,21 @@ namespace BSGraphics
 		ProfileCounterAdd("VIB Bytes Requested", AllocationSize);
 
 		//
-		// Try to use the global ring buffer instead of small temporary allocations. It
-		// must be used on the immediate D3D context only. No MTR here.
+		// Try to use the global ring buffer instead of small temporary allocations. Each
+		// context writes to its own lane of the ring.
 		//
-		if (!MTRenderer::IsRenderingMultithreaded())
+		if (uint32_t lane = GetRingBufferLane(); lane != InvalidRingBufferLane)
 		{
-			m_DynamicBuffers[0] = DynamicBuffer->D3DBuffer;
+			m_DynamicBuffers[0] = DynamicBuffer->GetBuffer(lane);
 			m_CurrentDynamicBufferIndex = 0;
 			m_FrameDataUsedSize = AllocationSize;
 
-			return DynamicBuffer->MapData(m_DeviceContext, AllocationSize, AllocationOffset, true);
+			return DynamicBuffer->MapData(m_DeviceContext, AllocationSize, AllocationOffset, true, lane);
 		}
 
 		//
-		// Select one of the random temporary buffers: index = ceil(log2(max(AllocationSize, 256)))
+		// Fallback when deferred contexts can't use WRITE_NO_OVERWRITE. Select one of the random
+		// temporary buffers: index = ceil(log2(max(AllocationSize, 256)))
 		//
 		// NOTE: There might be a race condition since there's only 1 array used. If skyrim discards
 		// each allocation after a draw call, this is generally OK.
@@ -1104,18 +1393,16 @@ namespace BSGraphics
 	{
 		return;
 		// First get the shader<->bytecode entry
-		const auto& oldData = m_ShaderBytecodeMap.find(Original);
-		const auto& newData = m_ShaderBytecodeMap.find(Replacement);
-
-		Assert(oldData != m_ShaderBytecodeMap.end() && newData != m_ShaderBytecodeMap.end());
+		const auto oldData = GetShaderBytecode(Original);
+		const auto newData = GetShaderBytecode(Replacement);
 
 		// Disassemble both shaders, then compare the string output (case insensitive)
 		UINT stripFlags = D3DCOMPILER_STRIP_REFLECTION_DATA | D3DCOMPILER_STRIP_DEBUG_INFO | D3DCOMPILER_STRIP_TEST_BLOBS | D3DCOMPILER_STRIP_PRIVATE_DATA;
 		ID3DBlob *oldStrippedBlob = nullptr;
 		ID3DBlob *newStrippedBlob = nullptr;
 
-		Assert(SUCCEEDED(D3DStripShader(oldData->second.first, oldData->second.second, stripFlags, &oldStrippedBlob)));
-		Assert(SUCCEEDED(D3DStripShader(newData->second.first, newData->second.second, stripFlags, &newStrippedBlob)));
+		Assert(SUCCEEDED(D3DStripShader(oldData.first, oldData.second, stripFlags, &oldStrippedBlob)));
+		Assert(SUCCEEDED(D3DStripShader(newData.first, newData.second, stripFlags, &newStrippedBlob)));
 
 		UINT disasmFlags = D3D_DISASM_ENABLE_INSTRUCTION_OFFSET;
 		ID3DBlob *oldDataBlob = nullptr;
@@ -1170,143 +1457,154 @@ namespace BSGraphics
 		newDataBlob->Release();
 	}
 
-	void Renderer::RegisterShaderBytecode(void *Shader, const void *Bytecode, size_t BytecodeLength)
+	void Renderer::RegisterShaderBytecode(ID3D11DeviceChild *Shader, const void *Bytecode, size_t BytecodeLength)
 	{
-		// Grab a copy since the pointer isn't going to be valid forever
-		void *codeCopy = malloc(BytecodeLength);
-		memcpy(codeCopy, Bytecode, BytecodeLength);
+		// Grab a reference since the pointer isn't going to be valid forever. Identical blobs are shared.
+		ShaderBytecodeStore::Handle handle = g_ShaderBytecodeStore.Acquire(Bytecode, BytecodeLength);
+		bool inserted;
+
+		m_ShaderBytecodeLock.LockForWrite();
+		inserted = m_ShaderBytecodeMap.try_emplace(Shader, handle).second;
+		m_ShaderBytecodeLock.UnlockWrite();
+
+		// Shaders created by the renderer go through the device proxy first and get here twice. The entry is
+		// erased when a shader is destroyed, so an existing one always belongs to this object.
+		if (!inserted)
+		{
+			g_ShaderBytecodeStore.Release(handle);
+			return;
+		}
 
-		m_ShaderBytecodeMap.emplace(Shader, std::make_pair(codeCopy, BytecodeLength));
+		auto reference = new ShaderBytecodeReference(Shader);
+		Assert(SUCCEEDED(Shader->SetPrivateDataInterface(ShaderBytecodeReferenceGuid, reference)));
+		reference->Release();
 	}
 
-	const std::pair<void *, size_t>& Renderer::GetShaderBytecode(void *Shader)
+	std::pair<void *, size_t> Renderer::GetShaderBytecode(void *Shader)
 	{
-		return m_ShaderBytecodeMap.at(Shader);
+		m_ShaderBytecodeLock.LockForRead();
+		ShaderBytecodeStore::Handle handle = m_ShaderBytecodeMap.at(Shader);
+		m_ShaderBytecodeLock.UnlockRead();
+
+		return g_ShaderBytecodeStore.Get(handle);
 	}
 
-	VertexShader *Renderer::CompileVertexShader(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, std::function<const char *(int Index)> GetConstant)
+	std::filesystem::path GetShaderCacheDirectory()
+	{
+		// Relative INI paths start in the game folder, not whatever the working directory happens to be
+		wchar_t exePath[MAX_PATH];
+		GetModuleFileNameW(GetModuleHandle(nullptr), exePath, ARRAYSIZE(exePath));
+
+		std::filesystem::path directory = std::filesystem::u8path(g_INI.Get("Rendering", "ShaderCacheDirectory", "ShaderCache"));
+
+		if (directory.is_relative())
+			directory = std::filesystem::path(exePath).parent_path() / directory;
+
+		return directory.lexically_normal();
+	}
+
+	ShaderCompileCache *Renderer::GetShaderCompileCache()
 	{
-		// Build defines (aka convert vector->D3DCONSTANT array)
-		D3D_SHADER_MACRO macros[20 + 3 + 1];
-		memset(macros, 0, sizeof(macros));
+		static D3DShaderCompiler compiler;
+		static ShaderCompileCache cache(&compiler, GetShaderCacheDirectory());
+
+		return &cache;
+	}
+
+	ShaderCompileRequest Renderer::GetShaderCompileRequest(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, bool PixelShader)
+	{
+		ShaderCompileRequest request;
+		request.FilePath = FilePath;
+		request.EntryPoint = "main";
+		request.Target = PixelShader ? "ps_5_0" : "vs_5_0";
+		request.Flags = D3DCOMPILE_DEBUG | D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_OPTIMIZATION_LEVEL3;
 
 		AssertMsg(Defines.size() <= 20, "Not enough space reserved for #defines and null terminator");
 
-		for (size_t i = 0; i < Defines.size(); i++)
-		{
-			macros[i].Name = Defines[i].first;
-			macros[i].Definition = Defines[i].second;
-		}
+		for (auto& [name, value] : Defines)
+			request.Defines.emplace_back(name, value);
 
-		macros[Defines.size() + 0].Name = "VSHADER";
-		macros[Defines.size() + 0].Definition = "";
-		macros[Defines.size() + 1].Name = "WINPC";
-		macros[Defines.size() + 1].Definition = "";
-		macros[Defines.size() + 2].Name = "DX11";
-		macros[Defines.size() + 2].Definition = "";
+		request.Defines.emplace_back(PixelShader ? "PSHADER" : "VSHADER", "");
+		request.Defines.emplace_back("WINPC", "");
+		request.Defines.emplace_back("DX11", "");
+		return request;
+	}
 
-		// Compiler setup
-		UINT flags = D3DCOMPILE_DEBUG | D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_OPTIMIZATION_LEVEL3;
-		ID3DBlob *shaderBlob = nullptr;
-		ID3DBlob *shaderErrors = nullptr;
+	VertexShader *Renderer::CompileVertexShader(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, std::function<const char *(int Index)> GetConstant)
+	{
+		ShaderCompileResult result;
+		GetShaderCompileCache()->Compile(GetShaderCompileRequest(FilePath, Defines, false), result);
 
-		if (FAILED(D3DCompileFromFile(FilePath, macros, D3D_COMPILE_STANDARD_FILE_INCLUDE, "main", "vs_5_0", flags, 0, &shaderBlob, &shaderErrors)))
-		{
-			AssertMsgVa(false, "Vertex shader compilation failed:\n\n%s", shaderErrors ? (const char *)shaderErrors->GetBufferPointer() : "Unknown error");
+		return CreateVertexShader(result, GetConstant);
+	}
 
-			if (shaderBlob)
-				shaderBlob->Release();
+	PixelShader *Renderer::CompilePixelShader(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, std::function<const char *(int Index)> GetSampler, std::function<const char *(int Index)> GetConstant)
+	{
+		ShaderCompileResult result;
+		GetShaderCompileCache()->Compile(GetShaderCompileRequest(FilePath, Defines, true), result);
 
-			if (shaderErrors)
-				shaderErrors->Release();
+		return CreatePixelShader(result, GetSampler, GetConstant);
+	}
 
+	VertexShader *Renderer::CreateVertexShader(const ShaderCompileResult& Compiled, std::function<const char *(int Index)> GetConstant)
+	{
+		if (!Compiled.Success)
+		{
+			AssertMsgVa(false, "Vertex shader compilation failed:\n\n%s", !Compiled.Errors.empty() ? Compiled.Errors.c_str() : "Unknown error");
 			return nullptr;
 		}
 
-		if (shaderErrors)
-			shaderErrors->Release();
+		const void *bytecode = Compiled.Bytecode.data();
+		const size_t bytecodeLength = Compiled.Bytecode.size();
 
-		void *rawPtr = malloc(sizeof(VertexShader) + shaderBlob->GetBufferSize());
+		void *rawPtr = malloc(sizeof(VertexShader) + bytecodeLength);
 		VertexShader *vs = new (rawPtr) VertexShader;
 
 		// Shader reflection: gather constant buffer variable offsets
 		ID3D11ShaderReflection *reflector;
-		Assert(SUCCEEDED(D3DReflect(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), __uuidof(ID3D11ShaderReflection), (void **)&reflector)));
+		Assert(SUCCEEDED(D3DReflect(bytecode, bytecodeLength, __uuidof(ID3D11ShaderReflection), (void **)&reflector)));
 
 		ReflectConstantBuffers(reflector, vs->m_ConstantGroups, ARRAYSIZE(vs->m_ConstantGroups), GetConstant, vs->m_ConstantOffsets, ARRAYSIZE(vs->m_ConstantOffsets));
 
 		// Register shader with the DX runtime itself
-		Assert(SUCCEEDED(m_Device->CreateVertexShader(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, &vs->m_Shader)));
+		Assert(SUCCEEDED(m_Device->CreateVertexShader(bytecode, bytecodeLength, nullptr, &vs->m_Shader)));
 
 		// Final step: append raw bytecode to the end of the struct
-		memcpy(vs->m_RawBytecode, shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize());
-		vs->m_ShaderLength = (uint32_t)shaderBlob->GetBufferSize();
+		memcpy(vs->m_RawBytecode, bytecode, bytecodeLength);
+		vs->m_ShaderLength = (uint32_t)bytecodeLength;
 
-		RegisterShaderBytecode(vs->m_Shader, shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize());
+		RegisterShaderBytecode(vs->m_Shader, bytecode, bytecodeLength);
 		reflector->Release();
-		shaderBlob->Release();
 
 		return vs;
 	}
 
-	PixelShader *Renderer::CompilePixelShader(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, std::function<const char *(int Index)> GetSampler, std::function<const char *(int Index)> GetConstant)
+	PixelShader *Renderer::CreatePixelShader(const ShaderCompileResult& Compiled, std::function<const char *(int Index)> GetSampler, std::function<const char *(int Index)> GetConstant)
 	{
-		// Build defines (aka convert vector->D3DCONSTANT array)
-		D3D_SHADER_MACRO macros[20 + 3 + 1];
-		memset(macros, 0, sizeof(macros));
-
-		AssertMsg(Defines.size() <= 20, "Not enough space reserved for #defines and null terminator");
-
-		for (size_t i = 0; i < Defines.size(); i++)
+		if (!Compiled.Success)
 		{
-			macros[i].Name = Defines[i].first;
-			macros[i].Definition = Defines[i].second;
-		}
-
-		macros[Defines.size() + 0].Name = "PSHADER";
-		macros[Defines.size() + 0].Definition = "";
-		macros[Defines.size() + 1].Name = "WINPC";
-		macros[Defines.size() + 1].Definition = "";
-		macros[Defines.size() + 2].Name = "DX11";
-		macros[Defines.size() + 2].Definition = "";
-
-		// Compiler setup
-		UINT flags = D3DCOMPILE_DEBUG | D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_OPTIMIZATION_LEVEL3;
-		ID3DBlob *shaderBlob = nullptr;
-		ID3DBlob *shaderErrors = nullptr;
-
-		if (FAILED(D3DCompileFromFile(FilePath, macros, D3D_COMPILE_STANDARD_FILE_INCLUDE, "main", "ps_5_0", flags, 0, &shaderBlob, &shaderErrors)))
-		{
-			AssertMsgVa(false, "Pixel shader compilation failed:\n\n%s", shaderErrors ? (const char *)shaderErrors->GetBufferPointer() : "Unknown error");
-
-			if (shaderBlob)
-				shaderBlob->Release();
-
-			if (shaderErrors)
-				shaderErrors->Release();
-
+			AssertMsgVa(false, "Pixel shader compilation failed:\n\n%s", !Compiled.Errors.empty() ? Compiled.Errors.c_str() : "Unknown error");
 			return nullptr;
 		}
 
-		if (shaderErrors)
-			shaderErrors->Release();
+		const void *bytecode = Compiled.Bytecode.data();
+		const size_t bytecodeLength = Compiled.Bytecode.size();
 
 		void *rawPtr = malloc(sizeof(PixelShader));
 		PixelShader *ps = new (rawPtr) PixelShader;
 
 		// Shader reflection: gather constant buffer variable offsets and check for valid sampler mappings
 		ID3D11ShaderReflection *reflector;
-		Assert(SUCCEEDED(D3DReflect(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), __uuidof(ID3D11ShaderReflection), (void **)&reflector)));
+		Assert(SUCCEEDED(D3DReflect(bytecode, bytecodeLength, __uuidof(ID3D11ShaderReflection), (void **)&reflector)));
 
 		ReflectConstantBuffers(reflector, ps->m_ConstantGroups, ARRAYSIZE(ps->m_ConstantGroups), GetConstant, ps->m_ConstantOffsets, ARRAYSIZE(ps->m_ConstantOffsets));
 		ReflectSamplers(reflector, GetSampler);
 
 		// Register shader with the DX runtime itself
-		Assert(SUCCEEDED(m_Device->CreatePixelShader(shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), nullptr, &ps->m_Shader)));
+		Assert(SUCCEEDED(m_Device->CreatePixelShader(bytecode, bytecodeLength, nullptr, &ps->m_Shader)));
 
-		RegisterShaderBytecode(ps->m_Shader, shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize());
+		RegisterShaderBytecode(ps->m_Shader, bytecode, bytecodeLength);
 		reflector->Release();
-		shaderBlob->Release();
 
 		return ps;
 	}
@@ -1314,10 +1612,22 @@ namespace BSGraphics
 	CustomConstantGroup Renderer::GetShaderConstantGroup(uint32_t Size, ConstantGroupLevel Level)
 	{
 		CustomConstantGroup temp;
-		temp.m_Buffer = MapConstantBuffer(&temp.m_Map.pData, &Size, &temp.m_UnifiedByteOffset, Level);
+		uint32_t lane = GetRingBufferLane();
+
+		if (MapStagedConstantBuffer(&temp.m_Map.pData, &Size, &temp.m_StagingSlot))
+		{
+			// Ring offset is assigned in FlushConstantGroup()
+			temp.m_Buffer = ShaderConstantBuffer->GetBuffer(lane);
+			temp.m_StagingLevel = Level;
+		}
+		else
+		{
+			temp.m_Buffer = MapConstantBuffer(&temp.m_Map.pData, &Size, &temp.m_UnifiedByteOffset, Level);
+		}
+
 		temp.m_Map.DepthPitch = Size;
 		temp.m_Map.RowPitch = Size;
-		temp.m_Unified = (temp.m_Buffer == ShaderConstantBuffer->D3DBuffer);
+		temp.m_Unified = (lane != InvalidRingBufferLane && temp.m_Buffer == ShaderConstantBuffer->GetBuffer(lane));
 
 		// DirectX expects you to overwrite the entire buffer. **SKYRIM DOES NOT**, so I'm zeroing it now.
 		memset(temp.m_Map.pData, 0, Size);
@@ -1390,8 +1700,15 @@ namespace BSGraphics
 	{
 		if (Group->m_Buffer)
 		{
-			if (!Group->m_Unified)
+			if (Group->m_StagingSlot != InvalidStagingSlot)
+			{
+				Group->m_UnifiedByteOffset = UploadStagedConstantBuffer(m_DeviceContext, Group->m_StagingSlot, Group->m_StagingLevel, Group->m_Map.RowPitch);
+				Group->m_StagingSlot = InvalidStagingSlot;
+			}
+			else if (!Group->m_Unified)
+			{
 				m_DeviceContext->Unmap(Group->m_Buffer, 0);
+			}
 
 			// Invalidate the data pointer only - ApplyConstantGroup still needs RowPitch info
 			Group->m_Map.pData = (void *)0xFEFEFEFEFEFEFEFE;
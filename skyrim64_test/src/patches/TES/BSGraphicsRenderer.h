@@ -9,6 +9,10 @@
 
 class BSTriShape;
 class BSDynamicTriShape;
+class ShaderCompileCache;
+struct PackedRenderState;
+struct ShaderCompileRequest;
+struct ShaderCompileResult;
 
 namespace BSGraphics::Utility
 {
@@ -32,6 +36,8 @@ namespace BSGraphics
 		static void OnNewFrame();
 
 		static void FlushThreadedVars();
+		static void OnExecuteCommandList();
+		static void SetRingBufferLane(uint32_t Lane);
 
 		//
 		// Debug
@@ -45,6 +51,7 @@ namespace BSGraphics
 		void DrawLineShape(LineShape *GraphicsLineShape, uint32_t StartIndex, uint32_t Count);
 
 		void DrawTriShape(TriShape *GraphicsTriShape, uint32_t StartIndex, uint32_t Count);
+		void DrawTriShapeInstanced(TriShape *GraphicsTriShape, uint32_t StartIndex, uint32_t Count, const InstanceData *Instances, uint32_t InstanceCount);
 
 		DynamicTriShape *GetParticlesDynamicTriShape();
 		void *MapDynamicTriShapeDynamicData(BSDynamicTriShape *Shape, DynamicTriShape *ShapeData, DynamicTriShapeDrawData *DrawData, uint32_t VertexSize);
@@ -59,6 +66,8 @@ namespace BSGraphics
 		//
 		static void SyncD3DState(bool Unknown);
 		static void SyncD3DResources();
+		PackedRenderState GetRenderStateKey() const;
+		static void InvalidateAppliedRenderState(uint64_t GroupMask);
 
 		void DepthStencilStateSetDepthMode(DepthStencilDepthMode Mode);
 		DepthStencilDepthMode DepthStencilStateGetDepthMode() const;
@@ -103,11 +112,15 @@ namespace BSGraphics
 		void ValidateShaderReplacement(ID3D11VertexShader *Original, ID3D11VertexShader *Replacement);
 		void ValidateShaderReplacement(ID3D11ComputeShader *Original, ID3D11ComputeShader *Replacement);
 		void ValidateShaderReplacement(void *Original, void *Replacement, const GUID& Guid);
-		void RegisterShaderBytecode(void *Shader, const void *Bytecode, size_t BytecodeLength);
-		const std::pair<void *, size_t>& GetShaderBytecode(void *Shader);
+		void RegisterShaderBytecode(ID3D11DeviceChild *Shader, const void *Bytecode, size_t BytecodeLength);
+		std::pair<void *, size_t> GetShaderBytecode(void *Shader);
 
 		VertexShader *CompileVertexShader(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, std::function<const char *(int Index)> GetConstant);
 		PixelShader *CompilePixelShader(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, std::function<const char *(int Index)> GetSampler, std::function<const char *(int Index)> GetConstant);
+		VertexShader *CreateVertexShader(const ShaderCompileResult& Compiled, std::function<const char *(int Index)> GetConstant);
+		PixelShader *CreatePixelShader(const ShaderCompileResult& Compiled, std::function<const char *(int Index)> GetSampler, std::function<const char *(int Index)> GetConstant);
+		static ShaderCompileCache *GetShaderCompileCache();
+		static ShaderCompileRequest GetShaderCompileRequest(const wchar_t *FilePath, const std::vector<std::pair<const char *, const char *>>& Defines, bool PixelShader);
 
 		//
 		// Shader constant buffers
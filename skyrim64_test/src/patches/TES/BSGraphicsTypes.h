@@ -6,6 +6,8 @@
 #define MAX_VS_CONSTANTS 20
 #define MAX_PS_CONSTANTS 64
 #define MAX_CS_CONSTANTS 32
+#define MAX_DRAW_INSTANCES 256
+#define INSTANCE_DATA_VS_SLOT 15
 
 namespace BSGraphics
 {
@@ -139,6 +141,8 @@ namespace BSGraphics
 		ID3D11Buffer *m_Buffer = nullptr;
 		bool m_Unified = false;				// True if buffer is from global ring buffer
 		uint32_t m_UnifiedByteOffset = 0;	// Offset into ring buffer
+		uint32_t m_StagingSlot = 0xFFFFFFFF;// CPU copy waiting for FlushConstantGroup(), see MapStagedConstantBuffer
+		uint32_t m_StagingLevel = 0;
 
 	public:
 		inline void *RawData() const
@@ -350,4 +354,18 @@ namespace BSGraphics
 	{
 		uint32_t m_Unknown;
 	};
+
+	//
+	// Per-instance data for DrawTriShapeInstanced(). Bound to the vertex shader as a
+	// StructuredBuffer at t15 (INSTANCE_DATA_VS_SLOT) and indexed by SV_InstanceID.
+	// Same layout as the World/PreviousWorld lighting constants.
+	//
+	struct InstanceData
+	{
+		float m_World[3][4];
+		float m_PreviousWorld[3][4];
+	};
+	static_assert(sizeof(InstanceData) == 0x60);
+	static_assert_offset(InstanceData, m_World, 0x0);
+	static_assert_offset(InstanceData, m_PreviousWorld, 0x30);
 }
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include "../../common.h"
+#include "BSShader/BSShaderProperty.h"
+#include "BSRenderPassSort.h"
+
+namespace BSRenderPassSort
+{
+	// Groups smaller than this are drawn in list order
+	const size_t MinSortCount = 4;
+
+	struct SortEntry
+	{
+		uint64_t Key;
+		BSRenderPass *Pass;
+	};
+
+	thread_local std::vector<SortEntry> Entries;
+	thread_local std::vector<SortEntry> Scratch;
+
+	uint64_t HashPointer(const void *Pointer)
+	{
+		// Heap pointers share their low bits, so mix before truncating
+		return ((uint64_t)Pointer * 0x9E3779B97F4A7C15ull) >> 32;
+	}
+
+	const BSShaderMaterial *GetMaterial(const BSRenderPass *Pass)
+	{
+		return Pass->m_Property ? Pass->m_Property->pMaterial : nullptr;
+	}
+
+	uint64_t MakeKey(const BSRenderPass *Pass)
+	{
+		const uint64_t technique = (HashPointer(Pass->m_Shader) ^ Pass->m_TechniqueID) & 0xFFFF;
+		const uint64_t material = HashPointer(GetMaterial(Pass)) & 0xFFFFFF;
+		const uint64_t geometry = HashPointer(Pass->m_Geometry ? Pass->m_Geometry->QRendererData() : nullptr) & 0xFFFFFF;
+
+		return (technique << 48) | (material << 24) | geometry;
+	}
+
+	void RadixSort(std::vector<SortEntry>& Data, std::vector<SortEntry>& Temp)
+	{
+		Temp.resize(Data.size());
+
+		SortEntry *source = Data.data();
+		SortEntry *dest = Temp.data();
+
+		for (uint32_t shift = 0; shift < 64; shift += 8)
+		{
+			size_t counts[256] = {};
+
+			for (size_t i = 0; i < Data.size(); i++)
+				counts[(source[i].Key >> shift) & 0xFF]++;
+
+			// Every key has the same byte here - nothing to reorder
+			if (counts[(source[0].Key >> shift) & 0xFF] == Data.size())
+				continue;
+
+			size_t offset = 0;
+
+			for (size_t& count : counts)
+			{
+				size_t c = count;
+				count = offset;
+				offset += c;
+			}
+
+			for (size_t i = 0; i < Data.size(); i++)
+				dest[counts[(source[i].Key >> shift) & 0xFF]++] = source[i];
+
+			std::swap(source, dest);
+		}
+
+		if (source != Data.data())
+			memcpy(Data.data(), source, Data.size() * sizeof(SortEntry));
+	}
+
+#if SKYRIM64_USE_PROFILER
+	void CountSwitches(const std::vector<SortEntry>& Data, uint64_t& TechniqueSwitches, uint64_t& MaterialSwitches)
+	{
+		TechniqueSwitches = 0;
+		MaterialSwitches = 0;
+
+		for (size_t i = 1; i < Data.size(); i++)
+		{
+			const BSRenderPass *prev = Data[i - 1].Pass;
+			const BSRenderPass *curr = Data[i].Pass;
+
+			if (prev->m_Shader != curr->m_Shader || prev->m_TechniqueID != curr->m_TechniqueID)
+				TechniqueSwitches++;
+
+			if (GetMaterial(prev) != GetMaterial(curr))
+				MaterialSwitches++;
+		}
+	}
+#endif
+
+	void Build(BSRenderPass *Head, std::vector<BSRenderPass *>& Output, bool Sort)
+	{
+		Output.clear();
+
+		if (!Sort)
+		{
+			for (BSRenderPass *pass = Head; pass; pass = pass->m_Next)
+				Output.push_back(pass);
+
+			return;
+		}
+
+		Entries.clear();
+
+		for (BSRenderPass *pass = Head; pass; pass = pass->m_Next)
+			Entries.push_back({ MakeKey(pass), pass });
+
+		if (Entries.size() >= MinSortCount)
+		{
+#if SKYRIM64_USE_PROFILER
+			uint64_t techniqueBefore;
+			uint64_t materialBefore;
+			uint64_t techniqueAfter;
+			uint64_t materialAfter;
+
+			CountSwitches(Entries, techniqueBefore, materialBefore);
+			RadixSort(Entries, Scratch);
+			CountSwitches(Entries, techniqueAfter, materialAfter);
+
+			ProfileCounterAdd("RenderPass Sorted", Entries.size());
+			ProfileCounterAdd("RenderPass Technique Switches Avoided", techniqueBefore - std::min(techniqueBefore, techniqueAfter));
+			ProfileCounterAdd("RenderPass Material Switches Avoided", materialBefore - std::min(materialBefore, materialAfter));
+#else
+			RadixSort(Entries, Scratch);
+#endif
+		}
+
+		for (const SortEntry& entry : Entries)
+			Output.push_back(entry.Pass);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+#include "BSRenderPass.h"
+
+//
+// Optional reordering of a BSBatchRenderer pass group before submission. Each pass gets a 64-bit key
+//
+//   [63:48] shader + technique   [47:24] material   [23:0] geometry renderer data (vertex buffer)
+//
+// and the group is LSD radix sorted on it, so SetupAndDrawPass() sees runs of identical technique
+// and material pointers instead of whatever order the passes were registered in. The sort is
+// stable, so equal keys keep their original order. Only hashes go into the key; a collision costs
+// a redundant state change, never a wrong one.
+//
+// The linked list itself is left untouched. Callers draw from the returned array.
+//
+namespace BSRenderPassSort
+{
+	uint64_t MakeKey(const BSRenderPass *Pass);
+	void Build(BSRenderPass *Head, std::vector<BSRenderPass *>& Output, bool Sort);
+}
\ No newline at end of file
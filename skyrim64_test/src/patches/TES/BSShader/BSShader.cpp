@@ -1,17 +1,38 @@
 #include "../../../common.h"
+#include <thread>
 #include "../MemoryContextTracker.h"
 #include "../BSGraphicsRenderer.h"
+#include "../../rendering/ShaderCompileCache.h"
 #include "BSShaderManager.h"
 #include "BSShader.h"
 #include "BSShader_Dumper.h"
 #include "Shaders/BSBloodSplatterShader.h"
 #include "Shaders/BSDistantTreeShader.h"
 #include "Shaders/BSGrassShader.h"
+#include "Shaders/BSLightingShader.h"
 #include "Shaders/BSSkyShader.h"
 
 bool BSShader::g_ShaderToggles[16][3];
 const ShaderDescriptor *BSShader::ShaderMetadata[BSShaderManager::BSSM_SHADER_COUNT];
 
+//
+// While hk_Load() runs CreateAllShaders(), CreateVertexShader()/CreatePixelShader() only queue their
+// compile request. The queue is compiled (or loaded from the bytecode cache) across all cores and the
+// D3D objects are then created in the original order on the loading thread.
+//
+struct PendingShaderCreate
+{
+	bool PixelShader;
+	uint32_t Technique;
+	std::string SourceFile;
+	std::function<const char *(int Index)> GetSampler;
+	std::function<const char *(int Index)> GetConstant;
+};
+
+bool BatchShaderCreation;
+std::vector<PendingShaderCreate> PendingShaderCreates;
+std::vector<ShaderCompileRequest> PendingShaderRequests;
+
 BSShader::BSShader(const char *LoaderType)
 {
 	m_LoaderType = LoaderType;
@@ -85,58 +106,99 @@ void BSShader::CreateVertexShader(uint32_t Technique, const char *SourceFile, co
 	wchar_t fxpPath[MAX_PATH];
 	swprintf_s(fxpPath, L"C:\\myshaders\\%S.hlsl", SourceFile);
 
-	BSGraphics::VertexShader *vertexShader = BSGraphics::Renderer::GetGlobals()->CompileVertexShader(fxpPath, Defines, GetConstant);
+	if (BatchShaderCreation)
+	{
+		PendingShaderCreates.push_back({ false, Technique, SourceFile, nullptr, GetConstant });
+		PendingShaderRequests.push_back(BSGraphics::Renderer::GetShaderCompileRequest(fxpPath, Defines, false));
+		return;
+	}
+
+	ReplaceVertexShader(Technique, SourceFile, BSGraphics::Renderer::GetGlobals()->CompileVertexShader(fxpPath, Defines, GetConstant));
+}
+
+void BSShader::CreatePixelShader(uint32_t Technique, const char *SourceFile, const std::vector<std::pair<const char *, const char *>>& Defines, std::function<const char *(int Index)> GetSampler, std::function<const char *(int Index)> GetConstant)
+{
+	// Build source disk path, hand off to D3D11
+	wchar_t fxpPath[MAX_PATH];
+	swprintf_s(fxpPath, L"C:\\myshaders\\%S.hlsl", SourceFile);
+
+	if (BatchShaderCreation)
+	{
+		PendingShaderCreates.push_back({ true, Technique, SourceFile, GetSampler, GetConstant });
+		PendingShaderRequests.push_back(BSGraphics::Renderer::GetShaderCompileRequest(fxpPath, Defines, true));
+		return;
+	}
+
+	ReplacePixelShader(Technique, SourceFile, BSGraphics::Renderer::GetGlobals()->CompilePixelShader(fxpPath, Defines, GetSampler, GetConstant));
+}
 
+void BSShader::CreatePendingShaders()
+{
+	auto renderer = BSGraphics::Renderer::GetGlobals();
+	std::vector<ShaderCompileResult> results;
+
+	BSGraphics::Renderer::GetShaderCompileCache()->CompileBatch(PendingShaderRequests, results, std::thread::hardware_concurrency());
+
+	for (size_t i = 0; i < PendingShaderCreates.size(); i++)
+	{
+		auto& pending = PendingShaderCreates[i];
+
+		if (pending.PixelShader)
+			ReplacePixelShader(pending.Technique, pending.SourceFile.c_str(), renderer->CreatePixelShader(results[i], pending.GetSampler, pending.GetConstant));
+		else
+			ReplaceVertexShader(pending.Technique, pending.SourceFile.c_str(), renderer->CreateVertexShader(results[i], pending.GetConstant));
+	}
+
+	PendingShaderCreates.clear();
+	PendingShaderRequests.clear();
+}
+
+void BSShader::ReplaceVertexShader(uint32_t Technique, const char *SourceFile, BSGraphics::VertexShader *Shader)
+{
 	auto e = m_VertexShaderTable.find(Technique);
 
 	Assert(e != m_VertexShaderTable.end());
 
 	if (!strstr(SourceFile, "DistantTree"))
 	{
-		BSGraphics::Renderer::GetGlobals()->ValidateShaderReplacement(e->m_Shader, vertexShader->m_Shader);
+		BSGraphics::Renderer::GetGlobals()->ValidateShaderReplacement(e->m_Shader, Shader->m_Shader);
 
 		for (int i = 0; i < 20; i++)
 		{
-			if (vertexShader->m_ConstantOffsets[i] == BSGraphics::INVALID_CONSTANT_BUFFER_OFFSET)
+			if (Shader->m_ConstantOffsets[i] == BSGraphics::INVALID_CONSTANT_BUFFER_OFFSET)
 				continue;
 
-			//if (vertexShader->m_ConstantOffsets[i] != e->m_ConstantOffsets[i])
+			//if (Shader->m_ConstantOffsets[i] != e->m_ConstantOffsets[i])
 			//	Assert(false);
 		}
 	}
 
-	vertexShader->m_TechniqueID = e->m_TechniqueID;
-	vertexShader->m_VertexDescription = e->m_VertexDescription;
-	e.temphack(vertexShader);
+	Shader->m_TechniqueID = e->m_TechniqueID;
+	Shader->m_VertexDescription = e->m_VertexDescription;
+	e.temphack(Shader);
 }
 
-void BSShader::CreatePixelShader(uint32_t Technique, const char *SourceFile, const std::vector<std::pair<const char *, const char *>>& Defines, std::function<const char *(int Index)> GetSampler, std::function<const char *(int Index)> GetConstant)
+void BSShader::ReplacePixelShader(uint32_t Technique, const char *SourceFile, BSGraphics::PixelShader *Shader)
 {
-	// Build source disk path, hand off to D3D11
-	wchar_t fxpPath[MAX_PATH];
-	swprintf_s(fxpPath, L"C:\\myshaders\\%S.hlsl", SourceFile);
-
-	BSGraphics::PixelShader *pixelShader = BSGraphics::Renderer::GetGlobals()->CompilePixelShader(fxpPath, Defines, GetSampler, GetConstant);
-
 	auto e = m_PixelShaderTable.find(Technique);
 
 	Assert(e != m_PixelShaderTable.end());
 
 	if (!strstr(SourceFile, "DistantTree"))
 	{
-		BSGraphics::Renderer::GetGlobals()->ValidateShaderReplacement(e->m_Shader, pixelShader->m_Shader);
+		BSGraphics::Renderer::GetGlobals()->ValidateShaderReplacement(e->m_Shader, Shader->m_Shader);
 
 		for (int i = 0; i < 64; i++)
 		{
-			if (pixelShader->m_ConstantOffsets[i] == BSGraphics::INVALID_CONSTANT_BUFFER_OFFSET)
+			if (Shader->m_ConstantOffsets[i] == BSGraphics::INVALID_CONSTANT_BUFFER_OFFSET)
 				continue;
 
-			Assert(pixelShader->m_ConstantOffsets[i] == e->m_ConstantOffsets[i]);
+			Assert(Shader->m_ConstantOffsets[i] == e->m_ConstantOffsets[i]);
 		}
 	}
 
-	pixelShader->m_TechniqueID = e->m_TechniqueID;
-	e.temphack(pixelShader);
+	Shader->m_TechniqueID = e->m_TechniqueID;
+	e.temphack(Shader);
 }
 
 void BSShader::hk_Load(BSIStream *Stream)
@@ -164,6 +226,8 @@ void BSShader::hk_Load(BSIStream *Stream)
 	}
 
 	// ...and then replace with custom ones
+	BatchShaderCreation = true;
+
 	if (this == BSBloodSplatterShader::pInstance)
 		BSBloodSplatterShader::pInstance->CreateAllShaders();
 
@@ -175,6 +239,13 @@ void BSShader::hk_Load(BSIStream *Stream)
 
 	if (this == BSSkyShader::pInstance)
 		BSSkyShader::pInstance->CreateAllShaders();
+
+	BatchShaderCreation = false;
+	CreatePendingShaders();
+
+	// Compiled up front so a draw never waits on the compiler
+	if (this == BSLightingShader::pInstance)
+		BSLightingShader::CreateInstancedVertexShaders();
 }
 
 bool BSShader::BeginTechnique(uint32_t VertexShaderID, uint32_t PixelShaderID, bool IgnorePixelShader)
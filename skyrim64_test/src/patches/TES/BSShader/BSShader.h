@@ -176,6 +176,10 @@ public:
 		std::function<const char *(int Index)> GetSampler,
 		std::function<const char *(int Index)> GetConstant);
 
+	void CreatePendingShaders();
+	void ReplaceVertexShader(uint32_t Technique, const char *SourceFile, BSGraphics::VertexShader *Shader);
+	void ReplacePixelShader(uint32_t Technique, const char *SourceFile, BSGraphics::PixelShader *Shader);
+
 	void hk_Load(struct BSIStream *Stream);
 
 	bool BeginTechnique(uint32_t VertexShaderID, uint32_t PixelShaderID, bool IgnorePixelShader);
@@ -1,5 +1,8 @@
 #include "../../../rendering/common.h"
 #include "../../../../common.h"
+#include <d3dcompiler.h>
+#include <thread>
+#include "../../../rendering/ShaderCompileCache.h"
 #include "../../NiMain/NiSourceTexture.h"
 #include "../../TES.h"
 #include "../../BSGraphicsState.h"
@@ -88,6 +91,8 @@ DEFINE_SHADER_DESCRIPTOR(
 // - A lock is held in GeometrySetupMTLandExtraConstants()
 // - "Bones" and "IndexScale" vertex constants are not used in the game (undefined types)
 // - AmbientSpecularTintAndFresnelPower has a bug where it's set in SetupMaterial() rather than SetupGeometry()
+// - Automatic instancing only swaps the vertex shader. Every per-geometry pixel constant has to be identical
+//   across the instances, so lights (model space), alpha, emit color and depth state are compared per pass.
 //
 using namespace DirectX;
 using namespace BSGraphics;
@@ -144,6 +149,9 @@ thread_local uint32_t TLS_m_CurrentRawTechnique;
 thread_local DepthStencilDepthMode TLS_dword_141E35280;
 thread_local uint32_t TLS_dword_141E3527C;
 
+SRWLOCK InstancedShaderLock = SRWLOCK_INIT;
+std::unordered_map<uint32_t, BSGraphics::VertexShader *> InstancedVertexShaders;// Vertex technique -> AUTO_INSTANCED variant (missing if unavailable)
+
 char hookbuffer[50];
 
 void TestHook5()
@@ -1106,6 +1114,278 @@ uint32_t BSLightingShader::GetPixelTechnique(uint32_t RawTechnique)
 	return flags | RAW_FLAG_VC;
 }
 
+bool BSLightingShader::IsInstancingCompatible(uint32_t Technique)
+{
+	return IsRawInstancingCompatible(GetRawTechnique(Technique));
+}
+
+bool BSLightingShader::IsRawInstancingCompatible(uint32_t RawTechnique)
+{
+	switch ((RawTechnique >> 24) & 0x3F)
+	{
+	case RAW_TECHNIQUE_NONE:
+	case RAW_TECHNIQUE_GLOWMAP:
+	case RAW_TECHNIQUE_PARALLAX:
+	case RAW_TECHNIQUE_PARALLAXOCC:
+		break;
+
+	default:
+		// Everything else writes per-geometry data other than World/PreviousWorld (eye position,
+		// tree/land params, or non-world-space lighting)
+		return false;
+	}
+
+	// Point light positions are transformed into each object's model space
+	if (((RawTechnique >> 3) & 0b111) != 0)
+		return false;
+
+	// Eye position, texture projection and bone matrices are per-object
+	if (RawTechnique & (
+		RAW_FLAG_SKINNED |
+		RAW_FLAG_SPECULAR |
+		RAW_FLAG_SOFT_LIGHTING |
+		RAW_FLAG_RIM_LIGHTING |
+		RAW_FLAG_BACK_LIGHTING |
+		RAW_FLAG_AMBIENT_SPECULAR |
+		RAW_FLAG_PROJECTED_UV |
+		RAW_FLAG_WORLD_MAP))
+		return false;
+
+	return true;
+}
+
+bool BSLightingShader::CanShareInstancedDraw(const BSRenderPass *First, const BSRenderPass *Other)
+{
+	auto firstProperty = static_cast<const BSLightingShaderProperty *>(First->m_Property);
+	auto otherProperty = static_cast<const BSLightingShaderProperty *>(Other->m_Property);
+
+	if (!firstProperty || !otherProperty)
+		return false;
+
+	// Fade node alpha (SingleLevel) and stencil reference (Byte1C 10) come from the object
+	if (Other->m_Lod.SingleLevel || Other->Byte1C == 10 || Other->Byte1C != First->Byte1C)
+		return false;
+
+	if (Other->QAlphaProperty() != First->QAlphaProperty())
+		return false;
+
+	// PS: MaterialData, EmitColor. Depth state comes from the flags.
+	if (otherProperty->ulFlags != firstProperty->ulFlags ||
+		otherProperty->GetAlpha() != firstProperty->GetAlpha() ||
+		otherProperty->fEmitColorScale != firstProperty->fEmitColorScale ||
+		memcmp(otherProperty->pEmitColor, firstProperty->pEmitColor, sizeof(NiColor)) != 0)
+		return false;
+
+	if (Other->m_LightCount != First->m_LightCount ||
+		memcmp(Other->m_SceneLights, First->m_SceneLights, First->m_LightCount * sizeof(BSLight *)) != 0)
+		return false;
+
+	// Directional and ambient lights are rotated into model space. Translation is the only thing allowed to differ.
+	const NiTransform& firstWorld = First->m_Geometry->GetWorldTransform();
+	const NiTransform& otherWorld = Other->m_Geometry->GetWorldTransform();
+
+	return otherWorld.m_fScale == firstWorld.m_fScale && memcmp(&otherWorld.m_Rotate, &firstWorld.m_Rotate, sizeof(NiMatrix3)) == 0;
+}
+
+void BSLightingShader::GetInstanceData(const BSRenderPass *Pass, uint32_t RenderFlags, BSGraphics::InstanceData& Data)
+{
+	// Must match what SetupGeometry() writes through GeometrySetupViewProjection()
+	auto *renderer = Renderer::GetGlobals();
+
+	const NiTransform& world = Pass->m_Geometry->GetWorldTransform();
+	const NiTransform& previousWorld = (RenderFlags & 0x10) ? world : Pass->m_Geometry->GetPreviousWorldTransform();
+
+	BSShaderUtil::TransposeStoreMatrix3x4(&Data.m_World[0][0], BSShaderUtil::GetXMFromNi(world));
+	BSShaderUtil::TransposeStoreMatrix3x4(&Data.m_PreviousWorld[0][0], BSShaderUtil::GetXMFromNiPosAdjust(previousWorld, renderer->m_PreviousPosAdjust));
+}
+
+bool BSLightingShader::IsInstancedVertexShaderUsable(const BSGraphics::VertexShader *Shader, const BSGraphics::VertexShader *Original)
+{
+	// A source file without the AUTO_INSTANCED path still compiles, but every instance would be drawn with the
+	// first pass's World constants. The variant has to actually read the instance buffer.
+	ID3D11ShaderReflection *reflector;
+	Assert(SUCCEEDED(D3DReflect(Shader->m_RawBytecode, Shader->m_ShaderLength, __uuidof(ID3D11ShaderReflection), (void **)&reflector)));
+
+	D3D11_SHADER_INPUT_BIND_DESC desc;
+	bool bindsInstances = SUCCEEDED(reflector->GetResourceBindingDescByName("Instances", &desc)) &&
+		desc.Type == D3D_SIT_STRUCTURED &&
+		desc.BindPoint == INSTANCE_DATA_VS_SLOT &&
+		desc.BindCount == 1;
+
+	reflector->Release();
+
+	if (!bindsInstances)
+	{
+		ui::log::Add("Instanced vertex shader for technique 0x%X doesn't read t%d, drawing it without instancing\n", Original->m_TechniqueID, INSTANCE_DATA_VS_SLOT);
+		return false;
+	}
+
+	// Constant groups are filled with the offsets of whichever shader is bound. Everything the variant
+	// still reads has to be at the original location or SetupTechnique/SetupMaterial data is misplaced.
+	for (int i = 0; i < MAX_VS_CONSTANTS; i++)
+	{
+		if (Shader->m_ConstantOffsets[i] == INVALID_CONSTANT_BUFFER_OFFSET)
+			continue;
+
+		if (Shader->m_ConstantOffsets[i] != Original->m_ConstantOffsets[i])
+		{
+			ui::log::Add("Instanced vertex shader constant %d doesn't match the original layout, drawing technique 0x%X without instancing\n", i, Original->m_TechniqueID);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool BSLightingShader::IsInstancedVertexShaderLinkable(const BSGraphics::VertexShader *Shader, const BSGraphics::PixelShader *Pixel)
+{
+	// Every pixel shader input has to be written by the variant, in the same register and component type
+	auto pixelBytecode = Renderer::GetGlobals()->GetShaderBytecode(Pixel->m_Shader);
+
+	ID3D11ShaderReflection *vertexReflector;
+	ID3D11ShaderReflection *pixelReflector;
+	Assert(SUCCEEDED(D3DReflect(Shader->m_RawBytecode, Shader->m_ShaderLength, __uuidof(ID3D11ShaderReflection), (void **)&vertexReflector)));
+	Assert(SUCCEEDED(D3DReflect(pixelBytecode.first, pixelBytecode.second, __uuidof(ID3D11ShaderReflection), (void **)&pixelReflector)));
+
+	D3D11_SHADER_DESC vertexDesc;
+	D3D11_SHADER_DESC pixelDesc;
+	vertexReflector->GetDesc(&vertexDesc);
+	pixelReflector->GetDesc(&pixelDesc);
+
+	bool linkable = true;
+
+	for (UINT i = 0; i < pixelDesc.InputParameters && linkable; i++)
+	{
+		D3D11_SIGNATURE_PARAMETER_DESC input;
+		pixelReflector->GetInputParameterDesc(i, &input);
+
+		// Generated by the rasterizer, not the vertex shader
+		if (input.SystemValueType == D3D_NAME_IS_FRONT_FACE || input.SystemValueType == D3D_NAME_SAMPLE_INDEX ||
+			input.SystemValueType == D3D_NAME_PRIMITIVE_ID || input.SystemValueType == D3D_NAME_COVERAGE)
+			continue;
+
+		linkable = false;
+
+		for (UINT j = 0; j < vertexDesc.OutputParameters; j++)
+		{
+			D3D11_SIGNATURE_PARAMETER_DESC output;
+			vertexReflector->GetOutputParameterDesc(j, &output);
+
+			if (_stricmp(output.SemanticName, input.SemanticName) == 0 &&
+				output.SemanticIndex == input.SemanticIndex &&
+				output.Register == input.Register &&
+				output.ComponentType == input.ComponentType &&
+				(input.Mask & ~output.Mask) == 0)
+			{
+				linkable = true;
+				break;
+			}
+		}
+
+		if (!linkable)
+			ui::log::Add("Instanced vertex shader for technique 0x%X doesn't write %s%u for pixel technique 0x%X, drawing it without instancing\n",
+				Shader->m_TechniqueID, input.SemanticName, input.SemanticIndex, Pixel->m_TechniqueID);
+	}
+
+	pixelReflector->Release();
+	vertexReflector->Release();
+
+	return linkable;
+}
+
+BSGraphics::VertexShader *BSLightingShader::GetInstancedVertexShader(const BSGraphics::VertexShader *Original)
+{
+	// Built by CreateInstancedVertexShaders() while loading, never at draw time
+	BSGraphics::VertexShader *shader = nullptr;
+
+	AcquireSRWLockShared(&InstancedShaderLock);
+	{
+		if (auto itr = InstancedVertexShaders.find(Original->m_TechniqueID); itr != InstancedVertexShaders.end())
+			shader = itr->second;
+	}
+	ReleaseSRWLockShared(&InstancedShaderLock);
+
+	return shader;
+}
+
+void BSLightingShader::CreateInstancedVertexShaders()
+{
+	// There's no instancing variant in the game data. It's only available with a replacement source file.
+	const wchar_t *sourcePath = L"C:\\myshaders\\Lighting.hlsl";
+
+	std::vector<BSGraphics::VertexShader *> originals;
+	std::vector<ShaderCompileRequest> requests;
+	std::vector<ShaderCompileResult> results;
+	std::unordered_map<uint32_t, BSGraphics::VertexShader *> created;
+
+	if (GetFileAttributesW(sourcePath) != INVALID_FILE_ATTRIBUTES)
+	{
+		for (auto itr = pInstance->m_VertexShaderTable.begin(); itr != pInstance->m_VertexShaderTable.end(); itr++)
+		{
+			// Vertex techniques carry every flag IsRawInstancingCompatible() looks at except the light count
+			if (!IsRawInstancingCompatible((*itr)->m_TechniqueID))
+				continue;
+
+			auto defines = BSShaderInfo::BSLightingShader::Defines::GetArray((*itr)->m_TechniqueID);
+			defines.emplace_back("AUTO_INSTANCED", "");
+
+			originals.push_back(*itr);
+			requests.push_back(Renderer::GetShaderCompileRequest(sourcePath, defines, false));
+		}
+
+		// Same worker pool and bytecode cache as the replacement shaders
+		Renderer::GetShaderCompileCache()->CompileBatch(requests, results, std::thread::hardware_concurrency());
+	}
+
+	auto getConstant = [](int i) { return ShaderConfigLighting.ByConstantIndexVS.count(i) ? ShaderConfigLighting.ByConstantIndexVS.at(i)->Name : nullptr; };
+
+	for (size_t i = 0; i < originals.size(); i++)
+	{
+		const BSGraphics::VertexShader *original = originals[i];
+
+		if (!results[i].Success)
+		{
+			ui::log::Add("Instanced vertex shader for technique 0x%X failed to compile, drawing it without instancing:\n%s\n", original->m_TechniqueID, results[i].Errors.c_str());
+			continue;
+		}
+
+		BSGraphics::VertexShader *shader = Renderer::GetGlobals()->CreateVertexShader(results[i], getConstant);
+
+		shader->m_TechniqueID = original->m_TechniqueID;
+		shader->m_VertexDescription = original->m_VertexDescription;
+
+		bool usable = IsInstancedVertexShaderUsable(shader, original);
+
+		// Pixel techniques keep the vertex technique's bits, plus vertex colors (see GetPixelTechnique)
+		for (auto itr = pInstance->m_PixelShaderTable.begin(); usable && itr != pInstance->m_PixelShaderTable.end(); itr++)
+		{
+			if ((GetVertexTechnique((*itr)->m_TechniqueID) | RAW_FLAG_VC) == (original->m_TechniqueID | RAW_FLAG_VC))
+				usable = IsInstancedVertexShaderLinkable(shader, *itr);
+		}
+
+		if (!usable)
+		{
+			// Keep drawing this technique one pass at a time. Destroying the D3D object also drops its bytecode reference.
+			shader->m_Shader->Release();
+			free(shader);
+			continue;
+		}
+
+		created.emplace(original->m_TechniqueID, shader);
+	}
+
+	AcquireSRWLockExclusive(&InstancedShaderLock);
+	InstancedVertexShaders.swap(created);
+	ReleaseSRWLockExclusive(&InstancedShaderLock);
+
+	// Previous load's variants (shaders are reloaded between frames, nothing is drawing with them)
+	for (auto& [technique, shader] : created)
+	{
+		shader->m_Shader->Release();
+		free(shader);
+	}
+}
+
 void BSLightingShader::TechUpdateHighDetailRangeConstants(BSGraphics::ConstantGroup<BSGraphics::VertexShader>& VertexCG)
 {
 	auto *renderer = BSGraphics::Renderer::GetGlobals();
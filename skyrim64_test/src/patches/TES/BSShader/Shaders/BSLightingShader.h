@@ -86,7 +86,17 @@ public:
 	static uint32_t GetVertexTechnique(uint32_t RawTechnique);
 	static uint32_t GetPixelTechnique(uint32_t RawTechnique);
 
+	static bool IsInstancingCompatible(uint32_t Technique);
+	static bool CanShareInstancedDraw(const BSRenderPass *First, const BSRenderPass *Other);
+	static void GetInstanceData(const BSRenderPass *Pass, uint32_t RenderFlags, BSGraphics::InstanceData& Data);
+	static BSGraphics::VertexShader *GetInstancedVertexShader(const BSGraphics::VertexShader *Original);
+	static void CreateInstancedVertexShaders();
+
 private:
+	static bool IsRawInstancingCompatible(uint32_t RawTechnique);
+	static bool IsInstancedVertexShaderUsable(const BSGraphics::VertexShader *Shader, const BSGraphics::VertexShader *Original);
+	static bool IsInstancedVertexShaderLinkable(const BSGraphics::VertexShader *Shader, const BSGraphics::PixelShader *Pixel);
+
 	static void TechUpdateHighDetailRangeConstants(BSGraphics::ConstantGroup<BSGraphics::VertexShader>& VertexCG);
 	static void TechUpdateFogConstants(BSGraphics::ConstantGroup<BSGraphics::VertexShader>& VertexCG, BSGraphics::ConstantGroup<BSGraphics::PixelShader>& PixelCG);
 
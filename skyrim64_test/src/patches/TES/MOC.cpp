@@ -15,10 +15,10 @@
 using namespace DirectX;
 
 #include "MOC_ThreadedMerger.h"
+#include "MOC_GeometryCache.h"
+#include "MOC_OcclusionView.h"
 #include <meshoptimizer/src/meshoptimizer.h>
-
-const int MOC_WIDTH = 1280;
-const int MOC_HEIGHT = 720;
+#include <thread>
 
 extern ID3D11Texture2D *g_OcclusionTexture;
 extern ID3D11ShaderResourceView *g_OcclusionTextureSRV;
@@ -28,15 +28,65 @@ namespace MOC
 	AutoPtr(NiNode *, WorldScenegraph, 0x2F4CE30);
 
 	MOC_ThreadedMerger *ThreadedMOC;
+	SRWLOCK ThreadedMOCLock = SRWLOCK_INIT;		// Held shared by readers outside the main thread while it gets replaced
+
+	struct ResolutionTier
+	{
+		uint32_t Width;
+		uint32_t Height;
+	};
 
-	struct IndexPair
+	// Every entry must be a multiple of the MOC sub-tile size (8x4)
+	const ResolutionTier ResolutionTiers[] =
 	{
-		uint32_t *Data;
-		uint32_t Count;
+		{ 640, 360 },
+		{ 960, 540 },
+		{ 1280, 720 },
+		{ 1600, 900 },
+		{ 1920, 1080 },
 	};
 
-	std::unordered_map<void *, float *> m_VertMap;
-	std::unordered_map<void *, IndexPair> m_IndexMap;
+	const uint32_t DefaultResolutionTier = 2;
+	const uint32_t AdaptiveWindowFrames = 60;
+	const uint32_t AdaptiveSampleInterval = 16;	// Time one occludee test/occluder render out of this many
+
+	AdaptiveStatus Adaptive;
+	uint32_t AdaptiveTier = DefaultResolutionTier;
+	uint32_t AdaptiveFrameCount = 0;
+	uint32_t AdaptiveCooldown = 0;
+	float AdaptiveCulledBeforeRaise = -1.0f;	// Culled % before the last efficiency-driven resolution increase
+	uint32_t AdaptiveRaiseBlocked = 0;			// Windows left before another efficiency-driven increase is allowed
+
+	// Decided in UpdateAdaptiveSettings(), applied on the next frame boundary
+	bool AdaptivePending = false;
+	uint32_t AdaptivePendingTier;
+	uint32_t AdaptivePendingThreadCount;
+	const char *AdaptivePendingReason;
+
+	// Per-window measurements (QPC ticks)
+	std::atomic<int64_t> AdaptiveWaitTicks;
+	std::atomic<int64_t> AdaptiveTestTicks;
+	std::atomic<int64_t> AdaptiveRasterTicks;
+	std::atomic_uint32_t AdaptiveTestedCount;
+	std::atomic_uint32_t AdaptivePassedCount;
+
+	__forceinline int64_t GetTicks()
+	{
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+
+		return counter.QuadPart;
+	}
+
+	// Per-thread so workers don't share a counter. A sampled call's time is scaled by the interval.
+	__forceinline bool ShouldSampleTicks()
+	{
+		thread_local uint32_t counter;
+
+		return (counter++ % AdaptiveSampleInterval) == 0;
+	}
+
+	MOC_GeometryCache GeometryCache;
 
 	uint32_t *ConvertIndices(const void *Input, uint32_t Count, uint32_t MaxVertexCount)
 	{
@@ -76,117 +126,102 @@ namespace MOC
 		return base;
 	}
 
-	SRWLOCK vertLock = SRWLOCK_INIT;
-	void GetCachedVerticesAndIndices(BSGeometry *Geometry, IndexPair *Indices, float **Vertices)
+	void CalculateHalfExtents(const float *Vertices, uint32_t Count, float *HalfExtents)
 	{
-		void *dataPtr;
-
-		const void *indexData;
-		uint32_t indexCount;
-
-		const void *vertexData;
-		uint32_t vertexCount;
-		uint32_t vertexStride;
-
-		AcquireSRWLockExclusive(&vertLock);
+		// Input is the converted XY1Z layout
+		float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
 
-		if (Geometry->QType() == GEOMETRY_TYPE_TRISHAPE)
+		for (uint32_t i = 0; i < Count; i++)
 		{
-			auto triShape = static_cast<BSTriShape *>(Geometry);
-			auto rendererData = reinterpret_cast<BSGraphics::TriShape *>(triShape->QRendererData());
-			dataPtr = rendererData;
-
-			auto itrI = m_IndexMap.find(rendererData);
-			auto itrV = m_VertMap.find(rendererData);
+			const float *v = &Vertices[i * 4];
+			const float xyz[3] = { v[0], v[1], v[3] };
 
-			if (itrI != m_IndexMap.end())
-				*Indices = itrI->second;
-			else
-				Indices->Data = nullptr;
-
-			if (itrV != m_VertMap.end())
-				*Vertices = itrV->second;
-			else
-				*Vertices = nullptr;
+			for (int j = 0; j < 3; j++)
+			{
+				minimum[j] = std::min(minimum[j], xyz[j]);
+				maximum[j] = std::max(maximum[j], xyz[j]);
+			}
+		}
 
-			indexData = rendererData->m_RawIndexData;
-			indexCount = triShape->m_TriangleCount * 3;
+		for (int j = 0; j < 3; j++)
+			HalfExtents[j] = (Count > 0) ? (maximum[j] - minimum[j]) * 0.5f : 0.0f;
+	}
 
-			vertexData = rendererData->m_RawVertexData;
-			vertexCount = triShape->m_VertexCount;
-			vertexStride = BSGeometry::CalculateVertexSize(rendererData->m_VertexDesc);
-		}
-		else if (Geometry->QType() == GEOMETRY_TYPE_DYNAMIC_TRISHAPE)
+	// Returned entry must be handed back with GeometryCache.Release()
+	MOC_GeometryCache::Entry *GetCachedVerticesAndIndices(BSGeometry *Geometry)
+	{
+		if (Geometry->QType() == GEOMETRY_TYPE_DYNAMIC_TRISHAPE)
 		{
 			AssertMsg(false, "BSGraphics::DynamicTriShape -> indices are always a nullptr");
 		}
-		else
+		else if (Geometry->QType() != GEOMETRY_TYPE_TRISHAPE)
 		{
 			Assert(false);
 		}
 
-		// If one wasn't found, it needs conversion
-		if (!Indices->Data)
-		{
-			IndexPair p;
-			p.Data = ConvertIndices(indexData, indexCount, vertexCount);
-			p.Count = indexCount;
-
-			if (indexCount > 300)
-				p.Count = meshopt_simplify(p.Data, p.Data, indexCount, (const float *)vertexData, vertexCount, vertexStride, (size_t)(indexCount * .50f), 1e-3f);// Target 33% of original triangles
+		auto triShape = static_cast<BSTriShape *>(Geometry);
+		auto rendererData = reinterpret_cast<BSGraphics::TriShape *>(triShape->QRendererData());
 
-			m_IndexMap.insert_or_assign(dataPtr, p);
-			*Indices = p;
-		}
+		uint32_t generation;
 
-		if (!*Vertices)
-		{
-			*Vertices = ConvertVerts(vertexData, vertexCount, vertexStride);
-			m_VertMap.insert_or_assign(dataPtr, *Vertices);
-		}
+		if (auto entry = GeometryCache.Acquire(rendererData, &generation))
+			return entry;
 
-		ReleaseSRWLockExclusive(&vertLock);
-	}
+		// Not found - convert outside of any lock. If another worker races us, Insert() keeps theirs.
+		const void *indexData = rendererData->m_RawIndexData;
+		uint32_t indexCount = triShape->m_TriangleCount * 3;
 
-	void RemoveCachedVerticesAndIndices(void *RendererData)
-	{
-		uint32_t *indices = nullptr;
-		float *verts = nullptr;
+		const void *vertexData = rendererData->m_RawVertexData;
+		uint32_t vertexCount = triShape->m_VertexCount;
+		uint32_t vertexStride = BSGeometry::CalculateVertexSize(rendererData->m_VertexDesc);
 
-		AcquireSRWLockExclusive(&vertLock);
+		uint32_t *indices = ConvertIndices(indexData, indexCount, vertexCount);
+		uint32_t finalIndexCount = indexCount;
 
-		if (auto itr = m_IndexMap.find(RendererData); itr != m_IndexMap.end())
-		{
-			indices = itr->second.Data;
-			m_IndexMap.erase(itr);
-		}
+		if (indexCount > 300)
+			finalIndexCount = (uint32_t)meshopt_simplify(indices, indices, indexCount, (const float *)vertexData, vertexCount, vertexStride, (size_t)(indexCount * .50f), 1e-3f);// Target 33% of original triangles
 
-		if (auto itr = m_VertMap.find(RendererData); itr != m_VertMap.end())
-		{
-			verts = itr->second;
-			m_VertMap.erase(itr);
-		}
+		float *vertices = ConvertVerts(vertexData, vertexCount, vertexStride);
 
-		ReleaseSRWLockExclusive(&vertLock);
+		float halfExtents[3];
+		CalculateHalfExtents(vertices, vertexCount, halfExtents);
 
-		// Both buffers might be used outside the lock - I don't care right now (cell_unload() + moc_render() => BOOM)
-		if (indices)
-			delete[] indices;
+		return GeometryCache.Insert(rendererData, generation, vertices, indices, finalIndexCount, halfExtents);
+	}
 
-		if (verts)
-			delete[] verts;
+	void RemoveCachedVerticesAndIndices(void *RendererData)
+	{
+		// Workers still rasterizing this shape hold their own reference
+		GeometryCache.Remove(RendererData);
 	}
 
 	void UpdateDepthViewTexture()
 	{
 		ZoneScopedN("MOC UpdateDepthView");
-		ThreadedMOC->UpdateDepthViewTexture(BSGraphics::Renderer::GetGlobals()->m_DeviceContext, g_OcclusionTexture);
-	}
+		auto renderer = BSGraphics::Renderer::GetGlobals();
 
-	void ForceFlush()
-	{
-		ProfileTimer("MOC WaitForRender");
-		ThreadedMOC->Flush();
+		// Runs on the render thread. ApplyPendingAdaptiveSettings() can't replace the merger while this is reading it.
+		AcquireSRWLockShared(&ThreadedMOCLock);
+
+		// Resize the viewer texture whenever the adaptive resolution changes
+		D3D11_TEXTURE2D_DESC desc;
+		g_OcclusionTexture->GetDesc(&desc);
+
+		if (desc.Width != ThreadedMOC->GetRenderWidth() || desc.Height != ThreadedMOC->GetRenderHeight())
+		{
+			desc.Width = ThreadedMOC->GetRenderWidth();
+			desc.Height = ThreadedMOC->GetRenderHeight();
+
+			g_OcclusionTextureSRV->Release();
+			g_OcclusionTexture->Release();
+
+			Assert(SUCCEEDED(renderer->m_Device->CreateTexture2D(&desc, nullptr, &g_OcclusionTexture)));
+			Assert(SUCCEEDED(renderer->m_Device->CreateShaderResourceView(g_OcclusionTexture, nullptr, &g_OcclusionTextureSRV)));
+		}
+
+		ThreadedMOC->UpdateDepthViewTexture(renderer->m_DeviceContext, g_OcclusionTexture);
+		ReleaseSRWLockShared(&ThreadedMOCLock);
 	}
 
 	XMMATRIX MyView;
@@ -194,243 +229,453 @@ namespace MOC
 	XMMATRIX MyViewProj;
 	NiPoint3 MyPosAdjust;
 
+	using OcclusionView = MOC_OcclusionView;
+
+	struct OcclusionHistory
+	{
+		MaskedOcclusionCulling *Buffer;
+		MOC_OcclusionCamera Camera;
+	};
+
+	MOC_OcclusionCamera MyCamera;
+	OcclusionView ActiveView;
+	OcclusionHistory History[2];
+	int HistoryReadIndex = -1;		// Most recent complete frame, -1 if none
+	bool HistoryFlushPending = false;
+	FILE *CameraPathFile;
+
 	bool mocInit = false;
 
-	void Init()
+	NiCamera *GetWorldCamera()
 	{
-		ThreadedMOC = new MOC_ThreadedMerger(MOC_WIDTH, MOC_HEIGHT, 4, true);
+		return static_cast<NiCamera *>(WorldScenegraph->GetAt(0)->IsNode()->GetAt(0));
+	}
 
-		ThreadedMOC->SetTraverseSceneCallback(TraverseSceneGraphCallback);
-		ThreadedMOC->SetRenderGeometryCallback(RenderGeometryCallback);
+	MOC_OcclusionCamera CreateOcclusionCamera(NiCamera *Camera, const XMMATRIX& View, const XMMATRIX& Proj, const XMMATRIX& ViewProj)
+	{
+		MOC_OcclusionCamera occlusionCamera;
 
-		mocInit = true;
+		for (int i = 0; i < 4; i++)
+		{
+			occlusionCamera.View[i] = View.r[i];
+			occlusionCamera.Proj[i] = Proj.r[i];
+			occlusionCamera.ViewProj[i] = ViewProj.r[i];
+		}
+
+		occlusionCamera.Position = Camera->GetWorldTranslate().AsXmm();
+		occlusionCamera.Direction = Camera->GetWorldDirection().AsXmm();
+		return occlusionCamera;
 	}
 
-	BSMultiBoundAABB *GetAABBNode(const NiAVObject *Object)
+	void RecordCameraPath(NiCamera *Camera)
 	{
-		if (BSMultiBoundNode *multiBoundNode = Object->IsMultiBoundNode())
+		// One line per traversal, replayed offline by tests/MOC_TemporalOcclusionTest
+		if (!ui::opt::RecordOcclusionCameraPath)
 		{
-			if (multiBoundNode->spMultiBound && multiBoundNode->spMultiBound->spShape)
+			if (CameraPathFile)
 			{
-				auto shape = multiBoundNode->spMultiBound->spShape;
-
-				if (shape->IsExactKindOf(NiRTTI::ms_BSMultiBoundAABB))
-					return static_cast<BSMultiBoundAABB *>(shape);
+				fclose(CameraPathFile);
+				CameraPathFile = nullptr;
 			}
+
+			return;
 		}
 
-		return nullptr;
+		if (!CameraPathFile && fopen_s(&CameraPathFile, "MOC_CameraPath.txt", "a") != 0)
+		{
+			CameraPathFile = nullptr;
+			ui::opt::RecordOcclusionCameraPath = false;
+			return;
+		}
+
+		NiPoint3 position = Camera->GetWorldTranslate();
+		NiPoint3 direction = Camera->GetWorldDirection();
+		NiPoint3 up = Camera->GetWorldUpVector();
+		NiPoint3 right = Camera->GetWorldRightVector();
+		const NiFrustum& frustum = Camera->m_kViewFrustum;
+
+		MOC_CameraPathFrame frame =
+		{
+			{ position.x, position.y, position.z },
+			{ direction.x, direction.y, direction.z },
+			{ up.x, up.y, up.z },
+			{ right.x, right.y, right.z },
+			{ frustum.m_fLeft, frustum.m_fRight, frustum.m_fTop, frustum.m_fBottom, frustum.m_fNear, frustum.m_fFar },
+		};
+
+		frame.Write(CameraPathFile);
 	}
 
-	bool TestSphere(NiAVObject *Object);
-	bool TestAABB(BSMultiBoundAABB *Object);
+	void SetCurrentFrameView()
+	{
+		ActiveView.SetCurrentFrame(ThreadedMOC->GetMOC(), MyCamera);
+	}
 
-	bool TestObject(NiAVObject *Object)
+	bool SetTemporalView()
 	{
-		if (!mocInit || !ui::opt::EnableOcclusionTesting)
-			return true;
+		if (HistoryReadIndex == -1)
+			return false;
 
-		if (Object->QAppCulled())
-			return true;
+		const OcclusionHistory& history = History[HistoryReadIndex];
+
+		NiCamera *camera = GetWorldCamera();
+		XMMATRIX view;
+		XMMATRIX proj;
+		XMMATRIX viewProj;
+		camera->CalculateViewProjection(view, proj, viewProj);
+
+		return ActiveView.SetTemporal(
+			history.Buffer,
+			history.Camera,
+			CreateOcclusionCamera(camera, view, proj, viewProj),
+			ui::opt::TemporalMaxTranslation,
+			XMConvertToRadians(ui::opt::TemporalMaxRotation),
+			ThreadedMOC->GetRenderWidth());
+	}
 
-		ProfileCounterInc("MOC CullObjectCount");
-		ProfileTimer("MOC CullTest");
+	void SaveTemporalHistory()
+	{
+		// Called before the next traversal clears the worker buffers. The merge queued by the previous
+		// ForceFlush() has had a whole frame to finish, so this rarely waits.
+		if (!HistoryFlushPending)
+			return;
 
-		BSMultiBoundAABB *aabb = GetAABBNode(Object);
-		bool visible = false;
+		ProfileTimer("MOC TemporalHistoryCopy");
+		HistoryFlushPending = false;
+		ThreadedMOC->WaitForFlush();
 
-		if (aabb)
-			visible = TestAABB(aabb);
-		else
-			visible = TestSphere(Object);
+		// Never overwrite the buffer that occludee tests may still be reading
+		int writeIndex = (HistoryReadIndex == 0) ? 1 : 0;
+		OcclusionHistory& history = History[writeIndex];
 
-		if (visible)
+		history.Buffer->ClearBuffer();
+		history.Buffer->MergeBuffer(ThreadedMOC->GetMOC());
+		history.Camera = MyCamera;
+
+		HistoryReadIndex = writeIndex;
+	}
+
+	void ForceFlush()
+	{
+		int64_t waitStart = GetTicks();
+
+		if (!ui::opt::EnableTemporalOcclusion)
 		{
-			ProfileCounterInc("MOC CullObjectPassed");
+			ProfileTimer("MOC WaitForRender");
+			ThreadedMOC->Flush();
+			SetCurrentFrameView();
+
+			AdaptiveWaitTicks += GetTicks() - waitStart;
+			return;
 		}
 
-		return visible;
+		// Don't wait: this frame's rasterization keeps running while occludees are tested against the
+		// previous frame. The merged result gets saved on the next SendTraverseCommand().
+		ThreadedMOC->FlushAsync();
+		HistoryFlushPending = true;
+
+		bool useHistory = SetTemporalView();
+
+		if (useHistory && !ui::opt::ValidateTemporalOcclusion)
+			return;
+
+		// No usable history (or validating) - fall back to the synchronous result
+		ProfileTimer("MOC WaitForRender");
+		ThreadedMOC->NotifyPreWork();
+		ThreadedMOC->WaitForFlush();
+		ThreadedMOC->ClearPreWorkNotify();
+
+		if (!useHistory)
+			SetCurrentFrameView();
+
+		AdaptiveWaitTicks += GetTicks() - waitStart;
 	}
 
-	bool TestSphere(NiAVObject *Object)
+	void CreateThreadedMOC(uint32_t Tier, uint32_t ThreadCount)
 	{
-		if (Object->m_kWorldBound.m_fRadius <= 5.0f)
-			return true;
-
-		//if (Object->IsTriShape() && Object->IsGeometry()->QType() != GEOMETRY_TYPE_TRISHAPE)
-		//	return true;
+		const ResolutionTier& res = ResolutionTiers[Tier];
 
-		float sphereRadius = Object->m_kWorldBound.m_fRadius;
+		ThreadedMOC = new MOC_ThreadedMerger(res.Width, res.Height, ThreadCount, true);
+		ThreadedMOC->SetTraverseSceneCallback(TraverseSceneGraphCallback);
+		ThreadedMOC->SetRenderGeometryCallback(RenderGeometryCallback);
 
-		XMMATRIX view = MyView;
-		XMMATRIX projection = MyProj;
+		// History from a different resolution or worker set is useless
+		for (auto& history : History)
+		{
+			history.Buffer->SetResolution(res.Width, res.Height);
+			history.Buffer->ClearBuffer();
+		}
 
-		// w as 1.0f
-		XMVECTOR bounds = _mm_sub_ps(_mm_setr_ps(
-			Object->m_kWorldBound.m_kCenter.x,
-			Object->m_kWorldBound.m_kCenter.y,
-			Object->m_kWorldBound.m_kCenter.z,
-			1.0f),
-			MyPosAdjust.AsXmm());
+		HistoryReadIndex = -1;
 
-		// Never cull sphere if player is inside it
-		if (XMVector3Length(bounds).m128_f32[0] <= sphereRadius)
-			return true;
+		Adaptive.Width = res.Width;
+		Adaptive.Height = res.Height;
+		Adaptive.ThreadCount = ThreadCount;
+	}
 
-		// ------ Early depth rejection test
+	void ApplyAdaptiveSettings(uint32_t Tier, uint32_t ThreadCount, const char *Reason)
+	{
+		// Only records the decision. The merger is replaced by ApplyPendingAdaptiveSettings() on the next frame.
+		if (Tier == AdaptiveTier && ThreadCount == ThreadedMOC->GetThreadCount())
+			return;
 
-		XMVECTOR v = XMVectorSubtract(_mm_setzero_ps(), bounds);
-		XMVECTOR closestPoint = XMVectorAdd(bounds, XMVectorScale(XMVector3Normalize(v), sphereRadius));
-		closestPoint = XMVector4Transform(XMVectorSetW(closestPoint, 1.0f), MyViewProj);// Project to clip space
+		AdaptivePending = true;
+		AdaptivePendingTier = Tier;
+		AdaptivePendingThreadCount = ThreadCount;
+		AdaptivePendingReason = Reason;
+	}
 
-		float closestSpherePointW = closestPoint.m128_f32[3];
+	void ApplyPendingAdaptiveSettings()
+	{
+		// Frame boundary: last frame's occludee tests are done and SaveTemporalHistory() has waited for its
+		// merge. A traversal without a matching flush could still be running, so drain the workers too.
+		if (!AdaptivePending)
+			return;
 
-		if (closestSpherePointW < 0.000001f)
-			return true;
+		AdaptivePending = false;
+		ThreadedMOC->WaitForIdle();
 
-		// ------
+		AcquireSRWLockExclusive(&ThreadedMOCLock);
+		{
+			AdaptiveTier = AdaptivePendingTier;
+			delete ThreadedMOC;
+			CreateThreadedMOC(AdaptivePendingTier, AdaptivePendingThreadCount);
+		}
+		ReleaseSRWLockExclusive(&ThreadedMOCLock);
 
-		XMVECTOR viewEye = { view.r[0].m128_f32[3], view.r[1].m128_f32[3], view.r[2].m128_f32[3], 0.0f };
-		viewEye = XMVectorNegate(viewEye);
+		sprintf_s(Adaptive.LastDecision, "%s -> %ux%u, %u thread(s)", AdaptivePendingReason, Adaptive.Width, Adaptive.Height, AdaptivePendingThreadCount);
+		Adaptive.DecisionCount++;
 
-		XMVECTOR viewEyeSphereDirection = XMVectorSubtract(viewEye, bounds);
-		float cameraSphereDistance = XMVector3Length(viewEyeSphereDirection).m128_f32[0];// distance()
+		AdaptiveCooldown = 2;
+	}
 
-		XMVECTOR viewUp = { view.r[0].m128_f32[1], view.r[1].m128_f32[1], view.r[2].m128_f32[1], 0.0f };
-		XMVECTOR viewRight = XMVector3Normalize(XMVector3Cross(viewEyeSphereDirection, viewUp));
+	void UpdateAdaptiveSettings()
+	{
+		if (++AdaptiveFrameCount < AdaptiveWindowFrames)
+			return;
 
-		// Help handle perspective distortion.
-		// http://article.gmane.org/gmane.games.devel.algorithms/21697/
-		float fRadius = cameraSphereDistance * tan(asin(sphereRadius / cameraSphereDistance));
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
 
-		// Compute the offsets for the points around the sphere
-		XMVECTOR vUpRadius = XMVectorScale(viewUp, fRadius);
-		XMVECTOR vRightRadius = XMVectorScale(viewRight, fRadius);
+		double ticksToMs = 1000.0 / (double)frequency.QuadPart / (double)AdaptiveFrameCount;
+		uint32_t tested = AdaptiveTestedCount.exchange(0);
+		uint32_t passed = AdaptivePassedCount.exchange(0);
 
-		// Generate the 4 corners of the sphere in world space
-		XMVECTOR vCorner0WS = XMVectorSubtract(XMVectorAdd(bounds, vUpRadius), vRightRadius);		// Top-Left
-		XMVECTOR vCorner1WS = XMVectorAdd(XMVectorAdd(bounds, vUpRadius), vRightRadius);			// Top-Right
-		XMVECTOR vCorner2WS = XMVectorSubtract(XMVectorSubtract(bounds, vUpRadius), vRightRadius);  // Bottom-Left
-		XMVECTOR vCorner3WS = XMVectorAdd(XMVectorSubtract(bounds, vUpRadius), vRightRadius);		// Bottom-Right
+		Adaptive.WaitMs = (float)(AdaptiveWaitTicks.exchange(0) * ticksToMs);
+		Adaptive.TestMs = (float)(AdaptiveTestTicks.exchange(0) * ticksToMs);
+		Adaptive.RasterMs = (float)(AdaptiveRasterTicks.exchange(0) * ticksToMs);
+		Adaptive.CulledPercent = (tested > 0) ? (100.0f * (float)(tested - passed) / (float)tested) : 0.0f;
+		AdaptiveFrameCount = 0;
 
-		// Project the 4 corners of the sphere into clip space, then convert to normalized device coordinates
-		XMVECTOR vCorner0CS = XMVector4Transform(vCorner0WS, MyViewProj);
-		XMVECTOR vCorner1CS = XMVector4Transform(vCorner1WS, MyViewProj);
-		XMVECTOR vCorner2CS = XMVector4Transform(vCorner2WS, MyViewProj);
-		XMVECTOR vCorner3CS = XMVector4Transform(vCorner3WS, MyViewProj);
+		if (!ui::opt::AdaptiveOcclusion)
+			return;
 
-		XMVECTOR vCorner0NDC = XMVectorDivide(vCorner0CS, XMVectorSplatW(vCorner0CS));
-		XMVECTOR vCorner1NDC = XMVectorDivide(vCorner1CS, XMVectorSplatW(vCorner1CS));
-		XMVECTOR vCorner2NDC = XMVectorDivide(vCorner2CS, XMVectorSplatW(vCorner2CS));
-		XMVECTOR vCorner3NDC = XMVectorDivide(vCorner3CS, XMVectorSplatW(vCorner3CS));
+		if (AdaptiveCooldown > 0)
+		{
+			// Measurements right after a change include thread startup and an empty history
+			AdaptiveCooldown--;
+			return;
+		}
 
-		// Bounding rect mins and maxs
-		XMVECTOR xyMins = _mm_min_ps(vCorner0NDC, _mm_min_ps(vCorner1NDC, _mm_min_ps(vCorner2NDC, vCorner3NDC)));// zw discarded
-		XMVECTOR xyMaxs = _mm_max_ps(vCorner0NDC, _mm_max_ps(vCorner1NDC, _mm_max_ps(vCorner2NDC, vCorner3NDC)));// zw discarded
+		if (AdaptiveRaiseBlocked > 0)
+			AdaptiveRaiseBlocked--;
 
-		auto r = ThreadedMOC->GetMOC()->TestRect(xyMins.m128_f32[0], xyMins.m128_f32[1], xyMaxs.m128_f32[0], xyMaxs.m128_f32[1], closestSpherePointW);
+		const uint32_t maxTier = ARRAYSIZE(ResolutionTiers) - 1;
+		uint32_t threads = ThreadedMOC->GetThreadCount();
 
-		if (r != MaskedOcclusionCulling::VISIBLE)
+		// Did the last efficiency-driven increase actually cull more? If not, undo it and stop trying for a while.
+		if (AdaptiveCulledBeforeRaise >= 0.0f)
 		{
-#define CONVERT_X(x) ((x) + 1.0) * 2560 * 0.5 + 0
-#define CONVERT_Y(y) (1.0 - (y)) * 1440 * 0.5 + 0
-			/*
-			static SRWLOCK lock = SRWLOCK_INIT;
+			float before = AdaptiveCulledBeforeRaise;
+			AdaptiveCulledBeforeRaise = -1.0f;
 
-			AcquireSRWLockExclusive(&lock);
+			if (Adaptive.CulledPercent < before + 2.0f && AdaptiveTier > 0)
+			{
+				AdaptiveRaiseBlocked = 10;
+				ApplyAdaptiveSettings(AdaptiveTier - 1, threads, "No efficiency gain, reverting resolution");
+				return;
+			}
+		}
 
-			ImGui::GetWindowDrawList()->AddRect(ImVec2(CONVERT_X(xyMins.m128_f32[0]), CONVERT_Y(xyMins.m128_f32[1])), ImVec2(CONVERT_X(xyMaxs.m128_f32[0]), CONVERT_Y(xyMaxs.m128_f32[1])), IM_COL32(255, 0, 0, 255));
+		// Render thread cost is the time blocked on the merge plus occludee tests
+		float criticalMs = Adaptive.WaitMs + Adaptive.TestMs;
+		float budgetMs = ui::opt::OcclusionBudgetMs;
 
-			ReleaseSRWLockExclusive(&lock);
-			*/
-			return false;
+		if (criticalMs > budgetMs)
+		{
+			// Rasterization dominates and there are idle cores: spread it wider first. Otherwise reduce the work.
+			if (threads < Adaptive.MaxThreadCount && Adaptive.RasterMs / threads > Adaptive.TestMs)
+				ApplyAdaptiveSettings(AdaptiveTier, threads + 1, "Over budget, raster bound");
+			else if (AdaptiveTier > 0)
+				ApplyAdaptiveSettings(AdaptiveTier - 1, threads, "Over budget");
+			else if (threads < Adaptive.MaxThreadCount)
+				ApplyAdaptiveSettings(AdaptiveTier, threads + 1, "Over budget at minimum resolution");
+		}
+		else if (criticalMs < budgetMs * 0.5f && Adaptive.CulledPercent < ui::opt::OcclusionTargetCullPercent)
+		{
+			// Plenty of headroom but little is being culled: a finer buffer lets thin occluders merge into solid coverage
+			if (AdaptiveTier < maxTier && AdaptiveRaiseBlocked == 0)
+			{
+				AdaptiveCulledBeforeRaise = Adaptive.CulledPercent;
+				ApplyAdaptiveSettings(AdaptiveTier + 1, threads, "Poor cull efficiency");
+			}
 		}
+	}
+
+	const AdaptiveStatus& GetAdaptiveStatus()
+	{
+		return Adaptive;
+	}
+
+	void Init()
+	{
+		for (auto& history : History)
+			history.Buffer = MaskedOcclusionCulling::Create();
+
+		// Leave the main and render threads their own cores
+		uint32_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+
+		Adaptive.MaxThreadCount = std::clamp<uint32_t>(cores - std::min(cores, 2u), 1, 16);
+		strcpy_s(Adaptive.LastDecision, "Initial settings");
+
+		CreateThreadedMOC(DefaultResolutionTier, std::min<uint32_t>(4, Adaptive.MaxThreadCount));
 
-		return true;
+		mocInit = true;
 	}
 
-	bool TestAABB(BSMultiBoundAABB *Object)
+	BSMultiBoundAABB *GetAABBNode(const NiAVObject *Object)
 	{
-		const static int AABB_VERTICES = 8;
-		const static uint32_t sBBxInd[AABB_VERTICES] = { 1, 0, 0, 1, 1, 1, 0, 0 };
-		const static uint32_t sBByInd[AABB_VERTICES] = { 1, 1, 1, 1, 0, 0, 0, 0 };
-		const static uint32_t sBBzInd[AABB_VERTICES] = { 1, 1, 0, 0, 0, 1, 1, 0 };
+		if (BSMultiBoundNode *multiBoundNode = Object->IsMultiBoundNode())
+		{
+			if (multiBoundNode->spMultiBound && multiBoundNode->spMultiBound->spShape)
+			{
+				auto shape = multiBoundNode->spMultiBound->spShape;
 
-		// w ends up being garbage, but it doesn't matter - we ignore it anyway.
-		__m128 vCenter = _mm_sub_ps(Object->m_kCenter.AsXmm(), MyPosAdjust.AsXmm());
-		__m128 vHalf = Object->m_kHalfExtents.AsXmm();
+				if (shape->IsExactKindOf(NiRTTI::ms_BSMultiBoundAABB))
+					return static_cast<BSMultiBoundAABB *>(shape);
+			}
+		}
 
-		__m128 vMin = _mm_sub_ps(vCenter, vHalf);
-		__m128 vMax = _mm_add_ps(vCenter, vHalf);
+		return nullptr;
+	}
 
-		// transforms
-		__m128 xRow[2], yRow[2], zRow[2];
-		xRow[0] = _mm_mul_ps(_mm_shuffle_ps(vMin, vMin, 0x00), MyViewProj.r[0]);
-		xRow[1] = _mm_mul_ps(_mm_shuffle_ps(vMax, vMax, 0x00), MyViewProj.r[0]);
-		yRow[0] = _mm_mul_ps(_mm_shuffle_ps(vMin, vMin, 0x55), MyViewProj.r[1]);
-		yRow[1] = _mm_mul_ps(_mm_shuffle_ps(vMax, vMax, 0x55), MyViewProj.r[1]);
-		zRow[0] = _mm_mul_ps(_mm_shuffle_ps(vMin, vMin, 0xaa), MyViewProj.r[2]);
-		zRow[1] = _mm_mul_ps(_mm_shuffle_ps(vMax, vMax, 0xaa), MyViewProj.r[2]);
+	bool TestSphere(const OcclusionView& View, NiAVObject *Object);
+	bool TestAABB(const OcclusionView& View, BSMultiBoundAABB *Object);
 
-		// Find the minimum of each component
-		__m128 minVert = _mm_add_ps(MyViewProj.r[3], _mm_add_ps(_mm_add_ps(_mm_min_ps(xRow[0], xRow[1]), _mm_min_ps(yRow[0], yRow[1])), _mm_min_ps(zRow[0], zRow[1])));
-		float minW = minVert.m128_f32[3];
+	bool TestObject(const OcclusionView& View, NiAVObject *Object)
+	{
+		if (BSMultiBoundAABB *aabb = GetAABBNode(Object))
+			return TestAABB(View, aabb);
 
-		if (minW < 0.00000001f)
+		return TestSphere(View, Object);
+	}
+
+	bool TestObject(NiAVObject *Object)
+	{
+		if (!mocInit || !ui::opt::EnableOcclusionTesting)
 			return true;
 
-		__m128 screenMin = _mm_set1_ps(FLT_MAX);
-		__m128 screenMax = _mm_set1_ps(-FLT_MAX);
-		__m128 baseVert = MyViewProj.r[3];
+		if (Object->QAppCulled())
+			return true;
 
-		for (uint32_t i = 0; i < AABB_VERTICES; i++)
-		{
-			// Transform the vertex
-			__m128 vert = baseVert;
-			vert += xRow[sBBxInd[i]];
-			vert += yRow[sBByInd[i]];
-			vert += zRow[sBBzInd[i]];
-
-			// We have inverted z; z is in front of near plane iff z <= w.
-			__m128 vertZ = _mm_shuffle_ps(vert, vert, 0xaa); // vert.zzzz
-			__m128 vertW = _mm_shuffle_ps(vert, vert, 0xff); // vert.wwww
-
-			// project
-			__m128 xformedPos = _mm_div_ps(vert, vertW);
-
-			// update bounds
-			screenMin = _mm_min_ps(screenMin, xformedPos);
-			screenMax = _mm_max_ps(screenMax, xformedPos);
-		}
+		ProfileCounterInc("MOC CullObjectCount");
+		ProfileTimer("MOC CullTest");
 
-		MaskedOcclusionCulling::CullingResult r = ThreadedMOC->GetMOC()->TestRect(screenMin.m128_f32[0], screenMin.m128_f32[1], screenMax.m128_f32[0], screenMax.m128_f32[1], minW);
+		bool sampled = ShouldSampleTicks();
+		int64_t testStart = sampled ? GetTicks() : 0;
+		bool visible = TestObject(ActiveView, Object);
 
-		if (r != MaskedOcclusionCulling::VISIBLE)
+		if (ui::opt::EnableTemporalOcclusion && ui::opt::ValidateTemporalOcclusion && ActiveView.Buffer != ThreadedMOC->GetMOC())
 		{
-#define CONVERT_X(x) ((x) + 1.0) * 2560 * 0.5 + 0
-#define CONVERT_Y(y) (1.0 - (y)) * 1440 * 0.5 + 0
-			/*
-			static SRWLOCK lock = SRWLOCK_INIT;
+			// Compare against the exact result from this frame's buffer. A temporal cull of something
+			// that's actually visible shows up as a popping object.
+			OcclusionView current;
+			current.SetCurrentFrame(ThreadedMOC->GetMOC(), MyCamera);
 
-			AcquireSRWLockExclusive(&lock);
+			bool reference = TestObject(current, Object);
 
-			ImGui::GetWindowDrawList()->AddRect(ImVec2(CONVERT_X(screenMin.m128_f32[0]), CONVERT_Y(screenMin.m128_f32[1])), ImVec2(CONVERT_X(screenMax.m128_f32[0]), CONVERT_Y(screenMax.m128_f32[1])), IM_COL32(255, 0, 0, 255));
+			ProfileCounterInc("MOC TemporalValidated");
 
-			ReleaseSRWLockExclusive(&lock);
-			*/
-			return false;
+			if (!visible && reference)
+				ProfileCounterInc("MOC TemporalFalseCull");
+			else if (visible && !reference)
+				ProfileCounterInc("MOC TemporalMissedCull");
+
+			// Never let validation change what gets drawn
+			visible = reference;
+		}
+
+		if (visible)
+		{
+			ProfileCounterInc("MOC CullObjectPassed");
+			AdaptivePassedCount++;
 		}
 
-		return true;
+		AdaptiveTestedCount++;
+
+		if (sampled)
+			AdaptiveTestTicks += (GetTicks() - testStart) * AdaptiveSampleInterval;
+
+		return visible;
 	}
 
-	struct GeometryDistEntry
+	bool TestSphere(const OcclusionView& View, NiAVObject *Object)
 	{
-		BSGeometry *Geometry;
-		float DistanceSquared;
-	};
+		if (Object->m_kWorldBound.m_fRadius <= 5.0f)
+			return true;
 
-	std::vector<GeometryDistEntry> GeoList;
+		//if (Object->IsTriShape() && Object->IsGeometry()->QType() != GEOMETRY_TYPE_TRISHAPE)
+		//	return true;
+
+		return View.TestSphere(Object->m_kWorldBound.m_kCenter.AsXmm(), Object->m_kWorldBound.m_fRadius);
+	}
+
+	bool TestAABB(const OcclusionView& View, BSMultiBoundAABB *Object)
+	{
+		return View.TestAABB(Object->m_kCenter.AsXmm(), Object->m_kHalfExtents.AsXmm());
+	}
+
+	MOC_OccluderSelector OccluderSelector;
+	std::vector<MOC_OccluderSelector::Candidate> GeoList;
+
+	MOC_OccluderSelector::Candidate CreateOccluderCandidate(BSGeometry *Geometry, BSGraphics::TriShape *RendererData, uint32_t TriangleCount)
+	{
+		MOC_OccluderSelector::Candidate candidate;
+		candidate.Key = Geometry;
+		candidate.DistanceSquared = XMVector3LengthSq(_mm_sub_ps(Geometry->m_kWorldBound.m_kCenter.AsXmm(), MyPosAdjust.AsXmm())).m128_f32[0];
+		candidate.Score = 0.0f;
+
+		float worldArea;
+
+		if (auto entry = GeometryCache.Acquire(RendererData))
+		{
+			// Already converted: exact (simplified) triangle count and the real box shape
+			worldArea = MOC_OccluderSelector::EstimateSilhouetteArea(entry->HalfExtents, Geometry->GetWorldTransform().m_fScale);
+			candidate.TriangleCount = entry->IndexCount / 3;
+
+			GeometryCache.Release(entry);
+		}
+		else
+		{
+			// Never rasterized. The bounding sphere overestimates thin shapes, which gets them converted
+			// once and then ranked properly from the next frame on.
+			worldArea = MOC_OccluderSelector::EstimateSphereArea(Geometry->m_kWorldBound.m_fRadius);
+			candidate.TriangleCount = (TriangleCount > 100) ? (TriangleCount / 2) : TriangleCount;
+		}
+
+		candidate.ProjectedArea = MOC_OccluderSelector::EstimateProjectedArea(
+			worldArea,
+			candidate.DistanceSquared,
+			MyProj.r[0].m128_f32[0],
+			MyProj.r[1].m128_f32[1]);
+
+		return candidate;
+	}
+
+	const MOC_OccluderSelector::Statistics& GetOccluderSelectionStats()
+	{
+		return OccluderSelector.GetStatistics();
+	}
 
 	void RegisterGeometry(BSGeometry *Geometry)
 	{
@@ -458,13 +703,7 @@ namespace MOC
 			auto rendererData = reinterpret_cast<BSGraphics::TriShape *>(triShape->QRendererData());
 
 			if (rendererData && rendererData->m_RawIndexData && triShape->m_TriangleCount > 1)
-			{
-				GeometryDistEntry entry;
-				entry.Geometry = Geometry;
-				entry.DistanceSquared = XMVector3LengthSq(_mm_sub_ps(Geometry->m_kWorldBound.m_kCenter.AsXmm(), MyPosAdjust.AsXmm())).m128_f32[0];
-
-				GeoList.push_back(entry);
-			}
+				GeoList.push_back(CreateOccluderCandidate(Geometry, rendererData, triShape->m_TriangleCount));
 		}
 	}
 
@@ -474,6 +713,8 @@ namespace MOC
 		ZoneScopedN("MOC RenderGeometry");
 
 		BSGeometry *geometry = (BSGeometry *)UserData;
+		bool sampled = ShouldSampleTicks();
+		int64_t rasterStart = sampled ? GetTicks() : 0;
 
 		// If double sided geometry, avoid culling back faces
 		MaskedOcclusionCulling::BackfaceWinding winding = MaskedOcclusionCulling::BACKFACE_CW;
@@ -482,23 +723,26 @@ namespace MOC
 			winding = MaskedOcclusionCulling::BACKFACE_NONE;
 
 		// Grab LOD-ified mesh out
-		IndexPair indexRawData;
-		float *vertexRawData;
-		GetCachedVerticesAndIndices(geometry, &indexRawData, &vertexRawData);
+		MOC_GeometryCache::Entry *meshData = GetCachedVerticesAndIndices(geometry);
 
 		XMMATRIX worldProj = BSShaderUtil::GetXMFromNiPosAdjust(geometry->GetWorldTransform(), MyPosAdjust);
 		XMMATRIX worldViewProj = XMMatrixMultiply(worldProj, MyViewProj);
 
 		MOC->RenderTriangles(
-			vertexRawData,
-			indexRawData.Data,
-			indexRawData.Count / 3,
+			meshData->Vertices,
+			meshData->Indices,
+			meshData->IndexCount / 3,
 			(float *)&worldViewProj,
 			winding,
 			MaskedOcclusionCulling::CLIP_PLANE_SIDES);
 
 		ProfileCounterInc("MOC ObjectsRendered");
-		ProfileCounterAdd("MOC TrianglesRendered", indexRawData.Count / 3);
+		ProfileCounterAdd("MOC TrianglesRendered", meshData->IndexCount / 3);
+
+		GeometryCache.Release(meshData);
+
+		if (sampled)
+			AdaptiveRasterTicks += (GetTicks() - rasterStart) * AdaptiveSampleInterval;
 	}
 
 	bool CullObject(const NiAVObject *Object, fplanes& Frustum)
@@ -599,6 +843,10 @@ namespace MOC
 		if (!mocInit || !ui::opt::EnableOccluderRendering)
 			return;
 
+		SaveTemporalHistory();
+		ApplyPendingAdaptiveSettings();
+		UpdateAdaptiveSettings();
+
 		ThreadedMOC->NotifyPreWork();
 		ThreadedMOC->SubmitSceneRender(Camera);
 		ThreadedMOC->ClearPreWorkNotify();
@@ -641,7 +889,7 @@ namespace MOC
 		// -- "Collision Node"        NiNode
 		//
 		if (!Camera)
-			Camera = static_cast<NiCamera *>(WorldScenegraph->GetAt(0)->IsNode()->GetAt(0));
+			Camera = GetWorldCamera();
 
 		GeoList.clear();
 
@@ -650,6 +898,8 @@ namespace MOC
 
 		MyPosAdjust = Camera->GetWorldTranslate();
 		Camera->CalculateViewProjection(MyView, MyProj, MyViewProj);
+		MyCamera = CreateOcclusionCamera(Camera, MyView, MyProj, MyViewProj);
+		RecordCameraPath(Camera);
 
 		float fov = atan(1.0f / MyProj.r[0].m128_f32[0]) * 2.0f * (180.0f / 3.14159265359f);
 		float aspect = MyProj.r[1].m128_f32[1] / MyProj.r[0].m128_f32[0];
@@ -697,15 +947,31 @@ namespace MOC
 			}
 		}
 
-		// Sort front to back (approx)
-		std::sort(GeoList.begin(), GeoList.end(),
-		[](GeometryDistEntry& a, GeometryDistEntry& b) -> bool
+		if (ui::opt::EnableOccluderSelection)
+		{
+			// Keep the best area-per-triangle occluders, returned front to back
+			MOC_OccluderSelector::Settings settings;
+			settings.MaxOccluders = (uint32_t)std::max(ui::opt::OccluderMaxCount, 1);
+			settings.TriangleBudget = (uint32_t)std::max(ui::opt::OccluderTriangleBudget, 1);
+			settings.MinProjectedArea = ui::opt::OccluderMinScreenArea;
+			settings.HysteresisBonus = 1.25f;
+
+			OccluderSelector.Select(GeoList, settings);
+		}
+		else
 		{
-			return a.DistanceSquared < b.DistanceSquared;
-		});
+			OccluderSelector.Reset();
+
+			// Sort front to back (approx)
+			std::sort(GeoList.begin(), GeoList.end(),
+			[](MOC_OccluderSelector::Candidate& a, MOC_OccluderSelector::Candidate& b) -> bool
+			{
+				return a.DistanceSquared < b.DistanceSquared;
+			});
+		}
 
-		for (GeometryDistEntry& entry : GeoList)
-			ThreadedMOC->SubmitGeometry(entry.Geometry);
+		for (MOC_OccluderSelector::Candidate& entry : GeoList)
+			ThreadedMOC->SubmitGeometry((BSGeometry *)entry.Key);
 
 		ThreadedMOC->ClearPreWorkNotify();
 	}
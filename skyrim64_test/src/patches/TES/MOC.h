@@ -3,6 +3,7 @@
 #include <immintrin.h>
 #include <smmintrin.h>
 #include <DirectXMath.h>
+#include "MOC_OccluderSelector.h"
 
 class MaskedOcclusionCulling;
 
@@ -21,6 +22,23 @@ namespace MOC
 
 	bool TestObject(NiAVObject *Object);
 
+	struct AdaptiveStatus
+	{
+		uint32_t Width;
+		uint32_t Height;
+		uint32_t ThreadCount;
+		uint32_t MaxThreadCount;
+		float WaitMs;			// Render thread blocked on the merge, per frame
+		float TestMs;			// Occludee tests, summed across threads, per frame
+		float RasterMs;			// Occluder rasterization, summed across workers, per frame
+		float CulledPercent;
+		uint32_t DecisionCount;
+		char LastDecision[128];
+	};
+
+	const AdaptiveStatus& GetAdaptiveStatus();
+	const MOC_OccluderSelector::Statistics& GetOccluderSelectionStats();
+
 	using namespace DirectX;
 
 	struct fplanes
@@ -0,0 +1,139 @@
+#include <mutex>
+#include "MOC_GeometryCache.h"
+
+MOC_GeometryCache::~MOC_GeometryCache()
+{
+	for (uint32_t i = 0; i < ShardCount; i++)
+	{
+		for (auto& [key, element] : m_Shards[i].Map)
+			Release(element);
+
+		m_Shards[i].Map.clear();
+	}
+}
+
+MOC_GeometryCache::Entry *MOC_GeometryCache::Acquire(void *Key, uint32_t *Generation)
+{
+	Shard& shard = GetShard(Key);
+	std::shared_lock lock(shard.Lock);
+
+	if (auto itr = shard.Map.find(Key); itr != shard.Map.end())
+	{
+		// The table's reference keeps this alive while the lock is held
+		Entry *element = itr->second;
+		element->RefCount.fetch_add(1);
+
+		return element;
+	}
+
+	if (Generation)
+		*Generation = GetGeneration(shard, Key);
+
+	return nullptr;
+}
+
+MOC_GeometryCache::Entry *MOC_GeometryCache::Insert(void *Key, uint32_t Generation, float *Vertices, uint32_t *Indices, uint32_t IndexCount, const float HalfExtents[3])
+{
+	Entry *element = new Entry;
+	element->RefCount.store(2);// Table + caller
+	element->Vertices = Vertices;
+	element->Indices = Indices;
+	element->IndexCount = IndexCount;
+	element->HalfExtents[0] = HalfExtents[0];
+	element->HalfExtents[1] = HalfExtents[1];
+	element->HalfExtents[2] = HalfExtents[2];
+
+	Shard& shard = GetShard(Key);
+	Entry *existing = nullptr;
+	bool stale = false;
+
+	{
+		std::unique_lock lock(shard.Lock);
+
+		if (GetGeneration(shard, Key) != Generation)
+		{
+			// Removed while we were converting. The caller may still use it for this frame.
+			stale = true;
+		}
+		else if (auto [itr, inserted] = shard.Map.try_emplace(Key, element); !inserted)
+		{
+			// Another worker converted the same shape first. Use theirs and throw ours away.
+			existing = itr->second;
+			existing->RefCount.fetch_add(1);
+		}
+	}
+
+	if (stale)
+	{
+		element->RefCount.store(1);
+		return element;
+	}
+
+	if (existing)
+	{
+		element->RefCount.store(1);
+		Release(element);
+		return existing;
+	}
+
+	m_LiveEntries++;
+	return element;
+}
+
+void MOC_GeometryCache::Remove(void *Key)
+{
+	Shard& shard = GetShard(Key);
+	Entry *element = nullptr;
+
+	{
+		std::unique_lock lock(shard.Lock);
+
+		// Invalidate any conversion that started before this point, even if nothing was published yet
+		GetGeneration(shard, Key)++;
+
+		if (auto itr = shard.Map.find(Key); itr != shard.Map.end())
+		{
+			element = itr->second;
+			shard.Map.erase(itr);
+		}
+	}
+
+	// Drop the table's reference. Buffers stay valid until every worker holding them is done.
+	if (element)
+	{
+		m_LiveEntries--;
+		Release(element);
+	}
+}
+
+void MOC_GeometryCache::Release(Entry *Element)
+{
+	if (Element->RefCount.fetch_sub(1) != 1)
+		return;
+
+	delete[] Element->Vertices;
+	delete[] Element->Indices;
+	delete Element;
+}
+
+uint32_t MOC_GeometryCache::GetLiveEntryCount() const
+{
+	return m_LiveEntries.load();
+}
+
+uint64_t MOC_GeometryCache::HashKey(void *Key)
+{
+	// Heap pointers share their low bits, so mix before picking a shard
+	return (uint64_t)Key * 0x9E3779B97F4A7C15ull;
+}
+
+MOC_GeometryCache::Shard& MOC_GeometryCache::GetShard(void *Key)
+{
+	return m_Shards[(HashKey(Key) >> 58) % ShardCount];
+}
+
+uint32_t& MOC_GeometryCache::GetGeneration(Shard& Owner, void *Key)
+{
+	// Different bits than the shard index, otherwise every key in a shard would share one slot
+	return Owner.Generations[(HashKey(Key) >> 52) % GenerationSlots];
+}
\ No newline at end of file
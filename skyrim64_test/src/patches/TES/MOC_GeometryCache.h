@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+
+//
+// Converted occluder geometry (XYZW vertices + simplified indices) keyed by the renderer's
+// TriShape pointer. The table is split into shards so cull workers only contend when they
+// hash to the same bucket, and readers take a shared lock.
+//
+// Entries are reference counted. The table itself owns one reference and every Acquire()
+// or Insert() hands out another one. Remove() only drops the table's reference, so a cell
+// unloading while a worker is still inside RenderTriangles() no longer frees the buffers
+// out from under it - the last Release() does.
+//
+// Conversion runs outside of any lock, so a Remove() can land between a worker's Acquire()
+// miss and its Insert(). Remove() bumps a per-key generation and Insert() only publishes if
+// the generation it got from Acquire() is unchanged; otherwise the entry is handed back to
+// the caller alone and freed on its Release(). Keys share generation slots by hash, so a
+// collision can only reject a publish, never accept a stale one. Nothing here depends on
+// Windows.
+//
+class MOC_GeometryCache
+{
+public:
+	struct Entry
+	{
+		std::atomic_uint32_t RefCount;
+		float *Vertices;
+		uint32_t *Indices;
+		uint32_t IndexCount;
+		float HalfExtents[3];		// Local space AABB, used for occluder selection
+	};
+
+private:
+	const static uint32_t ShardCount = 64;
+	const static uint32_t GenerationSlots = 64;
+
+	struct alignas(64) Shard
+	{
+		std::shared_mutex Lock;
+		std::unordered_map<void *, Entry *> Map;
+		uint32_t Generations[GenerationSlots] = {};
+	};
+
+	Shard m_Shards[ShardCount];
+	std::atomic_uint32_t m_LiveEntries = 0;
+
+public:
+	MOC_GeometryCache() = default;
+	~MOC_GeometryCache();
+
+	// On a miss, Generation (if given) receives the ticket Insert() needs
+	Entry *Acquire(void *Key, uint32_t *Generation = nullptr);
+	Entry *Insert(void *Key, uint32_t Generation, float *Vertices, uint32_t *Indices, uint32_t IndexCount, const float HalfExtents[3]);
+	void Remove(void *Key);
+	void Release(Entry *Element);
+
+	uint32_t GetLiveEntryCount() const;
+
+private:
+	static uint64_t HashKey(void *Key);
+	Shard& GetShard(void *Key);
+	static uint32_t& GetGeneration(Shard& Owner, void *Key);
+};
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include "MOC_OccluderSelector.h"
+
+void MOC_OccluderSelector::Select(std::vector<Candidate>& Candidates, const Settings& Config)
+{
+	m_Stats = {};
+	m_Stats.CandidateCount = (uint32_t)Candidates.size();
+
+	// Drop tiny objects outright and score the rest
+	auto smallEnd = std::remove_if(Candidates.begin(), Candidates.end(), [&Config](const Candidate& C)
+	{
+		return C.ProjectedArea < Config.MinProjectedArea;
+	});
+
+	m_Stats.RejectedSmall = (uint32_t)std::distance(smallEnd, Candidates.end());
+	Candidates.erase(smallEnd, Candidates.end());
+
+	for (Candidate& c : Candidates)
+	{
+		c.Score = c.ProjectedArea / (float)std::max<uint32_t>(c.TriangleCount, 1);
+
+		if (m_PreviousSelection.count(c.Key))
+			c.Score *= Config.HysteresisBonus;
+	}
+
+	// Best first. Ties broken by key so the result doesn't depend on traversal order.
+	std::sort(Candidates.begin(), Candidates.end(), [](const Candidate& A, const Candidate& B)
+	{
+		if (A.Score != B.Score)
+			return A.Score > B.Score;
+
+		return A.Key < B.Key;
+	});
+
+	// Greedy fill. A candidate that doesn't fit the remaining budget is skipped, not a stopping point -
+	// cheaper ones further down can still fit.
+	m_NextSelection.clear();
+	uint32_t kept = 0;
+
+	for (size_t i = 0; i < Candidates.size() && kept < Config.MaxOccluders; i++)
+	{
+		const Candidate& c = Candidates[i];
+
+		if (m_Stats.SelectedTriangles + c.TriangleCount > Config.TriangleBudget)
+		{
+			m_Stats.RejectedBudget++;
+			continue;
+		}
+
+		m_Stats.SelectedTriangles += c.TriangleCount;
+
+		if (m_PreviousSelection.count(c.Key))
+			m_Stats.Retained++;
+
+		m_NextSelection.insert(c.Key);
+		Candidates[kept++] = c;
+	}
+
+	m_Stats.Selected = kept;
+	Candidates.resize(kept);
+
+	// Submission order stays front to back so near occluders fill the buffer first
+	std::sort(Candidates.begin(), Candidates.end(), [](const Candidate& A, const Candidate& B)
+	{
+		return A.DistanceSquared < B.DistanceSquared;
+	});
+
+	std::swap(m_PreviousSelection, m_NextSelection);
+}
+
+void MOC_OccluderSelector::Reset()
+{
+	m_PreviousSelection.clear();
+	m_NextSelection.clear();
+	m_Stats = {};
+}
+
+const MOC_OccluderSelector::Statistics& MOC_OccluderSelector::GetStatistics() const
+{
+	return m_Stats;
+}
+
+float MOC_OccluderSelector::EstimateProjectedArea(float WorldArea, float DistanceSquared, float ProjScaleX, float ProjScaleY)
+{
+	// Area shrinks with the square of the distance. Clamp so objects around the camera don't explode.
+	return WorldArea * ProjScaleX * ProjScaleY / std::max(DistanceSquared, 1.0f);
+}
+
+float MOC_OccluderSelector::EstimateSilhouetteArea(const float HalfExtents[3], float Scale)
+{
+	// Largest face of the local bounding box. Walls and floors keep their area while poles, fences,
+	// and other thin shapes (small middle extent) score poorly.
+	float e[3] = { HalfExtents[0], HalfExtents[1], HalfExtents[2] };
+	std::sort(e, e + 3);
+
+	return 4.0f * e[2] * e[1] * Scale * Scale;
+}
+
+float MOC_OccluderSelector::EstimateSphereArea(float Radius)
+{
+	// Square inscribed in the bounding circle, used until real extents are known
+	return 2.0f * Radius * Radius;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_set>
+
+//
+// Chooses which registered geometry is worth rasterizing as an occluder this frame. Candidates are
+// ranked by projected screen area per triangle and accepted best-first until either the occluder
+// count or the triangle budget runs out. Anything selected last frame gets a score bonus so the set
+// doesn't thrash when scores are close.
+//
+// No engine types in here on purpose: candidates are plain numbers, so synthetic scenes can drive it.
+//
+class MOC_OccluderSelector
+{
+public:
+	struct Candidate
+	{
+		const void *Key;			// Stable identity across frames (BSGeometry pointer)
+		float ProjectedArea;		// Approximate silhouette area in NDC units (full screen = 4.0)
+		uint32_t TriangleCount;		// Triangles that would actually be rasterized
+		float DistanceSquared;		// Only used for the final front-to-back order
+		float Score;				// Written by Select()
+	};
+
+	struct Settings
+	{
+		uint32_t MaxOccluders;		// Top K
+		uint32_t TriangleBudget;	// Sum of TriangleCount over the selection
+		float MinProjectedArea;		// Anything smaller is rejected before ranking
+		float HysteresisBonus;		// Score multiplier for last frame's selections (>= 1.0)
+	};
+
+	struct Statistics
+	{
+		uint32_t CandidateCount;
+		uint32_t RejectedSmall;
+		uint32_t RejectedBudget;
+		uint32_t Selected;
+		uint32_t SelectedTriangles;
+		uint32_t Retained;			// Selected both this frame and last frame
+	};
+
+private:
+	std::unordered_set<const void *> m_PreviousSelection;
+	std::unordered_set<const void *> m_NextSelection;
+	Statistics m_Stats = {};
+
+public:
+	MOC_OccluderSelector() = default;
+
+	void Select(std::vector<Candidate>& Candidates, const Settings& Config);
+	void Reset();
+
+	const Statistics& GetStatistics() const;
+
+	static float EstimateProjectedArea(float WorldArea, float DistanceSquared, float ProjScaleX, float ProjScaleY);
+	static float EstimateSilhouetteArea(const float HalfExtents[3], float Scale);
+	static float EstimateSphereArea(float Radius);
+};
\ No newline at end of file
@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <float.h>
+#include <MaskedOcclusionCulling/MaskedOcclusionCulling.h>
+#include "MOC_OcclusionView.h"
+
+#define CAMERA_PATH_FORMAT "%f %f %f  %f %f %f  %f %f %f  %f %f %f  %f %f %f %f %f %f\n"
+
+namespace
+{
+	template<int Lane>
+	float GetLane(__m128 V)
+	{
+		return _mm_cvtss_f32(_mm_shuffle_ps(V, V, _MM_SHUFFLE(Lane, Lane, Lane, Lane)));
+	}
+
+	__m128 SetW(__m128 V, float W)
+	{
+		// (z, W, w, W) -> (x, y, z, W)
+		return _mm_shuffle_ps(V, _mm_unpackhi_ps(V, _mm_set1_ps(W)), _MM_SHUFFLE(1, 0, 1, 0));
+	}
+
+	float Dot3(__m128 A, __m128 B)
+	{
+		__m128 v = _mm_mul_ps(A, B);
+		return GetLane<0>(v) + GetLane<1>(v) + GetLane<2>(v);
+	}
+
+	float Length3(__m128 V)
+	{
+		return sqrtf(Dot3(V, V));
+	}
+
+	__m128 Normalize3(__m128 V)
+	{
+		// Zero stays zero, same as XMVector3Normalize
+		float length = Length3(V);
+
+		if (length <= 0.0f)
+			return _mm_setzero_ps();
+
+		return _mm_div_ps(V, _mm_set1_ps(length));
+	}
+
+	__m128 Cross3(__m128 A, __m128 B)
+	{
+		__m128 a = _mm_mul_ps(_mm_shuffle_ps(A, A, _MM_SHUFFLE(3, 0, 2, 1)), _mm_shuffle_ps(B, B, _MM_SHUFFLE(3, 1, 0, 2)));
+		__m128 b = _mm_mul_ps(_mm_shuffle_ps(A, A, _MM_SHUFFLE(3, 1, 0, 2)), _mm_shuffle_ps(B, B, _MM_SHUFFLE(3, 0, 2, 1)));
+
+		return SetW(_mm_sub_ps(a, b), 0.0f);
+	}
+
+	__m128 Transform(__m128 V, const __m128 M[4])
+	{
+		__m128 result = _mm_mul_ps(_mm_shuffle_ps(V, V, 0x00), M[0]);
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(V, V, 0x55), M[1]));
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(V, V, 0xAA), M[2]));
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(V, V, 0xFF), M[3]));
+
+		return result;
+	}
+
+	__m128 ProjectToNDC(__m128 V)
+	{
+		return _mm_div_ps(V, _mm_shuffle_ps(V, V, 0xFF));
+	}
+
+	uint32_t GetOutsideEdges(__m128 Clip)
+	{
+		// Float noise on a corner that didn't move isn't a new edge
+		const float limit = 1.0001f;
+
+		if (GetLane<3>(Clip) <= 0.0f)
+			return MOC_OcclusionView::EDGE_ALL;
+
+		__m128 ndc = ProjectToNDC(Clip);
+		uint32_t edges = 0;
+
+		if (GetLane<0>(ndc) < -limit)
+			edges |= MOC_OcclusionView::EDGE_LEFT;
+
+		if (GetLane<0>(ndc) > limit)
+			edges |= MOC_OcclusionView::EDGE_RIGHT;
+
+		if (GetLane<1>(ndc) < -limit)
+			edges |= MOC_OcclusionView::EDGE_BOTTOM;
+
+		if (GetLane<1>(ndc) > limit)
+			edges |= MOC_OcclusionView::EDGE_TOP;
+
+		return edges;
+	}
+}
+
+bool MOC_CameraPathFrame::Read(FILE *File)
+{
+	return fscanf(File, CAMERA_PATH_FORMAT,
+		&Position[0], &Position[1], &Position[2],
+		&Direction[0], &Direction[1], &Direction[2],
+		&Up[0], &Up[1], &Up[2],
+		&Right[0], &Right[1], &Right[2],
+		&Frustum[0], &Frustum[1], &Frustum[2], &Frustum[3], &Frustum[4], &Frustum[5]) == 18;
+}
+
+void MOC_CameraPathFrame::Write(FILE *File) const
+{
+	fprintf(File, CAMERA_PATH_FORMAT,
+		Position[0], Position[1], Position[2],
+		Direction[0], Direction[1], Direction[2],
+		Up[0], Up[1], Up[2],
+		Right[0], Right[1], Right[2],
+		Frustum[0], Frustum[1], Frustum[2], Frustum[3], Frustum[4], Frustum[5]);
+}
+
+void MOC_OcclusionView::SetCurrentFrame(MaskedOcclusionCulling *CurrentBuffer, const MOC_OcclusionCamera& Camera)
+{
+	Buffer = CurrentBuffer;
+	memcpy(View, Camera.View, sizeof(View));
+	memcpy(ViewProj, Camera.ViewProj, sizeof(ViewProj));
+	PosAdjust = Camera.Position;
+	UnknownEdges = 0;
+	DepthBias = 0.0f;
+	RectPadding = 0.0f;
+	ParallaxScale = 0.0f;
+}
+
+bool MOC_OcclusionView::SetTemporal(MaskedOcclusionCulling *HistoryBuffer, const MOC_OcclusionCamera& History, const MOC_OcclusionCamera& Current, float MaxTranslation, float MaxRotation, uint32_t RenderWidth)
+{
+	// Projection must match exactly (FOV zoom, near/far changes)
+	if (memcmp(Current.Proj, History.Proj, sizeof(History.Proj)) != 0)
+		return false;
+
+	float translation = Length3(_mm_sub_ps(Current.Position, History.Position));
+	float cosAngle = std::clamp(Dot3(Current.Direction, History.Direction), -1.0f, 1.0f);
+	float angle = acosf(cosAngle);
+
+	// Teleports, fast turns, and cuts would disocclude too much to pad around
+	if (translation > MaxTranslation || angle > MaxRotation)
+		return false;
+
+	// Turning by angle moves a direction at tangent T off the view axis by tan(angle) * (1 + T^2) / (1 - T * tan(angle))
+	// in tangent space. That's smallest in the middle of the screen and worst in the corners.
+	float projScaleX = GetLane<0>(History.Proj[0]);
+	float projScaleY = GetLane<1>(History.Proj[1]);
+	float projScale = std::max(projScaleX, projScaleY);
+	float cornerTangent = sqrtf(1.0f / (projScaleX * projScaleX) + 1.0f / (projScaleY * projScaleY));
+	float tanAngle = tanf(angle);
+
+	if (cornerTangent * tanAngle >= 1.0f)
+		return false;
+
+	// Project the corners of this frame's screen into the previous frame, both at the near plane and at infinity.
+	// Wherever one lands outside the old screen, part of what's visible now was never rasterized.
+	float nearDistance = -GetLane<2>(Current.Proj[3]) / GetLane<2>(Current.Proj[2]);
+	__m128 deltaPos = SetW(_mm_sub_ps(Current.Position, History.Position), 1.0f);
+
+	UnknownEdges = 0;
+
+	for (float x : { -1.0f, 1.0f })
+	{
+		for (float y : { -1.0f, 1.0f })
+		{
+			__m128 ray = _mm_setr_ps(
+				(x - GetLane<0>(Current.Proj[2])) / projScaleX,
+				(y - GetLane<1>(Current.Proj[2])) / projScaleY,
+				1.0f,
+				0.0f);
+
+			__m128 worldRay = _mm_setr_ps(Dot3(Current.View[0], ray), Dot3(Current.View[1], ray), Dot3(Current.View[2], ray), 0.0f);
+
+			UnknownEdges |= GetOutsideEdges(Transform(worldRay, History.ViewProj));
+			UnknownEdges |= GetOutsideEdges(Transform(_mm_add_ps(deltaPos, _mm_mul_ps(worldRay, _mm_set1_ps(nearDistance))), History.ViewProj));
+		}
+	}
+
+	Buffer = HistoryBuffer;
+	memcpy(View, History.View, sizeof(View));
+	memcpy(ViewProj, History.ViewProj, sizeof(ViewProj));
+	PosAdjust = History.Position;
+	DepthBias = translation;
+	RectPadding = tanAngle * (1.0f + cornerTangent * cornerTangent) / (1.0f - cornerTangent * tanAngle) * projScale + (4.0f / RenderWidth);
+	ParallaxScale = translation * projScale;
+	return true;
+}
+
+bool MOC_OcclusionView::TestSphere(__m128 Center, float Radius) const
+{
+	// w as 1.0f
+	__m128 bounds = SetW(_mm_sub_ps(Center, PosAdjust), 1.0f);
+
+	// Never cull sphere if player is inside it
+	if (Length3(bounds) <= Radius)
+		return true;
+
+	// ------ Early depth rejection test
+
+	__m128 v = _mm_sub_ps(_mm_setzero_ps(), bounds);
+	__m128 closestPoint = _mm_add_ps(bounds, _mm_mul_ps(Normalize3(v), _mm_set1_ps(Radius)));
+	closestPoint = Transform(SetW(closestPoint, 1.0f), ViewProj);// Project to clip space
+
+	float closestSpherePointW = GetLane<3>(closestPoint) - DepthBias;
+
+	if (closestSpherePointW < 0.000001f)
+		return true;
+
+	// ------
+
+	__m128 viewEye = _mm_setr_ps(-GetLane<3>(View[0]), -GetLane<3>(View[1]), -GetLane<3>(View[2]), 0.0f);
+
+	__m128 viewEyeSphereDirection = _mm_sub_ps(viewEye, bounds);
+	float cameraSphereDistance = Length3(viewEyeSphereDirection);// distance()
+
+	__m128 viewUp = _mm_setr_ps(GetLane<1>(View[0]), GetLane<1>(View[1]), GetLane<1>(View[2]), 0.0f);
+	__m128 viewRight = Normalize3(Cross3(viewEyeSphereDirection, viewUp));
+
+	// Help handle perspective distortion.
+	// http://article.gmane.org/gmane.games.devel.algorithms/21697/
+	float fRadius = cameraSphereDistance * tanf(asinf(Radius / cameraSphereDistance));
+
+	// Compute the offsets for the points around the sphere
+	__m128 vUpRadius = _mm_mul_ps(viewUp, _mm_set1_ps(fRadius));
+	__m128 vRightRadius = _mm_mul_ps(viewRight, _mm_set1_ps(fRadius));
+
+	// Generate the 4 corners of the sphere in world space, project them into clip space, then convert to
+	// normalized device coordinates
+	__m128 vCorner0NDC = ProjectToNDC(Transform(_mm_sub_ps(_mm_add_ps(bounds, vUpRadius), vRightRadius), ViewProj));	// Top-Left
+	__m128 vCorner1NDC = ProjectToNDC(Transform(_mm_add_ps(_mm_add_ps(bounds, vUpRadius), vRightRadius), ViewProj));	// Top-Right
+	__m128 vCorner2NDC = ProjectToNDC(Transform(_mm_sub_ps(_mm_sub_ps(bounds, vUpRadius), vRightRadius), ViewProj));	// Bottom-Left
+	__m128 vCorner3NDC = ProjectToNDC(Transform(_mm_add_ps(_mm_sub_ps(bounds, vUpRadius), vRightRadius), ViewProj));	// Bottom-Right
+
+	// Bounding rect mins and maxs
+	__m128 xyMins = _mm_min_ps(vCorner0NDC, _mm_min_ps(vCorner1NDC, _mm_min_ps(vCorner2NDC, vCorner3NDC)));// zw discarded
+	__m128 xyMaxs = _mm_max_ps(vCorner0NDC, _mm_max_ps(vCorner1NDC, _mm_max_ps(vCorner2NDC, vCorner3NDC)));// zw discarded
+
+	return TestRect(GetLane<0>(xyMins), GetLane<1>(xyMins), GetLane<0>(xyMaxs), GetLane<1>(xyMaxs), closestSpherePointW);
+}
+
+bool MOC_OcclusionView::TestAABB(__m128 Center, __m128 HalfExtents) const
+{
+	const static int AABB_VERTICES = 8;
+	const static uint32_t sBBxInd[AABB_VERTICES] = { 1, 0, 0, 1, 1, 1, 0, 0 };
+	const static uint32_t sBByInd[AABB_VERTICES] = { 1, 1, 1, 1, 0, 0, 0, 0 };
+	const static uint32_t sBBzInd[AABB_VERTICES] = { 1, 1, 0, 0, 0, 1, 1, 0 };
+
+	// w ends up being garbage, but it doesn't matter - we ignore it anyway.
+	__m128 vCenter = _mm_sub_ps(Center, PosAdjust);
+	__m128 vHalf = HalfExtents;
+
+	__m128 vMin = _mm_sub_ps(vCenter, vHalf);
+	__m128 vMax = _mm_add_ps(vCenter, vHalf);
+
+	// transforms
+	__m128 xRow[2], yRow[2], zRow[2];
+	xRow[0] = _mm_mul_ps(_mm_shuffle_ps(vMin, vMin, 0x00), ViewProj[0]);
+	xRow[1] = _mm_mul_ps(_mm_shuffle_ps(vMax, vMax, 0x00), ViewProj[0]);
+	yRow[0] = _mm_mul_ps(_mm_shuffle_ps(vMin, vMin, 0x55), ViewProj[1]);
+	yRow[1] = _mm_mul_ps(_mm_shuffle_ps(vMax, vMax, 0x55), ViewProj[1]);
+	zRow[0] = _mm_mul_ps(_mm_shuffle_ps(vMin, vMin, 0xaa), ViewProj[2]);
+	zRow[1] = _mm_mul_ps(_mm_shuffle_ps(vMax, vMax, 0xaa), ViewProj[2]);
+
+	// Find the minimum of each component
+	__m128 minVert = _mm_add_ps(ViewProj[3], _mm_add_ps(_mm_add_ps(_mm_min_ps(xRow[0], xRow[1]), _mm_min_ps(yRow[0], yRow[1])), _mm_min_ps(zRow[0], zRow[1])));
+	float minW = GetLane<3>(minVert) - DepthBias;
+
+	if (minW < 0.00000001f)
+		return true;
+
+	__m128 screenMin = _mm_set1_ps(FLT_MAX);
+	__m128 screenMax = _mm_set1_ps(-FLT_MAX);
+
+	for (uint32_t i = 0; i < AABB_VERTICES; i++)
+	{
+		// Transform the vertex
+		__m128 vert = ViewProj[3];
+		vert = _mm_add_ps(vert, xRow[sBBxInd[i]]);
+		vert = _mm_add_ps(vert, yRow[sBByInd[i]]);
+		vert = _mm_add_ps(vert, zRow[sBBzInd[i]]);
+
+		// project
+		__m128 xformedPos = ProjectToNDC(vert);
+
+		// update bounds
+		screenMin = _mm_min_ps(screenMin, xformedPos);
+		screenMax = _mm_max_ps(screenMax, xformedPos);
+	}
+
+	return TestRect(GetLane<0>(screenMin), GetLane<1>(screenMin), GetLane<0>(screenMax), GetLane<1>(screenMax), minW);
+}
+
+bool MOC_OcclusionView::TestRect(float MinX, float MinY, float MaxX, float MaxY, float W) const
+{
+	float padding = RectPadding + ParallaxScale / W;
+
+	MinX -= padding;
+	MinY -= padding;
+	MaxX += padding;
+	MaxY += padding;
+
+	// TestRect() only looks at the part on screen. Past an edge the previous frame never saw, that may be
+	// exactly the part that's visible now.
+	if (((UnknownEdges & EDGE_LEFT) && MinX < -1.0f) ||
+		((UnknownEdges & EDGE_RIGHT) && MaxX > 1.0f) ||
+		((UnknownEdges & EDGE_BOTTOM) && MinY < -1.0f) ||
+		((UnknownEdges & EDGE_TOP) && MaxY > 1.0f))
+		return true;
+
+	return Buffer->TestRect(MinX, MinY, MaxX, MaxY, W) == MaskedOcclusionCulling::VISIBLE;
+}
\ No newline at end of file
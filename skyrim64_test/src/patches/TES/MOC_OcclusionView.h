@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <xmmintrin.h>
+
+class MaskedOcclusionCulling;
+
+//
+// Camera for one frame of occlusion culling. Matrices are four __m128 rows laid out like XMMATRIX
+// (row vectors, v * M). The view has no translation: everything is rendered and tested relative to
+// Position, the camera's world translation.
+//
+struct MOC_OcclusionCamera
+{
+	__m128 View[4];
+	__m128 Proj[4];
+	__m128 ViewProj[4];
+	__m128 Position;
+	__m128 Direction;
+};
+
+//
+// One frame of a recorded camera path, written by the game with "Record Camera Path" and replayed by
+// the offline occlusion tests. Vectors are world space and the frustum is NiFrustum's (left, right,
+// top, bottom, near, far). The same format string is used for fprintf and fscanf.
+//
+struct MOC_CameraPathFrame
+{
+	float Position[3];
+	float Direction[3];
+	float Up[3];
+	float Right[3];
+	float Frustum[6];
+
+	bool Read(FILE *File);
+	void Write(FILE *File) const;
+};
+
+//
+// Everything an occludee test needs. Normally this is the current frame's merged buffer. With
+// temporal occlusion enabled it's the previous frame's buffer + camera, and the padding terms
+// make the test conservative for whatever the camera delta could have disoccluded.
+//
+// No engine types in here on purpose: recorded camera paths can be replayed through the exact tests
+// the game runs. Nothing here depends on Windows.
+//
+struct MOC_OcclusionView
+{
+	enum : uint32_t
+	{
+		EDGE_LEFT = 1,
+		EDGE_RIGHT = 2,
+		EDGE_BOTTOM = 4,
+		EDGE_TOP = 8,
+		EDGE_ALL = 15,
+	};
+
+	MaskedOcclusionCulling *Buffer;
+	__m128 View[4];
+	__m128 ViewProj[4];
+	__m128 PosAdjust;
+	uint32_t UnknownEdges;	// EDGE_* where this frame sees past the buffer's screen
+	float DepthBias;		// Occludee treated as this much closer to the camera
+	float RectPadding;		// NDC padding on each side of the occludee rectangle (rotation + rounding)
+	float ParallaxScale;	// Extra NDC padding = ParallaxScale / w (translation)
+
+	void SetCurrentFrame(MaskedOcclusionCulling *CurrentBuffer, const MOC_OcclusionCamera& Camera);
+	bool SetTemporal(MaskedOcclusionCulling *HistoryBuffer, const MOC_OcclusionCamera& History, const MOC_OcclusionCamera& Current, float MaxTranslation, float MaxRotation, uint32_t RenderWidth);
+
+	// Both return true if the object might be visible. Center and HalfExtents are world space, w is ignored.
+	bool TestSphere(__m128 Center, float Radius) const;
+	bool TestAABB(__m128 Center, __m128 HalfExtents) const;
+	bool TestRect(float MinX, float MinY, float MaxX, float MaxY, float W) const;
+};
\ No newline at end of file
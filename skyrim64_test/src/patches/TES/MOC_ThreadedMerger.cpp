@@ -14,6 +14,8 @@ MOC_ThreadedMerger::MOC_ThreadedMerger(uint32_t Width, uint32_t Height, uint32_t
 		m_EarlySignalEvent = nullptr;
 
 	m_EarlySignalStack.store(0);
+	m_OutstandingPackets.store(0);
+	m_FinalBuffer.store(nullptr);
 
 	m_TraverseSceneCallback = nullptr;
 	m_RenderGeometryCallback = nullptr;
@@ -27,6 +29,13 @@ MOC_ThreadedMerger::MOC_ThreadedMerger(uint32_t Width, uint32_t Height, uint32_t
 		std::thread cullThread(&MOC_ThreadedMerger::CullThread, this, i);
 		cullThread.detach();
 	}
+
+	// Clear() touches every instance, so don't hand this object out until they all exist
+	for (uint32_t i = 0; i < m_ThreadCount; i++)
+	{
+		while (!m_ThreadInitialized[i].load())
+			std::this_thread::yield();
+	}
 }
 
 MOC_ThreadedMerger::~MOC_ThreadedMerger()
@@ -39,16 +48,22 @@ MOC_ThreadedMerger::~MOC_ThreadedMerger()
 
 		m_PendingPackets.push(p);
 	}
-	
-	CloseHandle(m_EarlySignalEvent);
 
-	// Each thread will free remaining MaskedOcclusionCulling pointers. They will also exit before
-	// setting ThreadWorking to false.
+	// Wake anything sleeping in CullThread() so the terminate packets are seen right away
+	NotifyPreWork();
+
+	// Each thread will free its MaskedOcclusionCulling instance and clear ThreadInitialized right before exiting
 	for (uint32_t i = 0; i < m_ThreadCount; i++)
 	{
-		while (m_ThreadWorking[i].load())
-			_mm_pause();
+		while (m_ThreadInitialized[i].load())
+			std::this_thread::yield();
 	}
+
+	if (m_EarlySignalEvent)
+		CloseHandle(m_EarlySignalEvent);
+
+	delete[] m_DepthPixels;
+	delete[] m_ColorPixels;
 }
 
 void MOC_ThreadedMerger::SetTraverseSceneCallback(void(*Callback)(MaskedOcclusionCulling *MOC, void *UserData))
@@ -64,16 +79,36 @@ void MOC_ThreadedMerger::SetRenderGeometryCallback(void(*Callback)(MaskedOcclusi
 void MOC_ThreadedMerger::Flush()
 {
 	NotifyPreWork();
+	FlushAsync();
+	WaitForFlush();
+	ClearPreWorkNotify();
+}
 
+void MOC_ThreadedMerger::FlushAsync()
+{
+	// Queue the merge but don't wait for it. GetMOC() returns nullptr until a worker finishes.
 	CullPacket p;
 	p.UserData = nullptr;
 	p.Type = CULL_FLUSH;
 
 	m_FinalBuffer.store(nullptr);
+	m_OutstandingPackets++;
 	m_PendingPackets.push(p);
+}
 
+void MOC_ThreadedMerger::WaitForFlush()
+{
 	while (!m_FinalBuffer.load())
 		_mm_pause();
+}
+
+void MOC_ThreadedMerger::WaitForIdle()
+{
+	// Packets can queue more packets (scene traversal -> geometry), so wait on the counter instead of the queue
+	NotifyPreWork();
+
+	while (m_OutstandingPackets.load() != 0)
+		std::this_thread::yield();
 
 	ClearPreWorkNotify();
 }
@@ -86,16 +121,27 @@ void MOC_ThreadedMerger::Clear()
 
 void MOC_ThreadedMerger::UpdateDepthViewTexture(ID3D11DeviceContext *Context, ID3D11Texture2D *Texture)
 {
-	// Only allocate the buffer on demand
-	static float *rawDepthPixels = new float[m_RenderWidth * m_RenderHeight];
+	// Merge may still be in flight when flushing asynchronously
+	if (!GetMOC())
+		return;
+
+	// Only allocate the buffers on demand
+	if (!m_DepthPixels)
+	{
+		m_DepthPixels = new float[m_RenderWidth * m_RenderHeight];
+		m_ColorPixels = new uint8_t[m_RenderWidth * m_RenderHeight * 4];
+	}
 
-	GetMOC()->ComputePixelDepthBuffer(rawDepthPixels, false);
+	GetMOC()->ComputePixelDepthBuffer(m_DepthPixels, false);
+	DepthColorize(m_DepthPixels, m_ColorPixels);
 
 	D3D11_MAPPED_SUBRESOURCE resource;
 	if (SUCCEEDED(Context->Map(Texture, 0, D3D11_MAP_WRITE_DISCARD, 0, &resource)))
 	{
-		// Write directly to D3D11-allocated memory
-		DepthColorize(rawDepthPixels, (uint8_t *)resource.pData);
+		// Row pitch isn't guaranteed to be width * 4 for every resolution
+		for (uint32_t y = 0; y < m_RenderHeight; y++)
+			memcpy((uint8_t *)resource.pData + y * resource.RowPitch, &m_ColorPixels[y * m_RenderWidth * 4], m_RenderWidth * 4);
+
 		Context->Unmap(Texture, 0);
 	}
 }
@@ -232,11 +278,15 @@ void MOC_ThreadedMerger::CullThread(uint32_t ThreadIndex)
 			// !!!! THREAD EXITS HERE !!!!
 			// !!!!!!!!!!!!!!!!!!!!!!!!!!!
 			MaskedOcclusionCulling::Destroy(moc);
+			m_MOCInstances[ThreadIndex] = nullptr;
+			m_ThreadInitialized[ThreadIndex].store(false);
 			return;
 		}
 		break;
 		}
 
+		m_OutstandingPackets--;
+
 		if (m_PendingPackets.try_pop(p))
 			goto __fastloop;
 
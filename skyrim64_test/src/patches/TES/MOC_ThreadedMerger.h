@@ -27,6 +27,7 @@ private:
 	uint32_t m_ThreadCount;
 	HANDLE m_EarlySignalEvent;
 	std::atomic_uint m_EarlySignalStack;
+	std::atomic_uint m_OutstandingPackets;				// Queued or in-progress packets, excluding termination
 
 	void (*m_TraverseSceneCallback)(MaskedOcclusionCulling *MOC, void *UserData);
 	void (*m_RenderGeometryCallback)(MaskedOcclusionCulling *MOC, void *UserData);
@@ -38,6 +39,9 @@ private:
 
 	std::atomic<MaskedOcclusionCulling *> m_FinalBuffer;	// Final scene depth buffer after calling Flush()
 
+	float *m_DepthPixels = nullptr;							// Debug viewer scratch, allocated on demand
+	uint8_t *m_ColorPixels = nullptr;						// ^
+
 public:
 	MOC_ThreadedMerger(uint32_t Width, uint32_t Height, uint32_t Threads = 1, bool EnableCPUConservation = true);
 	~MOC_ThreadedMerger();
@@ -46,15 +50,34 @@ public:
 	void SetRenderGeometryCallback(void(*Callback)(MaskedOcclusionCulling *MOC, void *UserData));
 
 	void Flush();
+	void FlushAsync();
+	void WaitForFlush();
+	void WaitForIdle();
 	void Clear();
 	void UpdateDepthViewTexture(ID3D11DeviceContext *Context, ID3D11Texture2D *Texture);
 
+	__forceinline uint32_t GetRenderWidth() const
+	{
+		return m_RenderWidth;
+	}
+
+	__forceinline uint32_t GetRenderHeight() const
+	{
+		return m_RenderHeight;
+	}
+
+	__forceinline uint32_t GetThreadCount() const
+	{
+		return m_ThreadCount;
+	}
+
 	__forceinline void SubmitSceneRender(void *UserData)
 	{
 		CullPacket p;
 		p.UserData = UserData;
 		p.Type = CULL_TRAVERSE_SCENE;
 
+		m_OutstandingPackets++;
 		m_PendingPackets.push(p);
 	}
 
@@ -64,6 +87,7 @@ public:
 		p.UserData = UserData;
 		p.Type = CULL_RENDER_GEOMETRY;
 
+		m_OutstandingPackets++;
 		m_PendingPackets.push(p);
 	}
 
@@ -10,6 +10,8 @@ extern uintptr_t commandDataStart[6];
 extern uintptr_t commandData[6];
 extern thread_local class GameCommandList *ActiveManager;
 
+#define MAXIMUM_WORKER_THREADS 4
+
 int DC_RenderDeferred(__int64 a1, unsigned int a2, void(*func)(__int64, unsigned int), bool DisableRenderer);
 void DC_WaitDeferred(int JobHandle);
 
@@ -3,6 +3,8 @@
 #include "NiTransform.h"
 #include "NiObjectNET.h"
 
+class NiNode;
+
 struct NiBound
 {
 	NiPoint3 m_kCenter;
@@ -43,7 +45,8 @@ public:
 	virtual void Unk6();
 	virtual void OnVisible(class NiCullingProcess *Process, uint32_t Unknown);
 
-	char _pad0[0x4C];
+	NiNode *m_pkParent;
+	char _pad0[0x44];
 	NiTransform m_kWorld;
 	NiTransform m_kPreviousWorld;
 	NiBound m_kWorldBound;
@@ -60,6 +63,11 @@ public:
 		return m_kPreviousWorld;
 	}
 
+	NiNode *GetParent() const
+	{
+		return m_pkParent;
+	}
+
 	const NiPoint3& GetWorldTranslate() const
 	{
 		return m_kWorld.m_Translate;
@@ -151,6 +159,7 @@ public:
 	}
 };
 static_assert(sizeof(NiAVObject) == 0x110);
+static_assert_offset(NiAVObject, m_pkParent, 0x30);
 static_assert_offset(NiAVObject, m_kWorld, 0x7C);
 static_assert_offset(NiAVObject, m_kPreviousWorld, 0xB0);
 static_assert_offset(NiAVObject, m_kWorldBound, 0xE4);
@@ -1,6 +1,43 @@
-#include "../../../common.h"
+#include <immintrin.h>
 #include "NiCollisionUtils.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX_TARGET
+#else
+#define AVX_TARGET __attribute__((target("avx")))
+#endif
+
+//
+// Nothing here depends on Windows. MSVC emits AVX intrinsics without /arch:AVX; GCC and Clang need the
+// kernel marked as an AVX function so the rest of the file stays baseline x64.
+//
+namespace
+{
+	const float fTriangleTolerance = 1e-05f;
+
+	bool DetectAVX()
+	{
+#ifdef _MSC_VER
+		int cpuinfo[4];
+		__cpuid(cpuinfo, 1);
+
+		// CPU support plus OS support for saving YMM registers
+		const bool hasOSXSAVE = ((cpuinfo[2] & (1 << 27)) != 0);
+		const bool hasAVX = ((cpuinfo[2] & (1 << 28)) != 0);
+
+		return hasOSXSAVE && hasAVX && (_xgetbv(0) & 0x6) == 0x6;
+#else
+		// Also checks OS support for YMM state
+		return __builtin_cpu_supports("avx") != 0;
+#endif
+	}
+
+	const bool HasAVX = DetectAVX();
+}
+
+static AVX_TARGET uint32_t IntersectTriangles8AVX(const NiPoint3& kOrigin, const NiPoint3& kDir, const float (&kV)[3][3][8], bool bCull);
+
 bool NiCollisionUtils::IntersectTriangle(const NiPoint3& kOrigin, const NiPoint3& kDir, const NiPoint3& kV1, const NiPoint3& kV2, const NiPoint3& kV3, bool bCull, NiPoint3& kIntersect, float& r, float& s, float& t)
 {
 	// All input quantities are in model space of the NiTriBasedGeom object.
@@ -19,7 +56,7 @@ bool NiCollisionUtils::IntersectTriangle(const NiPoint3& kOrigin, const NiPoint3
 	// Tools, vol. 2, no. 1, pp 21-28, 1997. With some modifications to the 
 	// non-culling case by Michael Mounier.
 
-	const float fTolerance = 1e-05f;
+	const float fTolerance = fTriangleTolerance;
 
 	NiPoint3 kEdge1 = kV2 - kV1;
 	NiPoint3 kEdge2 = kV3 - kV1;
@@ -79,4 +116,114 @@ bool NiCollisionUtils::IntersectTriangle(const NiPoint3& kOrigin, const NiPoint3
 	kIntersect = kOrigin + r * kDir;
 
 	return true;
+}
+
+uint32_t NiCollisionUtils::IntersectTriangles8(const NiPoint3& kOrigin, const NiPoint3& kDir, const float (&kV)[3][3][8], uint32_t uiCount, bool bCull)
+{
+	if (HasAVX)
+	{
+		const uint32_t validMask = (uiCount >= 8) ? 0xFF : ((1u << uiCount) - 1);
+
+		return IntersectTriangles8AVX(kOrigin, kDir, kV, bCull) & validMask;
+	}
+
+	return IntersectTriangles8Scalar(kOrigin, kDir, kV, uiCount, bCull);
+}
+
+uint32_t NiCollisionUtils::IntersectTriangles8Scalar(const NiPoint3& kOrigin, const NiPoint3& kDir, const float (&kV)[3][3][8], uint32_t uiCount, bool bCull)
+{
+	uint32_t mask = 0;
+
+	for (uint32_t i = 0; i < uiCount && i < 8; i++)
+	{
+		NiPoint3 kV1(kV[0][0][i], kV[0][1][i], kV[0][2][i]);
+		NiPoint3 kV2(kV[1][0][i], kV[1][1][i], kV[1][2][i]);
+		NiPoint3 kV3(kV[2][0][i], kV[2][1][i], kV[2][2][i]);
+
+		NiPoint3 kIntersect;
+		float r, s, t;
+
+		if (IntersectTriangle(kOrigin, kDir, kV1, kV2, kV3, bCull, kIntersect, r, s, t))
+			mask |= 1u << i;
+	}
+
+	return mask;
+}
+
+bool NiCollisionUtils::HasIntersectTriangles8SIMD()
+{
+	return HasAVX;
+}
+
+static AVX_TARGET uint32_t IntersectTriangles8AVX(const NiPoint3& kOrigin, const NiPoint3& kDir, const float (&kV)[3][3][8], bool bCull)
+{
+	//
+	// Same operations in the same order as IntersectTriangle(), so every lane rounds identically and
+	// the masks agree bit for bit. All comparisons are ordered: NaNs fail the determinant tests and
+	// pass the rejection tests, exactly like the scalar branches.
+	//
+	const __m256 ox = _mm256_set1_ps(kOrigin.x);
+	const __m256 oy = _mm256_set1_ps(kOrigin.y);
+	const __m256 oz = _mm256_set1_ps(kOrigin.z);
+	const __m256 dx = _mm256_set1_ps(kDir.x);
+	const __m256 dy = _mm256_set1_ps(kDir.y);
+	const __m256 dz = _mm256_set1_ps(kDir.z);
+	const __m256 zero = _mm256_setzero_ps();
+
+	const __m256 v1x = _mm256_loadu_ps(kV[0][0]);
+	const __m256 v1y = _mm256_loadu_ps(kV[0][1]);
+	const __m256 v1z = _mm256_loadu_ps(kV[0][2]);
+
+	// kEdge1 = kV2 - kV1, kEdge2 = kV3 - kV1
+	const __m256 e1x = _mm256_sub_ps(_mm256_loadu_ps(kV[1][0]), v1x);
+	const __m256 e1y = _mm256_sub_ps(_mm256_loadu_ps(kV[1][1]), v1y);
+	const __m256 e1z = _mm256_sub_ps(_mm256_loadu_ps(kV[1][2]), v1z);
+	const __m256 e2x = _mm256_sub_ps(_mm256_loadu_ps(kV[2][0]), v1x);
+	const __m256 e2y = _mm256_sub_ps(_mm256_loadu_ps(kV[2][1]), v1y);
+	const __m256 e2z = _mm256_sub_ps(_mm256_loadu_ps(kV[2][2]), v1z);
+
+	// kPt = kDir.Cross(kEdge2)
+	const __m256 ptx = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+	const __m256 pty = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+	const __m256 ptz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+
+	// fDet = kEdge1 * kPt
+	const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, ptx), _mm256_mul_ps(e1y, pty)), _mm256_mul_ps(e1z, ptz));
+
+	// kS = kOrigin - kV1, s = kS * kPt
+	const __m256 sx = _mm256_sub_ps(ox, v1x);
+	const __m256 sy = _mm256_sub_ps(oy, v1y);
+	const __m256 sz = _mm256_sub_ps(oz, v1z);
+	const __m256 s = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, ptx), _mm256_mul_ps(sy, pty)), _mm256_mul_ps(sz, ptz));
+
+	// q = kS.Cross(kEdge1), t = kDir * q, r = kEdge2 * q
+	const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+	const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+	const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+	const __m256 t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz));
+	const __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz));
+	const __m256 st = _mm256_add_ps(s, t);
+
+	// Determinant is positive
+	__m256 positive = _mm256_cmp_ps(det, _mm256_set1_ps(fTriangleTolerance), _CMP_GE_OQ);
+	__m256 reject = _mm256_or_ps(_mm256_cmp_ps(s, zero, _CMP_LT_OQ), _mm256_cmp_ps(s, det, _CMP_GT_OQ));
+	reject = _mm256_or_ps(reject, _mm256_cmp_ps(t, zero, _CMP_LT_OQ));
+	reject = _mm256_or_ps(reject, _mm256_cmp_ps(st, det, _CMP_GT_OQ));
+	reject = _mm256_or_ps(reject, _mm256_cmp_ps(r, zero, _CMP_LT_OQ));
+
+	uint32_t mask = _mm256_movemask_ps(_mm256_andnot_ps(reject, positive));
+
+	// Determinant is negative
+	if (!bCull)
+	{
+		__m256 negative = _mm256_cmp_ps(det, _mm256_set1_ps(-fTriangleTolerance), _CMP_LE_OQ);
+		reject = _mm256_or_ps(_mm256_cmp_ps(s, zero, _CMP_GT_OQ), _mm256_cmp_ps(s, det, _CMP_LT_OQ));
+		reject = _mm256_or_ps(reject, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+		reject = _mm256_or_ps(reject, _mm256_cmp_ps(st, det, _CMP_LT_OQ));
+		reject = _mm256_or_ps(reject, _mm256_cmp_ps(r, zero, _CMP_GT_OQ));
+
+		mask |= _mm256_movemask_ps(_mm256_andnot_ps(reject, negative));
+	}
+
+	return mask;
 }
\ No newline at end of file
@@ -1,9 +1,18 @@
 #pragma once
 
+#include <stdint.h>
 #include "NiPoint.h"
 
 class NiCollisionUtils
 {
 public:
 	static bool IntersectTriangle(const NiPoint3& kOrigin, const NiPoint3& kDir, const NiPoint3& kV1, const NiPoint3& kV2, const NiPoint3& kV3, bool bCull, NiPoint3& kIntersect, float& r, float& s, float& t);
+
+	// Triangles are stored as kV[vertex][axis][lane]. Returns a bit for every lane below uiCount that
+	// IntersectTriangle() would accept; it does not produce intersection parameters.
+	static uint32_t IntersectTriangles8(const NiPoint3& kOrigin, const NiPoint3& kDir, const float (&kV)[3][3][8], uint32_t uiCount, bool bCull);
+
+	// Lane by lane IntersectTriangle(). IntersectTriangles8() falls back to this without AVX.
+	static uint32_t IntersectTriangles8Scalar(const NiPoint3& kOrigin, const NiPoint3& kDir, const float (&kV)[3][3][8], uint32_t uiCount, bool bCull);
+	static bool HasIntersectTriangles8SIMD();
 };
\ No newline at end of file
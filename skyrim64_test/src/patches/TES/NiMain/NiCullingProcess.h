@@ -6,10 +6,28 @@
 class NiCamera;
 class NiVisibleArray;
 
+struct NiPlane
+{
+	NiPoint3 m_kNormal;
+	float m_fConstant;
+};
+static_assert(sizeof(NiPlane) == 0x10);
+
 class NiFrustumPlanes
 {
 public:
-	char _pad[0x60];				// NiPlane m_akCullingPlanes[6];
+	enum
+	{
+		NEAR_PLANE = 0,
+		FAR_PLANE = 1,
+		LEFT_PLANE = 2,
+		RIGHT_PLANE = 3,
+		TOP_PLANE = 4,
+		BOTTOM_PLANE = 5,
+		MAX_PLANES = 6,
+	};
+
+	NiPlane m_akCullingPlanes[MAX_PLANES];
 	uint32_t m_uiActivePlanes;
 	uint32_t m_uiBasePlaneStates;
 	char _pad1[0x8];				// Intentional padding
@@ -28,6 +46,16 @@ public:
 	{
 		return m_uiActivePlanes != 0;
 	}
+
+	bool IsPlaneActive(uint32_t Plane) const
+	{
+		return (m_uiActivePlanes & (1 << Plane)) != 0;
+	}
+
+	const NiPlane& GetPlane(uint32_t Plane) const
+	{
+		return m_akCullingPlanes[Plane];
+	}
 };
 static_assert(sizeof(NiFrustumPlanes) == 0x70);
 static_assert_offset(NiFrustumPlanes, m_uiActivePlanes, 0x60);
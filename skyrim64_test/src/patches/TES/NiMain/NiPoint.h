@@ -31,6 +31,8 @@ public:
 	{
 	}
 
+	NiPoint3& operator=(const NiPoint3& Src) = default;
+
 	inline void Unitize()
 	{
 		// AKA vector normalization
@@ -674,4 +674,9 @@ void Patch_TESVCreationKit()
 
 	// Force multiple master loads
 	//XUtil::PatchMemory(OFFSET(0x163CDF3, 1530), (PBYTE)"\xEB", 1);
+
+	//
+	// Experimental. Must stay last, it has to see every hook above.
+	//
+	ExperimentalPatchPeephole();
 }
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include <string.h>
+#include <utility>
+#include "ConstantDedupCache.h"
+
+ConstantDedupCache::ConstantDedupCache()
+{
+	memset(m_Staging, 0, sizeof(m_Staging));
+	memset(m_Entries, 0, sizeof(m_Entries));
+	memset(m_NextEntry, 0, sizeof(m_NextEntry));
+}
+
+uint8_t *ConstantDedupCache::AcquireStaging(uint32_t *Slot)
+{
+	// Allocated on first use, most threads never touch this
+	if (m_Storage.empty())
+	{
+		m_Storage.resize((StagingSlots + Levels * EntriesPerLevel) * StagingSize);
+		uint8_t *data = m_Storage.data();
+
+		for (uint8_t *& staging : m_Staging)
+		{
+			staging = data;
+			data += StagingSize;
+		}
+
+		for (auto& level : m_Entries)
+		{
+			for (Entry& entry : level)
+			{
+				entry.Data = data;
+				data += StagingSize;
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < StagingSlots; i++)
+	{
+		if (m_StagingUsedBits & (1u << i))
+			continue;
+
+		m_StagingUsedBits |= (1u << i);
+		*Slot = i;
+		return m_Staging[i];
+	}
+
+	return nullptr;
+}
+
+uint8_t *ConstantDedupCache::GetStaging(uint32_t Slot) const
+{
+	return m_Staging[Slot];
+}
+
+void ConstantDedupCache::ReleaseStaging(uint32_t Slot)
+{
+	m_StagingUsedBits &= ~(1u << Slot);
+}
+
+void ConstantDedupCache::ReleaseAllStaging()
+{
+	m_StagingUsedBits = 0;
+}
+
+bool ConstantDedupCache::Find(uint32_t Slot, uint32_t Level, uint64_t Hash, uint32_t Size, uint32_t Lane, uint32_t *Offset) const
+{
+	if (Level >= Levels)
+		Level = Levels - 1;
+
+	for (const Entry& entry : m_Entries[Level])
+	{
+		if (entry.Hash == Hash && entry.Size == Size && entry.Lane == Lane && memcmp(entry.Data, m_Staging[Slot], Size) == 0)
+		{
+			*Offset = entry.Offset;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ConstantDedupCache::Insert(uint32_t Slot, uint32_t Level, uint64_t Hash, uint32_t Size, uint32_t Lane, uint32_t Offset)
+{
+	if (Level >= Levels)
+		Level = Levels - 1;
+
+	// Keep these bytes for later compares by trading buffers with the oldest entry
+	Entry& entry = m_Entries[Level][m_NextEntry[Level]++ % EntriesPerLevel];
+
+	std::swap(entry.Data, m_Staging[Slot]);
+	entry.Hash = Hash;
+	entry.Size = Size;
+	entry.Offset = Offset;
+	entry.Lane = Lane;
+}
+
+void ConstantDedupCache::Invalidate()
+{
+	// Staging buffers are kept, only the cached ring offsets are forgotten
+	for (auto& level : m_Entries)
+	{
+		for (Entry& entry : level)
+			entry.Size = 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+//
+// Constant buffer dedup: ring-sized groups are written to CPU staging memory first. When the group is
+// flushed its bytes are compared against the last few uploads at the same level, and a match gives back
+// the earlier ring offset instead of allocating and copying again.
+//
+// A cached offset is only good while the ring memory behind it holds the same bytes. The owner calls
+// Invalidate() whenever that stops being true: a new frame or command list, or an ExecuteCommandList that
+// may have renamed the buffer. The hash is supplied by the caller. Nothing here depends on Windows.
+//
+class ConstantDedupCache
+{
+public:
+	static const uint32_t StagingSize = 4096;
+	static const uint32_t StagingSlots = 8;
+	static const uint32_t Levels = 4;
+	static const uint32_t EntriesPerLevel = 4;
+
+private:
+	struct Entry
+	{
+		uint64_t Hash;
+		uint32_t Size;			// 0 = unused
+		uint32_t Offset;		// Ring buffer byte offset holding these bytes
+		uint32_t Lane;
+		uint8_t *Data;			// CPU copy for the final compare
+	};
+
+	std::vector<uint8_t> m_Storage;
+	uint8_t *m_Staging[StagingSlots];
+	uint32_t m_StagingUsedBits = 0;
+	Entry m_Entries[Levels][EntriesPerLevel];
+	uint32_t m_NextEntry[Levels];
+
+public:
+	ConstantDedupCache();
+
+	ConstantDedupCache(const ConstantDedupCache&) = delete;
+	ConstantDedupCache& operator=(const ConstantDedupCache&) = delete;
+
+	// Null when every slot is waiting for its flush
+	uint8_t *AcquireStaging(uint32_t *Slot);
+	uint8_t *GetStaging(uint32_t Slot) const;
+	void ReleaseStaging(uint32_t Slot);
+	void ReleaseAllStaging();
+
+	// Ring offset of an earlier upload with the same bytes as the staging slot
+	bool Find(uint32_t Slot, uint32_t Level, uint64_t Hash, uint32_t Size, uint32_t Lane, uint32_t *Offset) const;
+
+	// The staging slot's bytes were copied to Offset. Its buffer moves into the cache, and the slot gets the
+	// evicted entry's buffer in return.
+	void Insert(uint32_t Slot, uint32_t Level, uint64_t Hash, uint32_t Size, uint32_t Lane, uint32_t Offset);
+
+	void Invalidate();
+};
\ No newline at end of file
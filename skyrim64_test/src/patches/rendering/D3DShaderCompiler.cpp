@@ -0,0 +1,114 @@
+#include "D3DShaderCompiler.h"
+#include <fstream>
+#include <d3dcompiler.h>
+
+namespace
+{
+	bool ReadWholeFile(const std::filesystem::path& Path, std::vector<char>& Data)
+	{
+		std::ifstream file(Path, std::ios::binary);
+
+		if (!file)
+			return false;
+
+		Data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	//
+	// Same lookup rules as D3D_COMPILE_STANDARD_FILE_INCLUDE (relative to the including file), but
+	// every opened path is recorded.
+	//
+	class TrackingInclude : public ID3DInclude
+	{
+	private:
+		std::filesystem::path m_RootDirectory;
+		std::unordered_map<LPCVOID, std::filesystem::path> m_OpenDirectories;
+		std::vector<std::filesystem::path>& m_Dependencies;
+
+	public:
+		TrackingInclude(const std::filesystem::path& Source, std::vector<std::filesystem::path>& Dependencies) : m_RootDirectory(Source.parent_path()), m_Dependencies(Dependencies)
+		{
+		}
+
+		HRESULT STDMETHODCALLTYPE Open(D3D_INCLUDE_TYPE IncludeType, LPCSTR pFileName, LPCVOID pParentData, LPCVOID *ppData, UINT *pBytes) override
+		{
+			auto parent = m_OpenDirectories.find(pParentData);
+			std::filesystem::path path = ((parent != m_OpenDirectories.end()) ? parent->second : m_RootDirectory) / pFileName;
+			std::vector<char> data;
+
+			if (!ReadWholeFile(path, data))
+				return E_FAIL;
+
+			char *buffer = new char[std::max<size_t>(data.size(), 1)];
+			memcpy(buffer, data.data(), data.size());
+
+			m_OpenDirectories.emplace(buffer, path.parent_path());
+			m_Dependencies.push_back(path);
+
+			*ppData = buffer;
+			*pBytes = (UINT)data.size();
+			return S_OK;
+		}
+
+		HRESULT STDMETHODCALLTYPE Close(LPCVOID pData) override
+		{
+			m_OpenDirectories.erase(pData);
+			delete[] (char *)pData;
+			return S_OK;
+		}
+	};
+}
+
+std::string D3DShaderCompiler::GetIdentifier() const
+{
+	// Output changes with the compiler DLL, so fold its version in
+	char identifier[64];
+	sprintf_s(identifier, "d3dcompiler_%d", D3D_COMPILER_VERSION);
+
+	return identifier;
+}
+
+void D3DShaderCompiler::Compile(const ShaderCompileRequest& Request, ShaderCompileResult& Result)
+{
+	std::vector<char> source;
+
+	if (!ReadWholeFile(Request.FilePath, source))
+	{
+		Result.Errors = "Unable to open " + GetUtf8Path(Request.FilePath);
+		return;
+	}
+
+	Result.Dependencies.push_back(Request.FilePath);
+
+	std::vector<D3D_SHADER_MACRO> macros;
+
+	for (auto& [name, value] : Request.Defines)
+		macros.push_back({ name.c_str(), value.c_str() });
+
+	macros.push_back({ nullptr, nullptr });
+
+	TrackingInclude include(Request.FilePath, Result.Dependencies);
+	std::string sourceName = GetUtf8Path(Request.FilePath);
+	ID3DBlob *shaderBlob = nullptr;
+	ID3DBlob *shaderErrors = nullptr;
+
+	HRESULT hr = D3DCompile(source.data(), source.size(), sourceName.c_str(), macros.data(), &include, Request.EntryPoint.c_str(), Request.Target.c_str(), Request.Flags, 0, &shaderBlob, &shaderErrors);
+
+	if (shaderErrors)
+	{
+		Result.Errors.assign((const char *)shaderErrors->GetBufferPointer(), shaderErrors->GetBufferSize());
+		shaderErrors->Release();
+	}
+
+	if (SUCCEEDED(hr) && shaderBlob)
+	{
+		auto data = (const uint8_t *)shaderBlob->GetBufferPointer();
+
+		Result.Bytecode.assign(data, data + shaderBlob->GetBufferSize());
+		Result.Success = true;
+	}
+
+	if (shaderBlob)
+		shaderBlob->Release();
+}
\ No newline at end of file
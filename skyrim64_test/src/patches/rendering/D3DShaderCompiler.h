@@ -0,0 +1,15 @@
+#pragma once
+
+#include "../../common.h"
+#include "ShaderCompileCache.h"
+
+//
+// IShaderCompiler backed by d3dcompiler_47. Sources are read by hand and passed to D3DCompile() with a
+// tracking include handler, so the cache learns about every header a shader pulls in.
+//
+class D3DShaderCompiler : public IShaderCompiler
+{
+public:
+	virtual std::string GetIdentifier() const override;
+	virtual void Compile(const ShaderCompileRequest& Request, ShaderCompileResult& Result) override;
+};
\ No newline at end of file
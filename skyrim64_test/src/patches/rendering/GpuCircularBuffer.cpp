@@ -1,89 +1,136 @@
 #include "GpuCircularBuffer.h"
 
-GpuCircularBuffer::GpuCircularBuffer(ID3D11Device *Device, uint32_t Type, uint32_t BufferSize, uint32_t MaxFrames)
+GpuCircularBuffer::Lane::Lane(uint32_t Size, uint32_t MaxFrames) : Allocator(0, Size, MaxFrames)
 {
+	D3DBuffer = nullptr;
+	MappedContext = nullptr;
 	memset(&Map, 0, sizeof(Map));
+	NeedsDiscard = false;
+}
+
+GpuCircularBuffer::GpuCircularBuffer(ID3D11Device *Device, uint32_t Type, uint32_t BufferSize, uint32_t MaxFrames, uint32_t LaneCount)
+{
 	memset(&Description, 0, sizeof(Description));
 
+	//
+	// The immediate context does most of the work, so it keeps half of the total size. Worker lanes
+	// split the other half. Lane sizes stay 256-byte aligned (constant buffer offset requirement).
+	//
+	Assert(LaneCount >= 1);
+
+	if (LaneCount == 1)
+	{
+		Lanes.emplace_back(BufferSize, MaxFrames);
+	}
+	else
+	{
+		const uint32_t immediateSize = (BufferSize / 2) & ~255u;
+		const uint32_t workerSize = ((BufferSize - immediateSize) / (LaneCount - 1)) & ~255u;
+
+		Lanes.reserve(LaneCount);
+		Lanes.emplace_back(immediateSize, MaxFrames);
+
+		for (uint32_t i = 1; i < LaneCount; i++)
+			Lanes.emplace_back(workerSize, MaxFrames);
+	}
+
 	// Request GPU-side allocation
-	Description.ByteWidth = BufferSize;
 	Description.Usage = D3D11_USAGE_DYNAMIC;
 	Description.BindFlags = Type;
 	Description.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 	Description.MiscFlags = 0;
 	Description.StructureByteStride = 0;
-	Assert(SUCCEEDED(Device->CreateBuffer(&Description, nullptr, &D3DBuffer)));
 
-	FrameUtilizedAmounts = new uint32_t[MaxFrames];
-	CurrentAvailable = BufferSize;
+	for (Lane& lane : Lanes)
+	{
+		Description.ByteWidth = lane.Allocator.GetSize();
+		Assert(SUCCEEDED(Device->CreateBuffer(&Description, nullptr, &lane.D3DBuffer)));
 
-	D3DBuffer->SetPrivateData(WKPDID_D3DDebugObjectName, strlen("GpuCircularBuffer"), "GpuCircularBuffer");
+		lane.D3DBuffer->SetPrivateData(WKPDID_D3DDebugObjectName, strlen("GpuCircularBuffer"), "GpuCircularBuffer");
+	}
 }
 
 GpuCircularBuffer::~GpuCircularBuffer()
 {
-	// Buffer is expected to be unmapped across all contexts by now
-	if (D3DBuffer)
+	// Buffers are expected to be unmapped across all contexts by now
+	for (Lane& lane : Lanes)
 	{
-		D3DBuffer->Release();
-		D3DBuffer = nullptr;
+		if (lane.D3DBuffer)
+		{
+			lane.D3DBuffer->Release();
+			lane.D3DBuffer = nullptr;
+		}
 	}
-
-	delete[] FrameUtilizedAmounts;
-	FrameUtilizedAmounts = nullptr;
 }
 
-void *GpuCircularBuffer::MapData(ID3D11DeviceContext *Context, uint32_t AllocationSize, uint32_t *AllocationOffset, bool ForceRemap)
+void *GpuCircularBuffer::MapData(ID3D11DeviceContext *Context, uint32_t AllocationSize, uint32_t *AllocationOffset, bool ForceRemap, uint32_t LaneIndex)
 {
 	// GPU allocations are required to be 16-byte aligned (explicitly set by me)
 	Assert(AllocationSize % 16 == 0);
+	Assert(LaneIndex < Lanes.size());
 
-	//
-	// Allocation boundaries are linear - they don't wrap around to the beginning:
-	//
-	// <START> ||Free   ||F1 In Use||F2 In Use||F3 In Use||Free     || <END>
-	//
-	if (CurrentOffset + AllocationSize >= Description.ByteWidth)
-	{
-		// We exceeded <END> so let's try an allocation from <START>
-		CurrentUtilized += Description.ByteWidth - CurrentOffset;
-		CurrentOffset = 0;
-	}
+	Lane& lane = Lanes[LaneIndex];
+	uint32_t allocBase = 0;
 
-	uint32_t newSize = CurrentUtilized + AllocationSize;
-	uint32_t allocBase = CurrentOffset;
-	AssertMsg(newSize <= CurrentAvailable, "Allocation would exceed available free data for this frame");
+	AssertMsg(lane.Allocator.Allocate(AllocationSize, &allocBase), "Allocation would exceed available free data for this frame");
 
-	// Allow the buffer to stay mapped across multiple function calls
-	if (ForceRemap || !Map.pData)
-		Assert(SUCCEEDED(Context->Map(D3DBuffer, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &Map)));
+	// Allow the buffer to stay mapped across multiple function calls (on the same context only)
+	if (ForceRemap || lane.NeedsDiscard || !lane.Map.pData || lane.MappedContext != Context)
+	{
+		D3D11_MAP mapType = lane.NeedsDiscard ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
 
-	CurrentUtilized = newSize;
-	CurrentOffset += AllocationSize;
+		Assert(SUCCEEDED(Context->Map(lane.D3DBuffer, 0, mapType, 0, &lane.Map)));
+		lane.MappedContext = Context;
+		lane.NeedsDiscard = false;
+	}
 
 	if (AllocationOffset)
 		*AllocationOffset = allocBase;
 
-	return (void *)((uintptr_t)Map.pData + allocBase);
+	return (void *)((uintptr_t)lane.Map.pData + allocBase);
 }
 
-void GpuCircularBuffer::UnmapData(ID3D11DeviceContext *Context)
+void GpuCircularBuffer::UnmapData(ID3D11DeviceContext *Context, uint32_t LaneIndex)
 {
-	if (!Map.pData)
+	Lane& lane = Lanes[LaneIndex];
+
+	if (!lane.Map.pData)
 		return;
 
-	Context->Unmap(D3DBuffer, 0);
-	memset(&Map, 0, sizeof(Map));
+	Context->Unmap(lane.D3DBuffer, 0);
+	memset(&lane.Map, 0, sizeof(lane.Map));
+	lane.MappedContext = nullptr;
+}
+
+void GpuCircularBuffer::BeginCommandList(uint32_t LaneIndex)
+{
+	// The discard gives this command list its own copy of the lane, so nothing mapped before is valid here
+	Lane& lane = Lanes[LaneIndex];
+
+	memset(&lane.Map, 0, sizeof(lane.Map));
+	lane.MappedContext = nullptr;
+	lane.NeedsDiscard = true;
 }
 
 void GpuCircularBuffer::SwapFrame(uint32_t FrameIndex)
 {
-	FrameUtilizedAmounts[FrameIndex] = CurrentUtilized;
-	CurrentAvailable -= CurrentUtilized;
-	CurrentUtilized = 0;
+	for (Lane& lane : Lanes)
+		lane.Allocator.SwapFrame(FrameIndex);
 }
 
 void GpuCircularBuffer::FreeOldFrame(uint32_t FrameIndex)
 {
-	CurrentAvailable += FrameUtilizedAmounts[FrameIndex];
+	for (Lane& lane : Lanes)
+		lane.Allocator.FreeOldFrame(FrameIndex);
+}
+
+uint32_t GpuCircularBuffer::GetLaneCount() const
+{
+	return (uint32_t)Lanes.size();
+}
+
+ID3D11Buffer *GpuCircularBuffer::GetBuffer(uint32_t LaneIndex) const
+{
+	Assert(LaneIndex < Lanes.size());
+	return Lanes[LaneIndex].D3DBuffer;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../../common.h"
+#include "GpuRingAllocator.h"
 
 //
 // Idea implemented from http://gamedevs.org/uploads/efficient-buffer-management.pdf
@@ -9,20 +10,37 @@
 class GpuCircularBuffer
 {
 public:
-	D3D11_MAPPED_SUBRESOURCE Map;
-	D3D11_BUFFER_DESC Description;
-	ID3D11Buffer *D3DBuffer = nullptr;
+	//
+	// The ring is split into lanes. Lane 0 belongs to the immediate context and the rest are handed
+	// to deferred context worker threads, so every context sub-allocates from its own range and no
+	// locking is needed. Each lane keeps its own per-frame history; they're fenced together.
+	//
+	// D3D11 requires the first map of a dynamic buffer in a deferred context's command list to be
+	// WRITE_DISCARD. BeginCommandList() makes the lane's next map a discard. Every lane is a separate
+	// D3D buffer so that discard only renames the worker's own lane, never the immediate context's.
+	//
+	struct Lane
+	{
+		GpuRingAllocator Allocator;
+		ID3D11Buffer *D3DBuffer;
+		ID3D11DeviceContext *MappedContext;
+		D3D11_MAPPED_SUBRESOURCE Map;
+		bool NeedsDiscard;
+
+		Lane(uint32_t Size, uint32_t MaxFrames);
+	};
 
-	uint32_t *FrameUtilizedAmounts = nullptr;	// History tracker for how many bytes each frame is using
-	uint32_t CurrentOffset = 0;					// Byte offset into the buffer
-	uint32_t CurrentUtilized = 0;				// Number of bytes possibly in use by GPU (cannot be written)
-	uint32_t CurrentAvailable = 0;				// Number of unused bytes (as guaranteed by Initialize()/FreeOldFrame())
+	D3D11_BUFFER_DESC Description;
+	std::vector<Lane> Lanes;
 
-	GpuCircularBuffer(ID3D11Device *Device, uint32_t Type, uint32_t BufferSize, uint32_t MaxFrames);
+	GpuCircularBuffer(ID3D11Device *Device, uint32_t Type, uint32_t BufferSize, uint32_t MaxFrames, uint32_t LaneCount = 1);
 	~GpuCircularBuffer();
 
-	void *MapData(ID3D11DeviceContext *Context, uint32_t AllocationSize, uint32_t *AllocationOffset, bool ForceRemap);
-	void UnmapData(ID3D11DeviceContext *Context);
+	void *MapData(ID3D11DeviceContext *Context, uint32_t AllocationSize, uint32_t *AllocationOffset, bool ForceRemap, uint32_t LaneIndex = 0);
+	void UnmapData(ID3D11DeviceContext *Context, uint32_t LaneIndex = 0);
+	void BeginCommandList(uint32_t LaneIndex);
 	void SwapFrame(uint32_t FrameIndex);
 	void FreeOldFrame(uint32_t FrameIndex);
+	uint32_t GetLaneCount() const;
+	ID3D11Buffer *GetBuffer(uint32_t LaneIndex = 0) const;
 };
\ No newline at end of file
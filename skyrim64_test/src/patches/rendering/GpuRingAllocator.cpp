@@ -0,0 +1,66 @@
+#include "GpuRingAllocator.h"
+
+GpuRingAllocator::GpuRingAllocator(uint32_t Base, uint32_t Size, uint32_t MaxFrames) : m_FrameUtilizedAmounts(MaxFrames, 0)
+{
+	m_Base = Base;
+	m_Size = Size;
+	m_CurrentAvailable = Size;
+}
+
+bool GpuRingAllocator::Allocate(uint32_t AllocationSize, uint32_t *AllocationOffset)
+{
+	uint32_t offset = m_CurrentOffset;
+	uint32_t utilized = m_CurrentUtilized;
+
+	if (offset + AllocationSize >= m_Size)
+	{
+		// We exceeded <END> so let's try an allocation from <START>
+		utilized += m_Size - offset;
+		offset = 0;
+	}
+
+	// Still owned by a frame the GPU hasn't finished. Leave the state untouched for the caller.
+	if (utilized + AllocationSize > m_CurrentAvailable)
+		return false;
+
+	m_CurrentUtilized = utilized + AllocationSize;
+	m_CurrentOffset = offset + AllocationSize;
+
+	if (AllocationOffset)
+		*AllocationOffset = m_Base + offset;
+
+	return true;
+}
+
+void GpuRingAllocator::SwapFrame(uint32_t FrameIndex)
+{
+	m_FrameUtilizedAmounts[FrameIndex] = m_CurrentUtilized;
+	m_CurrentAvailable -= m_CurrentUtilized;
+	m_CurrentUtilized = 0;
+}
+
+void GpuRingAllocator::FreeOldFrame(uint32_t FrameIndex)
+{
+	m_CurrentAvailable += m_FrameUtilizedAmounts[FrameIndex];
+	m_FrameUtilizedAmounts[FrameIndex] = 0;
+}
+
+uint32_t GpuRingAllocator::GetBase() const
+{
+	return m_Base;
+}
+
+uint32_t GpuRingAllocator::GetSize() const
+{
+	return m_Size;
+}
+
+uint32_t GpuRingAllocator::GetAvailable() const
+{
+	return m_CurrentAvailable;
+}
+
+uint32_t GpuRingAllocator::GetUtilized() const
+{
+	return m_CurrentUtilized;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+//
+// CPU-side bookkeeping for one linear range of a GPU ring buffer. There is nothing D3D specific in
+// here: the owner says when a frame's allocations were submitted (SwapFrame) and when the GPU is known
+// to be done with them (FreeOldFrame), so any fence - including a fake one - can drive it.
+//
+// Allocation boundaries are linear - they don't wrap around to the beginning:
+//
+// <START> ||Free   ||F1 In Use||F2 In Use||F3 In Use||Free     || <END>
+//
+class GpuRingAllocator
+{
+private:
+	uint32_t m_Base;							// Byte offset of this range inside the full buffer
+	uint32_t m_Size;							// Byte length of this range
+	std::vector<uint32_t> m_FrameUtilizedAmounts;// History tracker for how many bytes each frame is using
+	uint32_t m_CurrentOffset = 0;				// Byte offset into the range
+	uint32_t m_CurrentUtilized = 0;				// Number of bytes possibly in use by GPU (cannot be written)
+	uint32_t m_CurrentAvailable = 0;			// Number of unused bytes (as guaranteed by the constructor/FreeOldFrame())
+
+public:
+	GpuRingAllocator(uint32_t Base, uint32_t Size, uint32_t MaxFrames);
+
+	bool Allocate(uint32_t AllocationSize, uint32_t *AllocationOffset);
+	void SwapFrame(uint32_t FrameIndex);
+	void FreeOldFrame(uint32_t FrameIndex);
+
+	uint32_t GetBase() const;
+	uint32_t GetSize() const;
+	uint32_t GetAvailable() const;
+	uint32_t GetUtilized() const;
+};
\ No newline at end of file
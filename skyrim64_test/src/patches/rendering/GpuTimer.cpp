@@ -1,6 +1,7 @@
 #include "GpuTimer.h"
 
 GPUTimer g_GPUTimers;
+GPUScopeTimer g_GPUScopeTimers;
 
 void GPUTimer::Create(ID3D11Device *D3DDevice, uint32_t NumTimers)
 {
@@ -113,4 +114,165 @@ void GPUTimer::StopTimer(ID3D11DeviceContext *DeviceContext, uint32_t Id)
 float GPUTimer::GetGPUTimeInMS(uint32_t Id)
 {
 	return m_Timers.at(Id).GPUTimeInMS;
+}
+
+void GPUScopeTimer::Create(ID3D11Device *D3DDevice, uint32_t MaxScopesPerFrame)
+{
+	D3D11_QUERY_DESC queryDesc;
+	memset(&queryDesc, 0, sizeof(D3D11_QUERY_DESC));
+
+	for (FrameQueries& frame : m_Frames)
+	{
+		queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+		Assert(SUCCEEDED(D3DDevice->CreateQuery(&queryDesc, &frame.DisjointQuery)));
+
+		// Two timestamps per scope
+		frame.Timestamps.resize(MaxScopesPerFrame * 2);
+		queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+
+		for (ID3D11Query *& query : frame.Timestamps)
+			Assert(SUCCEEDED(D3DDevice->CreateQuery(&queryDesc, &query)));
+
+		frame.Scopes.reserve(MaxScopesPerFrame);
+		frame.UsedTimestamps = 0;
+		frame.InFlight = false;
+	}
+}
+
+void GPUScopeTimer::Release()
+{
+	for (FrameQueries& frame : m_Frames)
+	{
+		frame.DisjointQuery->Release();
+		frame.DisjointQuery = nullptr;
+
+		for (ID3D11Query *query : frame.Timestamps)
+			query->Release();
+
+		frame.Timestamps.clear();
+		frame.Scopes.clear();
+	}
+}
+
+void GPUScopeTimer::BeginFrame(ID3D11DeviceContext *DeviceContext)
+{
+	AssertMsgDebug(!m_InFrame, "Starting frame while already in frame");
+
+	m_InFrame = true;
+	FrameQueries& frame = m_Frames[m_FrameIndex];
+
+	// Pool from FrameLatency frames ago still isn't done. Don't wait for it, just skip this frame.
+	if (frame.InFlight && !Resolve(DeviceContext, frame))
+		return;
+
+	frame.Scopes.clear();
+	frame.UsedTimestamps = 0;
+	m_OpenScopes.clear();
+
+	DeviceContext->Begin(frame.DisjointQuery);
+	m_Recording = true;
+}
+
+void GPUScopeTimer::EndFrame(ID3D11DeviceContext *DeviceContext)
+{
+	AssertMsgDebug(m_InFrame, "Ending a frame that was never started");
+
+	m_InFrame = false;
+
+	if (!m_Recording)
+		return;
+
+	// Unbalanced markers end with the frame
+	while (!m_OpenScopes.empty())
+		EndScope(DeviceContext);
+
+	FrameQueries& frame = m_Frames[m_FrameIndex];
+	DeviceContext->End(frame.DisjointQuery);
+	frame.InFlight = true;
+
+	m_Recording = false;
+	m_FrameIndex = (m_FrameIndex + 1) % FrameLatency;
+}
+
+void GPUScopeTimer::BeginScope(ID3D11DeviceContext *DeviceContext, const wchar_t *Name)
+{
+	if (!m_Recording)
+		return;
+
+	FrameQueries& frame = m_Frames[m_FrameIndex];
+
+	Scope scope;
+	scope.Name = Name;
+	scope.Depth = (uint32_t)m_OpenScopes.size();
+	scope.BeginQuery = IssueTimestamp(DeviceContext, frame);
+	scope.EndQuery = InvalidQuery;
+
+	m_OpenScopes.push_back((uint32_t)frame.Scopes.size());
+	frame.Scopes.push_back(std::move(scope));
+}
+
+void GPUScopeTimer::EndScope(ID3D11DeviceContext *DeviceContext)
+{
+	if (!m_Recording || m_OpenScopes.empty())
+		return;
+
+	FrameQueries& frame = m_Frames[m_FrameIndex];
+	Scope& scope = frame.Scopes[m_OpenScopes.back()];
+
+	if (scope.BeginQuery != InvalidQuery)
+		scope.EndQuery = IssueTimestamp(DeviceContext, frame);
+
+	m_OpenScopes.pop_back();
+}
+
+const std::vector<GPUScopeTimer::Result>& GPUScopeTimer::GetResults() const
+{
+	return m_Results;
+}
+
+bool GPUScopeTimer::Resolve(ID3D11DeviceContext *DeviceContext, FrameQueries& Frame)
+{
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointTimestampValue;
+
+	if (DeviceContext->GetData(Frame.DisjointQuery, &disjointTimestampValue, sizeof(disjointTimestampValue), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return false;
+
+	std::vector<UINT64> timestamps(Frame.UsedTimestamps);
+
+	for (uint32_t i = 0; i < Frame.UsedTimestamps; i++)
+	{
+		if (DeviceContext->GetData(Frame.Timestamps[i], &timestamps[i], sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+			return false;
+	}
+
+	Frame.InFlight = false;
+
+	// Clock changed mid-frame (power state etc.), keep the last good tree
+	if (disjointTimestampValue.Disjoint)
+		return true;
+
+	double invFrequencyMS = 1000.0 / disjointTimestampValue.Frequency;
+	m_Results.clear();
+
+	for (Scope& scope : Frame.Scopes)
+	{
+		float time = 0.0f;
+
+		if (scope.BeginQuery != InvalidQuery && scope.EndQuery != InvalidQuery)
+			time = float(double(timestamps[scope.EndQuery] - timestamps[scope.BeginQuery]) * invFrequencyMS);
+
+		m_Results.push_back({ std::move(scope.Name), scope.Depth, time });
+	}
+
+	return true;
+}
+
+uint32_t GPUScopeTimer::IssueTimestamp(ID3D11DeviceContext *DeviceContext, FrameQueries& Frame)
+{
+	// Out of queries: the scope shows up with no time
+	if (Frame.UsedTimestamps >= Frame.Timestamps.size())
+		return InvalidQuery;
+
+	DeviceContext->End(Frame.Timestamps[Frame.UsedTimestamps]);
+	return Frame.UsedTimestamps++;
 }
\ No newline at end of file
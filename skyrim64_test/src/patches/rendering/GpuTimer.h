@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include "../../common.h"
 
 class GPUTimer
@@ -33,4 +34,66 @@ protected:
 	std::vector<GPUTimerState> m_Timers;
 };
 
-extern GPUTimer g_GPUTimers;
\ No newline at end of file
+//
+// Nested GPU timing scopes, opened and closed by Renderer::BeginEvent()/EndEvent() on the immediate
+// context. Every scope writes two timestamps from a per-frame query pool. Pools are triple buffered
+// and only read back when the frame that used them comes around again, so the CPU never waits on
+// the GPU. If a pool still isn't ready, that frame simply isn't timed.
+//
+class GPUScopeTimer
+{
+public:
+	struct Result
+	{
+		std::wstring Name;
+		uint32_t Depth;
+		float GPUTimeInMS;
+	};
+
+private:
+	static constexpr uint32_t FrameLatency = 3;
+	static constexpr uint32_t InvalidQuery = 0xFFFFFFFF;
+
+	struct Scope
+	{
+		std::wstring Name;
+		uint32_t Depth;
+		uint32_t BeginQuery;
+		uint32_t EndQuery;
+	};
+
+	struct FrameQueries
+	{
+		ID3D11Query *DisjointQuery;
+		std::vector<ID3D11Query *> Timestamps;
+		std::vector<Scope> Scopes;
+		uint32_t UsedTimestamps;
+		bool InFlight;
+	};
+
+	FrameQueries m_Frames[FrameLatency];
+	uint32_t m_FrameIndex = 0;
+	bool m_InFrame = false;
+	bool m_Recording = false;
+	std::vector<uint32_t> m_OpenScopes;
+	std::vector<Result> m_Results;
+
+public:
+	void Create(ID3D11Device *D3DDevice, uint32_t MaxScopesPerFrame);
+	void Release();
+
+	void BeginFrame(ID3D11DeviceContext *DeviceContext);
+	void EndFrame(ID3D11DeviceContext *DeviceContext);
+
+	void BeginScope(ID3D11DeviceContext *DeviceContext, const wchar_t *Name);
+	void EndScope(ID3D11DeviceContext *DeviceContext);
+
+	const std::vector<Result>& GetResults() const;
+
+private:
+	bool Resolve(ID3D11DeviceContext *DeviceContext, FrameQueries& Frame);
+	uint32_t IssueTimestamp(ID3D11DeviceContext *DeviceContext, FrameQueries& Frame);
+};
+
+extern GPUTimer g_GPUTimers;
+extern GPUScopeTimer g_GPUScopeTimers;
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include "PageGuardHits.h"
+
+PageGuardHitRing::PageGuardHitRing(uint32_t Capacity) : m_Capacity(Capacity), m_Slots(new Slot[Capacity])
+{
+	for (uint32_t i = 0; i < m_Capacity; i++)
+		m_Slots[i].Sequence.store(i, std::memory_order_relaxed);
+}
+
+bool PageGuardHitRing::Push(const PageGuardHit& Hit)
+{
+	uint32_t pos = m_EnqueuePos.load(std::memory_order_relaxed);
+
+	for (;;)
+	{
+		Slot& slot = m_Slots[pos & (m_Capacity - 1)];
+		const uint32_t sequence = slot.Sequence.load(std::memory_order_acquire);
+		const int32_t difference = (int32_t)(sequence - pos);
+
+		if (difference == 0)
+		{
+			if (m_EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				slot.Hit = Hit;
+				slot.Sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (difference < 0)
+		{
+			// Full. Never wait here: the caller may be stopped inside the code that would drain it.
+			m_Dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		else
+		{
+			pos = m_EnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+uint32_t PageGuardHitRing::Drain(PageGuardHit *Hits, uint32_t MaxCount)
+{
+	uint32_t count = 0;
+
+	for (; count < MaxCount; count++)
+	{
+		Slot& slot = m_Slots[m_DequeuePos & (m_Capacity - 1)];
+
+		if (slot.Sequence.load(std::memory_order_acquire) != m_DequeuePos + 1)
+			break;
+
+		Hits[count] = slot.Hit;
+		slot.Sequence.store(m_DequeuePos + m_Capacity, std::memory_order_release);
+		m_DequeuePos++;
+	}
+
+	return count;
+}
+
+uint64_t PageGuardHitRing::GetDroppedCount() const
+{
+	return m_Dropped.load(std::memory_order_relaxed);
+}
+
+void PageGuardHitAggregator::Add(const PageGuardHit *Hits, uint32_t Count)
+{
+	for (uint32_t i = 0; i < Count; i++)
+	{
+		const PageGuardHit& hit = Hits[i];
+		auto [itr, inserted] = m_CallSites.try_emplace(std::make_pair(hit.Range, hit.Rip));
+		CallSite& site = itr->second;
+
+		if (inserted)
+		{
+			site.Range = hit.Range;
+			site.Rip = hit.Rip;
+			site.Reads = 0;
+			site.Writes = 0;
+			site.MinAddress = hit.Address;
+			site.MaxAddress = hit.Address;
+			site.FirstThreadId = hit.ThreadId;
+			site.MultipleThreads = false;
+		}
+
+		if (hit.Write)
+			site.Writes++;
+		else
+			site.Reads++;
+
+		site.MinAddress = std::min(site.MinAddress, hit.Address);
+		site.MaxAddress = std::max(site.MaxAddress, hit.Address);
+		site.MultipleThreads |= (site.FirstThreadId != hit.ThreadId);
+	}
+
+	m_TotalHits += Count;
+}
+
+void PageGuardHitAggregator::Clear()
+{
+	m_CallSites.clear();
+	m_TotalHits = 0;
+}
+
+std::vector<PageGuardHitAggregator::CallSite> PageGuardHitAggregator::GetCallSites() const
+{
+	std::vector<CallSite> sites;
+	sites.reserve(m_CallSites.size());
+
+	for (auto& [key, site] : m_CallSites)
+		sites.push_back(site);
+
+	std::stable_sort(sites.begin(), sites.end(), [](const CallSite& A, const CallSite& B)
+	{
+		return (A.Reads + A.Writes) > (B.Reads + B.Writes);
+	});
+
+	return sites;
+}
+
+uint64_t PageGuardHitAggregator::GetTotalHits() const
+{
+	return m_TotalHits;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <vector>
+
+//
+// Storage for page guard watch hits. The exception handler pushes one PageGuardHit per trapped access into
+// a fixed-size ring (Vyukov's bounded queue, multiple producers, one consumer). Pushing never blocks or
+// allocates; a full ring drops the hit and counts it. A background thread drains the ring into a
+// PageGuardHitAggregator, which groups hits by range and call site.
+//
+// Nothing here depends on Windows.
+//
+struct PageGuardHit
+{
+	uint64_t Address;		// Data address accessed
+	uint64_t Rip;			// Instruction that accessed it
+	uint32_t ThreadId;
+	uint16_t Range;			// Index of the watched range
+	uint8_t Write;
+	uint8_t Reserved;
+};
+
+class PageGuardHitRing
+{
+public:
+	static const uint32_t DefaultCapacity = 16384;
+
+private:
+	struct alignas(32) Slot
+	{
+		std::atomic<uint32_t> Sequence;
+		uint32_t Padding;
+		PageGuardHit Hit;
+	};
+
+	const uint32_t m_Capacity;
+	std::unique_ptr<Slot[]> m_Slots;
+
+	alignas(64) std::atomic<uint32_t> m_EnqueuePos = 0;
+	alignas(64) uint32_t m_DequeuePos = 0;
+	alignas(64) std::atomic<uint64_t> m_Dropped = 0;
+
+public:
+	// Capacity must be a power of two
+	PageGuardHitRing(uint32_t Capacity = DefaultCapacity);
+
+	PageGuardHitRing(const PageGuardHitRing&) = delete;
+	PageGuardHitRing& operator=(const PageGuardHitRing&) = delete;
+
+	// Safe from any thread, including exception handlers. Returns false if the hit was dropped.
+	bool Push(const PageGuardHit& Hit);
+
+	// Consumer thread only
+	uint32_t Drain(PageGuardHit *Hits, uint32_t MaxCount);
+
+	uint64_t GetDroppedCount() const;
+};
+
+class PageGuardHitAggregator
+{
+public:
+	struct CallSite
+	{
+		uint16_t Range;
+		uint64_t Rip;
+		uint64_t Reads;
+		uint64_t Writes;
+		uint64_t MinAddress;
+		uint64_t MaxAddress;
+		uint32_t FirstThreadId;
+		bool MultipleThreads;
+	};
+
+private:
+	std::map<std::pair<uint16_t, uint64_t>, CallSite> m_CallSites;
+	uint64_t m_TotalHits = 0;
+
+public:
+	void Add(const PageGuardHit *Hits, uint32_t Count);
+	void Clear();
+
+	// Sorted by hit count, highest first
+	std::vector<CallSite> GetCallSites() const;
+	uint64_t GetTotalHits() const;
+};
\ No newline at end of file
@@ -0,0 +1,772 @@
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "PatchCodeGen.h"
+
+PatchCodeGen::PatchCodeGen(const PatchEntry *Patch, uintptr_t Memory, size_t MemorySize, const PatchCodeGenContext& Context) : CodeGenerator(MemorySize, (void *)Memory), m_Context(Context)
+{
+	// Original globals: offsetof(BSGraphicsRendererGlobals, var)
+	// TLS: offsetof(IMAGE_TLS_DIRECTORY->StartAddressOfRawData, BSGraphicsRendererGlobals) + offsetof(BSGraphicsRendererGlobals, var)
+	const uintptr_t structMemberOffset = (m_Context.UseOriginalGlobals ? 0 : m_Context.TlsStructOffset) + Patch->Offset;
+
+	auto& s = GetFreeScratch(Patch->Register, Patch->Base, Patch->Index);	// Scratch register
+	m_Scratch = &s;
+	auto& mem = MemOpSize(Patch->MemSize);									// Memory operand size
+	auto memop = mem[s + structMemberOffset];
+
+	if (Patch->Base != ZYDIS_REGISTER_RIP)
+	{
+		if (m_Context.UseOriginalGlobals)
+		{
+			// Sanity check the base register, which **must** be the exe base address
+			if (Patch->ExeOffset != 0xD6BF7E && Patch->ExeOffset != 0xD6BF98 && Patch->ExeOffset != 0xD6C003)
+			{
+				Xbyak::Label label1;
+				Xbyak::Label label2;
+
+				db(0x9C);// pushfq
+				cmp(ZydisToXbyak64(Patch->Base), qword[rip + label1]);
+				je(label2);
+				db(0xCC);// int3
+
+				L(label1);
+				dq(m_Context.ModuleBase);
+
+				L(label2);
+				db(0x9D);// popfq
+			}
+		}
+
+		//
+		// We need to override displacement so it's structMemberOffset instead. There's
+		// a catch: we need to steal another register for the TLS address (base).
+		//
+		auto& base = s;// ZydisToXbyak(Patch->Base);
+
+		if (Patch->Index != ZYDIS_REGISTER_NONE)
+		{
+			// Base + Index * Scale + Displacement
+			auto& index = ZydisToXbyak(Patch->Index);
+			uint32_t scale = std::max<uint32_t>(Patch->Scale, 1);
+
+			if (Patch->ExeOffset == 0xD6BF7E || Patch->ExeOffset == 0xD6BF98 || Patch->ExeOffset == 0xD6C003)
+				memop = mem[s + rbx * 1 + structMemberOffset];
+			else
+				memop = mem[base + index * scale + structMemberOffset];
+		}
+		else
+		{
+			// Base + Displacement
+			memop = mem[base + structMemberOffset];
+		}
+	}
+
+	push(s);
+	SetTlsBase(s);
+
+	// SSE instructions
+	if (Patch->Type == PatchType::MOVSS_REG_MEM ||
+		Patch->Type == PatchType::MOVSS_MEM_REG ||
+		Patch->Type == PatchType::SUBSS_REG_MEM ||
+		Patch->Type == PatchType::ADDSS_REG_MEM ||
+		Patch->Type == PatchType::MOVUPS_REG_MEM ||
+		Patch->Type == PatchType::MOVUPS_MEM_REG ||
+		Patch->Type == PatchType::MOVAPS_REG_MEM ||
+		Patch->Type == PatchType::MOVAPS_MEM_REG ||
+		Patch->Type == PatchType::SHUFPS_REG_MEM ||
+		Patch->Type == PatchType::MOVSD_REG_MEM ||
+		Patch->Type == PatchType::MOVSD_MEM_REG)
+	{
+		auto& xmmReg = ZydisToXbyakXmm(Patch->Register);
+
+		switch (Patch->Type)
+		{
+		case PatchType::MOVSS_REG_MEM:movss(xmmReg, memop); break;		// movss   xmm, [address]
+		case PatchType::MOVSS_MEM_REG:movss(memop, xmmReg); break;		// movss   [address], xmm
+
+		case PatchType::ADDSS_REG_MEM:addss(xmmReg, memop); break;		// addss   xmm, [address]
+		case PatchType::SUBSS_REG_MEM:subss(xmmReg, memop); break;		// subss   xmm, [address]
+
+		case PatchType::MOVUPS_REG_MEM:movups(xmmReg, memop); break;	// movups  xmm, [address]
+		case PatchType::MOVUPS_MEM_REG:movups(memop, xmmReg); break;	// movss   [address], xmm
+
+		case PatchType::MOVAPS_REG_MEM:movaps(xmmReg, memop); break;	// movaps  xmm, [address]
+		case PatchType::MOVAPS_MEM_REG:movaps(memop, xmmReg); break;	// movaps  [address], xmm
+
+		case PatchType::SHUFPS_REG_MEM:
+		{
+			auto imm = m_Context.ShufpsImmediates->find(Patch->ExeOffset);
+
+			if (imm == m_Context.ShufpsImmediates->end())
+				throw Xbyak::Error(Xbyak::ERR_BAD_PARAMETER);
+
+			shufps(xmmReg, memop, imm->second);							// shufps xmm, [address], imm8
+		}
+		break;
+
+		case PatchType::MOVSD_REG_MEM:movsd(xmmReg, memop); break;		// movsd  xmm, [address]
+		case PatchType::MOVSD_MEM_REG:movsd(memop, xmmReg); break;		// movsd  [address], xmm
+
+		default:throw Xbyak::Error(Xbyak::ERR_BAD_PARAMETER);
+		}
+	}
+	else if (Patch->Type == PatchType::INC_MEM ||
+		Patch->Type == PatchType::DEC_MEM)
+	{
+		// Single operands
+		switch (Patch->Type)
+		{
+		case PatchType::INC_MEM:inc(memop); break;		// inc [address]
+		case PatchType::DEC_MEM:dec(memop); break;		// dec [address]
+
+		default:throw Xbyak::Error(Xbyak::ERR_BAD_PARAMETER);
+		}
+	}
+	else
+	{
+		bool isImmediate =
+			Patch->Type == PatchType::MOV_MEM_IMM ||
+			Patch->Type == PatchType::ADD_MEM_IMM ||
+			Patch->Type == PatchType::AND_MEM_IMM ||
+			Patch->Type == PatchType::CMP_MEM_IMM ||
+			Patch->Type == PatchType::OR_MEM_IMM;
+
+		if (isImmediate)
+		{
+			// Instructions with immediate values
+			switch (Patch->Type)
+			{
+			case PatchType::MOV_MEM_IMM:mov(memop, (uint32_t)Patch->Immediate); break;
+			case PatchType::ADD_MEM_IMM:add(memop, (uint32_t)Patch->Immediate); break;
+			case PatchType::AND_MEM_IMM:and_(memop, (uint32_t)Patch->Immediate); break;
+			case PatchType::CMP_MEM_IMM:cmp(memop, (uint32_t)Patch->Immediate); break;
+			case PatchType::OR_MEM_IMM:or_(memop, (uint32_t)Patch->Immediate); break;
+
+			default:throw Xbyak::Error(Xbyak::ERR_BAD_PARAMETER);
+			}
+		}
+		else
+		{
+			// Standard instructions
+			auto& r = ZydisToXbyak(Patch->Register);	// Original register
+			auto& r64 = ZydisToXbyak64(Patch->Register);// Temp
+
+			switch (Patch->Type)
+			{
+			case PatchType::MOV_REG_MEM:mov(r, memop); break;
+			case PatchType::ADD_REG_MEM:add(r, memop); break;
+			case PatchType::AND_REG_MEM:and_(r, memop); break;
+			case PatchType::CMP_REG_MEM:cmp(r, memop); break;
+			case PatchType::MOVSXD_REG_MEM:movsxd(r64, memop); break;
+			case PatchType::MOVZX_REG_MEM:movzx(r, memop); break;
+			case PatchType::LEA_REG_MEM:
+				// xbyak drops the operand size prefix and emits lea r32, which clears the upper half
+				if (r.isBit(16))
+					throw Xbyak::Error(Xbyak::ERR_BAD_SIZE_OF_REGISTER);
+
+				lea(r, memop);
+				break;
+
+			case PatchType::MOV_MEM_REG:mov(memop, r); break;
+			case PatchType::ADD_MEM_REG:add(memop, r); break;
+			case PatchType::AND_MEM_REG:and_(memop, r); break;
+			case PatchType::CMP_MEM_REG:cmp(memop, r); break;
+			case PatchType::OR_MEM_REG:or_(memop, r); break;
+			case PatchType::XADD_MEM_REG:xadd(memop, r); break;
+
+			default:throw Xbyak::Error(Xbyak::ERR_BAD_PARAMETER);
+			}
+		}
+	}
+
+	pop(s);
+	ret();
+}
+
+const Xbyak::Reg64& PatchCodeGen::GetScratch() const
+{
+	return *m_Scratch;
+}
+
+void PatchCodeGen::SetTlsBase(const Xbyak::Reg64& Register)
+{
+	if (m_Context.UseOriginalGlobals)
+	{
+		// Read old game data as if the hook didn't exist
+		mov(Register, (uintptr_t)(m_Context.ModuleBase + m_Context.GlobalsOffset));
+	}
+	else
+	{
+		//
+		// In C++: *(uintptr_t *)(__readgsqword(0x58) + _tls_index * sizeof(void *));
+		//
+		// ((BYTE *)TEB->Tls + tlsBaseOffset) which is really TEB->Tls[tls_index]
+		//
+		const uint32_t tlsBaseOffset = m_Context.TlsIndex * sizeof(void *);
+
+		// mov rax, qword ptr GS:[0x58]
+		// mov rax, qword ptr DS:[rax + tlsBaseOffset]
+		putSeg(gs);
+		mov(Register, Xbyak::Address(32, false, 0x58));
+		mov(Register, ptr[Register + tlsBaseOffset]);
+	}
+}
+
+const Xbyak::Reg64& PatchCodeGen::GetFreeScratch(ZydisRegister Operand, ZydisRegister Base, ZydisRegister Index)
+{
+	std::vector<Xbyak::Reg64> used;
+
+	if (Operand != ZYDIS_REGISTER_NONE)
+	{
+		switch (ZydisRegisterGetClass(Operand))
+		{
+		case ZYDIS_REGCLASS_GPR8:
+		case ZYDIS_REGCLASS_GPR16:
+		case ZYDIS_REGCLASS_GPR32:
+		case ZYDIS_REGCLASS_GPR64:
+			used.push_back(ZydisToXbyak64(Operand));
+			break;
+		}
+	}
+
+	if (Base != ZYDIS_REGISTER_NONE && Base != ZYDIS_REGISTER_RIP)
+		used.push_back(ZydisToXbyak64(Base));
+
+	if (Index != ZYDIS_REGISTER_NONE && Index != ZYDIS_REGISTER_RIP)
+		used.push_back(ZydisToXbyak64(Index));
+
+	// Arbitrary regs used
+	if (std::find(used.begin(), used.end(), rax) == used.end()) return rax;
+	if (std::find(used.begin(), used.end(), rdi) == used.end()) return rdi;
+	if (std::find(used.begin(), used.end(), rdx) == used.end()) return rdx;
+	if (std::find(used.begin(), used.end(), rbp) == used.end()) return rbp;
+	return r15;
+}
+
+const Xbyak::AddressFrame& PatchCodeGen::MemOpSize(int BitSize)
+{
+	switch (BitSize)
+	{
+	case 8:return byte;
+	case 16:return word;
+	case 32:return dword;
+	case 64:return qword;
+	case 128:return xword;
+	case 256:return yword;
+	case 512:return zword;
+	}
+
+	// For non-standard memory operand sizes
+	return ptr;
+}
+
+const Xbyak::Reg& PatchCodeGen::ZydisToXbyak(ZydisRegister Register)
+{
+	switch (Register)
+	{
+	case ZYDIS_REGISTER_AL:return al;
+	case ZYDIS_REGISTER_AH:return ah;
+	case ZYDIS_REGISTER_AX:return ax;
+	case ZYDIS_REGISTER_EAX:return eax;
+	case ZYDIS_REGISTER_RAX:return rax;
+
+	case ZYDIS_REGISTER_CL:return cl;
+	case ZYDIS_REGISTER_CH:return ch;
+	case ZYDIS_REGISTER_CX:return cx;
+	case ZYDIS_REGISTER_ECX:return ecx;
+	case ZYDIS_REGISTER_RCX:return rcx;
+
+	case ZYDIS_REGISTER_DL:return dl;
+	case ZYDIS_REGISTER_DH:return dh;
+	case ZYDIS_REGISTER_DX:return dx;
+	case ZYDIS_REGISTER_EDX:return edx;
+	case ZYDIS_REGISTER_RDX:return rdx;
+
+	case ZYDIS_REGISTER_BL:return bl;
+	case ZYDIS_REGISTER_BH:return bh;
+	case ZYDIS_REGISTER_BX:return bx;
+	case ZYDIS_REGISTER_EBX:return ebx;
+	case ZYDIS_REGISTER_RBX:return rbx;
+
+	case ZYDIS_REGISTER_SPL:return spl;
+	case ZYDIS_REGISTER_SP:return sp;
+	case ZYDIS_REGISTER_ESP:return esp;
+	case ZYDIS_REGISTER_RSP:return rsp;
+
+	case ZYDIS_REGISTER_BPL:return bpl;
+	case ZYDIS_REGISTER_BP:return bp;
+	case ZYDIS_REGISTER_EBP:return ebp;
+	case ZYDIS_REGISTER_RBP:return rbp;
+
+	case ZYDIS_REGISTER_SIL:return sil;
+	case ZYDIS_REGISTER_SI:return si;
+	case ZYDIS_REGISTER_ESI:return esi;
+	case ZYDIS_REGISTER_RSI:return rsi;
+
+	case ZYDIS_REGISTER_DIL:return dil;
+	case ZYDIS_REGISTER_DI:return di;
+	case ZYDIS_REGISTER_EDI:return edi;
+	case ZYDIS_REGISTER_RDI:return rdi;
+
+	case ZYDIS_REGISTER_R8B:return r8b;
+	case ZYDIS_REGISTER_R8W:return r8w;
+	case ZYDIS_REGISTER_R8D:return r8d;
+	case ZYDIS_REGISTER_R8:return r8;
+
+	case ZYDIS_REGISTER_R9B:return r9b;
+	case ZYDIS_REGISTER_R9W:return r9w;
+	case ZYDIS_REGISTER_R9D:return r9d;
+	case ZYDIS_REGISTER_R9:return r9;
+
+	case ZYDIS_REGISTER_R10B:return r10b;
+	case ZYDIS_REGISTER_R10W:return r10w;
+	case ZYDIS_REGISTER_R10D:return r10d;
+	case ZYDIS_REGISTER_R10:return r10;
+
+	case ZYDIS_REGISTER_R11B:return r11b;
+	case ZYDIS_REGISTER_R11W:return r11w;
+	case ZYDIS_REGISTER_R11D:return r11d;
+	case ZYDIS_REGISTER_R11:return r11;
+
+	case ZYDIS_REGISTER_R12B:return r12b;
+	case ZYDIS_REGISTER_R12W:return r12w;
+	case ZYDIS_REGISTER_R12D:return r12d;
+	case ZYDIS_REGISTER_R12:return r12;
+
+	case ZYDIS_REGISTER_R13B:return r13b;
+	case ZYDIS_REGISTER_R13W:return r13w;
+	case ZYDIS_REGISTER_R13D:return r13d;
+	case ZYDIS_REGISTER_R13:return r13;
+
+	case ZYDIS_REGISTER_R14B:return r14b;
+	case ZYDIS_REGISTER_R14W:return r14w;
+	case ZYDIS_REGISTER_R14D:return r14d;
+	case ZYDIS_REGISTER_R14:return r14;
+
+	case ZYDIS_REGISTER_R15B:return r15b;
+	case ZYDIS_REGISTER_R15W:return r15w;
+	case ZYDIS_REGISTER_R15D:return r15d;
+	case ZYDIS_REGISTER_R15:return r15;
+	}
+
+	throw Xbyak::Error(Xbyak::ERR_BAD_PARAMETER);
+}
+
+const Xbyak::Reg64& PatchCodeGen::ZydisToXbyak64(ZydisRegister Register)
+{
+	switch (Register)
+	{
+	case ZYDIS_REGISTER_AL:
+	case ZYDIS_REGISTER_AH:
+	case ZYDIS_REGISTER_AX:
+	case ZYDIS_REGISTER_EAX:
+	case ZYDIS_REGISTER_RAX:
+		return rax;
+
+	case ZYDIS_REGISTER_CL:
+	case ZYDIS_REGISTER_CH:
+	case ZYDIS_REGISTER_CX:
+	case ZYDIS_REGISTER_ECX:
+	case ZYDIS_REGISTER_RCX:
+		return rcx;
+
+	case ZYDIS_REGISTER_DL:
+	case ZYDIS_REGISTER_DH:
+	case ZYDIS_REGISTER_DX:
+	case ZYDIS_REGISTER_EDX:
+	case ZYDIS_REGISTER_RDX:
+		return rdx;
+
+	case ZYDIS_REGISTER_BL:
+	case ZYDIS_REGISTER_BH:
+	case ZYDIS_REGISTER_BX:
+	case ZYDIS_REGISTER_EBX:
+	case ZYDIS_REGISTER_RBX:
+		return rbx;
+
+	case ZYDIS_REGISTER_SPL:
+	case ZYDIS_REGISTER_SP:
+	case ZYDIS_REGISTER_ESP:
+	case ZYDIS_REGISTER_RSP:
+		return rsp;
+
+	case ZYDIS_REGISTER_BPL:
+	case ZYDIS_REGISTER_BP:
+	case ZYDIS_REGISTER_EBP:
+	case ZYDIS_REGISTER_RBP:
+		return rbp;
+
+	case ZYDIS_REGISTER_SIL:
+	case ZYDIS_REGISTER_SI:
+	case ZYDIS_REGISTER_ESI:
+	case ZYDIS_REGISTER_RSI:
+		return rsi;
+
+	case ZYDIS_REGISTER_DIL:
+	case ZYDIS_REGISTER_DI:
+	case ZYDIS_REGISTER_EDI:
+	case ZYDIS_REGISTER_RDI:
+		return rdi;
+
+	case ZYDIS_REGISTER_R8B:
+	case ZYDIS_REGISTER_R8W:
+	case ZYDIS_REGISTER_R8D:
+	case ZYDIS_REGISTER_R8:
+		return r8;
+
+	case ZYDIS_REGISTER_R9B:
+	case ZYDIS_REGISTER_R9W:
+	case ZYDIS_REGISTER_R9D:
+	case ZYDIS_REGISTER_R9:
+		return r9;
+
+	case ZYDIS_REGISTER_R10B:
+	case ZYDIS_REGISTER_R10W:
+	case ZYDIS_REGISTER_R10D:
+	case ZYDIS_REGISTER_R10:
+		return r10;
+
+	case ZYDIS_REGISTER_R11B:
+	case ZYDIS_REGISTER_R11W:
+	case ZYDIS_REGISTER_R11D:
+	case ZYDIS_REGISTER_R11:
+		return r11;
+
+	case ZYDIS_REGISTER_R12B:
+	case ZYDIS_REGISTER_R12W:
+	case ZYDIS_REGISTER_R12D:
+	case ZYDIS_REGISTER_R12:
+		return r12;
+
+	case ZYDIS_REGISTER_R13B:
+	case ZYDIS_REGISTER_R13W:
+	case ZYDIS_REGISTER_R13D:
+	case ZYDIS_REGISTER_R13:
+		return r13;
+
+	case ZYDIS_REGISTER_R14B:
+	case ZYDIS_REGISTER_R14W:
+	case ZYDIS_REGISTER_R14D:
+	case ZYDIS_REGISTER_R14:
+		return r14;
+
+	case ZYDIS_REGISTER_R15B:
+	case ZYDIS_REGISTER_R15W:
+	case ZYDIS_REGISTER_R15D:
+	case ZYDIS_REGISTER_R15:
+		return r15;
+	}
+
+	throw Xbyak::Error(Xbyak::ERR_BAD_PARAMETER);
+}
+
+const Xbyak::Xmm& PatchCodeGen::ZydisToXbyakXmm(ZydisRegister Register)
+{
+	switch (Register)
+	{
+	case ZYDIS_REGISTER_XMM0:return xmm0;
+	case ZYDIS_REGISTER_XMM1:return xmm1;
+	case ZYDIS_REGISTER_XMM2:return xmm2;
+	case ZYDIS_REGISTER_XMM3:return xmm3;
+	case ZYDIS_REGISTER_XMM4:return xmm4;
+	case ZYDIS_REGISTER_XMM5:return xmm5;
+	case ZYDIS_REGISTER_XMM6:return xmm6;
+	case ZYDIS_REGISTER_XMM7:return xmm7;
+	case ZYDIS_REGISTER_XMM8:return xmm8;
+	case ZYDIS_REGISTER_XMM9:return xmm9;
+	case ZYDIS_REGISTER_XMM10:return xmm10;
+	case ZYDIS_REGISTER_XMM11:return xmm11;
+	case ZYDIS_REGISTER_XMM12:return xmm12;
+	case ZYDIS_REGISTER_XMM13:return xmm13;
+	case ZYDIS_REGISTER_XMM14:return xmm14;
+	case ZYDIS_REGISTER_XMM15:return xmm15;
+	case ZYDIS_REGISTER_XMM16:return xmm16;
+	case ZYDIS_REGISTER_XMM17:return xmm17;
+	case ZYDIS_REGISTER_XMM18:return xmm18;
+	case ZYDIS_REGISTER_XMM19:return xmm19;
+	case ZYDIS_REGISTER_XMM20:return xmm20;
+	case ZYDIS_REGISTER_XMM21:return xmm21;
+	case ZYDIS_REGISTER_XMM22:return xmm22;
+	case ZYDIS_REGISTER_XMM23:return xmm23;
+	case ZYDIS_REGISTER_XMM24:return xmm24;
+	case ZYDIS_REGISTER_XMM25:return xmm25;
+	case ZYDIS_REGISTER_XMM26:return xmm26;
+	case ZYDIS_REGISTER_XMM27:return xmm27;
+	case ZYDIS_REGISTER_XMM28:return xmm28;
+	case ZYDIS_REGISTER_XMM29:return xmm29;
+	case ZYDIS_REGISTER_XMM30:return xmm30;
+	case ZYDIS_REGISTER_XMM31:return xmm31;
+	}
+
+	throw Xbyak::Error(Xbyak::ERR_BAD_PARAMETER);
+}
+
+namespace
+{
+	ZydisRegister GetEnclosingRegister64(ZydisRegister Register)
+	{
+		if (Register >= ZYDIS_REGISTER_AL && Register <= ZYDIS_REGISTER_BL)
+			return ZYDIS_REGISTER_RAX + (Register - ZYDIS_REGISTER_AL);
+
+		// AH/CH/DH/BH are the second byte of RAX/RCX/RDX/RBX
+		if (Register >= ZYDIS_REGISTER_AH && Register <= ZYDIS_REGISTER_BH)
+			return ZYDIS_REGISTER_RAX + (Register - ZYDIS_REGISTER_AH);
+
+		if (Register >= ZYDIS_REGISTER_SPL && Register <= ZYDIS_REGISTER_R15B)
+			return ZYDIS_REGISTER_RSP + (Register - ZYDIS_REGISTER_SPL);
+
+		if (Register >= ZYDIS_REGISTER_AX && Register <= ZYDIS_REGISTER_R15W)
+			return ZYDIS_REGISTER_RAX + (Register - ZYDIS_REGISTER_AX);
+
+		if (Register >= ZYDIS_REGISTER_EAX && Register <= ZYDIS_REGISTER_R15D)
+			return ZYDIS_REGISTER_RAX + (Register - ZYDIS_REGISTER_EAX);
+
+		if (Register >= ZYDIS_REGISTER_RAX && Register <= ZYDIS_REGISTER_R15)
+			return Register;
+
+		return ZYDIS_REGISTER_NONE;
+	}
+
+	bool IsImmediatePatch(PatchType Type)
+	{
+		return Type == PatchType::MOV_MEM_IMM ||
+			Type == PatchType::ADD_MEM_IMM ||
+			Type == PatchType::AND_MEM_IMM ||
+			Type == PatchType::CMP_MEM_IMM ||
+			Type == PatchType::OR_MEM_IMM;
+	}
+
+	const ZydisDecodedOperand *GetMemoryOperand(const ZydisDecodedInstruction& Instruction)
+	{
+		for (uint32_t i = 0; i < Instruction.operandCount; i++)
+		{
+			const ZydisDecodedOperand& operand = Instruction.operands[i];
+
+			if (operand.type == ZYDIS_OPERAND_TYPE_MEMORY && operand.visibility == ZYDIS_OPERAND_VISIBILITY_EXPLICIT)
+				return &operand;
+		}
+
+		return nullptr;
+	}
+}
+
+bool GeneratePatch(const ZydisDecoder *Decoder, const PatchEntry *Patch, const uint8_t *TargetCode, size_t TargetCodeSize, uintptr_t TargetAddress, const PatchCodeGenContext& Context, GeneratedPatch *Output)
+{
+	memset(Output, 0, sizeof(GeneratedPatch));
+	Output->TargetAddress = TargetAddress;
+
+	//
+	// Decode: make sure the bytes in memory are still the instruction the patch list was generated
+	// from. A mismatch here means a different exe version or somebody else hooked it first.
+	//
+	ZydisDecodedInstruction instruction;
+
+	if (!ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(Decoder, TargetCode, TargetCodeSize, TargetAddress, &instruction)))
+	{
+		Output->Error = "Unable to decode the target instruction";
+		return false;
+	}
+
+	// A relative call needs 5 bytes
+	if (instruction.length < 5)
+	{
+		Output->Error = "Target instruction is too short for a call";
+		return false;
+	}
+
+	Output->InstructionLength = instruction.length;
+
+	const ZydisDecodedOperand *memOperand = GetMemoryOperand(instruction);
+
+	if (!memOperand)
+	{
+		Output->Error = "Target instruction has no memory operand";
+		return false;
+	}
+
+	if (memOperand->mem.base != Patch->Base || memOperand->mem.index != Patch->Index || memOperand->size != Patch->MemSize)
+	{
+		Output->Error = "Target memory operand doesn't match the patch entry";
+		return false;
+	}
+
+	uint64_t globalOffset;
+
+	if (memOperand->mem.base == ZYDIS_REGISTER_RIP)
+	{
+		if (!ZYDIS_SUCCESS(ZydisCalcAbsoluteAddress(&instruction, memOperand, &globalOffset)))
+		{
+			Output->Error = "Unable to resolve the target's RIP-relative operand";
+			return false;
+		}
+
+		globalOffset -= Context.ModuleBase;
+	}
+	else
+	{
+		// The base register holds the exe base, so the displacement is a relative virtual address
+		globalOffset = memOperand->mem.disp.value;
+	}
+
+	if (globalOffset - Context.GlobalsOffset != Patch->Offset)
+	{
+		Output->Error = "Target memory operand doesn't point at the patched variable";
+		return false;
+	}
+
+	//
+	// Emit
+	//
+	try
+	{
+		PatchCodeGen gen(Patch, (uintptr_t)Output->Code, sizeof(Output->Code), Context);
+
+		Output->CodeSize = (uint32_t)gen.getSize();
+		Output->Scratch = ZYDIS_REGISTER_RAX + gen.GetScratch().getIdx();
+	}
+	catch (const Xbyak::Error&)
+	{
+		Output->Error = "Code generation failed";
+		return false;
+	}
+
+	return true;
+}
+
+bool VerifyGeneratedPatch(const ZydisDecoder *Decoder, const PatchEntry *Patch, const PatchCodeGenContext& Context, GeneratedPatch *Output)
+{
+	auto fail = [Output](const char *Error)
+	{
+		Output->Error = Error;
+		return false;
+	};
+
+	//
+	// Scratch register: it's saved and restored around the instruction, but the instruction itself
+	// must never see it in place of one of its own registers
+	//
+	if (!IsImmediatePatch(Patch->Type) && GetEnclosingRegister64(Patch->Register) == Output->Scratch)
+		return fail("Scratch register overlaps the instruction's register operand");
+
+	if (Patch->Base != ZYDIS_REGISTER_RIP && GetEnclosingRegister64(Patch->Base) == Output->Scratch)
+		return fail("Scratch register overlaps the memory base register");
+
+	if (GetEnclosingRegister64(Patch->Index) == Output->Scratch)
+		return fail("Scratch register overlaps the memory index register");
+
+	//
+	// Walk the block as if it started at address 0. Every RIP-relative reference must resolve inside it,
+	// otherwise copying the code to its final location breaks it. Data embedded with dq() is skipped using
+	// the operand that reads it.
+	//
+	std::vector<ZydisDecodedInstruction> instructions;
+	std::vector<std::pair<uint64_t, uint64_t>> dataRanges;
+
+	for (uint64_t offset = 0; offset < Output->CodeSize;)
+	{
+		auto data = std::find_if(dataRanges.begin(), dataRanges.end(), [offset](auto& Range) { return Range.first == offset; });
+
+		if (data != dataRanges.end())
+		{
+			offset = data->second;
+			continue;
+		}
+
+		ZydisDecodedInstruction instruction;
+
+		if (!ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(Decoder, &Output->Code[offset], Output->CodeSize - offset, offset, &instruction)))
+			return fail("Unable to decode generated code");
+
+		for (uint32_t i = 0; i < instruction.operandCount; i++)
+		{
+			const ZydisDecodedOperand& operand = instruction.operands[i];
+			uint64_t target;
+
+			if (operand.type == ZYDIS_OPERAND_TYPE_MEMORY && operand.mem.base == ZYDIS_REGISTER_RIP)
+			{
+				if (!ZYDIS_SUCCESS(ZydisCalcAbsoluteAddress(&instruction, &operand, &target)) || target + (operand.size / 8) > Output->CodeSize)
+					return fail("RIP-relative operand points outside the generated code");
+
+				if (target > offset)
+					dataRanges.emplace_back(target, target + (operand.size / 8));
+			}
+			else if (operand.type == ZYDIS_OPERAND_TYPE_IMMEDIATE && operand.imm.isRelative)
+			{
+				if (!ZYDIS_SUCCESS(ZydisCalcAbsoluteAddress(&instruction, &operand, &target)) || target >= Output->CodeSize)
+					return fail("Branch target is outside the generated code");
+			}
+		}
+
+		instructions.push_back(instruction);
+		offset += instruction.length;
+	}
+
+	// [base register check], push scratch, <load TLS base>, <instruction>, pop scratch, ret
+	if (instructions.size() < 5)
+		return fail("Generated code is too short");
+
+	const auto& rewritten = instructions[instructions.size() - 3];
+	const auto& epilogue = instructions[instructions.size() - 2];
+
+	auto prologue = std::find_if(instructions.begin(), instructions.end() - 3, [Output](const ZydisDecodedInstruction& Instruction)
+	{
+		return Instruction.mnemonic == ZYDIS_MNEMONIC_PUSH &&
+			Instruction.operands[0].type == ZYDIS_OPERAND_TYPE_REGISTER &&
+			Instruction.operands[0].reg.value == Output->Scratch;
+	});
+
+	if (prologue == instructions.end() - 3)
+		return fail("Generated code doesn't save the scratch register");
+
+	if (epilogue.mnemonic != ZYDIS_MNEMONIC_POP || epilogue.operands[0].type != ZYDIS_OPERAND_TYPE_REGISTER || epilogue.operands[0].reg.value != Output->Scratch)
+		return fail("Generated code doesn't restore the scratch register");
+
+	if (instructions.back().mnemonic != ZYDIS_MNEMONIC_RET)
+		return fail("Generated code doesn't return");
+
+	// The relocated operand: [scratch + (index * scale) + offset into the TLS block]
+	const ZydisDecodedOperand *memOperand = GetMemoryOperand(rewritten);
+	const uint64_t expectedOffset = (Context.UseOriginalGlobals ? 0 : Context.TlsStructOffset) + Patch->Offset;
+
+	if (!memOperand || memOperand->mem.base != Output->Scratch || (uint64_t)memOperand->mem.disp.value != expectedOffset)
+		return fail("Rewritten memory operand doesn't address the TLS block");
+
+	if (memOperand->size != Patch->MemSize)
+		return fail("Rewritten memory operand size changed");
+
+	// Base is only allowed here when the game keeps the exe base in the index register instead
+	if (memOperand->mem.index != Patch->Index && memOperand->mem.index != Patch->Base)
+		return fail("Rewritten memory operand has an unrelated index register");
+
+	Output->RewrittenIndex = memOperand->mem.index;
+
+	return true;
+}
+
+bool BuildCodeHook(uintptr_t TargetAddress, uint32_t InstructionLength, uintptr_t Code, uint8_t *Data)
+{
+	const int64_t delta = (int64_t)(Code - (TargetAddress + 5));
+
+	if (InstructionLength < 5 || InstructionLength > ZYDIS_MAX_INSTRUCTION_LENGTH || delta != (int32_t)delta)
+		return false;
+
+	memset(Data, 0x90, ZYDIS_MAX_INSTRUCTION_LENGTH);
+
+	// Relative CALL
+	const int32_t rel32 = (int32_t)delta;
+
+	Data[0] = 0xE8;
+	memcpy(&Data[1], &rel32, sizeof(rel32));
+
+	// Pad with nops so it shows up nicely in the debugger
+	switch (InstructionLength - 5)
+	{
+	case 1: Data[5] = 0x90; break;
+	case 2: Data[5] = 0x66; Data[6] = 0x90; break;
+	case 3: Data[5] = 0x0F; Data[6] = 0x1F; Data[7] = 0x00; break;
+	case 4: Data[5] = 0x0F; Data[6] = 0x1F; Data[7] = 0x40; Data[8] = 0x00; break;
+	default: break;
+	}
+
+	return true;
+}
\ No newline at end of file
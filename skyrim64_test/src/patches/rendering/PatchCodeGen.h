@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+#include <unordered_map>
+#include <xbyak/xbyak.h>
+#include <zydis/include/Zydis/Zydis.h>
+
+enum class PatchType
+{
+	MOV_REG_MEM,
+	MOV_MEM_REG,
+	MOV_MEM_IMM,
+
+	ADD_REG_MEM,
+	ADD_MEM_REG,
+	ADD_MEM_IMM,
+
+	AND_REG_MEM,
+	AND_MEM_REG,
+	AND_MEM_IMM,
+
+	CMP_REG_MEM,
+	CMP_MEM_REG,
+	CMP_MEM_IMM,
+
+	MOVSXD_REG_MEM,
+	MOVZX_REG_MEM,
+	LEA_REG_MEM,
+	OR_MEM_REG,
+	OR_MEM_IMM,
+	MOVSS_REG_MEM,
+	MOVSS_MEM_REG,
+	INC_MEM,
+	DEC_MEM,
+	SUBSS_REG_MEM,
+	ADDSS_REG_MEM,
+	MOVUPS_REG_MEM,
+	MOVUPS_MEM_REG,
+	MOVAPS_REG_MEM,
+	MOVAPS_MEM_REG,
+	SHUFPS_REG_MEM,
+	MOVSD_REG_MEM,
+	MOVSD_MEM_REG,
+	XADD_MEM_REG,
+};
+
+struct PatchEntry
+{
+	PatchType Type;
+	uintptr_t ExeOffset;
+	union
+	{
+		uint64_t Immediate;
+		ZydisRegister Register;
+	};
+	uintptr_t Offset;
+	int MemSize;
+
+	ZydisRegister Base;
+	ZydisRegister Index;
+	uint32_t Scale;
+};
+
+//
+// Everything the generator used to read from globals. Filled once and shared by every thread.
+//
+struct PatchCodeGenContext
+{
+	uint32_t TlsIndex;
+	uintptr_t TlsStructOffset;			// BSGRAPHICS_TLS_BASE_OFFSET
+	uintptr_t ModuleBase;
+	uintptr_t GlobalsOffset;			// BSGRAPHICS_BASE_OFFSET
+	bool UseOriginalGlobals;			// TLS_DEBUG_ENABLE: read the game's globals instead of the TLS copy
+	const std::unordered_map<uintptr_t, int> *ShufpsImmediates;
+};
+
+//
+// Emits the replacement for one patched instruction: push scratch, load the TLS block into it, run the
+// instruction against [scratch + offset], pop scratch, ret. Unknown registers or patch types throw
+// Xbyak::Error.
+//
+struct PatchCodeGen : public Xbyak::CodeGenerator
+{
+public:
+	static const size_t MaxCodeSize = 64;
+
+	PatchCodeGen(const PatchEntry *Patch, uintptr_t Memory, size_t MemorySize, const PatchCodeGenContext& Context);
+
+	const Xbyak::Reg64& GetScratch() const;
+
+private:
+	const PatchCodeGenContext& m_Context;
+	const Xbyak::Reg64 *m_Scratch;
+
+	void SetTlsBase(const Xbyak::Reg64& Register);
+
+	const Xbyak::Reg64& GetFreeScratch(ZydisRegister Operand, ZydisRegister Base, ZydisRegister Index);
+	const Xbyak::AddressFrame& MemOpSize(int BitSize);
+	const Xbyak::Reg& ZydisToXbyak(ZydisRegister Register);
+	const Xbyak::Reg64& ZydisToXbyak64(ZydisRegister Register);
+	const Xbyak::Xmm& ZydisToXbyakXmm(ZydisRegister Register);
+};
+
+//
+// Decode and emit stages of CreateXbyakPatches. Neither touches page protection or writes to the game's
+// code, so both can run on any thread against any copy of the instruction bytes. Nothing here depends on
+// Windows.
+//
+struct GeneratedPatch
+{
+	uintptr_t TargetAddress;
+	uint32_t InstructionLength;			// Bytes replaced at TargetAddress
+	uint32_t CodeSize;
+	ZydisRegister Scratch;
+	ZydisRegister RewrittenIndex;		// Index register of the rewritten operand, set by VerifyGeneratedPatch
+	uint8_t Code[PatchCodeGen::MaxCodeSize];
+	const char *Error;					// Null on success
+};
+
+// TargetCode holds the original instruction bytes that live at TargetAddress
+bool GeneratePatch(const ZydisDecoder *Decoder, const PatchEntry *Patch, const uint8_t *TargetCode, size_t TargetCodeSize, uintptr_t TargetAddress, const PatchCodeGenContext& Context, GeneratedPatch *Output);
+
+// Decodes the emitted code and checks the scratch register choice, the prologue/epilogue, the rewritten
+// memory operand, and that every RIP-relative operand or branch stays inside the block (the code is
+// copied elsewhere after generation).
+bool VerifyGeneratedPatch(const ZydisDecoder *Decoder, const PatchEntry *Patch, const PatchCodeGenContext& Context, GeneratedPatch *Output);
+
+// E8 rel32 to Code, then nops up to InstructionLength. Data must hold ZYDIS_MAX_INSTRUCTION_LENGTH bytes.
+bool BuildCodeHook(uintptr_t TargetAddress, uint32_t InstructionLength, uintptr_t Code, uint8_t *Data);
\ No newline at end of file
@@ -0,0 +1,355 @@
+#include <stddef.h>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include "PatchCodeGenValidator.h"
+
+namespace
+{
+	// CF, PF, AF, ZF, SF, OF
+	const uint64_t ArithmeticFlags = 0x8D5;
+
+	// Largest index * scale used for [base + index * scale + disp] operands. Kept a multiple of 16 so
+	// movaps still sees aligned addresses.
+	const uint64_t MaxIndexOffset = 512;
+
+	//
+	// void Thunk(const PatchExecutionState *In, PatchExecutionState *Out, uintptr_t Target)
+	//
+	// Loads every register from In, calls Target, and stores every register to Out. All registers the
+	// calling convention says are preserved (Windows or System V) are saved around it.
+	//
+	struct ExecutionThunk : Xbyak::CodeGenerator
+	{
+		ExecutionThunk(uint8_t *Memory, size_t MemorySize) : CodeGenerator(MemorySize, Memory)
+		{
+#ifdef _WIN32
+			const Xbyak::Reg64& in = rcx;
+			const Xbyak::Reg64& out = rdx;
+			const Xbyak::Reg64& target = r8;
+#else
+			const Xbyak::Reg64& in = rdi;
+			const Xbyak::Reg64& out = rsi;
+			const Xbyak::Reg64& target = rdx;
+#endif
+			const int xmmSaveSize = 10 * 16 + 8;
+			Xbyak::Label outSlot;
+			Xbyak::Label targetSlot;
+
+			push(rbx);
+			push(rbp);
+			push(rsi);
+			push(rdi);
+			push(r12);
+			push(r13);
+			push(r14);
+			push(r15);
+			sub(rsp, xmmSaveSize);
+
+			for (int i = 6; i < 16; i++)
+				movdqu(ptr[rsp + (i - 6) * 16], Xbyak::Xmm(i));
+
+			mov(ptr[rip + outSlot], out);
+			mov(ptr[rip + targetSlot], target);
+
+			// Load the input state. The pointer register goes last.
+			for (int i = 0; i < 16; i++)
+				movdqu(Xbyak::Xmm(i), ptr[in + offsetof(PatchExecutionState, Xmm) + i * 16]);
+
+			push(qword[in + offsetof(PatchExecutionState, Flags)]);
+			popf();
+
+			for (int i = 0; i < 16; i++)
+			{
+				if (i != rsp.getIdx() && i != in.getIdx())
+					mov(Xbyak::Reg64(i), ptr[in + offsetof(PatchExecutionState, Gpr) + i * 8]);
+			}
+
+			mov(in, ptr[in + offsetof(PatchExecutionState, Gpr) + in.getIdx() * 8]);
+			call(qword[rip + targetSlot]);
+
+			// Store the output state
+			pushf();
+			push(rax);
+			mov(rax, ptr[rip + outSlot]);
+
+			for (int i = 1; i < 16; i++)
+			{
+				if (i != rsp.getIdx())
+					mov(ptr[rax + offsetof(PatchExecutionState, Gpr) + i * 8], Xbyak::Reg64(i));
+			}
+
+			for (int i = 0; i < 16; i++)
+				movdqu(ptr[rax + offsetof(PatchExecutionState, Xmm) + i * 16], Xbyak::Xmm(i));
+
+			pop(qword[rax + offsetof(PatchExecutionState, Gpr)]);
+			pop(qword[rax + offsetof(PatchExecutionState, Flags)]);
+
+			for (int i = 6; i < 16; i++)
+				movdqu(Xbyak::Xmm(i), ptr[rsp + (i - 6) * 16]);
+
+			add(rsp, xmmSaveSize);
+			pop(r15);
+			pop(r14);
+			pop(r13);
+			pop(r12);
+			pop(rdi);
+			pop(rsi);
+			pop(rbp);
+			pop(rbx);
+			ret();
+
+			align(8);
+			L(outSlot);
+			dq(0);
+			L(targetSlot);
+			dq(0);
+		}
+	};
+
+	const ZydisDecodedOperand *GetMemoryOperand(const ZydisDecodedInstruction& Instruction)
+	{
+		for (uint32_t i = 0; i < Instruction.operandCount; i++)
+		{
+			const ZydisDecodedOperand& operand = Instruction.operands[i];
+
+			if (operand.type == ZYDIS_OPERAND_TYPE_MEMORY && operand.visibility == ZYDIS_OPERAND_VISIBILITY_EXPLICIT)
+				return &operand;
+		}
+
+		return nullptr;
+	}
+}
+
+PatchCodeGenValidator::PatchCodeGenValidator(uint8_t *Arena, const PatchCodeGenContext& BaseContext, uint64_t Seed) : m_Random(Seed)
+{
+	// [0x000, 0x800) thunk, [0x800, 0x880) original + ret, [0x880, 0x900) rewrite, [0x1000, ...) globals
+	m_Arena = Arena;
+	m_OriginalCode = Arena + 0x800;
+	m_RewrittenCode = Arena + 0x880;
+	m_Data = Arena + 0x1000;
+
+	ExecutionThunk thunk(m_Arena, 0x800);
+	m_Thunk = (decltype(m_Thunk))thunk.getCode();
+
+	m_BaseContext = BaseContext;
+	m_Context = BaseContext;
+	m_Context.ModuleBase = (uintptr_t)m_Data - BaseContext.GlobalsOffset;
+
+	m_DataSnapshot.resize(DataSize);
+	m_OriginalData.resize(DataSize);
+}
+
+const PatchCodeGenContext& PatchCodeGenValidator::GetContext() const
+{
+	return m_Context;
+}
+
+uintptr_t PatchCodeGenValidator::GetTlsBlock() const
+{
+	return (uintptr_t)m_Data - m_Context.TlsStructOffset;
+}
+
+bool PatchCodeGenValidator::Validate(const ZydisDecoder *Decoder, const PatchEntry *Patch, const uint8_t *OriginalCode, size_t OriginalCodeSize, uintptr_t OriginalAddress, uint32_t Iterations)
+{
+	m_Error.clear();
+
+	//
+	// Original: copy it next to the sandbox and point its RIP-relative operand at the same variable there.
+	// The variable comes from the instruction bytes, not from the patch entry, so a wrong table offset
+	// shows up as a difference.
+	//
+	ZydisDecodedInstruction instruction;
+
+	if (!ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(Decoder, OriginalCode, OriginalCodeSize, OriginalAddress, &instruction)))
+	{
+		m_Error = "Unable to decode the original instruction";
+		return false;
+	}
+
+	const ZydisDecodedOperand *memOperand = GetMemoryOperand(instruction);
+
+	if (!memOperand)
+	{
+		m_Error = "Original instruction has no memory operand";
+		return false;
+	}
+
+	uint64_t variableOffset;
+
+	if (memOperand->mem.base == ZYDIS_REGISTER_RIP)
+	{
+		if (!ZYDIS_SUCCESS(ZydisCalcAbsoluteAddress(&instruction, memOperand, &variableOffset)))
+		{
+			m_Error = "Unable to resolve the original's RIP-relative operand";
+			return false;
+		}
+
+		variableOffset -= m_BaseContext.ModuleBase + m_BaseContext.GlobalsOffset;
+	}
+	else
+	{
+		variableOffset = memOperand->mem.disp.value - m_BaseContext.GlobalsOffset;
+	}
+
+	if (variableOffset + MaxIndexOffset + (memOperand->size / 8) > DataSize)
+	{
+		m_Error = "Original memory operand is outside the sandbox";
+		return false;
+	}
+
+	memcpy(m_OriginalCode, OriginalCode, instruction.length);
+	m_OriginalCode[instruction.length] = 0xC3;
+
+	if (memOperand->mem.base == ZYDIS_REGISTER_RIP)
+	{
+		const int32_t disp = (int32_t)((intptr_t)(m_Data + variableOffset) - (intptr_t)(m_OriginalCode + instruction.length));
+		memcpy(&m_OriginalCode[instruction.raw.disp.offset], &disp, sizeof(disp));
+	}
+
+	//
+	// Rewrite: generated against the sandbox and checked the same way CreateXbyakPatches checks it
+	//
+	GeneratedPatch generated;
+	memset(&generated, 0, sizeof(generated));
+
+	try
+	{
+		PatchCodeGen gen(Patch, (uintptr_t)generated.Code, sizeof(generated.Code), m_Context);
+
+		generated.CodeSize = (uint32_t)gen.getSize();
+		generated.Scratch = ZYDIS_REGISTER_RAX + gen.GetScratch().getIdx();
+	}
+	catch (const Xbyak::Error&)
+	{
+		m_Error = "Code generation failed";
+		return false;
+	}
+
+	if (!VerifyGeneratedPatch(Decoder, Patch, m_Context, &generated))
+	{
+		m_Error = generated.Error;
+		return false;
+	}
+
+	memcpy(m_RewrittenCode, generated.Code, generated.CodeSize);
+
+	//
+	// The register the rewrite keeps as its index holds a real index in the game. The other one holds the
+	// exe base, which is usually the base register, but [rbx + r13] style operands have it either way.
+	//
+	if (Patch->Base == ZYDIS_REGISTER_RIP)
+		return Run(Patch, Iterations, ZYDIS_REGISTER_NONE, ZYDIS_REGISTER_NONE);
+
+	if (generated.RewrittenIndex != ZYDIS_REGISTER_NONE && generated.RewrittenIndex == Patch->Base)
+		return Run(Patch, Iterations, Patch->Index, Patch->Base);
+
+	return Run(Patch, Iterations, Patch->Base, Patch->Index);
+}
+
+const char *PatchCodeGenValidator::GetError() const
+{
+	return m_Error.c_str();
+}
+
+bool PatchCodeGenValidator::Run(const PatchEntry *Patch, uint32_t Iterations, ZydisRegister ExeBase, ZydisRegister Index)
+{
+	const uint64_t indexStep = 16 / std::min<uint32_t>(std::max<uint32_t>(Patch->Scale, 1), 16);
+
+	for (uint32_t i = 0; i < Iterations; i++)
+	{
+		PatchExecutionState in;
+		PatchExecutionState original;
+		PatchExecutionState rewritten;
+
+		for (auto& reg : in.Gpr)
+			reg = m_Random();
+
+		// Bit 1 is always set. Never set TF, IF or DF.
+		in.Flags = (m_Random() & ArithmeticFlags) | 0x2;
+
+		for (auto& xmm : in.Xmm)
+		{
+			for (size_t j = 0; j < sizeof(xmm); j += sizeof(uint64_t))
+			{
+				const uint64_t value = m_Random();
+				memcpy(&xmm[j], &value, sizeof(value));
+			}
+		}
+
+		// The exe base points the original's displacement into the sandbox
+		if (ExeBase != ZYDIS_REGISTER_NONE)
+			in.Gpr[ExeBase - ZYDIS_REGISTER_RAX] = (uintptr_t)m_Data - m_BaseContext.GlobalsOffset;
+
+		if (Index != ZYDIS_REGISTER_NONE)
+			in.Gpr[Index - ZYDIS_REGISTER_RAX] = (m_Random() % (MaxIndexOffset / 16)) * indexStep;
+
+		for (size_t j = 0; j < DataSize; j += sizeof(uint64_t))
+		{
+			const uint64_t value = m_Random();
+			memcpy(&m_DataSnapshot[j], &value, sizeof(value));
+		}
+
+		memcpy(m_Data, m_DataSnapshot.data(), DataSize);
+		m_Thunk(&in, &original, (uintptr_t)m_OriginalCode);
+		memcpy(m_OriginalData.data(), m_Data, DataSize);
+
+		memcpy(m_Data, m_DataSnapshot.data(), DataSize);
+		m_Thunk(&in, &rewritten, (uintptr_t)m_RewrittenCode);
+
+		if (!Compare(original, rewritten, m_OriginalData.data()))
+			return false;
+	}
+
+	return true;
+}
+
+bool PatchCodeGenValidator::Compare(const PatchExecutionState& Original, const PatchExecutionState& Rewritten, const uint8_t *OriginalData)
+{
+	char buffer[256];
+
+	for (int i = 0; i < 16; i++)
+	{
+		if (i == 4 || Original.Gpr[i] == Rewritten.Gpr[i])
+			continue;
+
+		snprintf(buffer, sizeof(buffer), "%s differs: 0x%llX (original) 0x%llX (rewrite)", ZydisRegisterGetString(ZYDIS_REGISTER_RAX + i),
+			(unsigned long long)Original.Gpr[i], (unsigned long long)Rewritten.Gpr[i]);
+
+		m_Error = buffer;
+		return false;
+	}
+
+	if ((Original.Flags & ArithmeticFlags) != (Rewritten.Flags & ArithmeticFlags))
+	{
+		snprintf(buffer, sizeof(buffer), "Flags differ: 0x%llX (original) 0x%llX (rewrite)",
+			(unsigned long long)(Original.Flags & ArithmeticFlags), (unsigned long long)(Rewritten.Flags & ArithmeticFlags));
+
+		m_Error = buffer;
+		return false;
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		if (memcmp(Original.Xmm[i], Rewritten.Xmm[i], sizeof(Original.Xmm[i])) == 0)
+			continue;
+
+		snprintf(buffer, sizeof(buffer), "XMM%d differs", i);
+
+		m_Error = buffer;
+		return false;
+	}
+
+	for (size_t i = 0; i < DataSize; i++)
+	{
+		if (OriginalData[i] == m_Data[i])
+			continue;
+
+		snprintf(buffer, sizeof(buffer), "Globals differ at offset 0x%llX", (unsigned long long)i);
+
+		m_Error = buffer;
+		return false;
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "PatchCodeGen.h"
+
+//
+// Differential check for PatchCodeGen. The original instruction and its rewrite both run from the same
+// random register, flag, XMM and memory state, and everything they leave behind is compared.
+//
+// The original's memory operand (RIP-relative or exe base relative) is pointed at a sandbox copy of the
+// globals. The rewrite is generated with GetContext(), which makes it read the same sandbox: directly when
+// the base context has UseOriginalGlobals set, otherwise through the TLS block returned by GetTlsBlock(). In
+// the TLS case the caller must make TEB->ThreadLocalStoragePointer[TlsIndex] (gs:[0x58]) point there.
+//
+// The arena must be readable, writable and executable and at least ArenaSize bytes. One validator per
+// thread. A rewrite that addresses memory outside the sandbox faults instead of failing validation.
+// Nothing here depends on Windows.
+//
+struct PatchExecutionState
+{
+	uint64_t Gpr[16];					// Encoding order (RAX, RCX, RDX, RBX, RSP, ...). RSP is ignored.
+	uint64_t Flags;
+	uint8_t Xmm[16][16];
+};
+
+class PatchCodeGenValidator
+{
+public:
+	static const size_t DataSize = 0x4000;
+	static const size_t ArenaSize = 0x1000 + DataSize;
+
+private:
+	uint8_t *m_Arena;
+	uint8_t *m_OriginalCode;
+	uint8_t *m_RewrittenCode;
+	uint8_t *m_Data;
+	void (*m_Thunk)(const PatchExecutionState *In, PatchExecutionState *Out, uintptr_t Target);
+
+	PatchCodeGenContext m_BaseContext;
+	PatchCodeGenContext m_Context;
+	std::mt19937_64 m_Random;
+	std::vector<uint8_t> m_DataSnapshot;
+	std::vector<uint8_t> m_OriginalData;
+	std::string m_Error;
+
+	bool Compare(const PatchExecutionState& Original, const PatchExecutionState& Rewritten, const uint8_t *OriginalData);
+	bool Run(const PatchEntry *Patch, uint32_t Iterations, ZydisRegister ExeBase, ZydisRegister Index);
+
+public:
+	PatchCodeGenValidator(uint8_t *Arena, const PatchCodeGenContext& BaseContext, uint64_t Seed);
+
+	PatchCodeGenValidator(const PatchCodeGenValidator&) = delete;
+	PatchCodeGenValidator& operator=(const PatchCodeGenValidator&) = delete;
+
+	const PatchCodeGenContext& GetContext() const;
+	uintptr_t GetTlsBlock() const;
+
+	// OriginalCode holds the instruction bytes recorded at OriginalAddress, in BaseContext's address space
+	bool Validate(const ZydisDecoder *Decoder, const PatchEntry *Patch, const uint8_t *OriginalCode, size_t OriginalCodeSize, uintptr_t OriginalAddress, uint32_t Iterations);
+	const char *GetError() const;
+};
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include <string.h>
+#include <initializer_list>
+#include "RenderStateKey.h"
+
+namespace RenderStateKey
+{
+	PackedRenderState Pack(const RenderStateFields& Fields)
+	{
+		PackedRenderState state;
+		state.Key = (uint64_t)Fields.StencilRef |
+			((uint64_t)Fields.DepthMode << 32) |
+			((uint64_t)Fields.StencilMode << 35) |
+			((uint64_t)Fields.RasterUnknown << 41) |
+			((uint64_t)Fields.CullMode << 42) |
+			((uint64_t)Fields.DepthBias << 44) |
+			((uint64_t)Fields.ScissorMode << 48) |
+			((uint64_t)Fields.BlendMode << 49) |
+			((uint64_t)Fields.AlphaToCoverage << 52) |
+			((uint64_t)Fields.WriteMode << 53) |
+			((uint64_t)Fields.BlendUnknown << 57);
+
+		static_assert(sizeof(state.BlendFactor) == sizeof(Fields.BlendFactor));
+		memcpy(state.BlendFactor, Fields.BlendFactor, sizeof(state.BlendFactor));
+
+		return state;
+	}
+
+	uint64_t GetChangedGroups(const PackedRenderState& Applied, const PackedRenderState& State)
+	{
+		uint64_t changed = 0;
+		const uint64_t difference = Applied.Key ^ State.Key;
+
+		for (uint64_t mask : { DepthStencilMask, RasterMask, BlendMask })
+		{
+			if (difference & mask)
+				changed |= mask;
+		}
+
+		if (memcmp(Applied.BlendFactor, State.BlendFactor, sizeof(State.BlendFactor)) != 0)
+			changed |= BlendMask;
+
+		return changed;
+	}
+
+	void Apply(PackedRenderState *Applied, const PackedRenderState& State, uint64_t Mask)
+	{
+		Applied->Key = (Applied->Key & ~Mask) | (State.Key & Mask);
+
+		if (Mask & BlendMask)
+			memcpy(Applied->BlendFactor, State.BlendFactor, sizeof(State.BlendFactor));
+	}
+
+	void Invalidate(PackedRenderState *Applied, uint64_t Mask)
+	{
+		Applied->Key |= Mask;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// Every field that selects an entry in m_DepthStates, m_RasterStates or m_BlendStates packed into one
+// value. All state objects are pre-built by the game, so a key maps directly to at most three
+// OMSet*/RSSet* calls. Comparing against the last applied key drops the ones that wouldn't change anything.
+//
+//   [31:0]  stencil ref   [34:32] depth mode   [40:35] stencil mode                        OMSetDepthStencilState
+//   [41]    unknown       [43:42] cull mode    [47:44] depth bias    [48] scissor           RSSetState
+//   [51:49] blend mode    [52] alpha to coverage  [56:53] write mode  [57] unknown          OMSetBlendState
+//
+// The blend factor is passed to OMSetBlendState too. It doesn't fit in the key and is compared next to it.
+//
+// Each group is tracked on its own. No table index reaches the all-ones value of its bits, so a group that
+// has every bit set never matches a real state and always gets re-applied. Nothing here depends on Windows.
+//
+struct RenderStateFields
+{
+	uint32_t StencilRef;
+	uint32_t DepthMode;				// m_DepthStates[6][]
+	uint32_t StencilMode;			// m_DepthStates[][40]
+	uint32_t RasterUnknown;			// m_RasterStates[2][][][]
+	uint32_t CullMode;				// m_RasterStates[][3][][]
+	uint32_t DepthBias;				// m_RasterStates[][][12][]
+	uint32_t ScissorMode;			// m_RasterStates[][][][2]
+	uint32_t BlendMode;				// m_BlendStates[7][][][]
+	uint32_t AlphaToCoverage;		// m_BlendStates[][2][][]
+	uint32_t WriteMode;				// m_BlendStates[][][13][]
+	uint32_t BlendUnknown;			// m_BlendStates[][][][2]
+	float BlendFactor[4];
+};
+
+struct PackedRenderState
+{
+	uint64_t Key;
+	uint32_t BlendFactor[4];		// Raw float bits
+};
+
+namespace RenderStateKey
+{
+	const uint64_t Invalid = 0xFFFFFFFFFFFFFFFF;	// Top bits are never set by a real key
+	const uint64_t DepthStencilMask = 0x000001FFFFFFFFFF;
+	const uint64_t RasterMask = 0x0001FE0000000000;
+	const uint64_t BlendMask = 0x03FE000000000000;
+	const uint64_t AllMask = DepthStencilMask | RasterMask | BlendMask;
+
+	PackedRenderState Pack(const RenderStateFields& Fields);
+
+	// Groups whose OMSet*/RSSet* call would bind something other than what Applied says is bound
+	uint64_t GetChangedGroups(const PackedRenderState& Applied, const PackedRenderState& State);
+
+	// The groups in Mask were sent to the context. The others keep what they had, valid or not.
+	void Apply(PackedRenderState *Applied, const PackedRenderState& State, uint64_t Mask);
+
+	// Something outside SyncD3DState changed the groups in Mask
+	void Invalidate(PackedRenderState *Applied, uint64_t Mask);
+}
\ No newline at end of file
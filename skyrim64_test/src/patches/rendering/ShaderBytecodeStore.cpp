@@ -0,0 +1,91 @@
+#include "ShaderBytecodeStore.h"
+
+ShaderBytecodeStore g_ShaderBytecodeStore;
+
+ShaderBytecodeStore::Handle ShaderBytecodeStore::Acquire(const void *Bytecode, size_t Length)
+{
+	Handle handle = XUtil::MurmurHash64A(Bytecode, Length);
+
+	AcquireSRWLockExclusive(&m_Lock);
+
+	for (;; handle++)
+	{
+		if (handle == InvalidHandle)
+			continue;
+
+		auto itr = m_Entries.find(handle);
+
+		if (itr == m_Entries.end())
+		{
+			Entry entry;
+			entry.Data = std::make_unique<uint8_t[]>(Length);
+			entry.Length = Length;
+			entry.RefCount = 1;
+			memcpy(entry.Data.get(), Bytecode, Length);
+
+			m_Entries.emplace(handle, std::move(entry));
+			m_UniqueBytes += Length;
+			break;
+		}
+
+		// Same key, different bytes: keep probing
+		if (itr->second.Length == Length && memcmp(itr->second.Data.get(), Bytecode, Length) == 0)
+		{
+			itr->second.RefCount++;
+			break;
+		}
+	}
+
+	m_TotalBytes += Length;
+	ReleaseSRWLockExclusive(&m_Lock);
+
+	return handle;
+}
+
+void ShaderBytecodeStore::Release(Handle Bytecode)
+{
+	AcquireSRWLockExclusive(&m_Lock);
+
+	auto itr = m_Entries.find(Bytecode);
+	Assert(itr != m_Entries.end());
+
+	m_TotalBytes -= itr->second.Length;
+
+	if (--itr->second.RefCount == 0)
+	{
+		m_UniqueBytes -= itr->second.Length;
+		m_Entries.erase(itr);
+	}
+
+	ReleaseSRWLockExclusive(&m_Lock);
+}
+
+std::pair<void *, size_t> ShaderBytecodeStore::Get(Handle Bytecode) const
+{
+	AcquireSRWLockShared(&m_Lock);
+
+	// Entries are never moved while referenced, so the pointer outlives the lock
+	const Entry& entry = m_Entries.at(Bytecode);
+	std::pair<void *, size_t> data(entry.Data.get(), entry.Length);
+
+	ReleaseSRWLockShared(&m_Lock);
+	return data;
+}
+
+uint64_t ShaderBytecodeStore::GetUniqueBytes() const
+{
+	AcquireSRWLockShared(&m_Lock);
+	uint64_t bytes = m_UniqueBytes;
+	ReleaseSRWLockShared(&m_Lock);
+
+	return bytes;
+}
+
+uint64_t ShaderBytecodeStore::GetTotalBytes() const
+{
+	AcquireSRWLockShared(&m_Lock);
+	uint64_t bytes = m_TotalBytes;
+	ReleaseSRWLockShared(&m_Lock);
+
+	return bytes;
+}
\ No newline at end of file
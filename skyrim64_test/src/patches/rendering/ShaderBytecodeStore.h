@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include "../../common.h"
+
+//
+// Content-addressed, reference counted storage for shader bytecode. Blobs are keyed by
+// XUtil::MurmurHash64A of their bytes, so every permutation that compiles to the same bytecode shares
+// one copy. A handle is the key of its entry; on the (unlikely) hash collision the next free key is
+// used, so handles are never ambiguous. Handle 0 is never returned.
+//
+class ShaderBytecodeStore
+{
+public:
+	using Handle = uint64_t;
+	static constexpr Handle InvalidHandle = 0;
+
+private:
+	struct Entry
+	{
+		std::unique_ptr<uint8_t[]> Data;
+		size_t Length;
+		uint32_t RefCount;
+	};
+
+	mutable SRWLOCK m_Lock = SRWLOCK_INIT;
+	std::unordered_map<Handle, Entry> m_Entries;
+	uint64_t m_UniqueBytes = 0;	// Bytes actually held
+	uint64_t m_TotalBytes = 0;	// Bytes held if every reference had its own copy
+
+public:
+	Handle Acquire(const void *Bytecode, size_t Length);
+	void Release(Handle Bytecode);
+	std::pair<void *, size_t> Get(Handle Bytecode) const;
+
+	uint64_t GetUniqueBytes() const;
+	uint64_t GetTotalBytes() const;
+};
+
+extern ShaderBytecodeStore g_ShaderBytecodeStore;
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include "ShaderCompileCache.h"
+
+namespace
+{
+	const uint32_t CacheMagic = 0x43435342;		// 'CCSB'
+	const uint32_t CacheVersion = 2;
+
+	uint64_t HashBytes(const void *Data, size_t Length, uint64_t Seed)
+	{
+		// FNV-1a. Keys and source files are small, and XUtil would pull in Windows.
+		uint64_t hash = 0xCBF29CE484222325ull ^ Seed;
+
+		for (size_t i = 0; i < Length; i++)
+		{
+			hash ^= ((const uint8_t *)Data)[i];
+			hash *= 0x100000001B3ull;
+		}
+
+		return hash;
+	}
+
+	uint64_t HashString(const std::string& Value, uint64_t Seed)
+	{
+		// Include the length so ("AB", "C") and ("A", "BC") differ
+		return HashBytes(Value.data(), Value.size(), Seed ^ Value.size());
+	}
+
+	std::string GetEntryName(uint64_t Key, const char *Extension)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "%016llX%s", (unsigned long long)Key, Extension);
+
+		return name;
+	}
+
+	template<typename T>
+	bool ReadValue(std::ifstream& Stream, T& Value)
+	{
+		return (bool)Stream.read((char *)&Value, sizeof(T));
+	}
+
+	template<typename T>
+	void WriteValue(std::ofstream& Stream, const T& Value)
+	{
+		Stream.write((const char *)&Value, sizeof(T));
+	}
+}
+
+std::string GetUtf8Path(const std::filesystem::path& Path)
+{
+	auto utf8 = Path.u8string();
+
+	return std::string(reinterpret_cast<const char *>(utf8.c_str()), utf8.size());
+}
+
+ShaderCompileCache::ShaderCompileCache(IShaderCompiler *Compiler, const std::filesystem::path& Directory) : m_Compiler(Compiler), m_Directory(Directory)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(m_Directory, ec);
+}
+
+void ShaderCompileCache::Compile(const ShaderCompileRequest& Request, ShaderCompileResult& Result)
+{
+	uint64_t key = GetRequestKey(Request);
+
+	if (Load(key, Result))
+	{
+		m_Hits++;
+		return;
+	}
+
+	m_Misses++;
+	Result = ShaderCompileResult();
+	m_Compiler->Compile(Request, Result);
+
+	if (Result.Success)
+		Store(key, Result);
+}
+
+void ShaderCompileCache::CompileBatch(const std::vector<ShaderCompileRequest>& Requests, std::vector<ShaderCompileResult>& Results, uint32_t ThreadCount)
+{
+	// Source files may have been edited since the last batch
+	ClearFileHashes();
+
+	Results.clear();
+	Results.resize(Requests.size());
+
+	std::atomic_size_t nextRequest = 0;
+	auto worker = [&]()
+	{
+		for (size_t i; (i = nextRequest++) < Requests.size();)
+			Compile(Requests[i], Results[i]);
+	};
+
+	ThreadCount = std::clamp<uint32_t>(ThreadCount, 1, (uint32_t)std::max<size_t>(Requests.size(), 1));
+	std::vector<std::thread> threads;
+
+	for (uint32_t i = 1; i < ThreadCount; i++)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (auto& thread : threads)
+		thread.join();
+}
+
+void ShaderCompileCache::ClearFileHashes()
+{
+	std::lock_guard<std::mutex> lock(m_FileHashLock);
+	m_FileHashes.clear();
+}
+
+uint32_t ShaderCompileCache::GetHitCount() const
+{
+	return m_Hits;
+}
+
+uint32_t ShaderCompileCache::GetMissCount() const
+{
+	return m_Misses;
+}
+
+uint64_t ShaderCompileCache::GetRequestKey(const ShaderCompileRequest& Request) const
+{
+	uint64_t hash = HashString(m_Compiler->GetIdentifier(), CacheVersion);
+
+	hash = HashString(GetUtf8Path(std::filesystem::absolute(Request.FilePath).lexically_normal()), hash);
+
+	for (auto& [name, value] : Request.Defines)
+	{
+		hash = HashString(name, hash);
+		hash = HashString(value, hash);
+	}
+
+	hash = HashString(Request.EntryPoint, hash);
+	hash = HashString(Request.Target, hash);
+	return HashBytes(&Request.Flags, sizeof(Request.Flags), hash);
+}
+
+bool ShaderCompileCache::GetFileHash(const std::filesystem::path& Path, uint64_t *Hash)
+{
+	std::wstring name = std::filesystem::absolute(Path).lexically_normal().wstring();
+
+	{
+		std::lock_guard<std::mutex> lock(m_FileHashLock);
+
+		if (auto itr = m_FileHashes.find(name); itr != m_FileHashes.end())
+		{
+			*Hash = itr->second;
+			return true;
+		}
+	}
+
+	std::ifstream file(Path, std::ios::binary);
+
+	if (!file)
+		return false;
+
+	std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	*Hash = HashBytes(data.data(), data.size(), 0);
+
+	std::lock_guard<std::mutex> lock(m_FileHashLock);
+	m_FileHashes.emplace(name, *Hash);
+	return true;
+}
+
+//
+// Entry layout:
+//
+// uint32 magic, uint32 version, uint64 key
+// uint32 dependency count, { uint32 path length, char[] UTF-8 path, uint64 content hash }
+// uint32 bytecode length, uint8[] bytecode
+//
+bool ShaderCompileCache::Load(uint64_t Key, ShaderCompileResult& Result)
+{
+	std::ifstream file(m_Directory / GetEntryName(Key, ".bin"), std::ios::binary);
+
+	if (!file)
+		return false;
+
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t dependencyCount;
+
+	if (!ReadValue(file, magic) || !ReadValue(file, version) || !ReadValue(file, key) || !ReadValue(file, dependencyCount))
+		return false;
+
+	if (magic != CacheMagic || version != CacheVersion || key != Key)
+		return false;
+
+	Result = ShaderCompileResult();
+
+	for (uint32_t i = 0; i < dependencyCount; i++)
+	{
+		uint32_t length;
+		uint64_t storedHash;
+		uint64_t currentHash;
+
+		if (!ReadValue(file, length) || length > 4096)
+			return false;
+
+		std::string path(length, '\0');
+
+		if (!file.read(path.data(), length) || !ReadValue(file, storedHash))
+			return false;
+
+		// Missing or edited file (source or include) invalidates the entry
+		Result.Dependencies.emplace_back(std::filesystem::u8path(path));
+
+		if (!GetFileHash(Result.Dependencies.back(), &currentHash) || currentHash != storedHash)
+			return false;
+	}
+
+	uint32_t bytecodeLength;
+
+	if (!ReadValue(file, bytecodeLength) || bytecodeLength == 0)
+		return false;
+
+	Result.Bytecode.resize(bytecodeLength);
+
+	if (!file.read((char *)Result.Bytecode.data(), bytecodeLength))
+		return false;
+
+	Result.Success = true;
+	Result.FromCache = true;
+	return true;
+}
+
+void ShaderCompileCache::Store(uint64_t Key, const ShaderCompileResult& Result)
+{
+	char threadSuffix[32];
+	snprintf(threadSuffix, sizeof(threadSuffix), ".%zX.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+	const std::string name = GetEntryName(Key, ".bin");
+	const std::string tempName = GetEntryName(Key, threadSuffix);
+
+	{
+		std::ofstream file(m_Directory / tempName, std::ios::binary | std::ios::trunc);
+
+		if (!file)
+			return;
+
+		WriteValue(file, CacheMagic);
+		WriteValue(file, CacheVersion);
+		WriteValue(file, Key);
+		WriteValue(file, (uint32_t)Result.Dependencies.size());
+
+		for (auto& dependency : Result.Dependencies)
+		{
+			std::string path = GetUtf8Path(std::filesystem::absolute(dependency).lexically_normal());
+			uint64_t hash = 0;
+
+			// Can't prove the entry is current later on, so don't write one
+			if (!GetFileHash(dependency, &hash))
+			{
+				std::error_code ec;
+				file.close();
+				std::filesystem::remove(m_Directory / tempName, ec);
+				return;
+			}
+
+			WriteValue(file, (uint32_t)path.size());
+			file.write(path.data(), path.size());
+			WriteValue(file, hash);
+		}
+
+		WriteValue(file, (uint32_t)Result.Bytecode.size());
+		file.write((const char *)Result.Bytecode.data(), Result.Bytecode.size());
+	}
+
+	// Readers only ever see complete entries
+	std::error_code ec;
+	std::filesystem::rename(m_Directory / tempName, m_Directory / name, ec);
+
+	if (ec)
+		std::filesystem::remove(m_Directory / tempName, ec);
+}
\ No newline at end of file
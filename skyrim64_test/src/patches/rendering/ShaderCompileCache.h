@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <filesystem>
+#include <unordered_map>
+
+struct ShaderCompileRequest
+{
+	std::filesystem::path FilePath;
+	std::vector<std::pair<std::string, std::string>> Defines;
+	std::string EntryPoint;
+	std::string Target;
+	uint32_t Flags;
+};
+
+struct ShaderCompileResult
+{
+	bool Success = false;
+	bool FromCache = false;
+	std::vector<uint8_t> Bytecode;
+	std::vector<std::filesystem::path> Dependencies;	// Every file the compiler opened, source included
+	std::string Errors;
+};
+
+// UTF-8 bytes of Path. From C++20 on path::u8string() returns std::u8string, which doesn't convert to std::string.
+std::string GetUtf8Path(const std::filesystem::path& Path);
+
+//
+// Anything that turns a request into bytecode. Implementations must be callable from several threads
+// at once and must report every file they read in ShaderCompileResult::Dependencies.
+//
+class IShaderCompiler
+{
+public:
+	virtual ~IShaderCompiler() = default;
+
+	// Changes whenever the compiler would produce different output for the same input (DLL version etc.)
+	virtual std::string GetIdentifier() const = 0;
+	virtual void Compile(const ShaderCompileRequest& Request, ShaderCompileResult& Result) = 0;
+};
+
+//
+// Disk cache in front of an IShaderCompiler. An entry is named after a hash of the compiler identifier,
+// source path, defines, entry point, target and flags. It stores the bytecode together with the
+// content hash of every file the compile read, and is only used while all of those still match.
+// Nothing in here talks to D3D or depends on Windows, so a stub compiler is enough to drive it.
+//
+class ShaderCompileCache
+{
+private:
+	IShaderCompiler *m_Compiler;
+	std::filesystem::path m_Directory;
+	std::mutex m_FileHashLock;
+	std::unordered_map<std::wstring, uint64_t> m_FileHashes;	// Memoized per batch, see ClearFileHashes()
+	std::atomic_uint32_t m_Hits = 0;
+	std::atomic_uint32_t m_Misses = 0;
+
+public:
+	ShaderCompileCache(IShaderCompiler *Compiler, const std::filesystem::path& Directory);
+
+	void Compile(const ShaderCompileRequest& Request, ShaderCompileResult& Result);
+	void CompileBatch(const std::vector<ShaderCompileRequest>& Requests, std::vector<ShaderCompileResult>& Results, uint32_t ThreadCount);
+	void ClearFileHashes();
+
+	uint32_t GetHitCount() const;
+	uint32_t GetMissCount() const;
+
+private:
+	uint64_t GetRequestKey(const ShaderCompileRequest& Request) const;
+	bool GetFileHash(const std::filesystem::path& Path, uint64_t *Hash);
+	bool Load(uint64_t Key, ShaderCompileResult& Result);
+	void Store(uint64_t Key, const ShaderCompileResult& Result);
+};
\ No newline at end of file
@@ -49,6 +49,7 @@ HRESULT WINAPI hk_IDXGISwapChain_Present(IDXGISwapChain *This, UINT SyncInterval
 
 		g_FrameDelta.QuadPart = g_FrameEnd.QuadPart - g_FrameStart.QuadPart;
 		g_GPUTimers.EndFrame(g_DeviceContext);
+		g_GPUScopeTimers.EndFrame(g_DeviceContext);
 	}
 
 	ui::EndFrame();
@@ -63,6 +64,7 @@ HRESULT WINAPI hk_IDXGISwapChain_Present(IDXGISwapChain *This, UINT SyncInterval
 
 	ui::BeginFrame();
 	g_GPUTimers.BeginFrame(g_DeviceContext);
+	g_GPUScopeTimers.BeginFrame(g_DeviceContext);
 
 	g_GPUTimers.StartTimer(g_DeviceContext, 0);
 	QueryPerformanceCounter(&g_FrameStart);
@@ -366,6 +368,7 @@ HRESULT WINAPI hk_D3D11CreateDeviceAndSwapChain(
 	*(PBYTE *)&RenderSceneNormal = Detours::X64::DetourFunctionClass((PBYTE)g_ModuleBase + 0x12E1960, &BSShaderAccumulator::RenderSceneNormal);
 
 	g_GPUTimers.Create(g_Device, 1);
+	g_GPUScopeTimers.Create(g_Device, 256);
 	//TracyDx11Context(g_Device, g_DeviceContext);
 	//DC_Init(g_Device, 0);
 
@@ -373,7 +376,7 @@ HRESULT WINAPI hk_D3D11CreateDeviceAndSwapChain(
 	CD3D11_TEXTURE2D_DESC cpuRenderTargetDescAVX
 	(
 		DXGI_FORMAT_R8G8B8A8_UNORM,
-		1280, // TODO: round up to full tile sizes
+		1280, // Initial size only, MOC::UpdateDepthViewTexture() resizes it to the adaptive resolution
 		720,
 		1, // Array Size
 		1, // MIP Levels
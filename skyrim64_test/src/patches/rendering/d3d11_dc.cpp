@@ -2,6 +2,7 @@
 #include <tbb/concurrent_queue.h>
 #include <atomic>
 #include "../TES/BSGraphicsRenderer.h"
+#include "../TES/MTRenderer.h"
 
 //
 // Random notes while I was writing this at 3am:
@@ -14,7 +15,6 @@
 // - Semaphores are used for notification (and a counter to number of pending jobs).
 // - All arrays are pre-allocated and queues only store the pointers.
 //
-#define MAXIMUM_WORKER_THREADS 4
 #define MAXIMUM_JOBS 32
 
 HANDLE ThreadInitSemaphore;// Counter between 0 and MAXIMUM_WORKER_THREADS
@@ -62,9 +62,10 @@ struct JobCommandData
 
 DWORD WINAPI DC_Thread(LPVOID Arg)
 {
-	UNREFERENCED_PARAMETER(Arg);
-
 	XUtil::SetThreadName(GetCurrentThreadId(), "DC_Thread");
+
+	// Lane 0 of the dynamic/constant ring buffers is reserved for the immediate context
+	BSGraphics::Renderer::SetRingBufferLane((uint32_t)(uintptr_t)Arg + 1);
 	ReleaseSemaphore(ThreadInitSemaphore, 1, nullptr);
 
 	// Loop forever: whichever thread gets a job first executes it. Semaphores are NOT FIFO.
@@ -89,8 +90,10 @@ DWORD WINAPI DC_Thread(LPVOID Arg)
 		}
 		else
 		{
+			// A fresh deferred context has default state. Forget whatever this thread applied last time.
 			jobData->ThreadGlobals.m_StateUpdateFlags = 0xFFFFFFFF & ~0x400;
 			jobData->ThreadGlobals.m_DeviceContext = jobData->DeferredContext;
+			BSGraphics::Renderer::FlushThreadedVars();
 			jobData->Callback(jobData->a1, jobData->a2);
 
 			Assert(SUCCEEDED(jobData->DeferredContext->FinishCommandList(FALSE, &jobData->CommandList)));
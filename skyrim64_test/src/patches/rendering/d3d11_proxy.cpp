@@ -1,6 +1,7 @@
 #include "../../common.h"
 #include "../TES/BSGraphicsRenderer.h"
 #include "d3d11_proxy.h"
+#include "RenderStateKey.h"
 
 // ***************************************** //
 //											 //
@@ -579,11 +580,13 @@ void STDMETHODCALLTYPE D3D11DeviceContextProxy::OMSetRenderTargetsAndUnorderedAc
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::OMSetBlendState(ID3D11BlendState *pBlendState, const FLOAT BlendFactor[4], UINT SampleMask)
 {
 	m_Context->OMSetBlendState(pBlendState, BlendFactor, SampleMask);
+	BSGraphics::Renderer::InvalidateAppliedRenderState(RenderStateKey::BlendMask);
 }
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::OMSetDepthStencilState(ID3D11DepthStencilState *pDepthStencilState, UINT StencilRef)
 {
 	m_Context->OMSetDepthStencilState(pDepthStencilState, StencilRef);
+	BSGraphics::Renderer::InvalidateAppliedRenderState(RenderStateKey::DepthStencilMask);
 }
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::SOSetTargets(UINT NumBuffers, ID3D11Buffer *const *ppSOTargets, const UINT *pOffsets)
@@ -629,6 +632,7 @@ void STDMETHODCALLTYPE D3D11DeviceContextProxy::DispatchIndirect(ID3D11Buffer *p
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::RSSetState(ID3D11RasterizerState *pRasterizerState)
 {
 	m_Context->RSSetState(pRasterizerState);
+	BSGraphics::Renderer::InvalidateAppliedRenderState(RenderStateKey::RasterMask);
 }
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::RSSetViewports(UINT NumViewports, const D3D11_VIEWPORT *pViewports)
@@ -704,6 +708,11 @@ void STDMETHODCALLTYPE D3D11DeviceContextProxy::ResolveSubresource(ID3D11Resourc
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::ExecuteCommandList(ID3D11CommandList *pCommandList, BOOL RestoreContextState)
 {
 	m_Context->ExecuteCommandList(pCommandList, RestoreContextState);
+	BSGraphics::Renderer::OnExecuteCommandList();
+
+	// Without RestoreContextState the context is left cleared
+	if (!RestoreContextState)
+		BSGraphics::Renderer::InvalidateAppliedRenderState(RenderStateKey::AllMask);
 }
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::HSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView *const *ppShaderResourceViews)
@@ -964,6 +973,7 @@ void STDMETHODCALLTYPE D3D11DeviceContextProxy::CSGetConstantBuffers(UINT StartS
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::ClearState()
 {
 	m_Context->ClearState();
+	BSGraphics::Renderer::InvalidateAppliedRenderState(RenderStateKey::AllMask);
 }
 
 void STDMETHODCALLTYPE D3D11DeviceContextProxy::Flush()
@@ -978,7 +988,12 @@ UINT STDMETHODCALLTYPE D3D11DeviceContextProxy::GetContextFlags()
 
 HRESULT STDMETHODCALLTYPE D3D11DeviceContextProxy::FinishCommandList(BOOL RestoreDeferredContextState, ID3D11CommandList **ppCommandList)
 {
-	return m_Context->FinishCommandList(RestoreDeferredContextState, ppCommandList);
+	HRESULT hr = m_Context->FinishCommandList(RestoreDeferredContextState, ppCommandList);
+
+	if (!RestoreDeferredContextState)
+		BSGraphics::Renderer::InvalidateAppliedRenderState(RenderStateKey::AllMask);
+
+	return hr;
 }
 
 D3D11_DEVICE_CONTEXT_TYPE STDMETHODCALLTYPE D3D11DeviceContextProxy::GetType()
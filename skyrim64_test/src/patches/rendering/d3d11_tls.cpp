@@ -1,4 +1,6 @@
 #include "common.h"
+#include <thread>
+#include "PageGuardHits.h"
 
 // Defined in CRT headers somewhere. Used purely for sanity checking.
 extern "C" unsigned int _tls_index;
@@ -13,9 +15,30 @@ uint32_t g_MainThreadId;
 
 std::unordered_map<uint32_t, uintptr_t> g_ThreadTLSMaps;
 
-uintptr_t g_PageGuardBase;
-size_t g_PageGuardSize;
-uint32_t g_PageGuardTls = TLS_OUT_OF_INDEXES;
+namespace
+{
+	const uint32_t PageGuardMaxRanges = 16;
+	const uintptr_t PageGuardPageSize = 4096;
+	const DWORD PageGuardPollInterval = 5;			// Milliseconds between hit ring drains/deferred re-arms
+	const DWORD PageGuardReportInterval = 5000;		// Milliseconds between call site reports
+	const uint32_t PageGuardReportSites = 32;
+
+	struct PageGuardRange
+	{
+		uintptr_t Base;
+		size_t Size;
+		uintptr_t FirstPage;
+		uint32_t PageCount;
+		DWORD Protect;									// Without PAGE_GUARD
+		uint32_t SamplePeriod;							// See PageGuard_Monitor
+		std::unique_ptr<std::atomic<uint64_t>[]> DisarmedAt;	// Per page tick count, 0 while armed
+	};
+
+	PageGuardRange g_PageGuardRanges[PageGuardMaxRanges];
+	std::atomic_uint32_t g_PageGuardRangeCount;
+	uint32_t g_PageGuardTls = TLS_OUT_OF_INDEXES;
+	std::unique_ptr<PageGuardHitRing> g_PageGuardHits;
+}
 
 uint32_t delayedThreadPatchIndex;
 uint32_t delayedTlsThreadIds[256];
@@ -183,51 +206,198 @@ void TLS_RestoreThread()
 	*(uintptr_t *)GET_TLS_BLOCK(g_TlsIndex) = GetMainTls();
 }
 
-void PageGuard_Monitor(uintptr_t VirtualAddress, size_t Size)
+void PageGuard_ArmPage(const PageGuardRange& Range, uintptr_t Page)
+{
+	DWORD old;
+	VirtualProtect((PVOID)Page, PageGuardPageSize, Range.Protect | PAGE_GUARD, &old);
+}
+
+void PageGuard_Report(const PageGuardHitAggregator& Aggregator)
+{
+	auto sites = Aggregator.GetCallSites();
+	char buf[512];
+
+	sprintf_s(buf, "PAGE GUARD: %llu hits, %zu call sites, %llu dropped\n", Aggregator.GetTotalHits(), sites.size(), g_PageGuardHits->GetDroppedCount());
+	OutputDebugStringA(buf);
+
+	for (size_t i = 0; i < sites.size() && i < PageGuardReportSites; i++)
+	{
+		auto& site = sites[i];
+		const PageGuardRange& range = g_PageGuardRanges[site.Range];
+
+		sprintf_s(buf, "  RANGE %u RIP 0x%llX (exe+0x%llX): %llu reads, %llu writes, offsets 0x%llX-0x%llX%s\n",
+			(uint32_t)site.Range,
+			site.Rip,
+			site.Rip - g_ModuleBase,
+			site.Reads,
+			site.Writes,
+			site.MinAddress - range.Base,
+			site.MaxAddress - range.Base,
+			site.MultipleThreads ? ", multiple threads" : "");
+		OutputDebugStringA(buf);
+	}
+}
+
+void PageGuard_WorkerThread()
 {
-	g_PageGuardBase = VirtualAddress;
-	g_PageGuardSize = Size;
+	PageGuardHitAggregator aggregator;
+	PageGuardHit hits[1024];
+	uint64_t reportedHits = 0;
+	ULONGLONG lastReport = GetTickCount64();
+
+	for (;; Sleep(PageGuardPollInterval))
+	{
+		while (uint32_t count = g_PageGuardHits->Drain(hits, ARRAYSIZE(hits)))
+			aggregator.Add(hits, count);
+
+		// Re-arm sampled pages whose period expired
+		const ULONGLONG now = GetTickCount64();
+		const uint32_t rangeCount = g_PageGuardRangeCount.load(std::memory_order_acquire);
+
+		for (uint32_t i = 0; i < rangeCount; i++)
+		{
+			PageGuardRange& range = g_PageGuardRanges[i];
+
+			if (range.SamplePeriod == 0)
+				continue;
+
+			for (uint32_t page = 0; page < range.PageCount; page++)
+			{
+				uint64_t disarmedAt = range.DisarmedAt[page].load(std::memory_order_relaxed);
+
+				if (disarmedAt == 0 || now - disarmedAt < range.SamplePeriod)
+					continue;
+
+				range.DisarmedAt[page].store(0, std::memory_order_relaxed);
+				PageGuard_ArmPage(range, range.FirstPage + page * PageGuardPageSize);
+			}
+		}
+
+		if (now - lastReport >= PageGuardReportInterval && aggregator.GetTotalHits() != reportedHits)
+		{
+			PageGuard_Report(aggregator);
+
+			reportedHits = aggregator.GetTotalHits();
+			lastReport = now;
+		}
+	}
+}
+
+void PageGuard_Monitor(uintptr_t VirtualAddress, size_t Size, uint32_t SamplePeriod)
+{
+	//
+	// Ranges are only ever added, and each one is fully built before the count is published, so the exception
+	// handler never takes a lock. Only pages that were hit are re-armed, never the whole range.
+	//
+	const uint32_t index = g_PageGuardRangeCount.load(std::memory_order_relaxed);
+	AssertMsg(index < PageGuardMaxRanges, "Too many page guard ranges");
 
 	if (g_PageGuardTls == TLS_OUT_OF_INDEXES)
 	{
 		g_PageGuardTls = TlsAlloc();
+		g_PageGuardHits = std::make_unique<PageGuardHitRing>();
 		AddVectoredExceptionHandler(TRUE, PageGuard_Check);
+		std::thread(PageGuard_WorkerThread).detach();
 	}
 
+	PageGuardRange& range = g_PageGuardRanges[index];
+	range.Base = VirtualAddress;
+	range.Size = Size;
+	range.FirstPage = VirtualAddress & ~(PageGuardPageSize - 1);
+	range.PageCount = (uint32_t)((VirtualAddress + Size - range.FirstPage + PageGuardPageSize - 1) / PageGuardPageSize);
+	range.SamplePeriod = SamplePeriod;
+	range.DisarmedAt = std::make_unique<std::atomic<uint64_t>[]>(range.PageCount);
+
+	for (uint32_t i = 0; i < range.PageCount; i++)
+		range.DisarmedAt[i].store(0, std::memory_order_relaxed);
+
 	MEMORY_BASIC_INFORMATION memInfo;
 	VirtualQuery((PVOID)VirtualAddress, &memInfo, sizeof(MEMORY_BASIC_INFORMATION));
-	VirtualProtect((PVOID)VirtualAddress, Size, memInfo.Protect | PAGE_GUARD, &memInfo.Protect);
+	range.Protect = memInfo.Protect & ~PAGE_GUARD;
+
+	g_PageGuardRangeCount.store(index + 1, std::memory_order_release);
+
+	VirtualProtect((PVOID)range.FirstPage, range.PageCount * PageGuardPageSize, range.Protect | PAGE_GUARD, &memInfo.Protect);
 }
 
 LONG WINAPI PageGuard_Check(PEXCEPTION_POINTERS ExceptionInfo)
 {
-	if (ExceptionInfo->ExceptionRecord->ExceptionCode == STATUS_GUARD_PAGE_VIOLATION)
+	const PEXCEPTION_RECORD record = ExceptionInfo->ExceptionRecord;
+	const uint32_t rangeCount = g_PageGuardRangeCount.load(std::memory_order_acquire);
+
+	if (record->ExceptionCode == STATUS_GUARD_PAGE_VIOLATION)
 	{
-		// Store the offset that is trying to be accessed
-		TlsSetValue(g_PageGuardTls, (LPVOID)ExceptionInfo->ExceptionRecord->ExceptionInformation[1]);
+		const uintptr_t address = record->ExceptionInformation[1];
+		const uintptr_t page = address & ~(PageGuardPageSize - 1);
+		bool handled = false;
+		bool rearmNow = false;
+
+		for (uint32_t i = 0; i < rangeCount; i++)
+		{
+			PageGuardRange& range = g_PageGuardRanges[i];
+
+			if (page < range.FirstPage || page >= range.FirstPage + range.PageCount * PageGuardPageSize)
+				continue;
+
+			handled = true;
+
+			// The guarded page can hold unrelated data around the range
+			if (address >= range.Base && address < range.Base + range.Size)
+			{
+				PageGuardHit hit;
+				hit.Address = address;
+				hit.Rip = (uint64_t)record->ExceptionAddress;
+				hit.ThreadId = GetCurrentThreadId();
+				hit.Range = (uint16_t)i;
+				hit.Write = (record->ExceptionInformation[0] == 1);
+				hit.Reserved = 0;
+
+				g_PageGuardHits->Push(hit);
+			}
+
+			if (range.SamplePeriod == 0)
+				rearmNow = true;
+			else
+				range.DisarmedAt[(page - range.FirstPage) / PageGuardPageSize].store(GetTickCount64(), std::memory_order_relaxed);
+		}
+
+		if (!handled)
+			return EXCEPTION_CONTINUE_SEARCH;
+
+		// The guard is gone after this trap. Either single step past the access and put it back right away, or
+		// leave the page open until the worker thread re-arms it.
+		if (rearmNow)
+		{
+			TlsSetValue(g_PageGuardTls, (LPVOID)page);
+			ExceptionInfo->ContextRecord->EFlags |= 0x100;
+		}
 
-		ExceptionInfo->ContextRecord->EFlags |= 0x100;
 		return EXCEPTION_CONTINUE_EXECUTION;
 	}
 
-	if (ExceptionInfo->ExceptionRecord->ExceptionCode == EXCEPTION_SINGLE_STEP)
+	if (record->ExceptionCode == EXCEPTION_SINGLE_STEP)
 	{
-		uintptr_t eip = (uintptr_t)ExceptionInfo->ExceptionRecord->ExceptionAddress;
-		uintptr_t offset = (uintptr_t)TlsGetValue(g_PageGuardTls);
+		const uintptr_t page = (uintptr_t)TlsGetValue(g_PageGuardTls);
+
+		// Not ours
+		if (!page)
+			return EXCEPTION_CONTINUE_SEARCH;
 
-		// Is the offset in our range?
-		if (offset >= g_PageGuardBase && offset < (g_PageGuardBase + g_PageGuardSize))
+		TlsSetValue(g_PageGuardTls, nullptr);
+
+		for (uint32_t i = 0; i < rangeCount; i++)
 		{
-			char buf[1024];
-			sprintf_s(buf, "ADDR HIT: 0x%llX FROM 0x%llX\n", offset, eip);
-			OutputDebugStringA(buf);
+			const PageGuardRange& range = g_PageGuardRanges[i];
+
+			if (page >= range.FirstPage && page < range.FirstPage + range.PageCount * PageGuardPageSize)
+			{
+				PageGuard_ArmPage(range, page);
+				break;
+			}
 		}
 
-		MEMORY_BASIC_INFORMATION memInfo;
-		VirtualQuery((PVOID)g_PageGuardBase, &memInfo, sizeof(MEMORY_BASIC_INFORMATION));
-		VirtualProtect(memInfo.BaseAddress, memInfo.RegionSize, memInfo.Protect | PAGE_GUARD, &memInfo.Protect);
 		return EXCEPTION_CONTINUE_EXECUTION;
 	}
 
 	return EXCEPTION_CONTINUE_SEARCH;
-}
\ No newline at end of file
+}
@@ -9,6 +9,7 @@
 
 #define TLS_DEBUG_ENABLE 0
 #define TLS_DEBUG_MEMORY_ACCESS 0
+#define TLS_DEBUG_VALIDATE_CODEGEN 0		// Run every patch against its original instruction at startup (PatchCodeGenValidator)
 
 extern unsigned int g_TlsIndex;
 
@@ -18,5 +19,12 @@ void *HACK_GetMainGlobals();
 void TLSPatcherInitialize();
 VOID WINAPI TLSPatcherCallback(PVOID DllHandle, DWORD Reason, PVOID Reserved);
 
-void PageGuard_Monitor(uintptr_t VirtualAddress, size_t Size);
+//
+// Page guard memory watch. Every watched range gets its own sample period in milliseconds. At 0, each
+// access is trapped: the page is re-armed right after the access by single stepping it. Otherwise a
+// page stays open for that long after a hit before a background thread re-arms it. That bounds the cost
+// to one trap per page per period. Hits are aggregated by call site and written with OutputDebugStringA
+// every few seconds.
+//
+void PageGuard_Monitor(uintptr_t VirtualAddress, size_t Size, uint32_t SamplePeriod = 0);
 LONG WINAPI PageGuard_Check(PEXCEPTION_POINTERS ExceptionInfo);
\ No newline at end of file
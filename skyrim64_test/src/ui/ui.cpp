@@ -25,6 +25,22 @@ namespace ui::opt
 	bool EnableOccluderRendering = true;
 	float OccluderMaxDistance = 15000.0f;
 	float OccluderFirstLevelMinSize = 550.0f;
+	bool EnableTemporalOcclusion = false;
+	bool ValidateTemporalOcclusion = false;
+	float TemporalMaxTranslation = 150.0f;
+	float TemporalMaxRotation = 10.0f;
+	bool RecordOcclusionCameraPath = false;
+	bool AdaptiveOcclusion = true;
+	float OcclusionBudgetMs = 1.5f;
+	float OcclusionTargetCullPercent = 15.0f;
+	bool EnableOccluderSelection = true;
+	int OccluderMaxCount = 256;
+	int OccluderTriangleBudget = 150000;
+	float OccluderMinScreenArea = 0.002f;
+	bool EnableBatchFrustumCulling = true;
+	bool EnableRenderPassSort = false;
+	bool EnableAutoInstancing = false;
+	bool EnableConstantBufferDedup = true;
 }
 
 namespace ui
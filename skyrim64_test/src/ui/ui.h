@@ -13,6 +13,22 @@ namespace ui
 		extern bool EnableOccluderRendering;
 		extern float OccluderMaxDistance;
 		extern float OccluderFirstLevelMinSize;
+		extern bool EnableTemporalOcclusion;
+		extern bool ValidateTemporalOcclusion;
+		extern float TemporalMaxTranslation;
+		extern float TemporalMaxRotation;
+		extern bool RecordOcclusionCameraPath;
+		extern bool AdaptiveOcclusion;
+		extern float OcclusionBudgetMs;
+		extern float OcclusionTargetCullPercent;
+		extern bool EnableOccluderSelection;
+		extern int OccluderMaxCount;
+		extern int OccluderTriangleBudget;
+		extern float OccluderMinScreenArea;
+		extern bool EnableBatchFrustumCulling;
+		extern bool EnableRenderPassSort;
+		extern bool EnableAutoInstancing;
+		extern bool EnableConstantBufferDedup;
 	}
 
 	extern bool showTracyWindow;
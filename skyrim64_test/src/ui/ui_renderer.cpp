@@ -2,6 +2,7 @@
 #include "../patches/dinput8.h"
 #include "../patches/TES/Setting.h"
 #include "../patches/rendering/GpuTimer.h"
+#include "../patches/rendering/ShaderBytecodeStore.h"
 #include "../patches/TES/BSShader/BSShaderRenderTargets.h"
 #include "../patches/TES/NiMain/NiNode.h"
 #include "imgui_ext.h"
@@ -13,6 +14,7 @@
 #include "../patches/TES/NiMain/BSMultiBoundNode.h"
 #include "../patches/TES/BSShader/BSShaderProperty.h"
 #include "../patches/TES/NiMain/NiCamera.h"
+#include "../patches/TES/MOC.h"
 
 extern LARGE_INTEGER g_FrameDelta;
 extern std::vector<std::pair<ID3D11ShaderResourceView *, std::string>> g_ResourceViews;
@@ -108,15 +110,47 @@ namespace ui
 				ProfileGetValue("Dispatch Calls");
 			}
 
+			// GPU time per BeginEvent()/EndEvent() scope, a few frames behind
+			if (ImGui::CollapsingHeader("GPU Passes"))
+			{
+				for (auto& result : g_GPUScopeTimers.GetResults())
+				{
+					ImGui::SetCursorPosX(ImGui::GetCursorPosX() + result.Depth * ImGui::GetStyle().IndentSpacing);
+					ImGui::Text("%S: %.3f ms", result.Name.c_str(), result.GPUTimeInMS);
+				}
+			}
+
 			ImGui::Text("FPS: %.2f", LastFpsCount);
 			ImGui::Spacing();
 			ImGui::Text("CB Bytes Requested: %s", ImGui::CommaFormat(ProfileGetDeltaValue("CB Bytes Requested")));
 			ImGui::Text("CB Bytes Wasted: %s", ImGui::CommaFormat(ProfileGetDeltaValue("CB Bytes Wasted")));
+			ImGui::Text("CB Bytes Uploaded: %s", ImGui::CommaFormat(ProfileGetDeltaValue("CB Bytes Uploaded")));
 			ImGui::Text("VIB Bytes Requested: %s", ImGui::CommaFormat(ProfileGetDeltaValue("VIB Bytes Requested")));
+			ImGui::Text("State Changes Skipped: %s", ImGui::CommaFormat(ProfileGetDeltaValue("State Changes Skipped")));
+			ImGui::Text("Shader Bytecode Unique Bytes: %s", ImGui::CommaFormat(g_ShaderBytecodeStore.GetUniqueBytes()));
+			ImGui::Text("Shader Bytecode Total Bytes: %s", ImGui::CommaFormat(g_ShaderBytecodeStore.GetTotalBytes()));
+			ImGui::Spacing();
+			ImGui::Checkbox("Sort Render Passes", &ui::opt::EnableRenderPassSort);
+			ImGui::Text("Sorted Passes: %s", ImGui::CommaFormat(ProfileGetDeltaValue("RenderPass Sorted")));
+			ImGui::Text("Technique Switches Avoided: %s", ImGui::CommaFormat(ProfileGetDeltaValue("RenderPass Technique Switches Avoided")));
+			ImGui::Text("Material Switches Avoided: %s", ImGui::CommaFormat(ProfileGetDeltaValue("RenderPass Material Switches Avoided")));
+			ImGui::Checkbox("Automatic Instancing", &ui::opt::EnableAutoInstancing);
+			ImGui::Text("Instanced Draws: %s", ImGui::CommaFormat(ProfileGetDeltaValue("Instanced Draws")));
+			ImGui::Text("Instanced Passes: %s", ImGui::CommaFormat(ProfileGetDeltaValue("Instanced Passes")));
+			ImGui::Checkbox("Deduplicate Constant Buffers", &ui::opt::EnableConstantBufferDedup);
+			ImGui::Text("CB Bytes Deduplicated: %s", ImGui::CommaFormat(ProfileGetDeltaValue("CB Bytes Deduplicated")));
 
 			ProfileGetValue("CB Bytes Requested");
 			ProfileGetValue("VIB Bytes Requested");
 			ProfileGetValue("CB Bytes Wasted");
+			ProfileGetValue("CB Bytes Uploaded");
+			ProfileGetValue("CB Bytes Deduplicated");
+			ProfileGetValue("State Changes Skipped");
+			ProfileGetValue("RenderPass Sorted");
+			ProfileGetValue("RenderPass Technique Switches Avoided");
+			ProfileGetValue("RenderPass Material Switches Avoided");
+			ProfileGetValue("Instanced Draws");
+			ProfileGetValue("Instanced Passes");
 		}
 		ImGui::End();
 	}
@@ -197,6 +231,19 @@ namespace ui
 			ImGui::Text("Passed Objects:"); ImGui::NextColumn();
 			ImGui::Text("%s (%.1f%%)", ImGui::CommaFormat(ProfileGetDeltaValue("MOC CullObjectPassed")), culledPercent); ImGui::NextColumn();
 
+			float falseCullPercent = 100.0f * (float)ProfileGetDeltaValue("MOC TemporalFalseCull") / (float)std::max<uint64_t>(ProfileGetDeltaValue("MOC TemporalValidated"), 1);
+
+			ImGui::Text("Temporal History Copy:"); ImGui::NextColumn();
+			ImGui::Text("%.2fms", ProfileGetDeltaTime("MOC TemporalHistoryCopy")); ImGui::NextColumn();
+
+			ImGui::Text("Temporal False Culls:"); ImGui::NextColumn();
+			ImGui::Text("%s (%.2f%%)", ImGui::CommaFormat(ProfileGetDeltaValue("MOC TemporalFalseCull")), falseCullPercent); ImGui::NextColumn();
+
+			ImGui::NextColumn(); ImGui::NextColumn();
+
+			ImGui::Text("Temporal Missed Culls:"); ImGui::NextColumn();
+			ImGui::Text("%s", ImGui::CommaFormat(ProfileGetDeltaValue("MOC TemporalMissedCull"))); ImGui::NextColumn();
+
 			ProfileGetTime("MOC TraverseSceneGraph");
 			ProfileGetTime("MOC WaitForRender");
 			ProfileGetTime("MOC RenderGeometry");
@@ -205,6 +252,10 @@ namespace ui
 			ProfileGetValue("MOC CullObjectCount");
 			ProfileGetValue("MOC TrianglesRendered");
 			ProfileGetValue("MOC CullObjectPassed");
+			ProfileGetTime("MOC TemporalHistoryCopy");
+			ProfileGetValue("MOC TemporalFalseCull");
+			ProfileGetValue("MOC TemporalMissedCull");
+			ProfileGetValue("MOC TemporalValidated");
 
 			ImGui::Columns(1);
 			ImGui::Separator();
@@ -214,6 +265,41 @@ namespace ui
 			ImGui::DragFloat("First Level Occluder Size", &ui::opt::OccluderFirstLevelMinSize, 1.0f, 1.0f, 100000.0f);
 			ImGui::Checkbox("Draw Occluders", &ui::opt::EnableOccluderRendering);
 			ImGui::Checkbox("Test Occludees", &ui::opt::EnableOcclusionTesting);
+			ImGui::Checkbox("Batched Sibling Frustum Culling", &ui::opt::EnableBatchFrustumCulling);
+			ImGui::Checkbox("Temporal (Previous Frame)", &ui::opt::EnableTemporalOcclusion);
+			ImGui::SameLine();
+			ImGui::Checkbox("Validate Against Current Frame", &ui::opt::ValidateTemporalOcclusion);
+			ImGui::DragFloat("Temporal Max Camera Translation", &ui::opt::TemporalMaxTranslation, 1.0f, 0.0f, 10000.0f);
+			ImGui::DragFloat("Temporal Max Camera Rotation (deg)", &ui::opt::TemporalMaxRotation, 0.1f, 0.0f, 90.0f);
+			ImGui::Checkbox("Record Camera Path (MOC_CameraPath.txt)", &ui::opt::RecordOcclusionCameraPath);
+			ImGui::Spacing();
+			ImGui::Text("Adaptive Settings");
+			ImGui::Separator();
+
+			const MOC::AdaptiveStatus& adaptive = MOC::GetAdaptiveStatus();
+
+			ImGui::Checkbox("Adaptive Resolution/Threads", &ui::opt::AdaptiveOcclusion);
+			ImGui::DragFloat("Render Thread Budget (ms)", &ui::opt::OcclusionBudgetMs, 0.05f, 0.1f, 16.0f);
+			ImGui::DragFloat("Target Culled Objects (%)", &ui::opt::OcclusionTargetCullPercent, 0.5f, 0.0f, 100.0f);
+			ImGui::Text("Buffer: %u x %u, Workers: %u / %u", adaptive.Width, adaptive.Height, adaptive.ThreadCount, adaptive.MaxThreadCount);
+			ImGui::Text("Wait: %.2fms, Test: %.2fms, Raster (CPU): %.2fms, Culled: %.1f%%", adaptive.WaitMs, adaptive.TestMs, adaptive.RasterMs, adaptive.CulledPercent);
+			ImGui::Text("Last Decision (%u): %s", adaptive.DecisionCount, adaptive.LastDecision);
+
+			ImGui::Spacing();
+			ImGui::Text("Occluder Selection");
+			ImGui::Separator();
+
+			const MOC_OccluderSelector::Statistics& selection = MOC::GetOccluderSelectionStats();
+
+			ImGui::Checkbox("Select Occluders By Area/Triangle", &ui::opt::EnableOccluderSelection);
+			ImGui::DragInt("Max Occluders", &ui::opt::OccluderMaxCount, 1.0f, 1, 100000);
+			ImGui::DragInt("Triangle Budget", &ui::opt::OccluderTriangleBudget, 100.0f, 1, 10000000);
+			ImGui::DragFloat("Min Screen Area (NDC)", &ui::opt::OccluderMinScreenArea, 0.0005f, 0.0f, 4.0f, "%.4f");
+			ImGui::Text("Candidates: %u, Selected: %u (%u kept from last frame), Triangles: %u", selection.CandidateCount, selection.Selected, selection.Retained, selection.SelectedTriangles);
+			ImGui::Text("Rejected: %u too small, %u over budget", selection.RejectedSmall, selection.RejectedBudget);
+
+			ImGui::Spacing();
+			ImGui::Separator();
 			ImGui::Checkbox("Disable Viewer Updates", &disableViewerUpdates);
 			ImGui::Combo("Viewer Resolution", &viewerResolutionIndex, " 640 x 480\0 1024 x 768\0 1920 x 1080\0\0");
 			ImGui::Spacing();
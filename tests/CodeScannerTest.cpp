@@ -0,0 +1,183 @@
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/CKSSE/CodeScanner.h"
+
+//
+// Scans a random buffer with patterns planted on and across chunk boundaries and at the very end, and
+// compares every matcher's results with a plain linear search. Chunks are scanned on several threads in
+// a shuffled order.
+//
+namespace
+{
+	const char *MemInitPattern = "83 3D ? ? ? ? 02 74 13 48 8D 15 ? ? ? ? 48 8D 0D ? ? ? ? E8";
+	const char *ShortPattern = "48 8B ? C3";
+
+	const uint8_t MemInitBytes[] = { 0x83, 0x3D, 0x11, 0x22, 0x33, 0x44, 0x02, 0x74, 0x13, 0x48, 0x8D, 0x15, 0x55, 0x66, 0x77, 0x88, 0x48, 0x8D, 0x0D, 0x99, 0xAA, 0xBB, 0xCC, 0xE8 };
+
+	// Stand-in for the edit & continue matcher: a call or jump into a table of jumps
+	uintptr_t TableStart;
+	uintptr_t TableEnd;
+
+	bool IsTableBranch(uintptr_t Address, uintptr_t End)
+	{
+		if (*(uint8_t *)Address != 0xE9 && *(uint8_t *)Address != 0xE8)
+			return false;
+
+		if (End - Address < 5)
+			return false;
+
+		int32_t displacement;
+		memcpy(&displacement, (void *)(Address + 1), sizeof(displacement));
+
+		const uintptr_t destination = Address + displacement + 5;
+		return destination >= TableStart && destination < TableEnd && *(uint8_t *)destination == 0xE9;
+	}
+
+	std::vector<uintptr_t> LinearSearch(const std::vector<uint8_t>& Buffer, const char *Mask)
+	{
+		std::vector<uint8_t> bytes;
+		std::vector<bool> wildcard;
+
+		for (const char *c = Mask; *c;)
+		{
+			wildcard.push_back(*c == '?');
+			bytes.push_back((*c == '?') ? 0 : (uint8_t)strtoul(c, nullptr, 16));
+			c += (*c == '?') ? 1 : 2;
+
+			while (*c == ' ')
+				c++;
+		}
+
+		std::vector<uintptr_t> matches;
+
+		for (size_t i = 0; i + bytes.size() <= Buffer.size(); i++)
+		{
+			size_t j = 0;
+
+			while (j < bytes.size() && (wildcard[j] || Buffer[i + j] == bytes[j]))
+				j++;
+
+			if (j == bytes.size())
+				matches.push_back((uintptr_t)&Buffer[i]);
+		}
+
+		return matches;
+	}
+
+	void Plant(std::vector<uint8_t>& Buffer, size_t Offset, const uint8_t *Data, size_t Size)
+	{
+		memcpy(&Buffer[Offset], Data, std::min(Size, Buffer.size() - Offset));
+	}
+
+	void TestScan(size_t BufferSize, uintptr_t ChunkSize, uint32_t ThreadCount)
+	{
+		std::mt19937 random(BufferSize);
+		std::vector<uint8_t> buffer(BufferSize);
+
+		// Lots of E8/E9 so the branch matcher has work to do
+		for (auto& b : buffer)
+			b = (random() % 4) ? (uint8_t)random() : 0xE9;
+
+		const uint8_t shortBytes[] = { 0x48, 0x8B, 0x01, 0xC3 };
+		const size_t chunkCount = (BufferSize + ChunkSize - 1) / ChunkSize;
+
+		// Straddling, ending right at, and starting right at a boundary
+		const size_t offsets[] = { ChunkSize - 3, ChunkSize - sizeof(MemInitBytes), ChunkSize, ChunkSize - 1 };
+		std::vector<size_t> plantedMemInit;
+		std::vector<size_t> plantedShort;
+
+		for (size_t chunk = 1; chunk < chunkCount; chunk++)
+		{
+			const size_t offset = (chunk - 1) * ChunkSize + offsets[chunk % 4];
+
+			if (chunk % 4 == 3)
+			{
+				Plant(buffer, offset, shortBytes, sizeof(shortBytes));
+				plantedShort.push_back(offset);
+			}
+			else
+			{
+				Plant(buffer, offset, MemInitBytes, sizeof(MemInitBytes));
+				plantedMemInit.push_back(offset);
+			}
+		}
+
+		// One complete match at the end, one cut short by it
+		Plant(buffer, BufferSize - sizeof(MemInitBytes) - 5, MemInitBytes, sizeof(MemInitBytes));
+		plantedMemInit.push_back(BufferSize - sizeof(MemInitBytes) - 5);
+		Plant(buffer, BufferSize - 2, shortBytes, sizeof(shortBytes));
+
+		TableStart = (uintptr_t)buffer.data() + BufferSize / 2;
+		TableEnd = TableStart + std::min<size_t>(65536, BufferSize / 4);
+
+		const uintptr_t start = (uintptr_t)buffer.data();
+		const uintptr_t end = start + buffer.size();
+
+		CodeScanner scanner(start, end, ChunkSize);
+		const size_t memInit = scanner.AddPattern(MemInitPattern);
+		const size_t shortMatch = scanner.AddPattern(ShortPattern);
+		const size_t branch = scanner.AddMatcher(IsTableBranch);
+
+		TEST_CHECK(scanner.GetChunkCount() == chunkCount);
+
+		std::vector<size_t> order(chunkCount);
+
+		for (size_t i = 0; i < chunkCount; i++)
+			order[i] = i;
+
+		std::shuffle(order.begin(), order.end(), random);
+
+		std::vector<std::thread> threads;
+
+		for (uint32_t i = 0; i < ThreadCount; i++)
+		{
+			threads.emplace_back([&, i]()
+			{
+				for (size_t j = i; j < order.size(); j += ThreadCount)
+					scanner.ScanChunk(order[j]);
+			});
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+
+		std::vector<uintptr_t> expectedBranches;
+
+		for (uintptr_t i = start; i < end; i++)
+		{
+			if (IsTableBranch(i, end))
+				expectedBranches.push_back(i);
+		}
+
+		const auto memInitMatches = scanner.GetMatches(memInit);
+		const auto shortMatches = scanner.GetMatches(shortMatch);
+
+		TEST_CHECK(memInitMatches == LinearSearch(buffer, MemInitPattern));
+		TEST_CHECK(shortMatches == LinearSearch(buffer, ShortPattern));
+		TEST_CHECK(scanner.GetMatches(branch) == expectedBranches);
+
+		// Every planted pattern is found, and the one running off the end isn't
+		for (size_t offset : plantedMemInit)
+			TEST_CHECK(std::binary_search(memInitMatches.begin(), memInitMatches.end(), start + offset));
+
+		for (size_t offset : plantedShort)
+			TEST_CHECK(std::binary_search(shortMatches.begin(), shortMatches.end(), start + offset));
+
+		TEST_CHECK(shortMatches.empty() || shortMatches.back() <= end - sizeof(shortBytes));
+	}
+}
+
+int main()
+{
+	TestScan(8 * 1024 * 1024 + 12345, 1024 * 1024, 4);
+	TestScan(100000, 4096, 8);
+	TestScan(4096, 4096, 2);
+	TestScan(1000, 4096, 1);
+
+	printf("CodeScannerTest passed\n");
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include <string.h>
+#include <random>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/rendering/ConstantDedupCache.h"
+
+//
+// Checks when ConstantDedupCache hands back an earlier ring offset: same level, lane, size and bytes, and
+// only until it's invalidated. Then replays constant uploads from the immediate context against a model of
+// ShaderConstantBuffer in which executing a worker's command list renames the buffer (its WRITE_DISCARD).
+// Every offset the renderer binds has to hold the bytes the draw asked for.
+//
+namespace
+{
+	uint64_t Hash(const uint8_t *Data, uint32_t Size)
+	{
+		uint64_t hash = 0xCBF29CE484222325;
+
+		for (uint32_t i = 0; i < Size; i++)
+			hash = (hash ^ Data[i]) * 0x100000001B3;
+
+		return hash;
+	}
+
+	uint32_t Stage(ConstantDedupCache& Cache, const std::vector<uint8_t>& Bytes)
+	{
+		uint32_t slot;
+		uint8_t *staging = Cache.AcquireStaging(&slot);
+
+		TEST_CHECK(staging);
+		memcpy(staging, Bytes.data(), Bytes.size());
+		return slot;
+	}
+
+	bool Find(ConstantDedupCache& Cache, const std::vector<uint8_t>& Bytes, uint32_t Level, uint32_t Lane, uint32_t *Offset)
+	{
+		const uint32_t slot = Stage(Cache, Bytes);
+		const uint32_t size = (uint32_t)Bytes.size();
+		const bool found = Cache.Find(slot, Level, Hash(Bytes.data(), size), size, Lane, Offset);
+
+		Cache.ReleaseStaging(slot);
+		return found;
+	}
+
+	void Insert(ConstantDedupCache& Cache, const std::vector<uint8_t>& Bytes, uint32_t Level, uint32_t Lane, uint32_t Offset)
+	{
+		const uint32_t slot = Stage(Cache, Bytes);
+		const uint32_t size = (uint32_t)Bytes.size();
+
+		Cache.Insert(slot, Level, Hash(Bytes.data(), size), size, Lane, Offset);
+		Cache.ReleaseStaging(slot);
+	}
+
+	std::vector<uint8_t> Bytes(uint32_t Size, uint8_t Seed)
+	{
+		std::vector<uint8_t> bytes(Size);
+
+		for (uint32_t i = 0; i < Size; i++)
+			bytes[i] = (uint8_t)(Seed + i * 7);
+
+		return bytes;
+	}
+
+	void TestStaging()
+	{
+		ConstantDedupCache cache;
+		uint32_t slots[ConstantDedupCache::StagingSlots];
+		uint32_t slot;
+
+		for (uint32_t i = 0; i < ConstantDedupCache::StagingSlots; i++)
+		{
+			TEST_CHECK(cache.AcquireStaging(&slots[i]) == cache.GetStaging(slots[i]));
+
+			for (uint32_t j = 0; j < i; j++)
+				TEST_CHECK(slots[i] != slots[j] && cache.GetStaging(slots[i]) != cache.GetStaging(slots[j]));
+		}
+
+		TEST_CHECK(!cache.AcquireStaging(&slot));
+
+		cache.ReleaseStaging(slots[3]);
+		TEST_CHECK(cache.AcquireStaging(&slot) && slot == slots[3]);
+		TEST_CHECK(!cache.AcquireStaging(&slot));
+
+		cache.ReleaseAllStaging();
+
+		for (uint32_t i = 0; i < ConstantDedupCache::StagingSlots; i++)
+			TEST_CHECK(cache.AcquireStaging(&slot));
+	}
+
+	void TestHitMiss()
+	{
+		ConstantDedupCache cache;
+		const std::vector<uint8_t> a = Bytes(256, 1);
+		uint32_t offset = 0;
+
+		TEST_CHECK(!Find(cache, a, 0, 0, &offset));
+		Insert(cache, a, 0, 0, 0x1000);
+
+		TEST_CHECK(Find(cache, a, 0, 0, &offset) && offset == 0x1000);
+		TEST_CHECK(!Find(cache, a, 1, 0, &offset));				// Other level
+		TEST_CHECK(!Find(cache, a, 0, 2, &offset));				// Other lane
+		TEST_CHECK(!Find(cache, Bytes(512, 1), 0, 0, &offset));	// Other size, same prefix
+
+		// Same hash and size, different bytes
+		std::vector<uint8_t> b = a;
+		b[100] ^= 1;
+
+		const uint32_t slot = Stage(cache, b);
+		TEST_CHECK(!cache.Find(slot, 0, Hash(a.data(), 256), 256, 0, &offset));
+		cache.ReleaseStaging(slot);
+
+		// Levels past the last share it
+		Insert(cache, a, ConstantDedupCache::Levels + 5, 0, 0x2000);
+		TEST_CHECK(Find(cache, a, ConstantDedupCache::Levels - 1, 0, &offset) && offset == 0x2000);
+
+		// The cached copy doesn't change when the staging slot it came from is reused
+		for (uint32_t i = 0; i < 4 * ConstantDedupCache::StagingSlots; i++)
+		{
+			const uint32_t reused = Stage(cache, Bytes(256, (uint8_t)(100 + i)));
+			cache.ReleaseStaging(reused);
+		}
+
+		TEST_CHECK(Find(cache, a, 0, 0, &offset) && offset == 0x1000);
+
+		// Oldest entry of a level goes first
+		for (uint32_t i = 0; i < ConstantDedupCache::EntriesPerLevel - 1; i++)
+			Insert(cache, Bytes(256, (uint8_t)(10 + i)), 0, 0, 0x3000 + i * 256);
+
+		TEST_CHECK(Find(cache, a, 0, 0, &offset) && offset == 0x1000);
+
+		Insert(cache, Bytes(256, 50), 0, 0, 0x4000);
+		TEST_CHECK(!Find(cache, a, 0, 0, &offset));
+
+		for (uint32_t i = 0; i < ConstantDedupCache::EntriesPerLevel - 1; i++)
+			TEST_CHECK(Find(cache, Bytes(256, (uint8_t)(10 + i)), 0, 0, &offset) && offset == 0x3000 + i * 256);
+
+		// Nothing survives an invalidate
+		cache.Invalidate();
+
+		for (uint32_t level = 0; level < ConstantDedupCache::Levels; level++)
+			TEST_CHECK(!Find(cache, Bytes(256, 50), level, 0, &offset) && !Find(cache, a, level, 0, &offset));
+	}
+
+	void TestCommandListRename()
+	{
+		const uint32_t RingSize = 64 * 1024;
+		const uint32_t DrawCount = 100000;
+
+		std::mt19937 random(1);
+		ConstantDedupCache cache;
+		std::vector<uint8_t> buffer(RingSize, 0xCD);	// What the immediate context's next draw sees
+		uint32_t ringOffset = 0;
+		uint32_t hits = 0;
+
+		// A few distinct constant groups that repeat a lot, like per-material constants
+		std::vector<std::vector<uint8_t>> groups;
+
+		for (uint32_t i = 0; i < 6; i++)
+			groups.push_back(Bytes(256 * (1 + i % 3), (uint8_t)(i * 19)));
+
+		for (uint32_t draw = 0; draw < DrawCount; draw++)
+		{
+			// A worker's command list mapped ShaderConstantBuffer with WRITE_DISCARD, so executing it leaves the
+			// immediate context with a fresh copy
+			if (random() % 50 == 0)
+			{
+				std::fill(buffer.begin(), buffer.end(), (uint8_t)random());
+				cache.Invalidate();
+			}
+
+			// Renderer::OnNewFrame
+			if (random() % 500 == 0)
+			{
+				cache.ReleaseAllStaging();
+				cache.Invalidate();
+			}
+
+			const std::vector<uint8_t>& group = groups[random() % groups.size()];
+			const uint32_t level = random() % ConstantDedupCache::Levels;
+			const uint32_t size = (uint32_t)group.size();
+
+			// Same steps as UploadStagedConstantBuffer
+			const uint32_t slot = Stage(cache, group);
+			const uint64_t hash = Hash(cache.GetStaging(slot), size);
+			uint32_t offset = 0;
+
+			if (cache.Find(slot, level, hash, size, 0, &offset))
+			{
+				hits++;
+			}
+			else
+			{
+				if (ringOffset + size > RingSize)
+					ringOffset = 0;
+
+				offset = ringOffset;
+				ringOffset += size;
+
+				memcpy(&buffer[offset], cache.GetStaging(slot), size);
+				cache.Insert(slot, level, hash, size, 0, offset);
+			}
+
+			cache.ReleaseStaging(slot);
+			TEST_CHECK(memcmp(&buffer[offset], group.data(), size) == 0);
+		}
+
+		TEST_CHECK(hits > DrawCount / 4);
+		printf("%u uploads, %u deduplicated\n", DrawCount, hits);
+	}
+}
+
+int main()
+{
+	TestStaging();
+	TestHitMiss();
+	TestCommandListRename();
+
+	printf("ConstantDedupCacheTest passed\n");
+	return 0;
+}
\ No newline at end of file
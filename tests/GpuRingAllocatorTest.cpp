@@ -0,0 +1,162 @@
+#include <deque>
+#include <random>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/rendering/GpuRingAllocator.h"
+
+//
+// Drives one ring lane through thousands of frames with a fake fence, the same way
+// Renderer::OnNewFrame does with D3D queries: SwapFrame() when a frame is submitted, FreeOldFrame()
+// once the fence says the GPU is done with it. Every byte handed out is tagged with its frame, so an
+// allocation that overlaps anything still in flight fails the test.
+//
+namespace
+{
+	const uint32_t MaxFrames = 8;
+	const uint32_t LaneBase = 4096;
+	const uint32_t LaneSize = 64 * 1024;
+	const uint32_t Free = 0xFFFFFFFF;
+
+	struct FakeFence
+	{
+		std::deque<std::pair<uint32_t, uint32_t>> Pending;	// (frame slot, frame number) in submit order
+		uint32_t Completed = 0;								// Frames the "GPU" has finished
+
+		void Submit(uint32_t Slot, uint32_t Frame)
+		{
+			Pending.emplace_back(Slot, Frame);
+		}
+	};
+
+	void TestBasics()
+	{
+		GpuRingAllocator allocator(LaneBase, 1024, MaxFrames);
+		uint32_t offset;
+
+		TEST_CHECK(allocator.GetBase() == LaneBase && allocator.GetSize() == 1024);
+		TEST_CHECK(allocator.GetAvailable() == 1024);
+
+		TEST_CHECK(allocator.Allocate(256, &offset) && offset == LaneBase);
+		TEST_CHECK(allocator.Allocate(256, &offset) && offset == LaneBase + 256);
+		TEST_CHECK(allocator.GetUtilized() == 512);
+		allocator.SwapFrame(0);
+
+		// Frame 1 may only use what frame 0 doesn't own
+		TEST_CHECK(allocator.Allocate(256, &offset) && offset == LaneBase + 512);
+
+		// Would hit the end, wraps to the start, which frame 0 still owns: fails and leaves the state alone
+		TEST_CHECK(!allocator.Allocate(256, &offset));
+		TEST_CHECK(allocator.GetUtilized() == 256);
+		allocator.SwapFrame(1);
+
+		// Fence signals frame 0: the wrapped allocation fits now and its offset restarts at the base
+		allocator.FreeOldFrame(0);
+		TEST_CHECK(allocator.Allocate(256, &offset) && offset == LaneBase);
+
+		// The skipped tail is charged to this frame, so it's only reusable after this frame retires
+		TEST_CHECK(allocator.GetUtilized() == 256 + 256);
+		allocator.SwapFrame(2);
+		allocator.FreeOldFrame(1);
+		allocator.FreeOldFrame(2);
+		TEST_CHECK(allocator.GetAvailable() == 1024);
+	}
+
+	void TestWraparound(uint32_t Seed, uint32_t MaxLatency)
+	{
+		GpuRingAllocator allocator(LaneBase, LaneSize, MaxFrames);
+		std::vector<uint32_t> owner(LaneSize, Free);
+		std::vector<std::vector<std::pair<uint32_t, uint32_t>>> frameRanges(MaxFrames);
+		std::mt19937 random(Seed);
+		FakeFence fence;
+
+		uint32_t wraps = 0;
+		uint32_t failures = 0;
+		uint32_t lastOffset = 0;
+
+		for (uint32_t frame = 0; frame < 20000; frame++)
+		{
+			const uint32_t slot = frame % MaxFrames;
+
+			// The real renderer asserts the frame in this slot retired long ago
+			TEST_CHECK(frameRanges[slot].empty());
+
+			const uint32_t allocations = random() % 24;
+
+			for (uint32_t i = 0; i < allocations; i++)
+			{
+				const uint32_t size = 16 * (1 + random() % 256);
+				uint32_t offset;
+
+				if (!allocator.Allocate(size, &offset))
+				{
+					failures++;
+					continue;
+				}
+
+				TEST_CHECK(offset >= LaneBase && offset + size <= LaneBase + LaneSize);
+
+				const uint32_t start = offset - LaneBase;
+
+				if (start < lastOffset)
+					wraps++;
+
+				lastOffset = start;
+
+				for (uint32_t b = start; b < start + size; b += 16)
+				{
+					TEST_CHECK(owner[b] == Free);
+					owner[b] = frame;
+				}
+
+				frameRanges[slot].emplace_back(start, size);
+			}
+
+			allocator.SwapFrame(slot);
+			fence.Submit(slot, frame);
+
+			// The fake GPU finishes frames in order, up to MaxLatency frames behind
+			const uint32_t latency = random() % (MaxLatency + 1);
+
+			while (!fence.Pending.empty() && fence.Pending.front().second + latency <= frame)
+			{
+				const uint32_t retired = fence.Pending.front().first;
+				fence.Pending.pop_front();
+
+				for (auto [start, size] : frameRanges[retired])
+				{
+					for (uint32_t b = start; b < start + size; b += 16)
+						owner[b] = Free;
+				}
+
+				frameRanges[retired].clear();
+				allocator.FreeOldFrame(retired);
+			}
+		}
+
+		// Drain the fence: every byte comes back
+		while (!fence.Pending.empty())
+		{
+			allocator.FreeOldFrame(fence.Pending.front().first);
+			fence.Pending.pop_front();
+		}
+
+		TEST_CHECK(allocator.GetAvailable() == LaneSize);
+		TEST_CHECK(allocator.GetUtilized() == 0);
+		TEST_CHECK(wraps > 100);
+
+		// A slow fence has to run the lane dry sometimes, otherwise this didn't test anything
+		if (MaxLatency >= 6)
+			TEST_CHECK(failures > 0);
+	}
+}
+
+int main()
+{
+	TestBasics();
+	TestWraparound(1, 0);
+	TestWraparound(2, 3);
+	TestWraparound(3, 6);
+
+	printf("GpuRingAllocator: ok\n");
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/CKSSE/HandleIndexQueue.h"
+
+//
+// Allocates and frees handle indices the way BSPointerHandleManager does: per-thread batches of 32 over
+// HandleIndexQueue. The stress run checks that no index is ever owned twice or lost. The benchmark compares
+// it with the old mutex-guarded free list; its timings depend on the machine's core count and are printed
+// for reference only.
+//
+namespace
+{
+	const uint32_t IndexCount = 1u << 21;
+	const uint32_t BatchSize = 32;
+	const uint32_t InvalidIndex = 0xFFFFFFFF;
+
+	HandleIndexQueue FreeIndices;
+
+	// Same logic as BSPointerHandleManager::AllocateIndex/ReleaseIndex/ThreadIndexCache
+	struct ThreadIndexCache
+	{
+		uint32_t Allocated[BatchSize];
+		uint32_t AllocatedNext = 0;
+		uint32_t AllocatedCount = 0;
+		uint32_t Freed[BatchSize];
+		uint32_t FreedCount = 0;
+
+		~ThreadIndexCache()
+		{
+			Flush();
+		}
+
+		void Flush()
+		{
+			if (AllocatedCount > 0)
+				FreeIndices.EnqueueBatch(&Allocated[AllocatedNext], AllocatedCount);
+
+			if (FreedCount > 0)
+				FreeIndices.EnqueueBatch(Freed, FreedCount);
+
+			AllocatedNext = 0;
+			AllocatedCount = 0;
+			FreedCount = 0;
+		}
+	};
+
+	thread_local ThreadIndexCache IndexCache;
+
+	uint32_t AllocateIndex()
+	{
+		auto& cache = IndexCache;
+
+		if (cache.AllocatedCount == 0)
+		{
+			cache.AllocatedNext = 0;
+			cache.AllocatedCount = FreeIndices.DequeueBatch(cache.Allocated, BatchSize);
+
+			if (cache.AllocatedCount == 0 && cache.FreedCount > 0)
+			{
+				FreeIndices.EnqueueBatch(cache.Freed, cache.FreedCount);
+				cache.FreedCount = 0;
+				cache.AllocatedCount = FreeIndices.DequeueBatch(cache.Allocated, BatchSize);
+			}
+
+			if (cache.AllocatedCount == 0)
+				return InvalidIndex;
+		}
+
+		cache.AllocatedCount--;
+		return cache.Allocated[cache.AllocatedNext++];
+	}
+
+	void ReleaseIndex(uint32_t Index)
+	{
+		auto& cache = IndexCache;
+		cache.Freed[cache.FreedCount++] = Index;
+
+		if (cache.FreedCount == BatchSize)
+		{
+			FreeIndices.EnqueueBatch(cache.Freed, cache.FreedCount);
+			cache.FreedCount = 0;
+		}
+	}
+
+	// The vanilla free list: entries linked through their next-free index, one lock around everything
+	struct LockedFreeList
+	{
+		std::mutex Lock;
+		std::vector<uint32_t> Next;
+		uint32_t Head = 0;
+		uint32_t Tail = IndexCount - 1;
+
+		LockedFreeList() : Next(IndexCount)
+		{
+			for (uint32_t i = 0; i < IndexCount; i++)
+				Next[i] = (i + 1 < IndexCount) ? i + 1 : i;
+		}
+
+		uint32_t Allocate()
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			const uint32_t head = Head;
+
+			if (head == InvalidIndex)
+				return head;
+
+			if (Next[head] == head)
+				Head = Tail = InvalidIndex;
+			else
+				Head = Next[head];
+
+			return head;
+		}
+
+		void Release(uint32_t Index)
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+
+			if (Tail == InvalidIndex)
+				Head = Index;
+			else
+				Next[Tail] = Index;
+
+			Next[Index] = Index;
+			Tail = Index;
+		}
+	};
+
+	void FillQueue()
+	{
+		FreeIndices.Initialize(IndexCount);
+
+		uint32_t indices[1024];
+
+		for (uint32_t i = 0; i < IndexCount; i += 1024)
+		{
+			for (uint32_t j = 0; j < 1024; j++)
+				indices[j] = i + j;
+
+			FreeIndices.EnqueueBatch(indices, 1024);
+		}
+	}
+
+	// Each thread keeps a working set of live indices and alternates creating and destroying, like cell loads
+	template<typename AllocateFunc, typename ReleaseFunc, typename OwnedFunc>
+	double RunThreads(uint32_t ThreadCount, uint32_t Iterations, AllocateFunc Allocate, ReleaseFunc Release, OwnedFunc Owned)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> threads;
+
+		for (uint32_t t = 0; t < ThreadCount; t++)
+		{
+			threads.emplace_back([&]()
+			{
+				std::vector<uint32_t> held;
+
+				for (uint32_t i = 0; i < Iterations; i++)
+				{
+					if (held.size() < 256 || (i & 1))
+					{
+						const uint32_t index = Allocate();
+						TEST_CHECK(index != InvalidIndex);
+
+						Owned(index, true);
+						held.push_back(index);
+					}
+					else
+					{
+						Owned(held.back(), false);
+						Release(held.back());
+						held.pop_back();
+					}
+				}
+
+				for (uint32_t index : held)
+				{
+					Owned(index, false);
+					Release(index);
+				}
+			});
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void TestSingleThreadOrder()
+	{
+		HandleIndexQueue queue;
+		queue.Initialize(8);
+
+		// Wraps the ring several times; FIFO order and counts hold throughout
+		uint32_t next = 0;
+		uint32_t expected = 0;
+
+		for (uint32_t round = 0; round < 10; round++)
+		{
+			uint32_t values[5];
+
+			for (uint32_t i = 0; i < 5; i++)
+				values[i] = next++;
+
+			queue.EnqueueBatch(values, 5);
+			TEST_CHECK(queue.GetApproximateCount() == 5);
+
+			uint32_t out[8];
+			TEST_CHECK(queue.DequeueBatch(out, 3) == 3);
+			TEST_CHECK(queue.DequeueBatch(out + 3, 8) == 2);
+			TEST_CHECK(queue.DequeueBatch(out, 8) == 0);
+
+			for (uint32_t i = 0; i < 5; i++)
+				TEST_CHECK(out[i] == expected++);
+		}
+	}
+
+	void TestStress()
+	{
+		FillQueue();
+
+		std::vector<std::atomic<uint8_t>> owned(IndexCount);
+
+		RunThreads(8, 200000, AllocateIndex, ReleaseIndex, [&](uint32_t Index, bool Take)
+		{
+			TEST_CHECK(owned[Index].exchange(Take ? 1 : 0) == (Take ? 0 : 1));
+		});
+
+		// Exiting threads hand their caches back; this thread's cache is still empty
+		TEST_CHECK(FreeIndices.GetApproximateCount() == IndexCount);
+
+		// Exhaustion returns InvalidIndex instead of spinning or handing out duplicates
+		std::vector<uint32_t> all;
+		uint32_t index;
+
+		while ((index = AllocateIndex()) != InvalidIndex)
+		{
+			TEST_CHECK(owned[index].exchange(1) == 0);
+			all.push_back(index);
+		}
+
+		TEST_CHECK(all.size() == IndexCount);
+
+		// A freed index goes to the back, behind everything else that's free
+		for (uint32_t i : all)
+			ReleaseIndex(i);
+
+		IndexCache.Flush();
+		TEST_CHECK(FreeIndices.GetApproximateCount() == IndexCount);
+		TEST_CHECK(AllocateIndex() == all[0]);
+
+		IndexCache.Flush();
+	}
+
+	void BenchmarkContention()
+	{
+		printf("create/destroy, 400000 operations per thread (%u hardware threads):\n", std::thread::hardware_concurrency());
+
+		for (uint32_t threadCount : { 1, 2, 4, 8 })
+		{
+			LockedFreeList locked;
+			const double lockedTime = RunThreads(threadCount, 400000, [&]() { return locked.Allocate(); }, [&](uint32_t Index) { locked.Release(Index); }, [](uint32_t, bool) {});
+
+			FillQueue();
+			const double queueTime = RunThreads(threadCount, 400000, AllocateIndex, ReleaseIndex, [](uint32_t, bool) {});
+
+			printf("  %u threads: locked list %.1f ms, batched queue %.1f ms\n", threadCount, lockedTime, queueTime);
+		}
+	}
+}
+
+int main()
+{
+	TestSingleThreadOrder();
+	TestStress();
+	BenchmarkContention();
+
+	printf("HandleIndexQueueTest passed\n");
+	return 0;
+}
\ No newline at end of file
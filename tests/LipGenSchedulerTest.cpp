@@ -0,0 +1,218 @@
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/CKSSE/LipGenScheduler.h"
+
+//
+// Runs LipGenScheduler over fake workers whose behavior is picked by the job's input path: "ok" jobs take
+// a few polls, "bad" ones fail, "crash" ones take the worker down, and "hang" ones never finish. Checks
+// retries, restarts, timeouts, a pool that dies completely, and that an empty batch starts nothing.
+//
+namespace
+{
+	using Scheduler = LipGenScheduler;
+	using PollResult = Scheduler::Worker::PollResult;
+
+	std::map<std::string, uint32_t> Runs;
+
+	class FakeWorker : public Scheduler::Worker
+	{
+	public:
+		uint32_t Starts = 0;
+		uint32_t Stops = 0;
+		uint32_t Terminations = 0;
+		uint32_t MaxStarts;
+		bool Running = false;
+		uint32_t Polls = 0;
+		std::string Current;
+
+		FakeWorker(uint32_t MaxStarts = 100) : MaxStarts(MaxStarts)
+		{
+		}
+
+		bool Start() override
+		{
+			TEST_CHECK(!Running);
+			return ++Starts <= MaxStarts;
+		}
+
+		bool Submit(const Scheduler::Job& Job) override
+		{
+			TEST_CHECK(!Running && Starts <= MaxStarts);
+
+			Current = Job.InputWAVPath;
+			Polls = 0;
+			Running = true;
+			Runs[Current]++;
+
+			return true;
+		}
+
+		PollResult Poll() override
+		{
+			TEST_CHECK(Running);
+
+			const bool hangs = Current.compare(0, 4, "hang") == 0 && (Current != "hang_once" || Runs[Current] == 1);
+
+			if (hangs || ++Polls < 3)
+				return PollResult::Busy;
+
+			Running = false;
+
+			if ((Current == "crash_once" && Runs[Current] == 1) || Current == "crash_always")
+				return PollResult::Crashed;
+
+			return (Current == "bad") ? PollResult::Failed : PollResult::Succeeded;
+		}
+
+		void Stop() override
+		{
+			Running = false;
+			Stops++;
+		}
+
+		void Terminate() override
+		{
+			Running = false;
+			Terminations++;
+		}
+	};
+
+	struct Pool
+	{
+		std::vector<FakeWorker *> Workers;
+		std::unique_ptr<Scheduler> Instance;
+
+		Pool(uint32_t WorkerCount, uint32_t MaxStarts, std::chrono::milliseconds JobTimeout)
+		{
+			std::vector<std::unique_ptr<Scheduler::Worker>> workers;
+
+			for (uint32_t i = 0; i < WorkerCount; i++)
+			{
+				Workers.push_back(new FakeWorker(MaxStarts));
+				workers.emplace_back(Workers.back());
+			}
+
+			Instance = std::make_unique<Scheduler>(std::move(workers), 3, JobTimeout);
+		}
+
+		void Run()
+		{
+			for (uint32_t i = 0; Instance->Pump(); i++)
+			{
+				TEST_CHECK(i < 100000);
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		}
+	};
+
+	void TestRetries()
+	{
+		Runs.clear();
+
+		Pool pool(3, 100, std::chrono::milliseconds(0));
+
+		for (int i = 0; i < 20; i++)
+			pool.Instance->AddJob(("ok" + std::to_string(i)).c_str(), "text", ("ok" + std::to_string(i) + ".lip").c_str());
+
+		const size_t crashOnce = pool.Instance->AddJob("crash_once", nullptr, "a.lip");
+		const size_t crashAlways = pool.Instance->AddJob("crash_always", "", "b.lip");
+		const size_t bad = pool.Instance->AddJob("bad", "", "c.lip");
+
+		pool.Run();
+
+		auto stats = pool.Instance->GetStatistics();
+		TEST_CHECK(stats.Completed == 21 && stats.Failed == 2 && stats.Pending == 0 && stats.Running == 0);
+		TEST_CHECK(stats.Retries == 3 && stats.WorkerRestarts == 4 && stats.Timeouts == 0 && stats.ActiveWorkers == 3);
+
+		TEST_CHECK(pool.Instance->GetJob(crashOnce).Status == Scheduler::JobStatus::Completed && Runs["crash_once"] == 2);
+		TEST_CHECK(pool.Instance->GetJob(crashAlways).Status == Scheduler::JobStatus::Failed && Runs["crash_always"] == 3);
+		TEST_CHECK(pool.Instance->GetJob(bad).Status == Scheduler::JobStatus::Failed && Runs["bad"] == 1);
+		TEST_CHECK(pool.Instance->GetJob(crashOnce).DialogueText.empty());
+
+		for (auto *worker : pool.Workers)
+			TEST_CHECK(worker->Terminations == 0);
+	}
+
+	void TestTimeouts()
+	{
+		Runs.clear();
+
+		// A hung job is killed, retried on a fresh worker, and fails once it runs out of attempts
+		Pool pool(2, 100, std::chrono::milliseconds(50));
+		const size_t hangOnce = pool.Instance->AddJob("hang_once", "", "a.lip");
+		const size_t hangAlways = pool.Instance->AddJob("hang_always", "", "b.lip");
+
+		for (int i = 0; i < 10; i++)
+			pool.Instance->AddJob(("ok" + std::to_string(i)).c_str(), "", "c.lip");
+
+		const auto start = std::chrono::steady_clock::now();
+		pool.Run();
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		auto stats = pool.Instance->GetStatistics();
+		TEST_CHECK(stats.Completed == 11 && stats.Failed == 1);
+		TEST_CHECK(stats.Timeouts == 4 && stats.Retries == 3 && stats.WorkerRestarts == 4);
+
+		TEST_CHECK(pool.Instance->GetJob(hangOnce).Status == Scheduler::JobStatus::Completed && Runs["hang_once"] == 2);
+		TEST_CHECK(pool.Instance->GetJob(hangAlways).Status == Scheduler::JobStatus::Failed && Runs["hang_always"] == 3);
+		TEST_CHECK(elapsed >= std::chrono::milliseconds(3 * 50));
+
+		uint32_t terminations = 0;
+
+		for (auto *worker : pool.Workers)
+			terminations += worker->Terminations;
+
+		TEST_CHECK(terminations == 4);
+
+		// Without a timeout the scheduler keeps waiting
+		Runs.clear();
+
+		Pool patient(1, 100, std::chrono::milliseconds(0));
+		patient.Instance->AddJob("hang_always", "", "a.lip");
+
+		for (int i = 0; i < 2000; i++)
+			TEST_CHECK(patient.Instance->Pump());
+
+		TEST_CHECK(patient.Instance->GetStatistics().Running == 1 && patient.Workers[0]->Terminations == 0);
+
+		patient.Instance->Shutdown();
+		TEST_CHECK(patient.Instance->GetStatistics().Failed == 1 && patient.Workers[0]->Stops == 1);
+	}
+
+	void TestDeadPool()
+	{
+		Runs.clear();
+
+		// The only worker can't be restarted after its first crash
+		Pool pool(1, 1, std::chrono::milliseconds(0));
+		pool.Instance->AddJob("crash_always", "", "a.lip");
+		pool.Instance->AddJob("ok", "", "b.lip");
+		pool.Run();
+
+		auto stats = pool.Instance->GetStatistics();
+		TEST_CHECK(stats.Failed == 2 && stats.Completed == 0 && stats.ActiveWorkers == 0);
+		TEST_CHECK(Runs["ok"] == 0);
+	}
+
+	void TestEmptyBatch()
+	{
+		Pool pool(2, 100, std::chrono::milliseconds(10));
+
+		TEST_CHECK(!pool.Instance->Pump());
+		TEST_CHECK(pool.Workers[0]->Starts == 0 && pool.Workers[1]->Starts == 0);
+	}
+}
+
+int main()
+{
+	TestRetries();
+	TestTimeouts();
+	TestDeadPool();
+	TestEmptyBatch();
+
+	printf("LipGenSchedulerTest passed\n");
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include <string.h>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim32_ckt/LipGenServer.h"
+
+//
+// Drives RunLipGenServer with a scripted transport and a fake generator. Checks that the CK image is
+// initialized once on the first request (and retried while it fails), that timeouts keep the loop waiting,
+// that shutdown or a broken transport ends it, and that every request is completed exactly once.
+//
+namespace
+{
+	using WaitResult = LipGenTransport::WaitResult;
+
+	class ScriptedTransport : public LipGenTransport
+	{
+	public:
+		std::vector<WaitResult> Script;
+		size_t Next = 0;
+		uint32_t Completed = 0;
+		bool Outstanding = false;
+		const char *DialogueText = "line";
+
+		WaitResult WaitForRequest(LipGenRequest *Request) override
+		{
+			// A new request is only handed out after the previous one completed
+			TEST_CHECK(!Outstanding);
+
+			if (Next >= Script.size())
+				return WaitResult::Shutdown;
+
+			WaitResult result = Script[Next++];
+
+			if (result == WaitResult::Request)
+			{
+				*Request = { "input.wav", "resample.wav", DialogueText, "Data\\Sound\\Voice\\Processing\\FonixData.cdf", "English" };
+				Outstanding = true;
+			}
+
+			return result;
+		}
+
+		void CompleteRequest() override
+		{
+			TEST_CHECK(Outstanding);
+			Outstanding = false;
+			Completed++;
+		}
+	};
+
+	class FakeGenerator : public LipGenGenerator
+	{
+	public:
+		uint32_t InitializeCalls = 0;
+		uint32_t GenerateCalls = 0;
+		uint32_t FailInitializeCount = 0;
+
+		bool Initialize() override
+		{
+			return ++InitializeCalls > FailInitializeCount;
+		}
+
+		bool Generate(const LipGenRequest& Request) override
+		{
+			TEST_CHECK(InitializeCalls > FailInitializeCount);
+			GenerateCalls++;
+
+			return strcmp(Request.DialogueText, "bad") != 0;
+		}
+	};
+
+	void TestResidentLoop()
+	{
+		ScriptedTransport transport;
+		transport.Script = { WaitResult::Timeout, WaitResult::Request, WaitResult::Request, WaitResult::Timeout, WaitResult::Timeout, WaitResult::Request, WaitResult::Shutdown, WaitResult::Request };
+
+		FakeGenerator generator;
+		auto stats = RunLipGenServer(transport, generator);
+
+		TEST_CHECK(stats.Requests == 3 && stats.Generated == 3 && stats.Failed == 0 && stats.Initialized);
+		TEST_CHECK(generator.InitializeCalls == 1 && generator.GenerateCalls == 3);
+		TEST_CHECK(transport.Completed == 3);
+
+		// Nothing after the shutdown is read
+		TEST_CHECK(transport.Next == 7);
+	}
+
+	void TestGenerateFailure()
+	{
+		ScriptedTransport transport;
+		transport.Script = { WaitResult::Request, WaitResult::Request };
+		transport.DialogueText = "bad";
+
+		FakeGenerator generator;
+		auto stats = RunLipGenServer(transport, generator);
+
+		TEST_CHECK(stats.Requests == 2 && stats.Generated == 0 && stats.Failed == 2 && stats.Initialized);
+		TEST_CHECK(generator.InitializeCalls == 1 && transport.Completed == 2);
+	}
+
+	void TestInitializeFailure()
+	{
+		// The first two requests fail without reaching the generator, the third one initializes it
+		ScriptedTransport transport;
+		transport.Script = { WaitResult::Request, WaitResult::Request, WaitResult::Request, WaitResult::Request };
+
+		FakeGenerator generator;
+		generator.FailInitializeCount = 2;
+
+		auto stats = RunLipGenServer(transport, generator);
+
+		TEST_CHECK(stats.Requests == 4 && stats.Generated == 2 && stats.Failed == 2 && stats.Initialized);
+		TEST_CHECK(generator.InitializeCalls == 3 && generator.GenerateCalls == 2);
+		TEST_CHECK(transport.Completed == 4);
+	}
+
+	void TestBrokenTransport()
+	{
+		ScriptedTransport transport;
+		transport.Script = { WaitResult::Request, WaitResult::Failed, WaitResult::Request };
+
+		FakeGenerator generator;
+		auto stats = RunLipGenServer(transport, generator);
+
+		TEST_CHECK(stats.Requests == 1 && stats.Generated == 1 && transport.Completed == 1);
+		TEST_CHECK(transport.Next == 2);
+
+		// Shutdown before any request never loads the CK image
+		ScriptedTransport idle;
+		idle.Script = { WaitResult::Timeout, WaitResult::Shutdown };
+
+		FakeGenerator unused;
+		stats = RunLipGenServer(idle, unused);
+
+		TEST_CHECK(stats.Requests == 0 && !stats.Initialized && unused.InitializeCalls == 0);
+	}
+}
+
+int main()
+{
+	TestResidentLoop();
+	TestGenerateFailure();
+	TestInitializeFailure();
+	TestBrokenTransport();
+
+	printf("LipGenServerTest passed\n");
+	return 0;
+}
\ No newline at end of file
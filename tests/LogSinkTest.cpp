@@ -0,0 +1,215 @@
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/CKSSE/LogSink.h"
+
+//
+// Plugin loads produce warning storms from many threads at once. Each producer tags its lines with a thread
+// and sequence number and every hundredth line is long enough to span several records, so the checks below
+// catch lost, reordered, interleaved or torn messages. Timings are printed for reference only.
+//
+namespace
+{
+	const uint32_t ProducerCount = 8;
+	const uint32_t MessagesPerProducer = 50000;
+	const uint32_t LongMessagePadding = 1500;
+
+	size_t FormatMessage(char *Buffer, size_t BufferSize, uint32_t Thread, uint32_t Index)
+	{
+		int length = snprintf(Buffer, BufferSize, "T%u %u FORMS: Non-parent REFR form exists in both file 'HearthFires.esm' and 'Dawnguard.esm'", Thread, Index);
+
+		if (Index % 100 == 0)
+		{
+			memset(Buffer + length, 'a' + (Index % 26), LongMessagePadding);
+			length += LongMessagePadding;
+		}
+
+		Buffer[length++] = '\n';
+		return length;
+	}
+
+	std::string ReadAll(FILE *File)
+	{
+		std::string text;
+		char buffer[4096];
+		size_t length;
+
+		rewind(File);
+
+		while ((length = fread(buffer, 1, sizeof(buffer), File)) > 0)
+			text.append(buffer, length);
+
+		return text;
+	}
+
+	// Returns the number of lines; fails on anything out of order or damaged
+	uint64_t CheckLines(const std::string& Text)
+	{
+		std::vector<int64_t> last(ProducerCount, -1);
+		char expected[2048];
+		uint64_t lines = 0;
+		size_t start = 0;
+
+		while (start < Text.size())
+		{
+			const size_t end = Text.find('\n', start);
+			TEST_CHECK(end != std::string::npos);
+
+			// Not sscanf: glibc's runs strlen over the rest of the buffer on every call
+			char *next;
+			TEST_CHECK(Text[start] == 'T');
+			const uint32_t thread = strtoul(Text.c_str() + start + 1, &next, 10);
+			const uint32_t index = strtoul(next, &next, 10);
+			TEST_CHECK(next > Text.c_str() + start + 1 && *next == ' ');
+			TEST_CHECK(thread < ProducerCount && index < MessagesPerProducer);
+			TEST_CHECK((int64_t)index > last[thread]);
+			last[thread] = index;
+
+			const size_t length = FormatMessage(expected, sizeof(expected), thread, index);
+			TEST_CHECK(end + 1 - start == length && memcmp(Text.c_str() + start, expected, length) == 0);
+
+			lines++;
+			start = end + 1;
+		}
+
+		return lines;
+	}
+
+	struct StormResult
+	{
+		LogSink::Statistics Stats;
+		std::string FileText;
+		uint64_t CallbackBytes;
+		uint64_t CallbackMessages;
+		double Milliseconds;
+	};
+
+	StormResult RunStorm(LogSink::OverflowPolicy Policy, uint32_t Capacity)
+	{
+		FILE *file = tmpfile();
+		TEST_CHECK(file);
+
+		LogSink sink(Capacity);
+		std::atomic<uint64_t> callbackBytes = 0;
+		std::atomic<uint64_t> callbackMessages = 0;
+		std::atomic<uint64_t> rejected = 0;
+
+		sink.Start(file, Policy, [&](const char *Text, size_t Length, uint32_t MessageCount)
+		{
+			// Batches only ever hold whole messages
+			TEST_CHECK(Length > 0 && Text[Length - 1] == '\n');
+
+			callbackBytes += Length;
+			callbackMessages += MessageCount;
+		});
+
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> producers;
+
+		for (uint32_t t = 0; t < ProducerCount; t++)
+		{
+			producers.emplace_back([&, t]()
+			{
+				char buffer[2048];
+
+				for (uint32_t i = 0; i < MessagesPerProducer; i++)
+				{
+					if (!sink.Submit(buffer, FormatMessage(buffer, sizeof(buffer), t, i)))
+						rejected++;
+				}
+			});
+		}
+
+		for (auto& producer : producers)
+			producer.join();
+
+		sink.Flush();
+		const auto end = std::chrono::steady_clock::now();
+
+		StormResult result;
+		result.Stats = sink.GetStatistics();
+		sink.Stop();
+
+		result.FileText = ReadAll(file);
+		result.CallbackBytes = callbackBytes;
+		result.CallbackMessages = callbackMessages;
+		result.Milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+		fclose(file);
+
+		TEST_CHECK(rejected == result.Stats.Dropped);
+		return result;
+	}
+
+	void TestBlockStorm()
+	{
+		// A small ring so producers keep running into the writer
+		const StormResult result = RunStorm(LogSink::OverflowPolicy::Block, 1024);
+		const uint64_t total = (uint64_t)ProducerCount * MessagesPerProducer;
+
+		TEST_CHECK(result.Stats.Submitted == total);
+		TEST_CHECK(result.Stats.Dropped == 0);
+		TEST_CHECK(result.Stats.Written == total);
+		TEST_CHECK(result.CallbackMessages == total);
+		TEST_CHECK(result.CallbackBytes == result.FileText.size());
+		TEST_CHECK(CheckLines(result.FileText) == total);
+
+		printf("block: %llu messages in %.1f ms, %llu stalls, %llu batches\n", (unsigned long long)total, result.Milliseconds,
+			(unsigned long long)result.Stats.Stalls, (unsigned long long)result.Stats.Batches);
+	}
+
+	void TestDropStorm()
+	{
+		const StormResult result = RunStorm(LogSink::OverflowPolicy::Drop, 256);
+		const uint64_t total = (uint64_t)ProducerCount * MessagesPerProducer;
+
+		// Every message is either written in full or counted as dropped
+		TEST_CHECK(result.Stats.Submitted + result.Stats.Dropped == total);
+		TEST_CHECK(result.Stats.Written == result.Stats.Submitted);
+		TEST_CHECK(result.CallbackMessages == result.Stats.Written);
+		TEST_CHECK(result.CallbackBytes == result.FileText.size());
+		TEST_CHECK(CheckLines(result.FileText) == result.Stats.Written);
+
+		printf("drop: %llu written, %llu dropped in %.1f ms\n", (unsigned long long)result.Stats.Written,
+			(unsigned long long)result.Stats.Dropped, result.Milliseconds);
+	}
+
+	void TestBeforeStart()
+	{
+		FILE *file = tmpfile();
+		TEST_CHECK(file);
+
+		// Without a writer, messages wait in the ring until it fills, then get dropped regardless of policy
+		LogSink sink(8);
+		char buffer[2048];
+
+		TEST_CHECK(sink.Submit(buffer, FormatMessage(buffer, sizeof(buffer), 0, 1)));
+		TEST_CHECK(sink.Submit(buffer, FormatMessage(buffer, sizeof(buffer), 0, 2)));
+		TEST_CHECK(!sink.Submit(buffer, FormatMessage(buffer, sizeof(buffer), 0, 100)));
+		TEST_CHECK(sink.GetStatistics().Dropped == 1);
+
+		sink.Start(file, LogSink::OverflowPolicy::Block, nullptr);
+		TEST_CHECK(sink.Submit(buffer, FormatMessage(buffer, sizeof(buffer), 0, 3)));
+		sink.Flush();
+
+		const std::string text = ReadAll(file);
+		TEST_CHECK(CheckLines(text) == 3);
+		TEST_CHECK(text.compare(0, 4, "T0 1") == 0);
+
+		sink.Stop();
+		fclose(file);
+	}
+}
+
+int main()
+{
+	TestBeforeStart();
+	TestBlockStorm();
+	TestDropStorm();
+
+	printf("LogSinkTest passed\n");
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/CKSSE/LogStore.h"
+
+//
+// Filters a large log against a plain list of (text, category, severity) and checks that the visible rows,
+// their text and the search results match what a linear pass over that list gives.
+//
+namespace
+{
+	struct ReferenceLine
+	{
+		std::string Text;
+		uint32_t Category;
+		uint32_t Severity;
+	};
+
+	const uint32_t LineCount = 500000;
+	const uint32_t NeedleLine = 123457;
+
+	void CheckFilter(const LogStore& Store, const std::vector<ReferenceLine>& Reference)
+	{
+		const uint32_t categoryMask = Store.GetCategoryMask();
+		const uint32_t severityMask = Store.GetSeverityMask();
+		uint32_t row = 0;
+
+		for (const ReferenceLine& line : Reference)
+		{
+			if (!(categoryMask & (1u << line.Category)) || !(severityMask & (1u << line.Severity)))
+				continue;
+
+			size_t length;
+			const char *text = Store.GetVisibleLine(row++, &length);
+
+			TEST_CHECK(line.Text.compare(0, std::string::npos, text, length) == 0);
+		}
+
+		TEST_CHECK(row == Store.GetVisibleCount());
+	}
+
+	void TestFilterAndSearch()
+	{
+		LogStore store;
+		std::vector<ReferenceLine> reference;
+		std::mt19937 random(3);
+
+		for (uint32_t i = 0; i < LineCount; i++)
+		{
+			ReferenceLine line;
+			line.Category = random() % LogStore::MaxCategories;
+			line.Severity = random() % (uint32_t)LogStore::Severity::Count;
+			line.Text = "CAT" + std::to_string(line.Category) + ": line " + std::to_string(i);
+
+			if (i == NeedleLine)
+				line.Text += " NeedleHere";
+
+			// A few lines bigger than a chunk
+			if (i % 100000 == 99999)
+				line.Text.append(1536 * 1024, 'x');
+
+			store.AppendLine(line.Text.data(), line.Text.size(), line.Category, (LogStore::Severity)line.Severity);
+			reference.push_back(std::move(line));
+		}
+
+		TEST_CHECK(store.GetLineCount() == LineCount);
+		TEST_CHECK(store.GetMaxLineLength() > 1536 * 1024);
+
+		double filterMilliseconds = 0.0;
+
+		for (uint32_t i = 0; i < 20; i++)
+		{
+			const uint32_t categoryMask = (i == 0) ? 0 : (uint32_t)random();
+			const uint32_t severityMask = random() % (LogStore::AllSeverities + 1);
+
+			const auto start = std::chrono::steady_clock::now();
+			store.SetFilter(categoryMask, severityMask);
+			filterMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			TEST_CHECK(store.GetCategoryMask() == categoryMask && store.GetSeverityMask() == severityMask);
+			CheckFilter(store, reference);
+		}
+
+		store.SetFilter(LogStore::AllCategories, LogStore::AllSeverities);
+		TEST_CHECK(store.GetVisibleCount() == LineCount);
+
+		// Out of range rows come back empty
+		size_t length;
+		TEST_CHECK(store.GetVisibleLine(LineCount, &length)[0] == '\0' && length == 0);
+
+		TEST_CHECK(store.FindVisible("needlehere", 0, true, false) == NeedleLine);
+		TEST_CHECK(store.FindVisible("needlehere", 0, true, true) == LogStore::InvalidRow);
+		TEST_CHECK(store.FindVisible("NeedleHere", 200000, true, true) == NeedleLine);		// Wraps
+		TEST_CHECK(store.FindVisible("NeedleHere", 100000, false, true) == NeedleLine);
+		TEST_CHECK(store.FindVisible("", 0, true, true) == LogStore::InvalidRow);
+
+		// Row numbers are relative to the filter
+		const uint32_t needleCategory = reference[NeedleLine].Category;
+		store.SetFilter(1u << needleCategory, LogStore::AllSeverities);
+
+		const uint32_t needleRow = store.FindVisible("NeedleHere", 0, true, true);
+		TEST_CHECK(needleRow != LogStore::InvalidRow && needleRow < NeedleLine);
+
+		const char *needleText = store.GetVisibleLine(needleRow, &length);
+		TEST_CHECK(reference[NeedleLine].Text.compare(0, std::string::npos, needleText, length) == 0);
+
+		store.SetFilter(~(1u << needleCategory), LogStore::AllSeverities);
+		TEST_CHECK(store.FindVisible("NeedleHere", 0, true, true) == LogStore::InvalidRow);
+
+		printf("filter: %u lines, %.2f ms per SetFilter\n", LineCount, filterMilliseconds / 20.0);
+	}
+
+	void TestAppendUnderFilter()
+	{
+		LogStore store;
+		store.SetFilter(1u << 5, 1u << (uint32_t)LogStore::Severity::Error);
+
+		// Crosses several bitmap words while the filter is set
+		for (uint32_t i = 0; i < 200; i++)
+		{
+			const std::string text = std::to_string(i);
+			store.AppendLine(text.data(), text.size(), 5 + (i % 2), (i % 3 == 0) ? LogStore::Severity::Error : LogStore::Severity::Info);
+		}
+
+		// i % 2 == 0 && i % 3 == 0
+		TEST_CHECK(store.GetVisibleCount() == 34);
+
+		size_t length;
+		const char *text = store.GetVisibleLine(1, &length);
+		TEST_CHECK(std::string(text, length) == "6");
+
+		// Recomputing from the bitmaps gives the same rows
+		store.SetFilter(LogStore::AllCategories, LogStore::AllSeverities);
+		store.SetFilter(1u << 5, 1u << (uint32_t)LogStore::Severity::Error);
+		TEST_CHECK(store.GetVisibleCount() == 34);
+
+		store.Clear();
+		TEST_CHECK(store.GetLineCount() == 0 && store.GetVisibleCount() == 0 && store.GetMaxLineLength() == 0);
+
+		// Clear keeps the filter
+		store.AppendLine("z", 1, 5, LogStore::Severity::Error);
+		store.AppendLine("w", 1, 0, LogStore::Severity::Info);
+		TEST_CHECK(store.GetLineCount() == 2 && store.GetVisibleCount() == 1);
+	}
+}
+
+int main()
+{
+	TestFilterAndSearch();
+	TestAppendUnderFilter();
+
+	printf("LogStoreTest passed\n");
+	return 0;
+}
\ No newline at end of file
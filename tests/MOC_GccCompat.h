@@ -0,0 +1,12 @@
+#pragma once
+
+//
+// Force-included into the MaskedOcclusionCulling library for the Linux build. CompilerSpecific.inl
+// defines its own __cpuidex and _xgetbv for GCC, but newer GCC headers already declare both. The
+// system versions are pulled in first and the library's copies renamed out of the way.
+//
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define __cpuidex MOC_cpuidex
+#define _xgetbv MOC_xgetbv
\ No newline at end of file
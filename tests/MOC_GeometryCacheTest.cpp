@@ -0,0 +1,150 @@
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/TES/MOC_GeometryCache.h"
+
+//
+// Concurrent convert/insert, remove and "rasterize" (read every buffer) on a small key set, then a
+// quiescent check that nothing stale was published after a remove.
+//
+namespace
+{
+	const uint32_t KeyCount = 64;
+	const uint32_t VertexCount = 96;
+	const uint32_t IndexCount = 3 * 32;
+
+	char Keys[KeyCount];
+	std::atomic_uint32_t Versions[KeyCount];
+
+	MOC_GeometryCache::Entry *Convert(MOC_GeometryCache& Cache, uint32_t Key, bool Yield)
+	{
+		uint32_t generation;
+
+		if (auto entry = Cache.Acquire(&Keys[Key], &generation))
+			return entry;
+
+		// Removers bump the version before calling Remove(), so anything published after this point
+		// either carries the final version or is removed again.
+		const uint32_t version = Versions[Key].load();
+
+		if (Yield)
+			std::this_thread::yield();
+
+		float *vertices = new float[VertexCount * 4];
+		uint32_t *indices = new uint32_t[IndexCount];
+
+		for (uint32_t i = 0; i < VertexCount * 4; i++)
+			vertices[i] = (float)(Key * 1000 + version);
+
+		for (uint32_t i = 0; i < IndexCount; i++)
+			indices[i] = i % VertexCount;
+
+		const float halfExtents[3] = { 1.0f, 2.0f, 3.0f };
+		return Cache.Insert(&Keys[Key], generation, vertices, indices, IndexCount, halfExtents);
+	}
+
+	void Rasterize(const MOC_GeometryCache::Entry *Entry)
+	{
+		// Touch everything a cull worker would. A freed buffer shows up here under ASan.
+		const float first = Entry->Vertices[0];
+
+		for (uint32_t i = 0; i < Entry->IndexCount; i++)
+		{
+			TEST_CHECK(Entry->Indices[i] < VertexCount);
+			TEST_CHECK(Entry->Vertices[Entry->Indices[i] * 4] == first);
+		}
+	}
+
+	void TestRemoveDuringConversion()
+	{
+		MOC_GeometryCache cache;
+		uint32_t generation;
+
+		TEST_CHECK(cache.Acquire(&Keys[0], &generation) == nullptr);
+		cache.Remove(&Keys[0]);
+
+		const float halfExtents[3] = {};
+		auto entry = cache.Insert(&Keys[0], generation, new float[4], new uint32_t[3](), 3, halfExtents);
+
+		// The caller keeps its copy for this frame, but the table must not
+		TEST_CHECK(entry != nullptr);
+		TEST_CHECK(cache.Acquire(&Keys[0]) == nullptr);
+		TEST_CHECK(cache.GetLiveEntryCount() == 0);
+		cache.Release(entry);
+
+		// A fresh ticket publishes normally
+		TEST_CHECK(cache.Acquire(&Keys[0], &generation) == nullptr);
+		entry = cache.Insert(&Keys[0], generation, new float[4], new uint32_t[3](), 3, halfExtents);
+		cache.Release(entry);
+
+		TEST_CHECK(cache.GetLiveEntryCount() == 1);
+		entry = cache.Acquire(&Keys[0]);
+		TEST_CHECK(entry != nullptr);
+		cache.Release(entry);
+	}
+
+	void TestStress()
+	{
+		MOC_GeometryCache cache;
+		std::atomic_bool stop = false;
+		std::vector<std::thread> threads;
+
+		for (uint32_t i = 0; i < 6; i++)
+		{
+			threads.emplace_back([&cache, &stop, i]()
+			{
+				std::mt19937 random(i);
+
+				while (!stop.load())
+				{
+					const uint32_t key = random() % KeyCount;
+
+					if (i < 4)
+					{
+						// Cull worker
+						auto entry = Convert(cache, key, (random() % 4) == 0);
+						Rasterize(entry);
+						cache.Release(entry);
+					}
+					else
+					{
+						// Cell unload
+						Versions[key]++;
+						cache.Remove(&Keys[key]);
+					}
+				}
+			});
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		stop.store(true);
+
+		for (auto& thread : threads)
+			thread.join();
+
+		for (uint32_t key = 0; key < KeyCount; key++)
+		{
+			if (auto entry = cache.Acquire(&Keys[key]))
+			{
+				TEST_CHECK(entry->Vertices[0] == (float)(key * 1000 + Versions[key].load()));
+				cache.Release(entry);
+			}
+
+			cache.Remove(&Keys[key]);
+		}
+
+		TEST_CHECK(cache.GetLiveEntryCount() == 0);
+	}
+}
+
+int main()
+{
+	TestRemoveDuringConversion();
+	TestStress();
+
+	printf("MOC_GeometryCache: ok\n");
+	return 0;
+}
\ No newline at end of file
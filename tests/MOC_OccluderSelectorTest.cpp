@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/TES/MOC_OccluderSelector.h"
+
+//
+// Synthetic scenes for the occluder selection stage: budgets, thin/small rejection, hysteresis and
+// output order.
+//
+namespace
+{
+	char Objects[64];
+
+	MOC_OccluderSelector::Settings DefaultSettings()
+	{
+		MOC_OccluderSelector::Settings settings;
+		settings.MaxOccluders = 4;
+		settings.TriangleBudget = 1000;
+		settings.MinProjectedArea = 0.01f;
+		settings.HysteresisBonus = 1.25f;
+
+		return settings;
+	}
+
+	MOC_OccluderSelector::Candidate MakeCandidate(uint32_t Index, float Area, uint32_t Triangles, float Distance)
+	{
+		MOC_OccluderSelector::Candidate candidate;
+		candidate.Key = &Objects[Index];
+		candidate.ProjectedArea = Area;
+		candidate.TriangleCount = Triangles;
+		candidate.DistanceSquared = Distance * Distance;
+		candidate.Score = 0.0f;
+
+		return candidate;
+	}
+
+	bool Contains(const std::vector<MOC_OccluderSelector::Candidate>& Selection, uint32_t Index)
+	{
+		return std::any_of(Selection.begin(), Selection.end(), [Index](const MOC_OccluderSelector::Candidate& C)
+		{
+			return C.Key == &Objects[Index];
+		});
+	}
+
+	void TestAreaEstimates()
+	{
+		// A wall and a pole with the same bounding sphere: only the wall keeps its area
+		const float wall[3] = { 200.0f, 10.0f, 150.0f };
+		const float pole[3] = { 5.0f, 5.0f, 250.0f };
+
+		TEST_CHECK(MOC_OccluderSelector::EstimateSilhouetteArea(wall, 1.0f) > 10.0f * MOC_OccluderSelector::EstimateSilhouetteArea(pole, 1.0f));
+		TEST_CHECK(MOC_OccluderSelector::EstimateSilhouetteArea(wall, 2.0f) == 4.0f * MOC_OccluderSelector::EstimateSilhouetteArea(wall, 1.0f));
+
+		// Twice as far, a quarter of the screen area
+		const float nearArea = MOC_OccluderSelector::EstimateProjectedArea(1000.0f, 100.0f * 100.0f, 1.5f, 2.0f);
+		const float farArea = MOC_OccluderSelector::EstimateProjectedArea(1000.0f, 200.0f * 200.0f, 1.5f, 2.0f);
+		TEST_CHECK(nearArea == 4.0f * farArea);
+
+		// Objects around the camera are clamped instead of dividing by ~0
+		TEST_CHECK(MOC_OccluderSelector::EstimateProjectedArea(1.0f, 0.0f, 1.0f, 1.0f) == 1.0f);
+	}
+
+	void TestBudgets()
+	{
+		MOC_OccluderSelector selector;
+		auto settings = DefaultSettings();
+
+		std::vector<MOC_OccluderSelector::Candidate> candidates =
+		{
+			MakeCandidate(0, 0.001f, 2, 10.0f),		// Too small, whatever it costs
+			MakeCandidate(1, 1.0f, 900, 10.0f),		// Best area, but dense
+			MakeCandidate(2, 0.8f, 100, 20.0f),
+			MakeCandidate(3, 0.6f, 600, 30.0f),		// Doesn't fit after 1 and 2 are... skipped, not a stop
+			MakeCandidate(4, 0.4f, 50, 40.0f),
+			MakeCandidate(5, 0.3f, 40, 50.0f),
+		};
+
+		selector.Select(candidates, settings);
+		auto& stats = selector.GetStatistics();
+
+		TEST_CHECK(stats.CandidateCount == 6);
+		TEST_CHECK(stats.RejectedSmall == 1);
+		TEST_CHECK(!Contains(candidates, 0));
+
+		// Ranked by area per triangle: 4, 5, 2, 3, 1. 3 fits (190 + 600), 1 doesn't, K isn't reached.
+		TEST_CHECK(candidates.size() == 4);
+		TEST_CHECK(Contains(candidates, 2) && Contains(candidates, 3) && Contains(candidates, 4) && Contains(candidates, 5));
+		TEST_CHECK(stats.RejectedBudget == 1);
+		TEST_CHECK(stats.SelectedTriangles == 790);
+		TEST_CHECK(stats.SelectedTriangles <= settings.TriangleBudget);
+
+		// Submitted front to back
+		for (size_t i = 1; i < candidates.size(); i++)
+			TEST_CHECK(candidates[i - 1].DistanceSquared <= candidates[i].DistanceSquared);
+	}
+
+	void TestTopK()
+	{
+		MOC_OccluderSelector selector;
+		auto settings = DefaultSettings();
+		settings.TriangleBudget = 1000000;
+
+		std::vector<MOC_OccluderSelector::Candidate> candidates;
+
+		for (uint32_t i = 0; i < 32; i++)
+			candidates.push_back(MakeCandidate(i, 0.1f + i * 0.01f, 10, (float)i));
+
+		selector.Select(candidates, settings);
+
+		TEST_CHECK(candidates.size() == settings.MaxOccluders);
+
+		for (uint32_t i = 28; i < 32; i++)
+			TEST_CHECK(Contains(candidates, i));
+	}
+
+	void TestHysteresis()
+	{
+		MOC_OccluderSelector selector;
+		auto settings = DefaultSettings();
+		settings.MaxOccluders = 1;
+
+		// Frame 1: A wins
+		std::vector<MOC_OccluderSelector::Candidate> frame = { MakeCandidate(0, 1.0f, 100, 10.0f), MakeCandidate(1, 0.9f, 100, 10.0f) };
+		selector.Select(frame, settings);
+		TEST_CHECK(frame.size() == 1 && Contains(frame, 0));
+
+		// Frame 2: B is slightly better now, inside the bonus - A stays
+		frame = { MakeCandidate(0, 1.0f, 100, 10.0f), MakeCandidate(1, 1.1f, 100, 10.0f) };
+		selector.Select(frame, settings);
+		TEST_CHECK(Contains(frame, 0));
+		TEST_CHECK(selector.GetStatistics().Retained == 1);
+
+		// Frame 3: B is clearly better - it takes over
+		frame = { MakeCandidate(0, 1.0f, 100, 10.0f), MakeCandidate(1, 1.5f, 100, 10.0f) };
+		selector.Select(frame, settings);
+		TEST_CHECK(Contains(frame, 1));
+		TEST_CHECK(selector.GetStatistics().Retained == 0);
+
+		// Reset forgets the previous selection
+		selector.Reset();
+		frame = { MakeCandidate(0, 1.3f, 100, 10.0f), MakeCandidate(1, 1.2f, 100, 10.0f) };
+		selector.Select(frame, settings);
+		TEST_CHECK(Contains(frame, 0));
+	}
+
+	void TestStableUnderReordering()
+	{
+		// A noisy scene over many frames: the selection must not depend on traversal order, and with a
+		// little jitter on every score the set should barely change from frame to frame.
+		auto settings = DefaultSettings();
+		settings.MaxOccluders = 16;
+		settings.TriangleBudget = 20000;
+
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> area(0.05f, 1.0f);
+		std::uniform_real_distribution<float> jitter(0.97f, 1.03f);
+
+		std::vector<MOC_OccluderSelector::Candidate> scene;
+
+		for (uint32_t i = 0; i < 64; i++)
+			scene.push_back(MakeCandidate(i, area(random), 100 + (random() % 2000), 10.0f + i));
+
+		MOC_OccluderSelector selector;
+		MOC_OccluderSelector shuffledSelector;
+		uint32_t changes = 0;
+
+		for (uint32_t frame = 0; frame < 100; frame++)
+		{
+			std::vector<MOC_OccluderSelector::Candidate> candidates = scene;
+
+			for (auto& c : candidates)
+				c.ProjectedArea *= jitter(random);
+
+			std::vector<MOC_OccluderSelector::Candidate> shuffled = candidates;
+			std::shuffle(shuffled.begin(), shuffled.end(), random);
+
+			selector.Select(candidates, settings);
+			shuffledSelector.Select(shuffled, settings);
+
+			TEST_CHECK(candidates.size() == shuffled.size());
+
+			for (size_t i = 0; i < candidates.size(); i++)
+				TEST_CHECK(candidates[i].Key == shuffled[i].Key);
+
+			if (frame > 0)
+				changes += selector.GetStatistics().Selected - selector.GetStatistics().Retained;
+		}
+
+		TEST_CHECK(changes < 10);
+	}
+}
+
+int main()
+{
+	TestAreaEstimates();
+	TestBudgets();
+	TestTopK();
+	TestHysteresis();
+	TestStableUnderReordering();
+
+	printf("MOC_OccluderSelector: ok\n");
+	return 0;
+}
\ No newline at end of file
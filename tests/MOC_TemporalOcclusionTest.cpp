@@ -0,0 +1,521 @@
+#include <algorithm>
+#include <iterator>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <MaskedOcclusionCulling/MaskedOcclusionCulling.h>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/TES/MOC_OcclusionView.h"
+
+//
+// Replays camera paths through the temporal occlusion test. Every frame the scene's occluders are
+// rasterized with that frame's camera, then each occludee in view is tested twice: exactly against
+// this frame's buffer, and temporally against the previous frame's buffer with the game's padding.
+// Anything culled temporally but visible to the exact test is a false cull (a popping object in
+// game), and the rate over every path has to stay under FalseCullThreshold.
+//
+// The built-in paths are walks, turns and flicks through a grid of buildings. They go through the
+// "Record Camera Path" file format, and paths recorded in game can be replayed through the same
+// scene by passing the files on the command line.
+//
+namespace
+{
+	const uint32_t RenderWidth = 640;
+	const uint32_t RenderHeight = 360;
+
+	// Game defaults for "Temporal Max Camera Translation/Rotation"
+	const float MaxTranslation = 150.0f;
+	const float MaxRotation = 10.0f * (3.14159265f / 180.0f);
+
+	// Currently ~0.004%. Dropping either the corner rotation bound or the unknown edges goes over.
+	const double FalseCullThreshold = 0.00005;
+
+	struct Box
+	{
+		float Center[3];
+		float HalfExtents[3];
+	};
+
+	struct Sphere
+	{
+		float Center[3];
+		float Radius;
+	};
+
+	struct Scene
+	{
+		std::vector<Box> Occluders;
+		std::vector<Box> Boxes;
+		std::vector<Sphere> Spheres;
+	};
+
+	struct PathStatistics
+	{
+		uint32_t Frames;
+		uint32_t Fallbacks;			// History rejected (cut, teleport, fast turn), the game waits for the exact result
+		uint64_t Tested;			// Occludees in view on frames that used history
+		uint64_t ExactCulls;
+		uint64_t TemporalCulls;
+		uint64_t FalseCulls;
+	};
+
+	bool Inside(const Box& Outer, const float Point[3], float Margin)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			if (fabsf(Point[i] - Outer.Center[i]) > Outer.HalfExtents[i] + Margin)
+				return false;
+		}
+
+		return true;
+	}
+
+	bool InsideAny(const Scene& World, const float Point[3], float Margin)
+	{
+		for (auto& occluder : World.Occluders)
+		{
+			if (Inside(occluder, Point, Margin))
+				return true;
+		}
+
+		return false;
+	}
+
+	//
+	// A 9x9 block town: buildings on a 1000 unit grid with streets along x = 500 + 1000k and
+	// y = 500 + 1000k, and clutter scattered everywhere outside the buildings.
+	//
+	Scene CreateScene()
+	{
+		Scene world;
+		std::mt19937 rng(27);
+		std::uniform_real_distribution<float> extent(200.0f, 350.0f);
+		std::uniform_real_distribution<float> height(300.0f, 600.0f);
+		std::uniform_real_distribution<float> position(-4500.0f, 4500.0f);
+		std::uniform_real_distribution<float> elevation(0.0f, 250.0f);
+		std::uniform_real_distribution<float> size(15.0f, 100.0f);
+
+		for (int x = -4; x <= 4; x++)
+		{
+			for (int y = -4; y <= 4; y++)
+			{
+				const float h = height(rng);
+				world.Occluders.push_back({ { x * 1000.0f, y * 1000.0f, h }, { extent(rng), extent(rng), h } });
+			}
+		}
+
+		while (world.Boxes.size() < 3000)
+		{
+			Box box = { { position(rng), position(rng), elevation(rng) }, { size(rng), size(rng), size(rng) } };
+
+			if (!InsideAny(world, box.Center, 0.0f))
+				world.Boxes.push_back(box);
+		}
+
+		while (world.Spheres.size() < 1000)
+		{
+			Sphere sphere = { { position(rng), position(rng), elevation(rng) }, size(rng) };
+
+			if (!InsideAny(world, sphere.Center, 0.0f))
+				world.Spheres.push_back(sphere);
+		}
+
+		return world;
+	}
+
+	// Yaw is clockwise from +y, z is up
+	MOC_CameraPathFrame CreateFrame(float X, float Y, float Z, float YawDegrees, float PitchDegrees)
+	{
+		const float yaw = YawDegrees * (3.14159265f / 180.0f);
+		const float pitch = PitchDegrees * (3.14159265f / 180.0f);
+		const float tanHalfFov = tanf(75.0f * 0.5f * (3.14159265f / 180.0f));
+
+		MOC_CameraPathFrame frame;
+		const float direction[3] = { cosf(pitch) * sinf(yaw), cosf(pitch) * cosf(yaw), sinf(pitch) };
+		const float right[3] = { cosf(yaw), -sinf(yaw), 0.0f };
+		const float up[3] =
+		{
+			right[1] * direction[2] - right[2] * direction[1],
+			right[2] * direction[0] - right[0] * direction[2],
+			right[0] * direction[1] - right[1] * direction[0],
+		};
+
+		for (int i = 0; i < 3; i++)
+		{
+			frame.Direction[i] = direction[i];
+			frame.Right[i] = right[i];
+			frame.Up[i] = up[i];
+		}
+
+		frame.Position[0] = X;
+		frame.Position[1] = Y;
+		frame.Position[2] = Z;
+		frame.Frustum[0] = -tanHalfFov;
+		frame.Frustum[1] = tanHalfFov;
+		frame.Frustum[2] = tanHalfFov * RenderHeight / RenderWidth;
+		frame.Frustum[3] = -tanHalfFov * RenderHeight / RenderWidth;
+		frame.Frustum[4] = 15.0f;
+		frame.Frustum[5] = 100000.0f;
+
+		return frame;
+	}
+
+	// Same matrices as NiCamera::CalculateViewProjection() for a perspective frustum
+	MOC_OcclusionCamera CreateCamera(const MOC_CameraPathFrame& Frame)
+	{
+		float view[4][4] =
+		{
+			{ Frame.Right[0], Frame.Up[0], Frame.Direction[0], 0.0f },
+			{ Frame.Right[1], Frame.Up[1], Frame.Direction[1], 0.0f },
+			{ Frame.Right[2], Frame.Up[2], Frame.Direction[2], 0.0f },
+			{ 0.0f, 0.0f, 0.0f, 1.0f },
+		};
+
+		const float left = Frame.Frustum[0];
+		const float right = Frame.Frustum[1];
+		const float top = Frame.Frustum[2];
+		const float bottom = Frame.Frustum[3];
+		const float nearPlane = Frame.Frustum[4];
+		const float farPlane = Frame.Frustum[5];
+		const float invNearFarDiff = 1.0f / (farPlane - nearPlane);
+
+		float proj[4][4] = {};
+		proj[0][0] = (1.0f / (right - left)) * 2.0f;
+		proj[1][1] = (1.0f / (top - bottom)) * 2.0f;
+		proj[2][0] = -((1.0f / (right - left)) * (right + left));
+		proj[2][1] = -((1.0f / (top - bottom)) * (top + bottom));
+		proj[2][2] = invNearFarDiff * farPlane;
+		proj[2][3] = 1.0f;
+		proj[3][2] = -(nearPlane * farPlane * invNearFarDiff);
+
+		MOC_OcclusionCamera camera;
+
+		for (int i = 0; i < 4; i++)
+		{
+			float viewProj[4];
+
+			for (int j = 0; j < 4; j++)
+				viewProj[j] = view[i][0] * proj[0][j] + view[i][1] * proj[1][j] + view[i][2] * proj[2][j] + view[i][3] * proj[3][j];
+
+			camera.View[i] = _mm_loadu_ps(view[i]);
+			camera.Proj[i] = _mm_loadu_ps(proj[i]);
+			camera.ViewProj[i] = _mm_loadu_ps(viewProj);
+		}
+
+		camera.Position = _mm_setr_ps(Frame.Position[0], Frame.Position[1], Frame.Position[2], 0.0f);
+		camera.Direction = _mm_setr_ps(Frame.Direction[0], Frame.Direction[1], Frame.Direction[2], 0.0f);
+		return camera;
+	}
+
+	std::vector<MOC_CameraPathFrame> CreatePath(int Type)
+	{
+		std::vector<MOC_CameraPathFrame> path;
+
+		for (int i = 0; i < 300; i++)
+		{
+			const float t = (float)i;
+
+			switch (Type)
+			{
+			case 0:		// Walking down a street with some head bob and looking around
+				path.push_back(CreateFrame(500.0f, -4000.0f + 4.0f * t, 120.0f + 3.0f * sinf(t * 0.3f), 15.0f * sinf(t * 0.02f), 5.0f * sinf(t * 0.05f)));
+				break;
+
+			case 1:		// Circling an intersection while turning on the spot
+				path.push_back(CreateFrame(500.0f + 100.0f * cosf(t * 0.02f), 500.0f + 100.0f * sinf(t * 0.02f), 120.0f, 2.0f * t, 0.0f));
+				break;
+
+			case 2:		// Sprinting across town with mouse look
+				path.push_back(CreateFrame(-4000.0f + 10.0f * t, 1500.0f, 120.0f, 90.0f + 25.0f * sinf(t * 0.1f), 3.0f * sinf(t * 0.07f)));
+				break;
+
+			case 3:		// Looking up at the rooftops and back down while walking
+				path.push_back(CreateFrame(-500.0f, 4000.0f - 3.0f * t, 120.0f, 180.0f, 30.0f * sinf(t * 0.05f)));
+				break;
+
+			case 4:		// Standing still with flicks past the rotation limit and a teleport halfway
+				path.push_back(CreateFrame((i < 150) ? 500.0f : -2500.0f, -1500.0f, 120.0f, ((i % 60) < 5) ? 30.0f * (i % 60) : 0.5f * t, 0.0f));
+				break;
+
+			// Single motions, so a regression points at the padding term that caused it
+			case 5:		// Not moving at all
+				path.push_back(CreateFrame(500.0f, -1500.0f, 120.0f, 0.0f, 0.0f));
+				break;
+
+			case 6:		// Turning slowly (rotation padding and unknown edges)
+				path.push_back(CreateFrame(500.0f, -1500.0f, 120.0f, 0.5f * t, 0.0f));
+				break;
+
+			case 7:		// Walking straight ahead (translation padding and depth bias)
+				path.push_back(CreateFrame(500.0f, -1500.0f + 2.0f * t, 120.0f, 0.0f, 0.0f));
+				break;
+			}
+		}
+
+		return path;
+	}
+
+	// Paths are replayed from the recording format, never straight from memory
+	bool LoadPath(const char *FilePath, std::vector<MOC_CameraPathFrame> *Path)
+	{
+		FILE *f = fopen(FilePath, "r");
+
+		if (!f)
+			return false;
+
+		MOC_CameraPathFrame frame;
+
+		while (frame.Read(f))
+			Path->push_back(frame);
+
+		fclose(f);
+		return !Path->empty();
+	}
+
+	bool RoundTripPath(const std::vector<MOC_CameraPathFrame>& Frames, std::vector<MOC_CameraPathFrame> *Path)
+	{
+		std::string filePath = "/tmp/MOC_TemporalOcclusionTest_" + std::to_string(getpid()) + ".txt";
+		FILE *f = fopen(filePath.c_str(), "w");
+
+		if (!f)
+			return false;
+
+		for (auto& frame : Frames)
+			frame.Write(f);
+
+		fclose(f);
+
+		bool loaded = LoadPath(filePath.c_str(), Path);
+		remove(filePath.c_str());
+
+		return loaded && Path->size() == Frames.size();
+	}
+
+	void RenderOccluders(MaskedOcclusionCulling *Buffer, const Scene& World, const MOC_OcclusionCamera& Camera)
+	{
+		static const unsigned int indices[36] =
+		{
+			0, 1, 2, 0, 2, 3,	4, 6, 5, 4, 7, 6,
+			0, 4, 5, 0, 5, 1,	1, 5, 6, 1, 6, 2,
+			2, 6, 7, 2, 7, 3,	3, 7, 4, 3, 4, 0,
+		};
+
+		float position[4];
+		_mm_storeu_ps(position, Camera.Position);
+
+		Buffer->ClearBuffer();
+
+		for (auto& box : World.Occluders)
+		{
+			// Relative to the camera, like BSShaderUtil::GetXMFromNiPosAdjust
+			float vertices[8][3];
+
+			for (int i = 0; i < 8; i++)
+			{
+				vertices[i][0] = box.Center[0] - position[0] + ((i & 1) ^ ((i >> 1) & 1) ? box.HalfExtents[0] : -box.HalfExtents[0]);
+				vertices[i][1] = box.Center[1] - position[1] + ((i & 2) ? box.HalfExtents[1] : -box.HalfExtents[1]);
+				vertices[i][2] = box.Center[2] - position[2] + ((i & 4) ? box.HalfExtents[2] : -box.HalfExtents[2]);
+			}
+
+			Buffer->RenderTriangles(&vertices[0][0], indices, 12, (const float *)Camera.ViewProj, MaskedOcclusionCulling::BACKFACE_NONE,
+				MaskedOcclusionCulling::CLIP_PLANE_ALL, MaskedOcclusionCulling::VertexLayout(12, 4, 8));
+		}
+	}
+
+	// The game frustum culls before any occludee test. MOC's TestRect() isn't a frustum test: a rect
+	// entirely off the left or bottom edge is tested against the first column or row of tiles.
+	bool InFrustum(const MOC_OcclusionCamera& Camera, const float Center[3], const float HalfExtents[3])
+	{
+		float viewProj[4][4];
+		float position[4];
+
+		for (int i = 0; i < 4; i++)
+			_mm_storeu_ps(viewProj[i], Camera.ViewProj[i]);
+
+		_mm_storeu_ps(position, Camera.Position);
+
+		uint32_t outside[5] = {};
+
+		for (int i = 0; i < 8; i++)
+		{
+			const float corner[3] =
+			{
+				Center[0] - position[0] + ((i & 1) ? HalfExtents[0] : -HalfExtents[0]),
+				Center[1] - position[1] + ((i & 2) ? HalfExtents[1] : -HalfExtents[1]),
+				Center[2] - position[2] + ((i & 4) ? HalfExtents[2] : -HalfExtents[2]),
+			};
+
+			float clip[4];
+
+			for (int j = 0; j < 4; j++)
+				clip[j] = corner[0] * viewProj[0][j] + corner[1] * viewProj[1][j] + corner[2] * viewProj[2][j] + viewProj[3][j];
+
+			outside[0] += clip[0] < -clip[3];
+			outside[1] += clip[0] > clip[3];
+			outside[2] += clip[1] < -clip[3];
+			outside[3] += clip[1] > clip[3];
+			outside[4] += clip[3] <= 0.0f;
+		}
+
+		for (uint32_t count : outside)
+		{
+			if (count == 8)
+				return false;
+		}
+
+		return true;
+	}
+
+	template<typename Callback>
+	void ForEachOccludee(const Scene& World, const MOC_OcclusionView& View, Callback&& Function)
+	{
+		for (auto& box : World.Boxes)
+			Function(View.TestAABB(_mm_loadu_ps(box.Center), _mm_setr_ps(box.HalfExtents[0], box.HalfExtents[1], box.HalfExtents[2], 0.0f)));
+
+		for (auto& sphere : World.Spheres)
+			Function(View.TestSphere(_mm_loadu_ps(sphere.Center), sphere.Radius));
+	}
+
+	PathStatistics ReplayPath(const Scene& World, const std::vector<MOC_CameraPathFrame>& Path)
+	{
+		MaskedOcclusionCulling *buffers[2] = { MaskedOcclusionCulling::Create(), MaskedOcclusionCulling::Create() };
+
+		for (auto buffer : buffers)
+		{
+			buffer->SetResolution(RenderWidth, RenderHeight);
+			buffer->ClearBuffer();
+		}
+
+		PathStatistics stats = {};
+		MOC_OcclusionCamera previous;
+		std::vector<uint8_t> inView;
+		std::vector<uint8_t> exactVisible;
+
+		for (size_t frame = 0; frame < Path.size(); frame++)
+		{
+			MaskedOcclusionCulling *current = buffers[frame & 1];
+			MaskedOcclusionCulling *history = buffers[(frame & 1) ^ 1];
+			const MOC_OcclusionCamera camera = CreateCamera(Path[frame]);
+
+			RenderOccluders(current, World, camera);
+			stats.Frames++;
+
+			MOC_OcclusionView temporal;
+
+			if (frame == 0 || !temporal.SetTemporal(history, previous, camera, MaxTranslation, MaxRotation, RenderWidth))
+			{
+				if (frame != 0)
+					stats.Fallbacks++;
+
+				previous = camera;
+				continue;
+			}
+
+			MOC_OcclusionView exact;
+			exact.SetCurrentFrame(current, camera);
+
+			inView.clear();
+			exactVisible.clear();
+
+			for (auto& box : World.Boxes)
+				inView.push_back(InFrustum(camera, box.Center, box.HalfExtents));
+
+			for (auto& sphere : World.Spheres)
+			{
+				const float halfExtents[3] = { sphere.Radius, sphere.Radius, sphere.Radius };
+				inView.push_back(InFrustum(camera, sphere.Center, halfExtents));
+			}
+
+			ForEachOccludee(World, exact, [&](bool Visible) { exactVisible.push_back(Visible); });
+
+			size_t index = 0;
+
+			ForEachOccludee(World, temporal, [&](bool Visible)
+			{
+				if (inView[index])
+				{
+					stats.Tested++;
+					stats.ExactCulls += !exactVisible[index];
+					stats.TemporalCulls += !Visible;
+					stats.FalseCulls += !Visible && exactVisible[index];
+				}
+
+				index++;
+			});
+
+			previous = camera;
+		}
+
+		for (auto buffer : buffers)
+			MaskedOcclusionCulling::Destroy(buffer);
+
+		return stats;
+	}
+
+	void Report(const char *Name, const PathStatistics& Stats)
+	{
+		printf("%-28s %4u frames, %3u fallbacks, %8llu tested, %5.1f%% exact culls, %5.1f%% temporal culls, %5llu false culls (%.3f%%)\n",
+			Name,
+			Stats.Frames,
+			Stats.Fallbacks,
+			(unsigned long long)Stats.Tested,
+			100.0 * Stats.ExactCulls / std::max<uint64_t>(Stats.Tested, 1),
+			100.0 * Stats.TemporalCulls / std::max<uint64_t>(Stats.Tested, 1),
+			(unsigned long long)Stats.FalseCulls,
+			100.0 * Stats.FalseCulls / std::max<uint64_t>(Stats.Tested, 1));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *builtinNames[] = { "walk", "circle and turn", "sprint with mouse look", "look up and down", "flicks and teleport", "standing still", "turning", "walking straight" };
+
+	const Scene world = CreateScene();
+	PathStatistics total = {};
+	std::vector<std::pair<std::string, std::vector<MOC_CameraPathFrame>>> paths;
+
+	for (int i = 0; i < (int)std::size(builtinNames); i++)
+	{
+		std::vector<MOC_CameraPathFrame> path;
+		TEST_CHECK(RoundTripPath(CreatePath(i), &path));
+
+		paths.emplace_back(builtinNames[i], std::move(path));
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::vector<MOC_CameraPathFrame> path;
+		TEST_CHECK(LoadPath(argv[i], &path));
+
+		paths.emplace_back(argv[i], std::move(path));
+	}
+
+	for (auto& [name, path] : paths)
+	{
+		PathStatistics stats = ReplayPath(world, path);
+		Report(name.c_str(), stats);
+
+		total.Frames += stats.Frames;
+		total.Fallbacks += stats.Fallbacks;
+		total.Tested += stats.Tested;
+		total.ExactCulls += stats.ExactCulls;
+		total.TemporalCulls += stats.TemporalCulls;
+		total.FalseCulls += stats.FalseCulls;
+	}
+
+	Report("total", total);
+
+	// The scene has to actually occlude, and the padding can't be so wide that history never culls anything
+	TEST_CHECK(total.Tested > 100000);
+	TEST_CHECK(total.ExactCulls > total.Tested / 4);
+	TEST_CHECK(total.TemporalCulls > total.ExactCulls / 2);
+	TEST_CHECK(total.Fallbacks >= 10);
+
+	TEST_CHECK((double)total.FalseCulls / total.Tested <= FalseCullThreshold);
+
+	printf("MOC_TemporalOcclusionTest passed\n");
+	return 0;
+}
\ No newline at end of file
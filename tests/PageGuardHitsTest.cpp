@@ -0,0 +1,202 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/rendering/PageGuardHits.h"
+
+//
+// Checks PageGuardHitRing's FIFO order, wraparound and drop-when-full behavior, then pushes from several
+// threads while one thread drains, the way the exception handler and the report thread use it. Every hit is
+// either received once, in per-thread order, or counted as dropped. The aggregator is checked for grouping,
+// counts, address bounds and ordering.
+//
+namespace
+{
+	PageGuardHit MakeHit(uint64_t Address, uint64_t Rip, uint32_t ThreadId, uint16_t Range, bool Write)
+	{
+		PageGuardHit hit = {};
+		hit.Address = Address;
+		hit.Rip = Rip;
+		hit.ThreadId = ThreadId;
+		hit.Range = Range;
+		hit.Write = Write ? 1 : 0;
+
+		return hit;
+	}
+
+	void TestRing()
+	{
+		PageGuardHitRing ring(8);
+		PageGuardHit hits[16];
+
+		TEST_CHECK(ring.Drain(hits, 16) == 0);
+
+		// Several laps so the sequence numbers wrap through every slot
+		uint64_t next = 0;
+		uint64_t expected = 0;
+
+		for (uint32_t lap = 0; lap < 10; lap++)
+		{
+			for (uint32_t i = 0; i < 8; i++)
+				TEST_CHECK(ring.Push(MakeHit(next++, 0, 0, 0, false)));
+
+			// Full: dropped and counted, never blocks
+			TEST_CHECK(!ring.Push(MakeHit(~0ull, 0, 0, 0, false)));
+			TEST_CHECK(ring.GetDroppedCount() == 2 * lap + 1);
+
+			const uint32_t count = ring.Drain(hits, 3);
+			TEST_CHECK(count == 3);
+
+			for (uint32_t i = 0; i < count; i++)
+				TEST_CHECK(hits[i].Address == expected++);
+
+			// Room for exactly the drained hits
+			for (uint32_t i = 0; i < 3; i++)
+				TEST_CHECK(ring.Push(MakeHit(next++, 0, 0, 0, false)));
+
+			TEST_CHECK(!ring.Push(MakeHit(~0ull, 0, 0, 0, false)));
+			TEST_CHECK(ring.Drain(hits, 16) == 8);
+
+			for (uint32_t i = 0; i < 8; i++)
+				TEST_CHECK(hits[i].Address == expected++);
+		}
+
+		TEST_CHECK(ring.GetDroppedCount() == 20);
+	}
+
+	void TestConcurrentPush()
+	{
+		const uint32_t threadCount = 8;
+		const uint32_t hitsPerThread = 200000;
+
+		PageGuardHitRing ring(1024);
+		PageGuardHitAggregator aggregator;
+		std::atomic<uint64_t> pushed = 0;
+		std::atomic<bool> done = false;
+
+		std::vector<std::thread> producers;
+
+		for (uint32_t t = 0; t < threadCount; t++)
+		{
+			producers.emplace_back([&, t]()
+			{
+				for (uint32_t i = 0; i < hitsPerThread; i++)
+				{
+					// Address carries the sequence number, Rip picks one of two call sites per thread
+					if (ring.Push(MakeHit(i, 0x5000 + t * 2 + (i & 1), t, (uint16_t)(t % 3), (i & 1) != 0)))
+						pushed++;
+				}
+			});
+		}
+
+		std::vector<int64_t> lastSequence(threadCount, -1);
+		uint64_t received = 0;
+
+		auto drain = [&]()
+		{
+			PageGuardHit hits[256];
+			uint32_t count = ring.Drain(hits, 256);
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const PageGuardHit& hit = hits[i];
+
+				TEST_CHECK(hit.ThreadId < threadCount);
+				TEST_CHECK((int64_t)hit.Address > lastSequence[hit.ThreadId]);
+				TEST_CHECK(hit.Rip == 0x5000 + hit.ThreadId * 2 + (hit.Address & 1) && hit.Range == hit.ThreadId % 3);
+
+				lastSequence[hit.ThreadId] = (int64_t)hit.Address;
+			}
+
+			aggregator.Add(hits, count);
+			received += count;
+			return count;
+		};
+
+		std::thread consumer([&]()
+		{
+			while (!done.load())
+				drain();
+		});
+
+		for (auto& thread : producers)
+			thread.join();
+
+		done = true;
+		consumer.join();
+
+		while (drain() > 0)
+		{
+		}
+
+		TEST_CHECK(received == pushed.load());
+		TEST_CHECK(pushed.load() + ring.GetDroppedCount() == (uint64_t)threadCount * hitsPerThread);
+		TEST_CHECK(aggregator.GetTotalHits() == received);
+
+		auto sites = aggregator.GetCallSites();
+		uint64_t total = 0;
+
+		TEST_CHECK(sites.size() <= threadCount * 2);
+
+		for (size_t i = 0; i < sites.size(); i++)
+		{
+			const auto& site = sites[i];
+			const uint32_t thread = (uint32_t)((site.Rip - 0x5000) / 2);
+			const bool writes = ((site.Rip - 0x5000) & 1) != 0;
+
+			TEST_CHECK(site.Range == thread % 3 && site.FirstThreadId == thread && !site.MultipleThreads);
+			TEST_CHECK(writes ? (site.Reads == 0 && site.Writes > 0) : (site.Writes == 0 && site.Reads > 0));
+			TEST_CHECK(site.MinAddress <= site.MaxAddress && site.MaxAddress < hitsPerThread);
+
+			if (i > 0)
+				TEST_CHECK(sites[i - 1].Reads + sites[i - 1].Writes >= site.Reads + site.Writes);
+
+			total += site.Reads + site.Writes;
+		}
+
+		TEST_CHECK(total == received);
+	}
+
+	void TestAggregator()
+	{
+		PageGuardHitAggregator aggregator;
+
+		const PageGuardHit hits[] =
+		{
+			MakeHit(0x1010, 0x9000, 1, 0, false),
+			MakeHit(0x1000, 0x9000, 2, 0, true),
+			MakeHit(0x1030, 0x9000, 1, 0, false),
+			MakeHit(0x2000, 0x9000, 1, 1, false),			// Same instruction, other range
+			MakeHit(0x2008, 0x9100, 3, 1, true),
+			MakeHit(0x2004, 0x9100, 3, 1, true),
+		};
+
+		aggregator.Add(hits, 3);
+		aggregator.Add(hits + 3, 3);
+
+		auto sites = aggregator.GetCallSites();
+		TEST_CHECK(sites.size() == 3 && aggregator.GetTotalHits() == 6);
+
+		TEST_CHECK(sites[0].Range == 0 && sites[0].Rip == 0x9000);
+		TEST_CHECK(sites[0].Reads == 2 && sites[0].Writes == 1);
+		TEST_CHECK(sites[0].MinAddress == 0x1000 && sites[0].MaxAddress == 0x1030);
+		TEST_CHECK(sites[0].FirstThreadId == 1 && sites[0].MultipleThreads);
+
+		TEST_CHECK(sites[1].Range == 1 && sites[1].Rip == 0x9100 && sites[1].Writes == 2 && !sites[1].MultipleThreads);
+		TEST_CHECK(sites[1].MinAddress == 0x2004 && sites[1].MaxAddress == 0x2008);
+		TEST_CHECK(sites[2].Range == 1 && sites[2].Rip == 0x9000 && sites[2].Reads == 1);
+
+		aggregator.Clear();
+		TEST_CHECK(aggregator.GetCallSites().empty() && aggregator.GetTotalHits() == 0);
+	}
+}
+
+int main()
+{
+	TestRing();
+	TestConcurrentPush();
+	TestAggregator();
+
+	printf("PageGuardHitsTest passed\n");
+	return 0;
+}
\ No newline at end of file
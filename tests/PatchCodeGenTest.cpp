@@ -0,0 +1,201 @@
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "TestCommon.h"
+#include "PatchListTestCommon.h"
+
+//
+// Runs the decode/emit/verify stages over every entry in the shipped TLS patch list, in both TLS and
+// original-globals mode, serially and on several threads. Every entry has to generate, the results have to
+// be identical, and the block has to contain the original instruction with only its address changed. Then checks by hand that the generator and verifier reject a wrong table entry,
+// a short instruction and tampered output, and checks BuildCodeHook's encoding and limits.
+//
+namespace
+{
+	const uintptr_t ModuleBase = 0x7FF600000000;
+	const uintptr_t GlobalsOffset = 0x304BEF0;
+
+	ZydisDecoder Decoder;
+
+	bool SameOperand(const ZydisDecodedOperand& A, const ZydisDecodedOperand& B)
+	{
+		if (A.type != B.type || A.size != B.size)
+			return false;
+
+		if (A.type == ZYDIS_OPERAND_TYPE_REGISTER)
+			return A.reg.value == B.reg.value;
+
+		if (A.type == ZYDIS_OPERAND_TYPE_IMMEDIATE)
+			return A.imm.value.u == B.imm.value.u;
+
+		return A.type == ZYDIS_OPERAND_TYPE_MEMORY;
+	}
+
+	// The rewrite has to run the original instruction with only the memory operand's address changed
+	bool HasRewrittenInstruction(const std::vector<uint8_t>& Original, const GeneratedPatch& Patch)
+	{
+		ZydisDecodedInstruction original;
+		TEST_CHECK(ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(&Decoder, Original.data(), Original.size(), 0, &original)));
+
+		for (uint32_t offset = 0; offset < Patch.CodeSize;)
+		{
+			ZydisDecodedInstruction instruction;
+
+			if (!ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(&Decoder, Patch.Code + offset, Patch.CodeSize - offset, 0, &instruction)))
+				return false;
+
+			offset += instruction.length;
+
+			if (instruction.mnemonic != original.mnemonic || instruction.operandCount != original.operandCount)
+				continue;
+
+			bool same = true;
+
+			for (uint32_t i = 0; i < instruction.operandCount; i++)
+			{
+				same &= SameOperand(instruction.operands[i], original.operands[i]);
+
+				if (instruction.operands[i].type == ZYDIS_OPERAND_TYPE_MEMORY)
+					same &= instruction.operands[i].mem.base == Patch.Scratch;
+			}
+
+			if (same)
+				return true;
+		}
+
+		return false;
+	}
+
+	void TestPatchList()
+	{
+		for (int mode = 0; mode < 2; mode++)
+		{
+			const PatchCodeGenContext context = { 44, 0x10, ModuleBase, GlobalsOffset, mode != 0, &ShippedShufps };
+
+			std::vector<std::vector<uint8_t>> recorded(ShippedPatchCount);
+
+			for (size_t i = 0; i < ShippedPatchCount; i++)
+				TEST_CHECK(RecordOriginalInstruction(ShippedPatches[i], ModuleBase, GlobalsOffset, ShippedShufps, &recorded[i]));
+
+			auto generate = [&](std::vector<GeneratedPatch>& Output, size_t Begin, size_t End)
+			{
+				for (size_t i = Begin; i < End; i++)
+				{
+					const PatchEntry& patch = ShippedPatches[i];
+
+					if (GeneratePatch(&Decoder, &patch, recorded[i].data(), recorded[i].size(), ModuleBase + patch.ExeOffset, context, &Output[i]))
+						VerifyGeneratedPatch(&Decoder, &patch, context, &Output[i]);
+				}
+			};
+
+			std::vector<GeneratedPatch> serial(ShippedPatchCount);
+			std::vector<GeneratedPatch> parallel(ShippedPatchCount);
+
+			// Unused bytes have to match too
+			memset(serial.data(), 0, serial.size() * sizeof(GeneratedPatch));
+			memset(parallel.data(), 0, parallel.size() * sizeof(GeneratedPatch));
+
+			generate(serial, 0, ShippedPatchCount);
+
+			const size_t threadCount = 8;
+			std::vector<std::thread> threads;
+
+			for (size_t t = 0; t < threadCount; t++)
+				threads.emplace_back(generate, std::ref(parallel), ShippedPatchCount * t / threadCount, ShippedPatchCount * (t + 1) / threadCount);
+
+			for (auto& thread : threads)
+				thread.join();
+
+			for (size_t i = 0; i < ShippedPatchCount; i++)
+			{
+				if (serial[i].Error)
+					fprintf(stderr, "%s mode, patch 0x%llX: %s\n", mode ? "globals" : "TLS", (unsigned long long)ShippedPatches[i].ExeOffset, serial[i].Error);
+
+				TEST_CHECK(!serial[i].Error);
+				TEST_CHECK(serial[i].TargetAddress == ModuleBase + ShippedPatches[i].ExeOffset);
+				TEST_CHECK(serial[i].InstructionLength == recorded[i].size());
+				TEST_CHECK(memcmp(&serial[i], &parallel[i], sizeof(GeneratedPatch)) == 0);
+
+				if (!HasRewrittenInstruction(recorded[i], serial[i]))
+				{
+					fprintf(stderr, "%s mode, patch 0x%llX: rewritten instruction not found\n", mode ? "globals" : "TLS", (unsigned long long)ShippedPatches[i].ExeOffset);
+					TEST_CHECK(false);
+				}
+			}
+		}
+	}
+
+	void TestRejects()
+	{
+		// mov eax, dword ptr [rip+0x1000] at 0x140001000, which reads the global at offset 0x1006
+		const PatchCodeGenContext context = { 3, 0, 0x140000000, 0x1000, false, &ShippedShufps };
+		const uint8_t bytes[] = { 0x8B, 0x05, 0x00, 0x10, 0x00, 0x00 };
+		const PatchEntry patch = { PatchType::MOV_REG_MEM, 0x1000, { (uint64_t)ZYDIS_REGISTER_EAX }, 0x1006, 32, ZYDIS_REGISTER_RIP, ZYDIS_REGISTER_NONE, 0 };
+
+		GeneratedPatch output;
+		TEST_CHECK(GeneratePatch(&Decoder, &patch, bytes, sizeof(bytes), 0x140001000, context, &output));
+		TEST_CHECK(VerifyGeneratedPatch(&Decoder, &patch, context, &output));
+		TEST_CHECK(output.Scratch == ZYDIS_REGISTER_RDI && output.InstructionLength == 6 && !output.Error);
+
+		// Table entry doesn't match the instruction's target
+		PatchEntry wrongOffset = patch;
+		wrongOffset.Offset = 0x1008;
+		TEST_CHECK(!GeneratePatch(&Decoder, &wrongOffset, bytes, sizeof(bytes), 0x140001000, context, &output) && output.Error);
+
+		// Not enough room for the 5 byte call: inc dword ptr [rax]
+		const uint8_t shortBytes[] = { 0xFF, 0x00 };
+		TEST_CHECK(!GeneratePatch(&Decoder, &patch, shortBytes, sizeof(shortBytes), 0x140001000, context, &output) && output.Error);
+
+		TEST_CHECK(GeneratePatch(&Decoder, &patch, bytes, sizeof(bytes), 0x140001000, context, &output));
+
+		// Scratch register that the instruction itself uses
+		GeneratedPatch tampered = output;
+		tampered.Scratch = ZYDIS_REGISTER_RAX;
+		TEST_CHECK(!VerifyGeneratedPatch(&Decoder, &patch, context, &tampered));
+
+		// Epilogue restores the wrong register: pop rdi -> pop rax
+		tampered = output;
+		TEST_CHECK(tampered.Code[tampered.CodeSize - 2] == 0x5F);
+		tampered.Code[tampered.CodeSize - 2] = 0x58;
+		TEST_CHECK(!VerifyGeneratedPatch(&Decoder, &patch, context, &tampered));
+
+		// RIP-relative load that would point somewhere else once the block is copied: mov rax, [rip+0x100]
+		const uint8_t ripLoad[] = { 0x48, 0x8B, 0x05, 0x00, 0x01, 0x00, 0x00 };
+
+		tampered = output;
+		memmove(tampered.Code + 1 + sizeof(ripLoad), tampered.Code + 1, tampered.CodeSize - 1);
+		memcpy(tampered.Code + 1, ripLoad, sizeof(ripLoad));
+		tampered.CodeSize += sizeof(ripLoad);
+		TEST_CHECK(!VerifyGeneratedPatch(&Decoder, &patch, context, &tampered) && strstr(tampered.Error, "RIP"));
+	}
+
+	void TestCodeHook()
+	{
+		uint8_t hook[ZYDIS_MAX_INSTRUCTION_LENGTH];
+
+		// call +0xFB, then a 1 byte nop
+		TEST_CHECK(BuildCodeHook(0x140001000, 6, 0x140001100, hook));
+		TEST_CHECK(hook[0] == 0xE8 && hook[1] == 0xFB && hook[2] == 0x00 && hook[3] == 0x00 && hook[4] == 0x00 && hook[5] == 0x90);
+
+		// Backwards call, then a 4 byte nop
+		TEST_CHECK(BuildCodeHook(0x140001000, 9, 0x140000000, hook));
+		TEST_CHECK(hook[0] == 0xE8 && hook[1] == 0xFB && hook[2] == 0xEF && hook[3] == 0xFF && hook[4] == 0xFF);
+		TEST_CHECK(hook[5] == 0x0F && hook[6] == 0x1F && hook[8] == 0x00);
+
+		// Too short for a call, or too far for rel32
+		TEST_CHECK(!BuildCodeHook(0x140001000, 4, 0x140000000, hook));
+		TEST_CHECK(!BuildCodeHook(0x140001000, 6, 0x240001000, hook));
+	}
+}
+
+int main()
+{
+	ZydisDecoderInit(&Decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_ADDRESS_WIDTH_64);
+
+	TestPatchList();
+	TestRejects();
+	TestCodeHook();
+
+	printf("PatchCodeGenTest passed\n");
+	return 0;
+}
\ No newline at end of file
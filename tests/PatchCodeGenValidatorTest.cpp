@@ -0,0 +1,386 @@
+#include <chrono>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <asm/prctl.h>
+#include <unistd.h>
+#include "TestCommon.h"
+#include "PatchListTestCommon.h"
+#include "../skyrim64_test/src/patches/rendering/PatchCodeGenValidator.h"
+
+//
+// Runs PatchCodeGenValidator over the shipped patch list and over every patch type paired with every
+// register, operand size and addressing form the generator accepts, in TLS and original-globals mode. Linux
+// has no TEB, so gs is pointed at a fake one whose TLS slot array leads to the validator's TLS block. Then
+// checks that a wrong table offset, register or shufps immediate is caught, and prints how fast the shipped
+// list is generated and verified.
+//
+namespace
+{
+	const uintptr_t ModuleBase = 0x7FF600000000;
+	const uintptr_t GlobalsOffset = 0x304BEF0;
+	const uint32_t TlsIndex = 44;
+
+	ZydisDecoder Decoder;
+	uint8_t *Arena;
+
+	// gs:[0x58] -> ThreadLocalStoragePointer -> [TlsIndex] -> TLS block
+	uint64_t FakeTeb[32];
+	uint64_t TlsSlots[64];
+
+	bool IsImmediateType(PatchType Type)
+	{
+		return Type == PatchType::MOV_MEM_IMM || Type == PatchType::ADD_MEM_IMM || Type == PatchType::AND_MEM_IMM ||
+			Type == PatchType::CMP_MEM_IMM || Type == PatchType::OR_MEM_IMM;
+	}
+
+	bool IsXmmType(PatchType Type)
+	{
+		switch (Type)
+		{
+		case PatchType::MOVSS_REG_MEM:
+		case PatchType::MOVSS_MEM_REG:
+		case PatchType::SUBSS_REG_MEM:
+		case PatchType::ADDSS_REG_MEM:
+		case PatchType::MOVUPS_REG_MEM:
+		case PatchType::MOVUPS_MEM_REG:
+		case PatchType::MOVAPS_REG_MEM:
+		case PatchType::MOVAPS_MEM_REG:
+		case PatchType::SHUFPS_REG_MEM:
+		case PatchType::MOVSD_REG_MEM:
+		case PatchType::MOVSD_MEM_REG:
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+	std::vector<PatchEntry> EnumerateCombinations()
+	{
+		struct Addressing
+		{
+			ZydisRegister Base;
+			ZydisRegister Index;
+			uint32_t Scale;
+		};
+
+		const Addressing addressing[] =
+		{
+			{ ZYDIS_REGISTER_RIP, ZYDIS_REGISTER_NONE, 0 },
+			{ ZYDIS_REGISTER_RBX, ZYDIS_REGISTER_NONE, 0 },
+			{ ZYDIS_REGISTER_R13, ZYDIS_REGISTER_RCX, 4 },
+			{ ZYDIS_REGISTER_RAX, ZYDIS_REGISTER_RDI, 8 },
+		};
+
+		std::vector<PatchEntry> entries;
+
+		for (int type = (int)PatchType::MOV_REG_MEM; type <= (int)PatchType::XADD_MEM_REG; type++)
+		{
+			const PatchType patchType = (PatchType)type;
+			std::vector<std::pair<uint64_t, int>> operands;		// Register or immediate, memory size
+
+			if (IsXmmType(patchType))
+			{
+				int size = 128;
+
+				if (patchType == PatchType::MOVSS_REG_MEM || patchType == PatchType::MOVSS_MEM_REG || patchType == PatchType::ADDSS_REG_MEM || patchType == PatchType::SUBSS_REG_MEM)
+					size = 32;
+				else if (patchType == PatchType::MOVSD_REG_MEM || patchType == PatchType::MOVSD_MEM_REG)
+					size = 64;
+
+				for (int i = 0; i < 16; i++)
+					operands.emplace_back(ZYDIS_REGISTER_XMM0 + i, size);
+			}
+			else if (IsImmediateType(patchType) || patchType == PatchType::INC_MEM || patchType == PatchType::DEC_MEM)
+			{
+				for (int size : { 8, 16, 32, 64 })
+				{
+					for (uint64_t value : { 0x1ull, 0x7Full, 0x1234ull, 0x12345678ull, 0xFFFFFFFFull })
+					{
+						if (size >= 32 || value < (1ull << (size - 1)))
+							operands.emplace_back(value, size);
+					}
+				}
+			}
+			else if (patchType == PatchType::MOVZX_REG_MEM)
+			{
+				for (int size : { 8, 16 })
+				{
+					for (int r = ZYDIS_REGISTER_AX; r <= ZYDIS_REGISTER_R15D; r++)
+					{
+						if (r != ZYDIS_REGISTER_SP && r != ZYDIS_REGISTER_ESP)
+							operands.emplace_back(r, size);
+					}
+				}
+			}
+			else if (patchType == PatchType::MOVSXD_REG_MEM)
+			{
+				for (int r = ZYDIS_REGISTER_RAX; r <= ZYDIS_REGISTER_R15; r++)
+				{
+					if (r != ZYDIS_REGISTER_RSP)
+						operands.emplace_back(r, 32);
+				}
+			}
+			else
+			{
+				for (int r = ZYDIS_REGISTER_AL; r <= ZYDIS_REGISTER_R15; r++)
+				{
+					const int size = (r <= ZYDIS_REGISTER_R15B) ? 8 : (r <= ZYDIS_REGISTER_R15W) ? 16 : (r <= ZYDIS_REGISTER_R15D) ? 32 : 64;
+
+					if (r == ZYDIS_REGISTER_SPL || r == ZYDIS_REGISTER_SP || r == ZYDIS_REGISTER_ESP || r == ZYDIS_REGISTER_RSP)
+						continue;
+
+					if (patchType == PatchType::LEA_REG_MEM && size == 8)
+						continue;
+
+					operands.emplace_back(r, size);
+				}
+			}
+
+			for (auto& mode : addressing)
+			{
+				for (auto& [value, size] : operands)
+				{
+					PatchEntry entry = {};
+					entry.Type = patchType;
+					entry.ExeOffset = 0x100000 + entries.size() * 16;
+					entry.Immediate = value;
+					entry.Offset = 0x100 + (entries.size() % 64) * 16;
+					entry.MemSize = size;
+					entry.Base = mode.Base;
+					entry.Index = mode.Index;
+					entry.Scale = mode.Scale;
+
+					entries.push_back(entry);
+				}
+			}
+		}
+
+		return entries;
+	}
+
+	// Decoded memory operand size and whether xbyak encoded the register that was asked for
+	bool FixupRecordedEntry(PatchEntry *Entry, const std::vector<uint8_t>& Bytes)
+	{
+		ZydisDecodedInstruction instruction;
+		TEST_CHECK(ZYDIS_SUCCESS(ZydisDecoderDecodeBuffer(&Decoder, Bytes.data(), Bytes.size(), 0, &instruction)));
+
+		bool encodable = true;
+
+		for (uint32_t i = 0; i < instruction.operandCount; i++)
+		{
+			const ZydisDecodedOperand& operand = instruction.operands[i];
+
+			if (operand.visibility != ZYDIS_OPERAND_VISIBILITY_EXPLICIT)
+				continue;
+
+			if (operand.type == ZYDIS_OPERAND_TYPE_MEMORY)
+				Entry->MemSize = operand.size;
+
+			// AH/CH/DH/BH can't be encoded next to a REX prefix, xbyak silently emits SPL/BPL/SIL/DIL instead
+			if (operand.type == ZYDIS_OPERAND_TYPE_REGISTER && !IsImmediateType(Entry->Type))
+				encodable &= operand.reg.value == Entry->Register;
+		}
+
+		return encodable;
+	}
+
+	void TestPatchList(bool UseOriginalGlobals)
+	{
+		const PatchCodeGenContext context = { TlsIndex, 0x10, ModuleBase, GlobalsOffset, UseOriginalGlobals, &ShippedShufps };
+
+		PatchCodeGenValidator validator(Arena, context, 1234);
+		TlsSlots[TlsIndex] = validator.GetTlsBlock();
+
+		for (size_t i = 0; i < ShippedPatchCount; i++)
+		{
+			const PatchEntry& patch = ShippedPatches[i];
+			std::vector<uint8_t> bytes;
+
+			TEST_CHECK(RecordOriginalInstruction(patch, ModuleBase, GlobalsOffset, ShippedShufps, &bytes));
+
+			if (!validator.Validate(&Decoder, &patch, bytes.data(), bytes.size(), ModuleBase + patch.ExeOffset, 16))
+			{
+				fprintf(stderr, "%s mode, patch 0x%llX: %s\n", UseOriginalGlobals ? "globals" : "TLS", (unsigned long long)patch.ExeOffset, validator.GetError());
+				TEST_CHECK(false);
+			}
+		}
+	}
+
+	void TestCombinations(bool UseOriginalGlobals)
+	{
+		auto entries = EnumerateCombinations();
+		std::unordered_map<uintptr_t, int> shufps;
+
+		for (auto& entry : entries)
+		{
+			if (entry.Type == PatchType::SHUFPS_REG_MEM)
+				shufps[entry.ExeOffset] = (int)((entry.ExeOffset >> 4) & 0xFF);
+		}
+
+		const PatchCodeGenContext context = { TlsIndex, 0x10, ModuleBase, GlobalsOffset, UseOriginalGlobals, &shufps };
+
+		PatchCodeGenValidator validator(Arena, context, 99);
+		TlsSlots[TlsIndex] = validator.GetTlsBlock();
+
+		uint32_t validated = 0;
+
+		for (auto& entry : entries)
+		{
+			std::vector<uint8_t> bytes;
+
+			if (!RecordOriginalInstruction(entry, ModuleBase, GlobalsOffset, shufps, &bytes) || !FixupRecordedEntry(&entry, bytes))
+				continue;
+
+			// Combinations the generator doesn't support are refused up front, never miscompiled
+			if (validator.Validate(&Decoder, &entry, bytes.data(), bytes.size(), ModuleBase + entry.ExeOffset, 8))
+			{
+				validated++;
+				continue;
+			}
+
+			if (strcmp(validator.GetError(), "Code generation failed") == 0)
+				continue;
+
+			fprintf(stderr, "%s mode, type %d, register %s, base %s: %s\n", UseOriginalGlobals ? "globals" : "TLS", (int)entry.Type,
+				IsImmediateType(entry.Type) ? "imm" : ZydisRegisterGetString(entry.Register), ZydisRegisterGetString(entry.Base), validator.GetError());
+			TEST_CHECK(false);
+		}
+
+		// Most of them are supported
+		TEST_CHECK(validated > entries.size() / 2);
+	}
+
+	// GeneratePatch + VerifyGeneratedPatch throughput over the shipped list, single threaded. Printed, not checked.
+	void BenchmarkPatchList(bool UseOriginalGlobals)
+	{
+		const PatchCodeGenContext context = { TlsIndex, 0x10, ModuleBase, GlobalsOffset, UseOriginalGlobals, &ShippedShufps };
+		const int RoundCount = 20;
+
+		std::vector<std::vector<uint8_t>> recorded(ShippedPatchCount);
+
+		for (size_t i = 0; i < ShippedPatchCount; i++)
+			TEST_CHECK(RecordOriginalInstruction(ShippedPatches[i], ModuleBase, GlobalsOffset, ShippedShufps, &recorded[i]));
+
+		GeneratedPatch output;
+		size_t generated = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		for (int round = 0; round < RoundCount; round++)
+		{
+			for (size_t i = 0; i < ShippedPatchCount; i++)
+			{
+				const PatchEntry& patch = ShippedPatches[i];
+
+				if (GeneratePatch(&Decoder, &patch, recorded[i].data(), recorded[i].size(), ModuleBase + patch.ExeOffset, context, &output) &&
+					VerifyGeneratedPatch(&Decoder, &patch, context, &output))
+					generated++;
+			}
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		TEST_CHECK(generated == ShippedPatchCount * RoundCount);
+
+		const double seconds = std::chrono::duration<double>(end - start).count();
+
+		printf("%s mode: %.0f patches/s, %.2f ms per patch list (%zu patches)\n", UseOriginalGlobals ? "Globals" : "TLS",
+			generated / seconds, seconds * 1000.0 / RoundCount, ShippedPatchCount);
+	}
+
+	void TestMismatches()
+	{
+		const PatchCodeGenContext context = { TlsIndex, 0x10, ModuleBase, GlobalsOffset, false, &ShippedShufps };
+
+		PatchCodeGenValidator validator(Arena, context, 7);
+		TlsSlots[TlsIndex] = validator.GetTlsBlock();
+
+		auto validate = [&](const PatchEntry& Recorded, const PatchEntry& Table)
+		{
+			std::vector<uint8_t> bytes;
+			TEST_CHECK(RecordOriginalInstruction(Recorded, ModuleBase, GlobalsOffset, ShippedShufps, &bytes));
+
+			return validator.Validate(&Decoder, &Table, bytes.data(), bytes.size(), ModuleBase + Recorded.ExeOffset, 16);
+		};
+
+		// mov ecx, [rip + global+0x100] and mov [rbx + global+0x200], rdx
+		const PatchEntry load = { PatchType::MOV_REG_MEM, 0x1000, { (uint64_t)ZYDIS_REGISTER_ECX }, 0x100, 32, ZYDIS_REGISTER_RIP, ZYDIS_REGISTER_NONE, 0 };
+		const PatchEntry store = { PatchType::MOV_MEM_REG, 0x2000, { (uint64_t)ZYDIS_REGISTER_RDX }, 0x200, 64, ZYDIS_REGISTER_RBX, ZYDIS_REGISTER_NONE, 0 };
+
+		TEST_CHECK(validate(load, load));
+		TEST_CHECK(validate(store, store));
+
+		// Wrong offset in the table
+		PatchEntry wrong = load;
+		wrong.Offset += 8;
+		TEST_CHECK(!validate(load, wrong) && strstr(validator.GetError(), "rcx differs"));
+
+		wrong = store;
+		wrong.Offset += 8;
+		TEST_CHECK(!validate(store, wrong) && strstr(validator.GetError(), "Globals differ"));
+
+		// Wrong register
+		wrong = load;
+		wrong.Register = ZYDIS_REGISTER_EDX;
+		TEST_CHECK(!validate(load, wrong) && strstr(validator.GetError(), "differs"));
+
+		// Operands swapped: only the flags tell them apart
+		const PatchEntry compare = { PatchType::CMP_MEM_REG, 0x4000, { (uint64_t)ZYDIS_REGISTER_EDX }, 0x180, 32, ZYDIS_REGISTER_RIP, ZYDIS_REGISTER_NONE, 0 };
+
+		wrong = compare;
+		wrong.Type = PatchType::CMP_REG_MEM;
+		TEST_CHECK(validate(compare, compare));
+		TEST_CHECK(!validate(compare, wrong) && strstr(validator.GetError(), "Flags differ"));
+
+		// Wrong shufps immediate for the rewrite
+		const PatchEntry shuffle = { PatchType::SHUFPS_REG_MEM, 0x3000, { (uint64_t)ZYDIS_REGISTER_XMM3 }, 0x300, 128, ZYDIS_REGISTER_RIP, ZYDIS_REGISTER_NONE, 0 };
+		std::unordered_map<uintptr_t, int> shufps = { { 0x3000, 0x1B } };
+		std::unordered_map<uintptr_t, int> wrongShufps = { { 0x3000, 0x1A } };
+
+		std::vector<uint8_t> bytes;
+		TEST_CHECK(RecordOriginalInstruction(shuffle, ModuleBase, GlobalsOffset, shufps, &bytes));
+
+		PatchCodeGenContext shuffleContext = context;
+		shuffleContext.ShufpsImmediates = &shufps;
+
+		PatchCodeGenValidator shuffleValidator(Arena, shuffleContext, 8);
+		TlsSlots[TlsIndex] = shuffleValidator.GetTlsBlock();
+		TEST_CHECK(shuffleValidator.Validate(&Decoder, &shuffle, bytes.data(), bytes.size(), ModuleBase + shuffle.ExeOffset, 16));
+
+		shuffleContext.ShufpsImmediates = &wrongShufps;
+
+		PatchCodeGenValidator wrongValidator(Arena, shuffleContext, 8);
+		TlsSlots[TlsIndex] = wrongValidator.GetTlsBlock();
+		TEST_CHECK(!wrongValidator.Validate(&Decoder, &shuffle, bytes.data(), bytes.size(), ModuleBase + shuffle.ExeOffset, 16));
+		TEST_CHECK(strstr(wrongValidator.GetError(), "XMM3 differs"));
+
+		// An original that reads outside the sandbox is refused instead of run
+		PatchEntry far = load;
+		far.Offset = PatchCodeGenValidator::DataSize * 2;
+		TEST_CHECK(!validate(far, far) && strstr(validator.GetError(), "outside the sandbox"));
+	}
+}
+
+int main()
+{
+	ZydisDecoderInit(&Decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_ADDRESS_WIDTH_64);
+
+	Arena = (uint8_t *)mmap(nullptr, PatchCodeGenValidator::ArenaSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	TEST_CHECK(Arena != MAP_FAILED);
+
+	FakeTeb[0x58 / sizeof(uint64_t)] = (uint64_t)TlsSlots;
+	TEST_CHECK(syscall(SYS_arch_prctl, ARCH_SET_GS, (unsigned long)FakeTeb) == 0);
+
+	TestPatchList(false);
+	TestPatchList(true);
+	TestCombinations(false);
+	TestCombinations(true);
+	TestMismatches();
+	BenchmarkPatchList(false);
+	BenchmarkPatchList(true);
+
+	printf("PatchCodeGenValidatorTest passed\n");
+	return 0;
+}
\ No newline at end of file
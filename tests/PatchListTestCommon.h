@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "../skyrim64_test/src/patches/rendering/PatchCodeGen.h"
+
+//
+// The shipped TLS patch list, and a way to get the game instruction each entry replaces without the
+// game's executable: the instruction is re-encoded from the entry, with its memory operand pointed at the
+// recorded global. d3d11_tls_patchlist.inl is copied by CMake with MSVC's i64 literal suffix rewritten.
+//
+const PatchEntry ShippedPatches[] =
+{
+#define DO_THREADING_PATCH_REG(TYPE, EXE_OFFSET, REG, OFFSET, MEM_SIZE, B, I, S) { PatchType::TYPE, EXE_OFFSET, { (uint64_t)ZYDIS_REGISTER_##REG }, OFFSET, MEM_SIZE, ZYDIS_REGISTER_##B, ZYDIS_REGISTER_##I, S },
+#define DO_THREADING_PATCH_IMM(TYPE, EXE_OFFSET, IMM, OFFSET, MEM_SIZE, B, I, S) { PatchType::TYPE, EXE_OFFSET, { (uint64_t)IMM }, OFFSET, MEM_SIZE, ZYDIS_REGISTER_##B, ZYDIS_REGISTER_##I, S },
+#define DO_SHUFPS_FIXUP(EXE_OFFSET, IMM)
+
+#include "d3d11_tls_patchlist.inl"
+
+#undef DO_SHUFPS_FIXUP
+#undef DO_THREADING_PATCH_REG
+#undef DO_THREADING_PATCH_IMM
+};
+
+const std::unordered_map<uintptr_t, int> ShippedShufps
+({
+#define DO_THREADING_PATCH_REG(TYPE, EXE_OFFSET, REG, OFFSET, MEM_SIZE, B, I, S)
+#define DO_THREADING_PATCH_IMM(TYPE, EXE_OFFSET, IMM, OFFSET, MEM_SIZE, B, I, S)
+#define DO_SHUFPS_FIXUP(EXE_OFFSET, IMM) { EXE_OFFSET, IMM },
+
+#include "d3d11_tls_patchlist.inl"
+
+#undef DO_SHUFPS_FIXUP
+#undef DO_THREADING_PATCH_REG
+#undef DO_THREADING_PATCH_IMM
+});
+
+const size_t ShippedPatchCount = sizeof(ShippedPatches) / sizeof(ShippedPatches[0]);
+
+struct OriginalInstruction : public Xbyak::CodeGenerator
+{
+	// Displacement is the global's offset from the module base, or the RIP displacement for RIP-relative entries
+	OriginalInstruction(const PatchEntry& Patch, int64_t Displacement, const std::unordered_map<uintptr_t, int>& Shufps) : CodeGenerator(64)
+	{
+		const Xbyak::AddressFrame& frame = (Patch.MemSize == 8) ? byte : (Patch.MemSize == 16) ? word : (Patch.MemSize == 32) ? dword : (Patch.MemSize == 64) ? qword : xword;
+		const bool ripRelative = Patch.Base == ZYDIS_REGISTER_RIP;
+
+		Xbyak::RegExp address = ripRelative ? Xbyak::RegExp() : Xbyak::RegExp(Reg64(Patch.Base) + (uint32_t)Displacement);
+
+		if (!ripRelative && Patch.Index != ZYDIS_REGISTER_NONE)
+			address = Reg64(Patch.Base) + Reg64(Patch.Index) * std::max<uint32_t>(Patch.Scale, 1) + (uint32_t)Displacement;
+
+		const Xbyak::Address mem = ripRelative ? frame[rip + (int32_t)Displacement] : frame[address];
+		const Xbyak::Address anySize = ripRelative ? ptr[rip + (int32_t)Displacement] : ptr[address];
+		const uint32_t imm = (uint32_t)Patch.Immediate;
+
+		Xbyak::Reg reg;
+		Xbyak::Xmm xmm;
+
+		if (ZydisRegisterGetClass(Patch.Register) == ZYDIS_REGCLASS_XMM)
+			xmm = Xbyak::Xmm(Patch.Register - ZYDIS_REGISTER_XMM0);
+		else
+			reg = Reg(Patch.Register);
+
+		switch (Patch.Type)
+		{
+		case PatchType::MOV_REG_MEM: mov(reg, mem); break;
+		case PatchType::MOV_MEM_REG: mov(mem, reg); break;
+		case PatchType::MOV_MEM_IMM: mov(mem, imm); break;
+		case PatchType::ADD_REG_MEM: add(reg, mem); break;
+		case PatchType::ADD_MEM_REG: add(mem, reg); break;
+		case PatchType::ADD_MEM_IMM: add(mem, imm); break;
+		case PatchType::AND_REG_MEM: and_(reg, mem); break;
+		case PatchType::AND_MEM_REG: and_(mem, reg); break;
+		case PatchType::AND_MEM_IMM: and_(mem, imm); break;
+		case PatchType::CMP_REG_MEM: cmp(reg, mem); break;
+		case PatchType::CMP_MEM_REG: cmp(mem, reg); break;
+		case PatchType::CMP_MEM_IMM: cmp(mem, imm); break;
+		case PatchType::MOVSXD_REG_MEM: movsxd(Reg64(Patch.Register), mem); break;
+		case PatchType::MOVZX_REG_MEM: movzx(reg, mem); break;
+		case PatchType::LEA_REG_MEM: lea(reg, anySize); break;
+		case PatchType::OR_MEM_REG: or_(mem, reg); break;
+		case PatchType::OR_MEM_IMM: or_(mem, imm); break;
+		case PatchType::MOVSS_REG_MEM: movss(xmm, mem); break;
+		case PatchType::MOVSS_MEM_REG: movss(mem, xmm); break;
+		case PatchType::INC_MEM: inc(mem); break;
+		case PatchType::DEC_MEM: dec(mem); break;
+		case PatchType::SUBSS_REG_MEM: subss(xmm, mem); break;
+		case PatchType::ADDSS_REG_MEM: addss(xmm, mem); break;
+		case PatchType::MOVUPS_REG_MEM: movups(xmm, mem); break;
+		case PatchType::MOVUPS_MEM_REG: movups(mem, xmm); break;
+		case PatchType::MOVAPS_REG_MEM: movaps(xmm, mem); break;
+		case PatchType::MOVAPS_MEM_REG: movaps(mem, xmm); break;
+		case PatchType::SHUFPS_REG_MEM: shufps(xmm, mem, (uint8_t)Shufps.at(Patch.ExeOffset)); break;
+		case PatchType::MOVSD_REG_MEM: movsd(xmm, mem); break;
+		case PatchType::MOVSD_MEM_REG: movsd(mem, xmm); break;
+		case PatchType::XADD_MEM_REG: xadd(mem, reg); break;
+		}
+	}
+
+	static Xbyak::Reg64 Reg64(ZydisRegister Register)
+	{
+		return Xbyak::Reg64(Register - ZYDIS_REGISTER_RAX);
+	}
+
+	static Xbyak::Reg Reg(ZydisRegister Register)
+	{
+		if (Register >= ZYDIS_REGISTER_AH && Register <= ZYDIS_REGISTER_BH)
+			return Xbyak::Reg8(Register - ZYDIS_REGISTER_AH + 4);
+
+		if (Register >= ZYDIS_REGISTER_AL && Register <= ZYDIS_REGISTER_BL)
+			return Xbyak::Reg8(Register - ZYDIS_REGISTER_AL);
+
+		if (Register >= ZYDIS_REGISTER_SPL && Register <= ZYDIS_REGISTER_R15B)
+			return Xbyak::Reg8(Register - ZYDIS_REGISTER_SPL + 4, true);
+
+		if (Register >= ZYDIS_REGISTER_AX && Register <= ZYDIS_REGISTER_R15W)
+			return Xbyak::Reg16(Register - ZYDIS_REGISTER_AX);
+
+		if (Register >= ZYDIS_REGISTER_EAX && Register <= ZYDIS_REGISTER_R15D)
+			return Xbyak::Reg32(Register - ZYDIS_REGISTER_EAX);
+
+		return Reg64(Register);
+	}
+};
+
+// The bytes the game has at ModuleBase + Patch.ExeOffset, false if xbyak can't encode the entry
+inline bool RecordOriginalInstruction(const PatchEntry& Patch, uintptr_t ModuleBase, uintptr_t GlobalsOffset, const std::unordered_map<uintptr_t, int>& Shufps, std::vector<uint8_t> *Bytes)
+{
+	const int64_t globalOffset = (int64_t)(GlobalsOffset + Patch.Offset);
+
+	try
+	{
+		int64_t displacement = globalOffset;
+
+		if (Patch.Base == ZYDIS_REGISTER_RIP)
+		{
+			// The length doesn't depend on the displacement value, so a first pass gives the next RIP
+			OriginalInstruction probe(Patch, 0, Shufps);
+			displacement = (int64_t)(ModuleBase + globalOffset) - (int64_t)(ModuleBase + Patch.ExeOffset + probe.getSize());
+		}
+
+		OriginalInstruction instruction(Patch, displacement, Shufps);
+		Bytes->assign(instruction.getCode(), instruction.getCode() + instruction.getSize());
+		return true;
+	}
+	catch (const Xbyak::Error&)
+	{
+		return false;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,423 @@
+#include <stdarg.h>
+#include <string.h>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/CKSSE/PeepholeOptimizer.h"
+
+//
+// Runs the matcher over hand-assembled debug-build functions and checks the rewritten bodies byte for
+// byte, then runs Scan()/Apply() over small synthetic modules to check which branch sites are decoded,
+// which targets count as function starts and what ends up patched.
+//
+namespace
+{
+	using Bytes = std::vector<uint8_t>;
+	using Kind = PeepholeOptimizer::FunctionKind;
+
+	const uint64_t ModuleBase = 0x140001000;
+
+	struct MatcherCase
+	{
+		const char *Name;
+		Bytes Code;
+		bool Accepted;
+		Kind ExpectedKind;
+		Bytes Body;
+	};
+
+	const Bytes VarargsStub =
+	{
+		0x4C, 0x89, 0x4C, 0x24, 0x20,			// mov [rsp+20h], r9
+		0x4C, 0x89, 0x44, 0x24, 0x18,			// mov [rsp+18h], r8
+		0x48, 0x89, 0x54, 0x24, 0x10,			// mov [rsp+10h], rdx
+		0x89, 0x4C, 0x24, 0x08,					// mov [rsp+8], ecx
+		0xC3,									// ret
+	};
+
+	const Bytes VarargsFrameStub =
+	{
+		0x4C, 0x89, 0x4C, 0x24, 0x20,			// mov [rsp+20h], r9
+		0x4C, 0x89, 0x44, 0x24, 0x18,			// mov [rsp+18h], r8
+		0x48, 0x89, 0x54, 0x24, 0x10,			// mov [rsp+10h], rdx
+		0x89, 0x4C, 0x24, 0x08,					// mov [rsp+8], ecx
+		0x48, 0x83, 0xEC, 0x28,					// sub rsp, 28h
+		0x48, 0x83, 0xC4, 0x28,					// add rsp, 28h
+		0xC3,									// ret
+	};
+
+	const MatcherCase MatcherCases[] =
+	{
+		// Every signature in the fixed NullsubPatch table
+		{ "retn 0", { 0xC2, 0x00, 0x00 }, true, Kind::Nullsub, {} },
+		{ "ret", { 0xC3 }, true, Kind::Nullsub, {} },
+		{ "spill rcx", { 0x48, 0x89, 0x4C, 0x24, 0x08, 0xC3 }, true, Kind::Nullsub, {} },
+		{ "spill rdx rcx", { 0x48, 0x89, 0x54, 0x24, 0x10, 0x48, 0x89, 0x4C, 0x24, 0x08, 0xC3 }, true, Kind::Nullsub, {} },
+		{ "frame and nop", { 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x83, 0xEC, 0x28, 0x48, 0x8B, 0x4C, 0x24, 0x30, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0x48, 0x83, 0xC4, 0x28, 0xC3 }, true, Kind::Nullsub, {} },
+		{ "return this", { 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0xC3 }, true, Kind::Getter, { 0x48, 0x89, 0xC8 } },
+
+		// An empty varargs function only spills its arguments. Before its hook is installed it really is a
+		// nullsub, which is why the pass has to run after every hook.
+		{ "varargs stub", VarargsStub, true, Kind::Nullsub, {} },
+		{ "varargs stub with frame", VarargsFrameStub, true, Kind::Nullsub, {} },
+
+		// Getters
+		{ "get qword [rcx]", { 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x48, 0x8B, 0x00, 0xC3 }, true, Kind::Getter, { 0x48, 0x8B, 0x01 } },
+		{ "get qword [rcx+8]", { 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x48, 0x8B, 0x40, 0x08, 0xC3 }, true, Kind::Getter, { 0x48, 0x8B, 0x41, 0x08 } },
+		{ "get dword [rcx]", { 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x8B, 0x00, 0xC3 }, true, Kind::Getter, { 0x8B, 0x01 } },
+		{ "get byte [rcx+26h]", { 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x0F, 0xB6, 0x40, 0x26, 0xC3 }, true, Kind::Getter, { 0x0F, 0xB6, 0x41, 0x26 } },
+
+		// movzx eax, word [rcx+rdx*2] with a 32-bit index: the upper half of rdx has to be cleared first
+		{ "get word [rcx+rdx*2]", { 0x89, 0x54, 0x24, 0x10, 0x48, 0x89, 0x4C, 0x24, 0x08, 0x8B, 0x44, 0x24, 0x10, 0x48, 0x8B, 0x4C, 0x24, 0x08, 0x0F, 0xB7, 0x04, 0x41, 0xC3 }, true, Kind::Getter, { 0x89, 0xD0, 0x0F, 0xB7, 0x04, 0x41 } },
+
+		// cmp dword [rcx+8], 0; setne al
+		{ "bool getter", { 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x83, 0x78, 0x08, 0x00, 0x0F, 0x95, 0xC0, 0xC3 }, true, Kind::Getter, { 0x83, 0x79, 0x08, 0x00, 0x0F, 0x95, 0xC0 } },
+
+		// Read-modify-write on a reloaded argument materializes it in rax first
+		{ "this + 8", { 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x48, 0x83, 0xC0, 0x08, 0xC3 }, true, Kind::Getter, { 0x48, 0x89, 0xC8, 0x48, 0x83, 0xC0, 0x08 } },
+
+		// mov [rcx+8], edx; rax still holds this
+		{ "setter", { 0x89, 0x54, 0x24, 0x10, 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x8B, 0x4C, 0x24, 0x10, 0x89, 0x48, 0x08, 0xC3 }, true, Kind::Setter, { 0x89, 0x51, 0x08, 0x48, 0x89, 0xC8 } },
+
+		// Rejected
+		{ "call", { 0xE8, 0x00, 0x00, 0x00, 0x00, 0xC3 }, false, Kind::Nullsub, {} },
+		{ "branch", { 0x74, 0x01, 0xC3, 0xC3 }, false, Kind::Nullsub, {} },
+		{ "push/pop", { 0x53, 0x5B, 0xC3 }, false, Kind::Nullsub, {} },
+		{ "rip-relative", { 0x48, 0x8B, 0x05, 0x10, 0x00, 0x00, 0x00, 0xC3 }, false, Kind::Nullsub, {} },
+		{ "writes rbx", { 0x48, 0x8B, 0xD9, 0xC3 }, false, Kind::Nullsub, {} },
+		{ "reads stack argument", { 0x48, 0x8B, 0x44, 0x24, 0x28, 0xC3 }, false, Kind::Nullsub, {} },
+		{ "32-bit spill reloaded as 64", { 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x48, 0x8B, 0x00, 0xC3 }, false, Kind::Nullsub, {} },
+		{ "unbalanced frame", { 0x48, 0x83, 0xEC, 0x28, 0xC3 }, false, Kind::Nullsub, {} },
+		{ "gs: access", { 0x65, 0x48, 0x8B, 0x04, 0x25, 0x58, 0x00, 0x00, 0x00, 0xC3 }, false, Kind::Nullsub, {} },
+		{ "no ret", { 0x48, 0x89, 0x4C, 0x24, 0x08 }, false, Kind::Nullsub, {} },
+
+		// What a detour leaves at the start of a hooked function
+		{ "detour jmp rel32", { 0xE9, 0x00, 0x10, 0x00, 0x00, 0x89, 0x4C, 0x24, 0x08, 0xC3 }, false, Kind::Nullsub, {} },
+		{ "detour jmp [rip]", { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x40, 0x01, 0x00, 0x00, 0x00, 0xC3 }, false, Kind::Nullsub, {} },
+		{ "detour mov rax, jmp rax", { 0x48, 0xB8, 0x00, 0x10, 0x00, 0x40, 0x01, 0x00, 0x00, 0x00, 0xFF, 0xE0, 0xC3 }, false, Kind::Nullsub, {} },
+	};
+
+	void TestMatcher()
+	{
+		PeepholeOptimizer optimizer;
+
+		for (const MatcherCase& test : MatcherCases)
+		{
+			PeepholeOptimizer::LeafFunction function = {};
+			const bool accepted = optimizer.AnalyzeFunction(test.Code.data(), test.Code.size(), &function);
+
+			if (accepted != test.Accepted)
+			{
+				fprintf(stderr, "%s: expected %s\n", test.Name, test.Accepted ? "accept" : "reject");
+				TEST_CHECK(false);
+			}
+
+			if (!accepted)
+				continue;
+
+			if (function.Kind != test.ExpectedKind || function.OriginalLength != test.Code.size() ||
+				function.BodyLength != test.Body.size() || memcmp(function.Body, test.Body.data(), test.Body.size()) != 0)
+			{
+				fprintf(stderr, "%s: kind %d, length %u, body", test.Name, (int)function.Kind, function.OriginalLength);
+
+				for (uint32_t i = 0; i < function.BodyLength; i++)
+					fprintf(stderr, " %02X", function.Body[i]);
+
+				fprintf(stderr, "\n");
+				TEST_CHECK(false);
+			}
+		}
+	}
+
+	// A small module: code is appended in order and branches are patched once every label is known
+	struct Module
+	{
+		Bytes Code;
+
+		size_t Emit(const Bytes& Data)
+		{
+			const size_t offset = Code.size();
+			Code.insert(Code.end(), Data.begin(), Data.end());
+			return offset;
+		}
+
+		size_t EmitBranch(uint8_t Opcode)
+		{
+			return Emit({ Opcode, 0x00, 0x00, 0x00, 0x00 });
+		}
+
+		void Link(size_t Site, size_t Target)
+		{
+			const int32_t displacement = (int32_t)(Target - (Site + 5));
+			memcpy(&Code[Site + 1], &displacement, sizeof(displacement));
+		}
+	};
+
+	const PeepholeOptimizer::Candidate *FindCandidate(const PeepholeOptimizer& Optimizer, size_t Offset)
+	{
+		for (auto& candidate : Optimizer.GetCandidates())
+		{
+			if (candidate.Address == ModuleBase + Offset)
+				return &candidate;
+		}
+
+		return nullptr;
+	}
+
+	PeepholeOptimizer::FunctionRange Range(size_t Start, size_t End)
+	{
+		return { ModuleBase + Start, ModuleBase + End };
+	}
+
+	void TestScanAndApply()
+	{
+		const Bytes getter = { 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x48, 0x8B, 0x40, 0x08, 0xC3 };
+		const Bytes setter = { 0x89, 0x54, 0x24, 0x10, 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x8B, 0x4C, 0x24, 0x10, 0x89, 0x48, 0x08, 0xC3 };
+
+		// call getter; call setter; jmp getter
+		Module module;
+		const size_t callGetter = module.EmitBranch(0xE8);
+		const size_t callSetter = module.EmitBranch(0xE8);
+		const size_t jumpGetter = module.EmitBranch(0xE9);
+		module.Emit({ 0xCC, 0xCC, 0xCC });
+		const size_t getterStart = module.Emit(getter);
+		module.Emit({ 0xCC, 0xCC, 0xCC });
+		const size_t setterStart = module.Emit(setter);
+		module.Emit({ 0xCC });
+
+		module.Link(callGetter, getterStart);
+		module.Link(callSetter, setterStart);
+		module.Link(jumpGetter, getterStart);
+
+		// Only the caller has unwind data, the leaf functions are found through the padding before them
+		PeepholeOptimizer optimizer;
+		optimizer.Scan(module.Code.data(), module.Code.size(), ModuleBase, { Range(0, jumpGetter + 5) });
+
+		const auto& stats = optimizer.GetStatistics();
+		TEST_CHECK(stats.BranchSites == 3);
+		TEST_CHECK(stats.Candidates[(size_t)Kind::Getter] == 1 && stats.Candidates[(size_t)Kind::Setter] == 1);
+		TEST_CHECK(stats.InlinedSites == 2 && stats.ShortenedFunctions == 2);
+
+		// The setter body is 6 bytes, so its call is left alone
+		const auto *setterCandidate = FindCandidate(optimizer, setterStart);
+		TEST_CHECK(setterCandidate && setterCandidate->SkippedSites == 1 && setterCandidate->CallSites == 0);
+
+		optimizer.Apply(module.Code.data());
+
+		Module expected;
+		expected.Emit({ 0x48, 0x8B, 0x41, 0x08, 0x90 });					// mov rax, [rcx+8]; nop
+		expected.Emit({ 0xE8, 0x1A, 0x00, 0x00, 0x00 });					// call setter
+		expected.Emit({ 0x48, 0x8B, 0x41, 0x08, 0xC3 });					// mov rax, [rcx+8]; ret
+		expected.Emit({ 0xCC, 0xCC, 0xCC });
+
+		// Both functions are cut down to their body and a ret, the rest is filled with int3
+		expected.Emit({ 0x48, 0x8B, 0x41, 0x08, 0xC3 });
+		expected.Emit(Bytes(getter.size() - 5, 0xCC));
+		expected.Emit({ 0xCC, 0xCC, 0xCC });
+		expected.Emit({ 0x89, 0x51, 0x08, 0x48, 0x89, 0xC8, 0xC3 });
+		expected.Emit(Bytes(setter.size() - 7, 0xCC));
+		expected.Emit({ 0xCC });
+
+		TEST_CHECK(module.Code == expected.Code);
+	}
+
+	void TestHookedVarargsStub()
+	{
+		// Calls to a warning stub. Once hooked, it starts with the detour's jump and the calls must survive.
+		for (const Bytes& detour : { Bytes{ 0xE9, 0x00, 0x10, 0x00, 0x00 }, Bytes{ 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x40, 0x01, 0x00, 0x00, 0x00 } })
+		{
+			for (const Bytes *stub : { &VarargsStub, &VarargsFrameStub })
+			{
+				Module module;
+				const size_t call1 = module.EmitBranch(0xE8);
+				const size_t call2 = module.EmitBranch(0xE8);
+				module.Emit({ 0xC3, 0xCC, 0xCC });
+
+				const size_t stubStart = module.Emit(*stub);
+				memcpy(&module.Code[stubStart], detour.data(), std::min(detour.size(), stub->size()));
+				module.Emit({ 0xCC, 0xCC, 0xCC, 0xCC });
+
+				module.Link(call1, stubStart);
+				module.Link(call2, stubStart);
+
+				const Bytes original = module.Code;
+
+				PeepholeOptimizer optimizer;
+				optimizer.Scan(module.Code.data(), module.Code.size(), ModuleBase, { Range(0, call2 + 6) });
+				optimizer.Apply(module.Code.data());
+
+				TEST_CHECK(optimizer.GetStatistics().BranchSites == 2);
+				TEST_CHECK(optimizer.GetCandidates().empty());
+				TEST_CHECK(module.Code == original);
+			}
+		}
+
+		// Unhooked, the same stub's calls are removed
+		Module module;
+		const size_t call = module.EmitBranch(0xE8);
+		module.Emit({ 0xC3, 0xCC });
+		const size_t stubStart = module.Emit(VarargsStub);
+		module.Link(call, stubStart);
+
+		PeepholeOptimizer optimizer;
+		optimizer.Scan(module.Code.data(), module.Code.size(), ModuleBase, { Range(0, call + 6) });
+		TEST_CHECK(optimizer.GetStatistics().Candidates[(size_t)Kind::Nullsub] == 1 && optimizer.GetStatistics().InlinedSites == 1);
+	}
+
+	void TestFunctionStarts()
+	{
+		const Bytes getter = { 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x48, 0x8B, 0x00, 0xC3 };
+
+		Module module;
+		const size_t callModRM = module.EmitBranch(0xE8);
+		const size_t callAfterRet = module.EmitBranch(0xE8);
+		const size_t callPdata = module.EmitBranch(0xE8);
+		const size_t callInside = module.EmitBranch(0xE8);
+		const size_t callerEnd = module.Emit({ 0xC3 }) + 1;
+		module.Emit({ 0xCC, 0xCC, 0xCC });
+
+		// mov eax, ebx ends in a C3 ModRM byte, followed by what looks like a getter
+		const size_t modrmFunction = module.Emit({ 0x48, 0x89, 0x4C, 0x24, 0x08, 0x8B, 0xC3 });
+		const size_t afterModRM = module.Emit(getter);
+		module.Emit({ 0xCC, 0xCC });
+
+		// A leaf function directly after another function's ret, no padding
+		const size_t beforeAfterRet = module.Emit({ 0x48, 0x8B, 0xC1, 0xC3 });
+		const size_t afterRet = module.Emit(getter);
+		module.Emit({ 0xCC });
+
+		// Starts of .pdata functions count even without padding. The second one has its own range, and a
+		// target inside it isn't a function start even though it follows a ret.
+		module.Emit({ 0x90 });
+		const size_t pdataGetter = module.Emit(getter);
+		module.Emit({ 0x48, 0x8B, 0xC1, 0xC3 });
+		const size_t inside = module.Emit(getter);
+		const size_t pdataEnd = module.Code.size();
+		module.Emit({ 0xCC });
+
+		module.Link(callModRM, afterModRM);
+		module.Link(callAfterRet, afterRet);
+		module.Link(callPdata, pdataGetter);
+		module.Link(callInside, inside);
+
+		const std::vector<PeepholeOptimizer::FunctionRange> functions =
+		{
+			Range(0, callerEnd),
+			Range(modrmFunction, afterModRM + getter.size()),
+			Range(beforeAfterRet, afterRet),
+			Range(pdataGetter, pdataEnd),
+		};
+
+		// Without unwind data nothing is decoded, so there are no sites at all
+		PeepholeOptimizer optimizer;
+		optimizer.Scan(module.Code.data(), module.Code.size(), ModuleBase, {});
+
+		TEST_CHECK(optimizer.GetStatistics().Instructions == 0 && optimizer.GetStatistics().BranchSites == 0);
+		TEST_CHECK(optimizer.GetCandidates().empty());
+
+		// Outside the .pdata ranges only padding and decoded rets mark a start
+		optimizer.Scan(module.Code.data(), module.Code.size(), ModuleBase, functions);
+
+		TEST_CHECK(!FindCandidate(optimizer, afterModRM));
+		TEST_CHECK(FindCandidate(optimizer, afterRet));
+		TEST_CHECK(FindCandidate(optimizer, pdataGetter));
+		TEST_CHECK(!FindCandidate(optimizer, inside));
+		TEST_CHECK(optimizer.GetStatistics().BranchSites == 2);
+	}
+
+	void TestDataInText()
+	{
+		const Bytes getter = { 0x48, 0x89, 0x4C, 0x24, 0x08, 0x48, 0x8B, 0x44, 0x24, 0x08, 0x48, 0x8B, 0x40, 0x08, 0xC3 };
+		const Bytes inlined = { 0x48, 0x8B, 0x41, 0x08, 0x90 };
+
+		// call getter; je block; jmp short over embedded data; call getter; ret
+		// block: call getter; ret
+		// followed by a jump table entry that's still inside the .pdata range
+		Module module;
+		const size_t call = module.EmitBranch(0xE8);
+		const size_t branch = module.Emit({ 0x74, 0x00 });
+		module.Emit({ 0xEB, 0x05 });
+		const size_t embedded = module.EmitBranch(0xE8);
+		const size_t afterData = module.EmitBranch(0xE8);
+		module.Emit({ 0xC3 });
+		const size_t block = module.EmitBranch(0xE8);
+		module.Emit({ 0xC3 });
+		const size_t jumpTable = module.EmitBranch(0xE8);
+		const size_t callerEnd = module.Code.size();
+		module.Emit({ 0xCC, 0xCC });
+
+		// Data between functions, outside every range
+		const size_t between = module.EmitBranch(0xE9);
+		module.Emit({ 0xCC });
+		const size_t getterStart = module.Emit(getter);
+		module.Emit({ 0xCC });
+
+		module.Code[branch + 1] = (uint8_t)(block - (branch + 2));
+
+		for (size_t site : { call, embedded, afterData, block, jumpTable, between })
+			module.Link(site, getterStart);
+
+		const Bytes original = module.Code;
+
+		PeepholeOptimizer optimizer;
+		optimizer.Scan(module.Code.data(), module.Code.size(), ModuleBase, { Range(0, callerEnd) });
+		optimizer.Apply(module.Code.data());
+
+		TEST_CHECK(optimizer.GetStatistics().BranchSites == 3 && optimizer.GetStatistics().InlinedSites == 3);
+
+		for (size_t site : { call, afterData, block })
+			TEST_CHECK(memcmp(&module.Code[site], inlined.data(), inlined.size()) == 0);
+
+		for (size_t site : { embedded, jumpTable, between })
+			TEST_CHECK(memcmp(&module.Code[site], &original[site], 5) == 0);
+
+		// A branch into the middle of a decoded call means the function was misread. None of its sites are used.
+		Module overlap;
+		const size_t overlapCall = overlap.EmitBranch(0xE8);
+		overlap.Emit({ 0x74, (uint8_t)(overlapCall + 2 - (overlapCall + 7)) });
+		overlap.Emit({ 0xC3 });
+		const size_t overlapEnd = overlap.Code.size();
+		overlap.Emit({ 0xCC });
+		overlap.Link(overlapCall, overlap.Emit(getter));
+
+		const Bytes overlapOriginal = overlap.Code;
+
+		optimizer.Scan(overlap.Code.data(), overlap.Code.size(), ModuleBase, { Range(0, overlapEnd) });
+		optimizer.Apply(overlap.Code.data());
+
+		TEST_CHECK(optimizer.GetStatistics().BranchSites == 0);
+		TEST_CHECK(overlap.Code == overlapOriginal);
+	}
+
+	void Log(const char *Format, ...)
+	{
+		va_list va;
+		va_start(va, Format);
+		vprintf(Format, va);
+		va_end(va);
+	}
+
+	void TestReport()
+	{
+		Module module;
+		const size_t call = module.EmitBranch(0xE8);
+		module.Emit({ 0xC3, 0xCC });
+		module.Link(call, module.Emit({ 0x48, 0x89, 0x4C, 0x24, 0x08, 0xC3 }));
+
+		PeepholeOptimizer optimizer;
+		optimizer.Scan(module.Code.data(), module.Code.size(), ModuleBase, { Range(0, call + 6) });
+		optimizer.WriteReport(Log, true);
+	}
+}
+
+int main()
+{
+	TestMatcher();
+	TestScanAndApply();
+	TestHookedVarargsStub();
+	TestFunctionStarts();
+	TestDataInText();
+	TestReport();
+
+	printf("PeepholeOptimizerTest passed\n");
+	return 0;
+}
\ No newline at end of file
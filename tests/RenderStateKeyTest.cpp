@@ -0,0 +1,293 @@
+#include <chrono>
+#include <random>
+#include <stddef.h>
+#include <string.h>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/rendering/RenderStateKey.h"
+
+//
+// Checks the RenderStateKey bit layout against the sizes of the game's state tables, then replays a
+// synthetic draw stream through the same filter SyncD3DState uses. The game re-sets state it already
+// has all the time, so most dirty flags in the stream are redundant. The stream also changes the blend
+// factor on its own, and binds state objects or clears the context behind the filter the way the context
+// proxy sees it. Every draw must still see the state it asked for. Call counts and the cost of building a
+// key are printed for reference.
+//
+namespace
+{
+	// Table sizes from m_DepthStates[6][40], m_RasterStates[2][3][12][2] and m_BlendStates[7][2][13][2]
+	const RenderStateFields MaxFields = { 0xFF, 5, 39, 1, 2, 11, 1, 6, 1, 12, 1, {} };
+
+	enum StateGroup
+	{
+		DEPTH_STENCIL,
+		RASTER,
+		BLEND,
+		GROUP_COUNT,
+	};
+
+	const uint64_t GroupMasks[GROUP_COUNT] =
+	{
+		RenderStateKey::DepthStencilMask,
+		RenderStateKey::RasterMask,
+		RenderStateKey::BlendMask,
+	};
+
+	uint32_t& GetField(RenderStateFields& Fields, int Index)
+	{
+		return (&Fields.StencilRef)[Index];
+	}
+
+	uint32_t GetMaxField(int Index)
+	{
+		return (&MaxFields.StencilRef)[Index];
+	}
+
+	StateGroup GetFieldGroup(int Index)
+	{
+		if (Index <= 2)
+			return DEPTH_STENCIL;
+
+		return (Index <= 6) ? RASTER : BLEND;
+	}
+
+	const int FieldCount = offsetof(RenderStateFields, BlendFactor) / sizeof(uint32_t);
+
+	RenderStateFields RandomFields(std::mt19937& Random)
+	{
+		RenderStateFields fields = {};
+
+		for (int i = 0; i < FieldCount; i++)
+			GetField(fields, i) = Random() % (GetMaxField(i) + 1);
+
+		return fields;
+	}
+
+	void TestLayout()
+	{
+		TEST_CHECK((RenderStateKey::DepthStencilMask & RenderStateKey::RasterMask) == 0);
+		TEST_CHECK((RenderStateKey::DepthStencilMask & RenderStateKey::BlendMask) == 0);
+		TEST_CHECK((RenderStateKey::RasterMask & RenderStateKey::BlendMask) == 0);
+
+		// Each field, at every value its table allows, stays inside its own group
+		for (int i = 0; i < FieldCount; i++)
+		{
+			const uint32_t maxValue = (i == 0) ? 0xFFFFFFFF : GetMaxField(i);
+			const uint64_t mask = GroupMasks[GetFieldGroup(i)];
+
+			for (uint32_t bit = 0; bit < 32; bit++)
+			{
+				if ((1ull << bit) > maxValue)
+					break;
+
+				RenderStateFields fields = {};
+				GetField(fields, i) = 1u << bit;
+
+				const uint64_t key = RenderStateKey::Pack(fields).Key;
+				TEST_CHECK(key != 0);
+				TEST_CHECK((key & ~mask) == 0);
+			}
+		}
+
+		// No two fields share a bit
+		uint64_t fieldBits[FieldCount] = {};
+
+		for (int i = 0; i < FieldCount; i++)
+		{
+			RenderStateFields fields = {};
+			GetField(fields, i) = (i == 0) ? 0xFFFFFFFF : GetMaxField(i);
+
+			// Every bit up to the highest one a table index can use
+			while (GetField(fields, i) & (GetField(fields, i) + 1))
+				GetField(fields, i) |= GetField(fields, i) >> 1;
+
+			fieldBits[i] = RenderStateKey::Pack(fields).Key;
+
+			for (int j = 0; j < i; j++)
+				TEST_CHECK((fieldBits[i] & fieldBits[j]) == 0);
+		}
+
+		// Distinct field values give distinct keys
+		std::mt19937 random(1);
+
+		for (int i = 0; i < 10000; i++)
+		{
+			RenderStateFields a = RandomFields(random);
+			RenderStateFields b = RandomFields(random);
+			bool same = true;
+
+			for (int j = 0; j < FieldCount; j++)
+				same &= GetField(a, j) == GetField(b, j);
+
+			TEST_CHECK(same == (RenderStateKey::Pack(a).Key == RenderStateKey::Pack(b).Key));
+			TEST_CHECK(same == (RenderStateKey::GetChangedGroups(RenderStateKey::Pack(a), RenderStateKey::Pack(b)) == 0));
+
+			// A freshly reset context has to re-apply every group
+			PackedRenderState applied = RenderStateKey::Pack(b);
+			RenderStateKey::Invalidate(&applied, RenderStateKey::AllMask);
+			TEST_CHECK(RenderStateKey::GetChangedGroups(applied, RenderStateKey::Pack(a)) == RenderStateKey::AllMask);
+
+			// Invalidating or applying one group leaves the others alone, whatever they held
+			for (uint64_t mask : GroupMasks)
+			{
+				PackedRenderState partial = RenderStateKey::Pack(a);
+				RenderStateKey::Invalidate(&partial, mask);
+				TEST_CHECK(RenderStateKey::GetChangedGroups(partial, RenderStateKey::Pack(a)) == mask);
+
+				partial = applied;
+				RenderStateKey::Apply(&partial, RenderStateKey::Pack(a), mask);
+				TEST_CHECK(RenderStateKey::GetChangedGroups(partial, RenderStateKey::Pack(a)) == (RenderStateKey::AllMask & ~mask));
+			}
+		}
+	}
+
+	void TestBlendFactor()
+	{
+		std::mt19937 random(3);
+		RenderStateFields fields = RandomFields(random);
+		const PackedRenderState applied = RenderStateKey::Pack(fields);
+
+		for (int i = 0; i < 4; i++)
+		{
+			RenderStateFields changed = fields;
+			changed.BlendFactor[i] = 0.5f;
+
+			const PackedRenderState state = RenderStateKey::Pack(changed);
+			TEST_CHECK(state.Key == applied.Key);
+			TEST_CHECK(RenderStateKey::GetChangedGroups(applied, state) == RenderStateKey::BlendMask);
+
+			// The factor is only taken over when the blend group is applied
+			PackedRenderState partial = applied;
+			RenderStateKey::Apply(&partial, state, RenderStateKey::DepthStencilMask | RenderStateKey::RasterMask);
+			TEST_CHECK(RenderStateKey::GetChangedGroups(partial, state) == RenderStateKey::BlendMask);
+
+			RenderStateKey::Apply(&partial, state, RenderStateKey::BlendMask);
+			TEST_CHECK(RenderStateKey::GetChangedGroups(partial, state) == 0);
+		}
+	}
+
+	struct BoundState
+	{
+		PackedRenderState Groups[GROUP_COUNT];	// What each OMSet*/RSSet* call last bound
+		bool Known[GROUP_COUNT];				// Set by the game through SyncD3DState since the last outside change
+	};
+
+	// Whatever an outside OMSet*/RSSet* call or ClearState left bound
+	const PackedRenderState Garbage = { RenderStateKey::Invalid, { 1, 2, 3, 4 } };
+
+	void TestReplay()
+	{
+		const int DrawCount = 200000;
+
+		std::mt19937 random(2);
+		RenderStateFields fields = RandomFields(random);
+
+		PackedRenderState applied;
+		RenderStateKey::Invalidate(&applied, RenderStateKey::AllMask);
+
+		BoundState bound = {};
+		uint64_t naiveCalls = 0;
+		uint64_t filteredCalls = 0;
+
+		for (int draw = 0; draw < DrawCount; draw++)
+		{
+			bool dirty[GROUP_COUNT] = {};
+
+			// A pass usually sets a handful of states, and most of them to what's already there
+			for (int set = random() % 4; set > 0; set--)
+			{
+				const int field = random() % FieldCount;
+
+				if (random() % 8 == 0)
+					GetField(fields, field) = random() % (GetMaxField(field) + 1);
+
+				dirty[GetFieldGroup(field)] = true;
+			}
+
+			if (random() % 16 == 0)
+			{
+				fields.BlendFactor[random() % 4] = (random() % 4) * 0.25f;
+				dirty[BLEND] = true;
+			}
+
+			// State set straight on the context proxy, or the context cleared
+			if (random() % 64 == 0)
+			{
+				const int group = random() % (GROUP_COUNT + 1);
+
+				for (int i = 0; i < GROUP_COUNT; i++)
+				{
+					if (group == GROUP_COUNT || group == i)
+					{
+						bound.Groups[i] = Garbage;
+						bound.Known[i] = false;
+						RenderStateKey::Invalidate(&applied, GroupMasks[i]);
+					}
+				}
+			}
+
+			// Same decision as SyncD3DState. Its own calls go through the proxy as well.
+			const PackedRenderState state = RenderStateKey::Pack(fields);
+			const uint64_t changed = RenderStateKey::GetChangedGroups(applied, state);
+			uint64_t appliedGroups = 0;
+
+			for (int group = 0; group < GROUP_COUNT; group++)
+			{
+				if (!dirty[group])
+					continue;
+
+				naiveCalls++;
+				bound.Known[group] = true;
+
+				if (changed & GroupMasks[group])
+				{
+					bound.Groups[group] = state;
+					RenderStateKey::Invalidate(&applied, GroupMasks[group]);
+
+					appliedGroups |= GroupMasks[group];
+					filteredCalls++;
+				}
+			}
+
+			RenderStateKey::Apply(&applied, state, appliedGroups);
+
+			for (int group = 0; group < GROUP_COUNT; group++)
+			{
+				if (!bound.Known[group])
+					continue;
+
+				TEST_CHECK((bound.Groups[group].Key & GroupMasks[group]) == (state.Key & GroupMasks[group]));
+
+				if (group == BLEND)
+					TEST_CHECK(memcmp(bound.Groups[group].BlendFactor, state.BlendFactor, sizeof(state.BlendFactor)) == 0);
+			}
+		}
+
+		TEST_CHECK(filteredCalls < naiveCalls);
+		printf("%d draws: %llu state calls unfiltered, %llu filtered\n", DrawCount, (unsigned long long)naiveCalls, (unsigned long long)filteredCalls);
+
+		// Key building cost
+		const int PackCount = 10000000;
+		volatile uint64_t sink = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < PackCount; i++)
+		{
+			fields.StencilRef = i & 0xFF;
+			sink = sink ^ RenderStateKey::Pack(fields).Key;
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		printf("Pack: %.2f ns per key\n", std::chrono::duration<double, std::nano>(end - start).count() / PackCount);
+	}
+}
+
+int main()
+{
+	TestLayout();
+	TestBlendFactor();
+	TestReplay();
+
+	printf("RenderStateKeyTest passed\n");
+	return 0;
+}
\ No newline at end of file
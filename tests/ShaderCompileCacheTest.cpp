@@ -0,0 +1,278 @@
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/rendering/ShaderCompileCache.h"
+
+//
+// Drives ShaderCompileCache with a stub compiler. The "bytecode" is the preprocessed text (includes
+// expanded, defines appended), so a stale cache entry shows up as wrong output, and the compile
+// counter shows whether the cache was consulted at all.
+//
+namespace
+{
+	class StubCompiler : public IShaderCompiler
+	{
+	public:
+		std::string Identifier = "stub-1";
+		std::atomic_uint32_t Compiles = 0;
+
+		std::string GetIdentifier() const override
+		{
+			return Identifier;
+		}
+
+		void Compile(const ShaderCompileRequest& Request, ShaderCompileResult& Result) override
+		{
+			Compiles++;
+
+			std::string output;
+
+			if (!Expand(Request.FilePath, output, Result))
+			{
+				Result.Errors = "cannot open " + GetUtf8Path(Request.FilePath);
+				return;
+			}
+
+			if (output.find("#error") != std::string::npos)
+			{
+				Result.Errors = "error directive";
+				return;
+			}
+
+			for (auto& [name, value] : Request.Defines)
+				output += name + "=" + value + ";";
+
+			output += Request.EntryPoint + "/" + Request.Target;
+
+			Result.Bytecode.assign(output.begin(), output.end());
+			Result.Success = true;
+		}
+
+	private:
+		bool Expand(const std::filesystem::path& Path, std::string& Output, ShaderCompileResult& Result)
+		{
+			std::ifstream file(Path);
+
+			if (!file)
+				return false;
+
+			Result.Dependencies.push_back(Path);
+
+			for (std::string line; std::getline(file, line);)
+			{
+				if (line.rfind("#include ", 0) == 0)
+				{
+					if (!Expand(Path.parent_path() / line.substr(9), Output, Result))
+						return false;
+				}
+				else
+				{
+					Output += line + "\n";
+				}
+			}
+
+			return true;
+		}
+	};
+
+	std::filesystem::path TestDirectory;
+
+	void WriteFile(const char *Name, const char *Text)
+	{
+		std::ofstream(TestDirectory / Name, std::ios::binary | std::ios::trunc) << Text;
+	}
+
+	ShaderCompileRequest MakeRequest(const char *Name, const char *Define = nullptr)
+	{
+		ShaderCompileRequest request;
+		request.FilePath = TestDirectory / Name;
+		request.EntryPoint = "main";
+		request.Target = "vs_5_0";
+		request.Flags = 0;
+
+		if (Define)
+			request.Defines.emplace_back(Define, "");
+
+		return request;
+	}
+
+	std::string AsString(const ShaderCompileResult& Result)
+	{
+		return std::string(Result.Bytecode.begin(), Result.Bytecode.end());
+	}
+
+	void TestHitsAndInvalidation()
+	{
+		StubCompiler compiler;
+		ShaderCompileCache cache(&compiler, TestDirectory / "cache");
+		ShaderCompileResult result;
+
+		WriteFile("common.h", "common 1");
+		WriteFile("a.hlsl", "#include common.h\nbody a");
+
+		cache.Compile(MakeRequest("a.hlsl"), result);
+		TEST_CHECK(result.Success && !result.FromCache && compiler.Compiles == 1);
+		TEST_CHECK(AsString(result) == "common 1\nbody a\nmain/vs_5_0");
+		TEST_CHECK(result.Dependencies.size() == 2);
+
+		cache.Compile(MakeRequest("a.hlsl"), result);
+		TEST_CHECK(result.Success && result.FromCache && compiler.Compiles == 1);
+		TEST_CHECK(AsString(result) == "common 1\nbody a\nmain/vs_5_0");
+
+		// Defines are part of the key
+		cache.Compile(MakeRequest("a.hlsl", "VC"), result);
+		TEST_CHECK(!result.FromCache && compiler.Compiles == 2);
+		TEST_CHECK(AsString(result) == "common 1\nbody a\nVC=;main/vs_5_0");
+
+		// Editing an include invalidates every entry that read it, once file hashes are re-read
+		WriteFile("common.h", "common 2");
+		cache.ClearFileHashes();
+
+		cache.Compile(MakeRequest("a.hlsl"), result);
+		TEST_CHECK(!result.FromCache && compiler.Compiles == 3);
+		TEST_CHECK(AsString(result) == "common 2\nbody a\nmain/vs_5_0");
+
+		cache.Compile(MakeRequest("a.hlsl", "VC"), result);
+		TEST_CHECK(!result.FromCache && compiler.Compiles == 4);
+
+		// A new compiler version doesn't reuse old output
+		compiler.Identifier = "stub-2";
+		cache.Compile(MakeRequest("a.hlsl"), result);
+		TEST_CHECK(!result.FromCache && compiler.Compiles == 5);
+
+		TEST_CHECK(cache.GetHitCount() == 1 && cache.GetMissCount() == 5);
+	}
+
+	void TestPersistence()
+	{
+		WriteFile("b.hlsl", "body b");
+
+		{
+			StubCompiler compiler;
+			ShaderCompileCache cache(&compiler, TestDirectory / "cache");
+			ShaderCompileResult result;
+
+			cache.Compile(MakeRequest("b.hlsl"), result);
+			TEST_CHECK(result.Success && compiler.Compiles == 1);
+		}
+
+		// A new process (new cache object) picks up the entry from disk
+		StubCompiler compiler;
+		ShaderCompileCache cache(&compiler, TestDirectory / "cache");
+		ShaderCompileResult result;
+
+		cache.Compile(MakeRequest("b.hlsl"), result);
+		TEST_CHECK(result.Success && result.FromCache && compiler.Compiles == 0);
+		TEST_CHECK(AsString(result) == "body b\nmain/vs_5_0");
+
+		// Truncated entries are recompiled instead of returning garbage
+		for (auto& entry : std::filesystem::directory_iterator(TestDirectory / "cache"))
+			std::filesystem::resize_file(entry.path(), 20);
+
+		cache.Compile(MakeRequest("b.hlsl"), result);
+		TEST_CHECK(result.Success && !result.FromCache && compiler.Compiles == 1);
+		TEST_CHECK(AsString(result) == "body b\nmain/vs_5_0");
+	}
+
+	void TestFailures()
+	{
+		StubCompiler compiler;
+		ShaderCompileCache cache(&compiler, TestDirectory / "cache");
+		ShaderCompileResult result;
+
+		// Failed compiles are never stored
+		WriteFile("c.hlsl", "#error");
+
+		cache.Compile(MakeRequest("c.hlsl"), result);
+		TEST_CHECK(!result.Success && !result.Errors.empty());
+		cache.Compile(MakeRequest("c.hlsl"), result);
+		TEST_CHECK(!result.Success && compiler.Compiles == 2);
+
+		WriteFile("c.hlsl", "fixed");
+		cache.ClearFileHashes();
+
+		cache.Compile(MakeRequest("c.hlsl"), result);
+		TEST_CHECK(result.Success && AsString(result) == "fixed\nmain/vs_5_0");
+
+		// Deleting a dependency invalidates the entry
+		WriteFile("d.h", "d");
+		WriteFile("d.hlsl", "#include d.h\nbody d");
+
+		cache.Compile(MakeRequest("d.hlsl"), result);
+		TEST_CHECK(result.Success);
+
+		std::filesystem::remove(TestDirectory / "d.h");
+		cache.ClearFileHashes();
+
+		uint32_t compiles = compiler.Compiles;
+		cache.Compile(MakeRequest("d.hlsl"), result);
+		TEST_CHECK(!result.Success && compiler.Compiles == compiles + 1);
+	}
+
+	void TestBatch()
+	{
+		StubCompiler compiler;
+		ShaderCompileCache cache(&compiler, TestDirectory / "batch_cache");
+		std::vector<ShaderCompileRequest> requests;
+		std::vector<ShaderCompileResult> results;
+
+		const char *defines[] = { "A", "B", "C", "D", "E", "F", "G", "H" };
+
+		WriteFile("common.h", "common batch");
+		WriteFile("e.hlsl", "#include common.h\nbody e");
+
+		for (int round = 0; round < 2; round++)
+		{
+			requests.clear();
+
+			for (const char *define : defines)
+			{
+				requests.push_back(MakeRequest("e.hlsl", define));
+				requests.push_back(MakeRequest("a.hlsl", define));
+			}
+
+			cache.CompileBatch(requests, results, 4);
+			TEST_CHECK(results.size() == requests.size());
+
+			for (size_t i = 0; i < results.size(); i++)
+			{
+				const std::string& define = requests[i].Defines[0].first;
+				const std::string body = (i % 2 == 0) ? "common batch\nbody e\n" : "common batch\nbody a\n";
+
+				TEST_CHECK(results[i].Success);
+				TEST_CHECK(results[i].FromCache == (round == 1));
+				TEST_CHECK(AsString(results[i]) == body + define + "=;main/vs_5_0");
+			}
+		}
+
+		TEST_CHECK(compiler.Compiles == 16);
+		TEST_CHECK(cache.GetHitCount() == 16 && cache.GetMissCount() == 16);
+
+		// Nothing but finished entries is left behind
+		for (auto& entry : std::filesystem::directory_iterator(TestDirectory / "batch_cache"))
+			TEST_CHECK(entry.path().extension() == ".bin");
+	}
+}
+
+int main()
+{
+	std::ostringstream name;
+	// Built once per language standard, and ctest may run both at the same time
+	name << "ShaderCompileCacheTest_" << std::hash<std::string>()(GetUtf8Path(std::filesystem::current_path())) << "_" << __cplusplus;
+
+	TestDirectory = std::filesystem::temp_directory_path() / name.str();
+	std::filesystem::remove_all(TestDirectory);
+	std::filesystem::create_directories(TestDirectory);
+
+	TestHitsAndInvalidation();
+	TestPersistence();
+	TestFailures();
+	TestBatch();
+
+	std::filesystem::remove_all(TestDirectory);
+
+	printf("ShaderCompileCacheTest passed\n");
+	return 0;
+}
\ No newline at end of file
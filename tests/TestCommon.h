@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+//
+// Minimal checks for the Linux test programs. A failed check prints where it failed and exits
+// with a non-zero status, which is all ctest looks at.
+//
+#define TEST_CHECK(Expression) \
+	do \
+	{ \
+		if (!(Expression)) \
+		{ \
+			fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__, #Expression); \
+			exit(1); \
+		} \
+	} while (0)
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <vector>
+#include "TestCommon.h"
+#include "../skyrim64_test/src/patches/TES/NiMain/NiCollisionUtils.h"
+#include "../skyrim64_test/src/patches/CKSSE/TrianglePickBVH.h"
+
+//
+// The picking fast path relies on two things: IntersectTriangles8() returns exactly the lanes
+// IntersectTriangle() accepts, and TrianglePickBVH::Intersect() returns exactly the triangles a linear
+// scan accepts, in the same order. Rays are aimed at vertices, edges and triangle interiors so most
+// of them land on the tolerance boundaries where the two paths could disagree.
+//
+namespace
+{
+	std::mt19937 Random(1234);
+
+	float RandomFloat(float Min, float Max)
+	{
+		return std::uniform_real_distribution<float>(Min, Max)(Random);
+	}
+
+	NiPoint3 RandomPoint(float Extent)
+	{
+		return NiPoint3(RandomFloat(-Extent, Extent), RandomFloat(-Extent, Extent), RandomFloat(-Extent, Extent));
+	}
+
+	// A ray that passes through (or very close to) a point on the triangle
+	void AimRay(const NiPoint3 *Triangle, NiPoint3& Origin, NiPoint3& Dir)
+	{
+		float a;
+		float b;
+
+		switch (Random() % 4)
+		{
+		case 0: a = 0.0f; b = 0.0f; break;										// Vertex
+		case 1: a = RandomFloat(0.0f, 1.0f); b = 0.0f; break;					// Edge
+		case 2: a = RandomFloat(0.0f, 1.0f); b = 1.0f - a; break;				// Opposite edge
+		default: a = RandomFloat(0.0f, 0.5f); b = RandomFloat(0.0f, 0.5f); break;
+		}
+
+		const NiPoint3 target = Triangle[0] + a * (Triangle[1] - Triangle[0]) + b * (Triangle[2] - Triangle[0]);
+
+		Dir = RandomPoint(1.0f);
+		Origin = target - RandomFloat(-0.5f, 4.0f) * Dir;
+	}
+
+	uint32_t ScalarMask(const NiPoint3& Origin, const NiPoint3& Dir, const NiPoint3 *Triangles, uint32_t Count, bool Cull)
+	{
+		uint32_t mask = 0;
+
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			NiPoint3 intersect;
+			float r, s, t;
+
+			if (NiCollisionUtils::IntersectTriangle(Origin, Dir, Triangles[i * 3 + 0], Triangles[i * 3 + 1], Triangles[i * 3 + 2], Cull, intersect, r, s, t))
+				mask |= 1u << i;
+		}
+
+		return mask;
+	}
+
+	void TestPackEquivalence()
+	{
+		uint32_t hits = 0;
+		uint32_t tests = 0;
+
+		for (uint32_t iteration = 0; iteration < 200000; iteration++)
+		{
+			NiPoint3 triangles[8 * 3];
+			float v[3][3][8];
+
+			// Garbage in the unused lanes must not leak into the mask
+			const uint32_t count = 1 + (Random() % 8);
+
+			for (uint32_t lane = 0; lane < 8; lane++)
+			{
+				const NiPoint3 base = RandomPoint(100.0f);
+
+				for (uint32_t j = 0; j < 3; j++)
+				{
+					// Some nearly degenerate triangles to hit the determinant tolerance
+					const float size = (Random() % 16 == 0) ? 1e-3f : 10.0f;
+					NiPoint3 p = base + RandomPoint(size);
+
+					if (lane < count)
+						triangles[lane * 3 + j] = p;
+
+					v[j][0][lane] = p.x;
+					v[j][1][lane] = p.y;
+					v[j][2][lane] = p.z;
+				}
+			}
+
+			NiPoint3 origin;
+			NiPoint3 dir;
+			AimRay(&triangles[(Random() % count) * 3], origin, dir);
+
+			for (bool cull : { false, true })
+			{
+				const uint32_t expected = ScalarMask(origin, dir, triangles, count, cull);
+
+				TEST_CHECK(NiCollisionUtils::IntersectTriangles8(origin, dir, v, count, cull) == expected);
+				TEST_CHECK(NiCollisionUtils::IntersectTriangles8Scalar(origin, dir, v, count, cull) == expected);
+
+				hits += (expected != 0) ? 1 : 0;
+				tests++;
+			}
+		}
+
+		// Make sure the rays actually exercise the accept path
+		TEST_CHECK(hits > tests / 4);
+		printf("packs: %u tests, %u with hits, SIMD %s\n", tests, hits, NiCollisionUtils::HasIntersectTriangles8SIMD() ? "on" : "off");
+	}
+
+	void TestBVHMatchesLinearScan()
+	{
+		// A grid-like mesh with shared edges, like real geometry
+		const uint32_t gridSize = 64;
+		std::vector<NiPoint3> triangles;
+
+		for (uint32_t y = 0; y < gridSize; y++)
+		{
+			for (uint32_t x = 0; x < gridSize; x++)
+			{
+				auto vertex = [&](uint32_t X, uint32_t Y)
+				{
+					return NiPoint3((float)X * 8.0f, (float)Y * 8.0f, sinf((float)(X * 7 + Y * 3)) * 4.0f);
+				};
+
+				triangles.push_back(vertex(x, y));
+				triangles.push_back(vertex(x + 1, y));
+				triangles.push_back(vertex(x, y + 1));
+				triangles.push_back(vertex(x + 1, y));
+				triangles.push_back(vertex(x + 1, y + 1));
+				triangles.push_back(vertex(x, y + 1));
+			}
+		}
+
+		const uint32_t triangleCount = (uint32_t)triangles.size() / 3;
+
+		TrianglePickBVH hierarchy;
+		TrianglePickBVH flat;
+		hierarchy.Build(triangles.data(), triangleCount, true);
+		flat.Build(triangles.data(), triangleCount, false);
+
+		TEST_CHECK(hierarchy.GetTriangleCount() == triangleCount);
+		TEST_CHECK(flat.GetTriangleCount() == triangleCount);
+
+		uint32_t totalHits = 0;
+		std::vector<uint32_t> expected;
+		std::vector<uint32_t> hits;
+
+		for (uint32_t iteration = 0; iteration < 5000; iteration++)
+		{
+			NiPoint3 origin;
+			NiPoint3 dir;
+			AimRay(&triangles[(Random() % triangleCount) * 3], origin, dir);
+
+			for (bool cull : { false, true })
+			{
+				expected.clear();
+
+				for (uint32_t i = 0; i < triangleCount; i++)
+				{
+					NiPoint3 intersect;
+					float r, s, t;
+
+					if (NiCollisionUtils::IntersectTriangle(origin, dir, triangles[i * 3 + 0], triangles[i * 3 + 1], triangles[i * 3 + 2], cull, intersect, r, s, t))
+						expected.push_back(i);
+				}
+
+				hits.clear();
+				hierarchy.Intersect(origin, dir, cull, hits);
+				TEST_CHECK(hits == expected);
+
+				hits.clear();
+				flat.Intersect(origin, dir, cull, hits);
+				TEST_CHECK(hits == expected);
+
+				totalHits += (uint32_t)expected.size();
+			}
+		}
+
+		TEST_CHECK(totalHits > 5000);
+		printf("bvh: %u triangles, %u hits\n", triangleCount, totalHits);
+
+		// Empty builds return nothing
+		TrianglePickBVH empty;
+		empty.Build(nullptr, 0, true);
+		hits.clear();
+		empty.Intersect(NiPoint3(0, 0, 0), NiPoint3(0, 0, 1), false, hits);
+		TEST_CHECK(hits.empty());
+	}
+}
+
+int main()
+{
+	TestPackEquivalence();
+	TestBVHMatchesLinearScan();
+
+	printf("TrianglePickTest passed\n");
+	return 0;
+}
\ No newline at end of file